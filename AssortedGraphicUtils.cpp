@@ -1,5 +1,7 @@
 #include "AssortedGraphicUtils.h"
+#include "ChangeJournal.h"
 #include "LevelComponents/Layer.h"
+#include "ROMReferenceIndex.h"
 #include "WL4EditorWindow.h"
 
 #define AssortedGraphic_CHUNK_VERSION 0
@@ -498,6 +500,40 @@ QVector<unsigned int> AssortedGraphicUtils::GetSaveDataAddresses(AssortedGraphic
     return result;
 }
 
+/// <summary>
+/// Get the save data addresses referenced by all the entries of the assorted graphic list chunk in the ROM.
+/// </summary>
+/// <remarks>
+/// The list stores the addresses as hex text, so neither the reference index nor a scan for pointer words finds them.
+/// Only the entry infos are parsed, the graphic data is not extracted.
+/// </remarks>
+/// <param name="addresses">
+/// Output, the palette, tile and mapping data addresses which are in the save data area.
+/// </param>
+/// <returns>
+/// False if the ROM contains a list chunk which cannot be parsed.
+/// </returns>
+bool AssortedGraphicUtils::GetReferencedSaveDataAddressesFromROM(QVector<unsigned int> &addresses)
+{
+    unsigned int assortedGraphicListAddr = ROMUtils::FindChunkInROM(
+        ROMUtils::ROMFileMetadata->ROMDataPtr,
+        ROMUtils::ROMFileMetadata->Length,
+        WL4Constants::AvailableSpaceBeginningInROM,
+        ROMUtils::SaveDataChunkType::AssortedGraphicListChunkType
+    );
+    if(!assortedGraphicListAddr) return true;
+    QString contents = GetUpgradedAssortedGraphicListChunkData(assortedGraphicListAddr);
+    QStringList assortedGraphicTuples = contents.split(";");
+    if(!contents.length() || assortedGraphicTuples.count() % AssortedGraphic_FIELD_COUNT) return false;
+    for(int i = 0; i < assortedGraphicTuples.count(); i += AssortedGraphic_FIELD_COUNT)
+    {
+        struct AssortedGraphicUtils::AssortedGraphicEntryItem entry =
+                DeserializeAssortedGraphicMetadata(assortedGraphicTuples.mid(i, AssortedGraphic_FIELD_COUNT));
+        addresses.append(GetSaveDataAddresses(entry));
+    }
+    return true;
+}
+
 /// <summary>
 /// Create SaveData if the current input entry need some chunks to save palette, tiles or mapping data.
 /// </summary>
@@ -659,27 +695,37 @@ bool AssortedGraphicUtils::FindbgGFXptrInAllTilesets(unsigned int address, unsig
     // in case the return value is not initialzed in the caller
     *tilesetId_find = -1;
 
-    // Go through all the Tilesets to see if tile data is used in any Tileset
-    for(int i = 0; i < (sizeof(ROMUtils::singletonTilesets) / sizeof(ROMUtils::singletonTilesets[0])); i++)
+    // Tilesets with unsaved changes may already point somewhere else than the ROM does
+    for(unsigned int i = 0; i < (sizeof(ROMUtils::singletonTilesets) / sizeof(ROMUtils::singletonTilesets[0])); i++)
     {
-        unsigned int addr = ROMUtils::singletonTilesets[i]->GetbgGFXptr();
-        if (addr == address)
+        if (ChangeJournal::IsChanged(ChangeJournal::TilesetAsset, i) && ROMUtils::singletonTilesets[i]->GetbgGFXptr() == address)
         {
             *tilesetId_find = i;
             return true;
         }
     }
+
+    // Saved Tilesets are looked up in the reference index
+    for (const struct ROMReferenceIndex::Reference &reference : ROMReferenceIndex::FindReferencesTo(address))
+    {
+        if (reference.Type == ROMReferenceIndex::TilesetBGTile8x8Data &&
+            !ChangeJournal::IsChanged(ChangeJournal::TilesetAsset, reference.OwnerId))
+        {
+            *tilesetId_find = reference.OwnerId;
+            return true;
+        }
+    }
     return false;
 }
 
 /// <summary>
-/// Find if a mapping data chunk is used in any Tileset.
+/// Find if a mapping data chunk is used in any Room.
 /// </summary>
 /// <param name="address">
 /// The address of the mapping data.
 /// </param>
 /// <param name="levelId">
-/// output the id of the Level in which the mapping data is found.
+/// output the passage index of the Level in which the mapping data is found.
 /// </param>
 /// <param name="roomId">
 /// output the id of the Room in which the mapping data is found.
@@ -693,38 +739,27 @@ bool AssortedGraphicUtils::FindLayerptrInAllRooms(unsigned int address, unsigned
     *levelId_found = -1;
     *roomId_found = -1;
 
-    // loop throough all the Rooms
-    QVector<unsigned int> levelid_array = {0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 5, 5};
-    QVector<unsigned int> roomid_array = {0, 2, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 4};
-    for (int i = 0; i < levelid_array.size(); i++)
+    // only Layer 0 and Layer 3 with mapping type 0x20 can use assorted graphic mapping data
+    for (const struct ROMReferenceIndex::Reference &reference : ROMReferenceIndex::FindReferencesTo(address))
     {
-        LevelComponents::Level *tmpLevel = new LevelComponents::Level(static_cast<LevelComponents::__passage>(levelid_array[i]),
-                                                                      static_cast<LevelComponents::__stage>(roomid_array[i]));
-        for (int j = 0; j < tmpLevel->GetRooms().size(); j++)
+        if (reference.Type == ROMReferenceIndex::RoomLayerData && reference.Info == 0x20 &&
+            (reference.SubId == 0 || reference.SubId == 3))
         {
-            LevelComponents::__RoomHeader header = tmpLevel->GetRooms()[j]->GetRoomHeader();
-            if ((header.Layer0MappingType & 0x30) == 0x20)
-            {
-                if ((header.Layer0Data & 0x7FFFFFF) == address)
-                {
-                    *levelId_found = levelid_array[i];
-                    *roomId_found = roomid_array[j];
-                    return true;
-                }
-            }
-            if ((header.Layer3MappingType & 0x30) == 0x20)
+            // The reference index knows the internal level id, report the passage of the level like before
+            for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
             {
-                if ((header.Layer3Data & 0x7FFFFFF) == address)
+                unsigned int levelHeaderIndex = ROMUtils::IntFromData(WL4Constants::LevelHeaderIndexTable +
+                                                                      WL4Constants::VanillaLevelPassages[i] * 24 +
+                                                                      WL4Constants::VanillaLevelStages[i] * 4);
+                if (ROMUtils::ROMFileMetadata->ROMDataPtr[WL4Constants::LevelHeaderTable + levelHeaderIndex * 12] == reference.OwnerId)
                 {
-                    *levelId_found = levelid_array[i];
-                    *roomId_found = roomid_array[j];
-                    return true;
+                    *levelId_found = WL4Constants::VanillaLevelPassages[i];
+                    break;
                 }
             }
+            *roomId_found = reference.RoomId;
+            return true;
         }
-
-        delete tmpLevel;
     }
-
     return false;
 }
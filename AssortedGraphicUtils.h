@@ -100,6 +100,7 @@ namespace AssortedGraphicUtils
 
     // savechunk relative functions
     QVector<unsigned int> GetSaveDataAddresses(AssortedGraphicEntryItem &entry);
+    bool GetReferencedSaveDataAddressesFromROM(QVector<unsigned int> &addresses);
     QVector<struct ROMUtils::SaveData> CreateSaveData(AssortedGraphicEntryItem &entry, unsigned int entryId);
 
     // helper functions
@@ -0,0 +1,463 @@
+#include "BatchRunner.h"
+#include "BenchmarkUtils.h"
+#include "BulkExportUtils.h"
+#include "PatchUtils.h"
+#include "ROMUtils.h"
+#include "SelfCheckUtils.h"
+
+#include <QApplication>
+#include <QDialog>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#ifndef WINDOW_INSTANCE_SINGLETON
+#define WINDOW_INSTANCE_SINGLETON
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+#endif
+
+namespace BatchRunner
+{
+    enum StepType
+    {
+        ScriptFileStep,
+        ScriptCodeStep,
+        CommandStep,
+        BenchmarkStep,
+        ExportStep,
+        SaveStep
+    };
+
+    struct Step
+    {
+        enum StepType Type;
+        QString Argument;
+    };
+
+    static bool Active = false;
+
+    // The level loaded before the steps run, set by --level
+    static int StartPassage = 0;
+    static int StartStage = 0;
+    static int StartRoomId = 0;
+
+    // Timed passes run for each benchmark of a --benchmark step
+    static const int BenchmarkRepetitions = 5;
+
+    // Fixed seed and size of the random cases of the self-check command, so that runs are reproducible
+    static const unsigned int SelfCheckSeed = 0x574C34;
+    static const int SelfCheckRandomCases = 500;
+
+    /// <summary>
+    /// Print a message to stderr.
+    /// </summary>
+    static void PrintError(QString message)
+    {
+        QTextStream(stderr) << message << Qt::endl;
+    }
+
+    /// <summary>
+    /// Print the command line help to stderr.
+    /// </summary>
+    static void PrintUsage()
+    {
+        PrintError("Usage: WL4Editor --batch [--jobs N] [--level P-S[-R]] <steps...> rom.gba [more.gba ...]\n"
+                   "  --level P-S[-R]    the passage, stage and room loaded before the steps, 0-0-0 by default\n"
+                   "  --script file.js   run a JS script file against the ROM\n"
+                   "  --eval \"code\"      run a line of JS code\n"
+                   "  --command name     run a built-in command: analyze-save, defragment, defragment-dry-run, recompile-patches, self-check\n"
+                   "  --benchmark file   time the decode, render, compress and save hot paths, write JSON to the file (- for stdout)\n"
+                   "  --export dir       export the graphics of every room, tileset, entity set and wall paint to dir/<rom name>\n"
+                   "  --save             save the ROM after the previous steps\n"
+                   "Steps run in the given order. Several ROMs are processed by child processes, N at a time.");
+    }
+
+    /// <summary>
+    /// Reject the dialog the editor code is waiting on, there is nobody to answer it in batch mode.
+    /// </summary>
+    /// <remarks>
+    /// Modal dialogs run a nested event loop, so this is called by a timer while the dialog is open.
+    /// </remarks>
+    static void DismissModalDialog()
+    {
+        QDialog *dialog = qobject_cast<QDialog *>(QApplication::activeModalWidget());
+        if (!dialog)
+        {
+            return;
+        }
+        QString text = dialog->windowTitle();
+        if (QMessageBox *messageBox = qobject_cast<QMessageBox *>(dialog))
+        {
+            text += ": " + messageBox->text();
+        }
+        PrintError(QString("Dismissed dialog: %1").arg(text));
+        dialog->reject();
+    }
+
+    /// <summary>
+    /// Run one of the built-in commands against the loaded ROM.
+    /// </summary>
+    /// <param name="name">
+    /// The command name given after --command.
+    /// </param>
+    /// <returns>
+    /// True if the command succeeded.
+    /// </returns>
+    static bool RunCommand(QString name)
+    {
+        OutputDockWidget *output = singleton->GetOutputWidgetPtr();
+        if (name == "analyze-save")
+        {
+            output->PrintString(ROMUtils::SaveDataAnalysis());
+            return true;
+        }
+        else if (name == "defragment" || name == "defragment-dry-run")
+        {
+            bool dryRun = name == "defragment-dry-run";
+            bool saved = false;
+            output->PrintString(ROMUtils::DefragmentSaveData(dryRun, &saved));
+            return dryRun || saved;
+        }
+        else if (name == "self-check")
+        {
+            bool passed = false;
+            output->PrintString(SelfCheckUtils::RunSelfChecks(SelfCheckSeed, SelfCheckRandomCases, &passed));
+            return passed;
+        }
+        else if (name == "recompile-patches")
+        {
+            QString errorMessage = PatchUtils::SavePatchesToROM(PatchUtils::GetPatchesFromROM());
+            if (!errorMessage.isEmpty())
+            {
+                PrintError(errorMessage);
+                return false;
+            }
+            return true;
+        }
+        PrintError(QString("Unknown command: %1").arg(name));
+        return false;
+    }
+
+    /// <summary>
+    /// Load a ROM into a hidden editor window and run all the steps against it.
+    /// </summary>
+    /// <param name="romPath">
+    /// The path of the ROM file.
+    /// </param>
+    /// <param name="steps">
+    /// The steps to run, in order.
+    /// </param>
+    /// <returns>
+    /// The exit code of the process.
+    /// </returns>
+    static int RunOnROM(QString romPath, const QVector<struct Step> &steps)
+    {
+        WL4EditorWindow window;
+        window.GetOutputWidgetPtr()->SetConsoleEcho(true);
+        QTimer dialogWatcher;
+        QObject::connect(&dialogWatcher, &QTimer::timeout, &DismissModalDialog);
+        dialogWatcher.start(100);
+
+        ROMUtils::FormatPathSeperators(romPath);
+        if (!window.LoadROMDataFromFile(romPath, false))
+        {
+            return ExitLoadFailed;
+        }
+
+        for (const struct Step &step : steps)
+        {
+            switch (step.Type)
+            {
+            case ScriptFileStep:
+            {
+                QFile file(step.Argument);
+                if (!file.open(QIODevice::ReadOnly))
+                {
+                    PrintError(QString("Cannot open script file: %1").arg(step.Argument));
+                    return ExitStepFailed;
+                }
+                QString code = QString::fromUtf8(file.readAll());
+                file.close();
+                if (window.GetOutputWidgetPtr()->ExecuteJSScript(code, true).isError())
+                {
+                    return ExitStepFailed;
+                }
+                break;
+            }
+            case ScriptCodeStep:
+                if (window.GetOutputWidgetPtr()->ExecuteJSScript(step.Argument, true).isError())
+                {
+                    return ExitStepFailed;
+                }
+                break;
+            case CommandStep:
+                if (!RunCommand(step.Argument))
+                {
+                    return ExitStepFailed;
+                }
+                break;
+            case BenchmarkStep:
+            {
+                QByteArray json = BenchmarkUtils::RunBenchmarks(BenchmarkRepetitions);
+                if (step.Argument == "-")
+                {
+                    QTextStream(stdout) << json;
+                    break;
+                }
+                QFile file(step.Argument);
+                if (!file.open(QIODevice::WriteOnly))
+                {
+                    PrintError(QString("Cannot write benchmark results: %1").arg(step.Argument));
+                    return ExitStepFailed;
+                }
+                file.write(json);
+                file.close();
+                break;
+            }
+            case ExportStep:
+            {
+                // One subdirectory per ROM, several ROMs can be exported to the same directory in parallel
+                bool exported = false;
+                QString exportDir = QDir(step.Argument).filePath(QFileInfo(romPath).completeBaseName());
+                window.GetOutputWidgetPtr()->PrintString(BulkExportUtils::ExportAllGraphics(exportDir, &exported));
+                if (!exported)
+                {
+                    return ExitStepFailed;
+                }
+                break;
+            }
+            case SaveStep:
+                if (!ROMUtils::SaveLevel(ROMUtils::ROMFileMetadata->FilePath))
+                {
+                    return ExitSaveFailed;
+                }
+                break;
+            }
+        }
+        return ExitSuccess;
+    }
+
+    /// <summary>
+    /// Process several ROMs in parallel, one child process per ROM.
+    /// </summary>
+    /// <remarks>
+    /// The editor keeps the loaded ROM in global state, so each ROM gets its own process.
+    /// Patches are built next to their sources and cached next to the ROM, so when patches are recompiled,
+    /// ROMs of the same directory are processed one at a time.
+    /// </remarks>
+    /// <param name="stepArguments">
+    /// The command line arguments describing the steps, passed on to every child process.
+    /// </param>
+    /// <param name="romPaths">
+    /// The paths of the ROM files.
+    /// </param>
+    /// <param name="jobs">
+    /// How many child processes may run at the same time.
+    /// </param>
+    /// <param name="buildsPatches">
+    /// True if the steps compile patches.
+    /// </param>
+    /// <returns>
+    /// The exit code of the process.
+    /// </returns>
+    static int RunInChildProcesses(const QStringList &stepArguments, const QStringList &romPaths, int jobs, bool buildsPatches)
+    {
+        int result = ExitSuccess;
+        QStringList pendingROMs = romPaths;
+        QVector<QProcess *> processes;
+        QStringList processROMs;
+        QStringList processDirs;
+        while (pendingROMs.size() || processes.size())
+        {
+            // Keep up to "jobs" child processes running, skipping the ROMs whose directory is busy building patches
+            for (int next = 0; next < pendingROMs.size() && processes.size() < jobs;)
+            {
+                QString romDir = QFileInfo(pendingROMs[next]).absolutePath();
+                if (buildsPatches && processDirs.contains(romDir))
+                {
+                    ++next;
+                    continue;
+                }
+                QString romPath = pendingROMs.takeAt(next);
+                QProcess *process = new QProcess();
+                process->setProcessChannelMode(QProcess::ForwardedChannels);
+                process->start(QCoreApplication::applicationFilePath(),
+                               QStringList("--batch") + stepArguments + QStringList(romPath));
+                if (!process->waitForStarted())
+                {
+                    PrintError(QString("[%1] cannot start child process").arg(romPath));
+                    result = ExitChildFailed;
+                    delete process;
+                    continue;
+                }
+                processes.push_back(process);
+                processROMs.push_back(romPath);
+                processDirs.push_back(romDir);
+            }
+
+            // Collect finished child processes
+            for (int i = 0; i < processes.size(); ++i)
+            {
+                QProcess *process = processes[i];
+                if (process->state() != QProcess::NotRunning && !process->waitForFinished(50))
+                {
+                    continue;
+                }
+                int exitCode = process->exitStatus() == QProcess::NormalExit ? process->exitCode() : ExitChildFailed;
+                PrintError(QString("[%1] finished with exit code %2").arg(processROMs[i]).arg(exitCode));
+                if (exitCode != ExitSuccess)
+                {
+                    result = ExitChildFailed;
+                }
+                delete process;
+                processes.remove(i);
+                processROMs.removeAt(i);
+                processDirs.removeAt(i);
+                --i;
+            }
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// Check if the editor was started as a batch job.
+    /// </summary>
+    /// <remarks>
+    /// This is called before the QApplication exists, so that the offscreen platform can still be selected.
+    /// </remarks>
+    bool IsBatchCommandLine(int argc, char *argv[])
+    {
+        return argc > 1 && !strcmp(argv[1], "--batch");
+    }
+
+    /// <summary>
+    /// Check if the editor is running as a batch job.
+    /// </summary>
+    bool IsActive()
+    {
+        return Active;
+    }
+
+    /// <summary>
+    /// Get the level the batch job loads before running its steps.
+    /// </summary>
+    /// <remarks>
+    /// Batch jobs don't use the recent level of the INI file, so that their result doesn't depend on the last GUI session.
+    /// </remarks>
+    void GetStartLevel(int *passage, int *stage, int *roomId)
+    {
+        *passage = StartPassage;
+        *stage = StartStage;
+        *roomId = StartRoomId;
+    }
+
+    /// <summary>
+    /// Parse the batch command line and process the ROMs.
+    /// </summary>
+    /// <param name="arguments">
+    /// The application arguments, starting with the program path and "--batch".
+    /// </param>
+    /// <returns>
+    /// The exit code of the process.
+    /// </returns>
+    int Run(const QStringList &arguments)
+    {
+        Active = true;
+        QVector<struct Step> steps;
+        QStringList stepArguments;
+        QStringList romPaths;
+        int jobs = QThread::idealThreadCount();
+        for (int i = 2; i < arguments.size(); ++i)
+        {
+            QString argument = arguments[i];
+            bool hasValue = i + 1 < arguments.size();
+            if (argument == "--save")
+            {
+                steps.push_back({SaveStep, QString()});
+                stepArguments << argument;
+            }
+            else if (hasValue && argument == "--script")
+            {
+                steps.push_back({ScriptFileStep, arguments[++i]});
+                stepArguments << argument << arguments[i];
+            }
+            else if (hasValue && argument == "--eval")
+            {
+                steps.push_back({ScriptCodeStep, arguments[++i]});
+                stepArguments << argument << arguments[i];
+            }
+            else if (hasValue && argument == "--command")
+            {
+                steps.push_back({CommandStep, arguments[++i]});
+                stepArguments << argument << arguments[i];
+            }
+            else if (hasValue && argument == "--benchmark")
+            {
+                steps.push_back({BenchmarkStep, arguments[++i]});
+                stepArguments << argument << arguments[i];
+            }
+            else if (hasValue && argument == "--export")
+            {
+                steps.push_back({ExportStep, arguments[++i]});
+                stepArguments << argument << arguments[i];
+            }
+            else if (hasValue && argument == "--jobs")
+            {
+                jobs = qMax(1, arguments[++i].toInt());
+            }
+            else if (hasValue && argument == "--level")
+            {
+                QStringList numbers = arguments[++i].split('-');
+                bool ok = numbers.size() == 2 || numbers.size() == 3;
+                int values[3] = {0, 0, 0};
+                for (int j = 0; ok && j < numbers.size(); ++j)
+                {
+                    values[j] = numbers[j].toInt(&ok);
+                }
+                if (!ok || values[0] < 0 || values[0] > 5 || values[1] < 0 || values[1] > 4 || values[2] < 0)
+                {
+                    PrintError(QString("Invalid level: %1").arg(arguments[i]));
+                    PrintUsage();
+                    return ExitUsage;
+                }
+                StartPassage = values[0];
+                StartStage = values[1];
+                StartRoomId = values[2];
+                stepArguments << argument << arguments[i];
+            }
+            else if (argument.endsWith(".gba", Qt::CaseInsensitive))
+            {
+                romPaths << argument;
+            }
+            else
+            {
+                PrintError(QString("Unknown argument: %1").arg(argument));
+                PrintUsage();
+                return ExitUsage;
+            }
+        }
+        if (romPaths.isEmpty() || steps.isEmpty())
+        {
+            PrintUsage();
+            return ExitUsage;
+        }
+
+        if (romPaths.size() > 1)
+        {
+            bool buildsPatches = std::any_of(steps.begin(), steps.end(), [](const struct Step &step) {
+                return step.Type == CommandStep && step.Argument == "recompile-patches";
+            });
+            return RunInChildProcesses(stepArguments, romPaths, jobs, buildsPatches);
+        }
+        return RunOnROM(romPaths[0], steps);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QString>
+#include <QStringList>
+
+// Run the editor without showing its window, for scripted processing of ROM files.
+//
+// WL4Editor --batch [--jobs N] [--level P-S[-R]] <steps...> rom.gba [more.gba ...]
+//   --level P-S[-R]    the passage, stage and room loaded before the steps, 0-0-0 by default
+//   --script file.js   run a JS script file against the ROM (same API as the output window)
+//   --eval "code"      run a line of JS code
+//   --command name     run a built-in command: analyze-save, defragment, defragment-dry-run, recompile-patches, self-check
+//   --benchmark file   time the decode, render, compress and save hot paths, write JSON to the file (- for stdout)
+//   --export dir       export the graphics of every room, tileset, entity set and wall paint to dir/<rom name>
+//   --save             save the ROM after the previous steps
+// Steps run in the given order. Several ROMs are processed by child processes, N at a time.
+namespace BatchRunner
+{
+    // Process exit codes
+    enum ExitCode
+    {
+        ExitSuccess     = 0,
+        ExitStepFailed  = 1,
+        ExitLoadFailed  = 2,
+        ExitSaveFailed  = 3,
+        ExitChildFailed = 4,
+        ExitUsage       = 64
+    };
+
+    bool IsBatchCommandLine(int argc, char *argv[]);
+    bool IsActive();
+    void GetStartLevel(int *passage, int *stage, int *roomId);
+    int Run(const QStringList &arguments);
+}
+
+#endif // BATCHRUNNER_H
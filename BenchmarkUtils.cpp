@@ -0,0 +1,347 @@
+#include "BenchmarkUtils.h"
+#include "ROMUtils.h"
+#include "LevelComponents/Level.h"
+
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QGraphicsScene>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#ifndef WINDOW_INSTANCE_SINGLETON
+#define WINDOW_INSTANCE_SINGLETON
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+#endif
+
+namespace BenchmarkUtils
+{
+    /// <summary>
+    /// Time a benchmark pass several times and summarize the timings.
+    /// </summary>
+    /// <remarks>
+    /// The pass is run once more before timing starts, so that lazily built caches are warm for every repetition.
+    /// </remarks>
+    /// <param name="name">
+    /// The name of the benchmark in the JSON output.
+    /// </param>
+    /// <param name="repetitions">
+    /// How many timed passes to run.
+    /// </param>
+    /// <param name="pass">
+    /// Runs the benchmarked code over all its inputs once, and returns the number of processed items, or -1 on error.
+    /// </param>
+    /// <return>The JSON object describing the results.</return>
+    static QJsonObject Measure(QString name, int repetitions, std::function<qint64 ()> pass)
+    {
+        QJsonObject result;
+        result["name"] = name;
+        qint64 items = pass();
+        QVector<qint64> times;
+        QElapsedTimer timer;
+        for (int i = 0; i < repetitions && items >= 0; ++i)
+        {
+            timer.start();
+            items = pass();
+            times << timer.nsecsElapsed();
+        }
+        if (items < 0)
+        {
+            result["error"] = true;
+            return result;
+        }
+        std::sort(times.begin(), times.end());
+        qint64 median = times[times.size() / 2];
+        result["items"] = static_cast<double>(items);
+        result["repetitions"] = repetitions;
+        result["min_ns"] = static_cast<double>(times.first());
+        result["median_ns"] = static_cast<double>(median);
+        result["max_ns"] = static_cast<double>(times.last());
+        result["median_ns_per_item"] = items ? static_cast<double>(median) / items : 0.0;
+        return result;
+    }
+
+    /// <summary>
+    /// X flip a Tile8x8 one byte at a time, the reference for ROMUtils::FlipTiles4bpp.
+    /// </summary>
+    static void ScalarTileXFlip(const unsigned char *source, unsigned char *destination)
+    {
+        for (int col = 0; col < 8; col++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                unsigned char curByte = source[col * 4 + row];
+                destination[col * 4 + (3 - row)] = ((curByte & 0xF) << 4) | ((curByte & 0xF0) >> 4);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Y flip a Tile8x8 one row at a time, the reference for ROMUtils::FlipTiles4bpp.
+    /// </summary>
+    static void ScalarTileYFlip(const unsigned char *source, unsigned char *destination)
+    {
+        for (int col = 0; col < 8; col++)
+        {
+            memcpy(&destination[col * 4], &source[(7 - col) * 4], 4);
+        }
+    }
+
+    /// <summary>
+    /// Read the color indices of a flipped Tile8x8 one nybble at a time, the reference for ROMUtils::UnpackTiles4bpp.
+    /// </summary>
+    static void ScalarTileUnpack(const unsigned char *source, unsigned char *destination, bool flipX, bool flipY)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            int srcY = flipY ? 7 - i : i;
+            for (int j = 0; j < 8; ++j)
+            {
+                int srcX = flipX ? 7 - j : j;
+                destination[i * 8 + j] = (source[(srcY << 2) + (srcX >> 1)] >> ((srcX & 1) << 2)) & 0xF;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Write the color indices of a Tile8x8 one nybble at a time, the reference for ROMUtils::PackTiles4bpp.
+    /// </summary>
+    static void ScalarTilePack(const unsigned char *source, unsigned char *destination)
+    {
+        for (int i = 0; i < 32; ++i)
+        {
+            destination[i] = (source[i * 2] & 0xF) | ((source[i * 2 + 1] & 0xF) << 4);
+        }
+    }
+
+    /// <summary>
+    /// Run every benchmark against the loaded ROM.
+    /// </summary>
+    /// <remarks>
+    /// The save benchmark runs last: it saves the current level to a temporary file, which relocates
+    /// the level's chunks in the loaded ROM data but leaves the ROM file itself untouched.
+    /// </remarks>
+    /// <param name="repetitions">
+    /// How many timed passes to run for each benchmark.
+    /// </param>
+    /// <return>The results as an indented JSON document.</return>
+    QByteArray RunBenchmarks(int repetitions)
+    {
+        repetitions = qMax(1, repetitions);
+        QJsonArray results;
+
+        // Load every level once, the benchmarks below work on their rooms and layers
+        std::vector<LevelComponents::Level *> levels;
+        std::vector<LevelComponents::Layer *> layers;
+        for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
+        {
+            LevelComponents::Level *level = new LevelComponents::Level(static_cast<LevelComponents::__passage>(WL4Constants::VanillaLevelPassages[i]),
+                                                                       static_cast<LevelComponents::__stage>(WL4Constants::VanillaLevelStages[i]));
+            levels.push_back(level);
+            for (LevelComponents::Room *room : level->GetRooms())
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    LevelComponents::Layer *layer = room->GetLayer(j);
+                    if (layer->IsEnabled() && layer->ReadLayerData())
+                    {
+                        layers.push_back(layer);
+                    }
+                }
+            }
+        }
+
+        results << Measure("LayerRLEDecompress", repetitions, [&layers]() {
+            for (LevelComponents::Layer *layer : layers)
+            {
+                int headerSize = layer->GetMappingType() == LevelComponents::LayerMap16 ? 2 : 1;
+                size_t size = layer->GetLayerWidth() * layer->GetLayerHeight() * 2;
+                delete[] ROMUtils::LayerRLEDecompress(layer->GetDataPtr() + headerSize, size);
+            }
+            return static_cast<qint64>(layers.size());
+        });
+
+        results << Measure("LayerRLECompress", repetitions, [&layers]() {
+            for (LevelComponents::Layer *layer : layers)
+            {
+                unsigned char *compressedData = nullptr;
+                ROMUtils::LayerRLECompress(layer->GetLayerWidth() * layer->GetLayerHeight(), layer->ReadLayerData(), &compressedData);
+                delete[] compressedData;
+            }
+            return static_cast<qint64>(layers.size());
+        });
+
+        results << Measure("PackScreen", repetitions, [&layers]() {
+            // Pack every 32x32 screen of the 8x8 tile layers
+            qint64 screens = 0;
+            unsigned short screen[32 * 32];
+            for (LevelComponents::Layer *layer : layers)
+            {
+                if (layer->GetMappingType() != LevelComponents::LayerTile8x8) continue;
+                int width = layer->GetLayerWidth();
+                for (int y = 0; y < layer->GetLayerHeight(); y += 32)
+                {
+                    for (int x = 0; x < width; x += 32)
+                    {
+                        for (int row = 0; row < 32; ++row)
+                        {
+                            memcpy(screen + row * 32, layer->ReadLayerData() + (y + row) * width + x, 32 * sizeof(unsigned short));
+                        }
+                        unsigned short *compressedData = nullptr;
+                        ROMUtils::PackScreen(screen, compressedData);
+                        delete[] compressedData;
+                        ++screens;
+                    }
+                }
+            }
+            return screens;
+        });
+
+        results << Measure("Layer::RenderLayer", repetitions, [&levels]() {
+            qint64 count = 0;
+            for (LevelComponents::Level *level : levels)
+            {
+                for (LevelComponents::Room *room : level->GetRooms())
+                {
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        LevelComponents::Layer *layer = room->GetLayer(i);
+                        if (!layer->IsEnabled()) continue;
+                        layer->RenderLayer(room->GetTileset());
+                        ++count;
+                    }
+                }
+            }
+            return count;
+        });
+
+        results << Measure("Room::RenderGraphicsScene", repetitions, [&levels]() {
+            qint64 count = 0;
+            for (LevelComponents::Level *level : levels)
+            {
+                for (LevelComponents::Room *room : level->GetRooms())
+                {
+                    struct LevelComponents::RenderUpdateParams renderParams(LevelComponents::FullRender);
+                    renderParams.localDoors = level->GetRoomDoorVec(room->GetRoomID());
+                    delete room->RenderGraphicsScene(nullptr, &renderParams);
+                    ++count;
+                }
+            }
+            return count;
+        });
+
+        results << Measure("Tileset::RenderAllTile", repetitions, []() {
+            qint64 count = 0;
+            for (LevelComponents::Tileset *tileset : ROMUtils::singletonTilesets)
+            {
+                tileset->RenderAllTile8x8(0);
+                tileset->RenderAllTile16(1);
+                ++count;
+            }
+            return count;
+        });
+
+        results << Measure("Entity::Render", repetitions, []() {
+            qint64 count = 0;
+            for (LevelComponents::Entity *entity : ROMUtils::entities)
+            {
+                if (!entity) continue;
+                entity->Render();
+                ++count;
+            }
+            return count;
+        });
+
+        // The graphics of every tileset, through the tile codec and through the nybble by nybble loops it replaced
+        QByteArray tileData;
+        for (LevelComponents::Tileset *tileset : ROMUtils::singletonTilesets)
+        {
+            for (LevelComponents::Tile8x8 *tile : tileset->GetTile8x8arrayPtr())
+            {
+                tileData += tile->CreateGraphicsData();
+            }
+        }
+        qint64 tileCount = tileData.size() / 32;
+        QByteArray flippedData(tileData.size(), 0), indexData(tileCount * 64, 0);
+        const unsigned char *tiles = reinterpret_cast<const unsigned char *>(tileData.constData());
+        unsigned char *flipped = reinterpret_cast<unsigned char *>(flippedData.data());
+        unsigned char *indices = reinterpret_cast<unsigned char *>(indexData.data());
+
+        results << Measure("Tile8x8XYFlip (scalar)", repetitions, [tiles, flipped, tileCount]() {
+            unsigned char xFlipped[32];
+            for (qint64 i = 0; i < tileCount; ++i)
+            {
+                ScalarTileXFlip(tiles + i * 32, xFlipped);
+                ScalarTileYFlip(xFlipped, flipped + i * 32);
+            }
+            return tileCount;
+        });
+
+        results << Measure("ROMUtils::FlipTiles4bpp", repetitions, [tiles, flipped, tileCount]() {
+            ROMUtils::FlipTiles4bpp(tiles, flipped, static_cast<int>(tileCount), ROMUtils::TileFlipXY);
+            return tileCount;
+        });
+
+        results << Measure("Tile8x8XYUnpack (scalar)", repetitions, [tiles, indices, tileCount]() {
+            for (qint64 i = 0; i < tileCount; ++i)
+            {
+                ScalarTileUnpack(tiles + i * 32, indices + i * 64, true, true);
+            }
+            return tileCount;
+        });
+
+        results << Measure("ROMUtils::UnpackTiles4bpp", repetitions, [tiles, indices, tileCount]() {
+            ROMUtils::UnpackTiles4bpp(tiles, indices, static_cast<int>(tileCount), ROMUtils::TileFlipXY);
+            return tileCount;
+        });
+
+        results << Measure("Tile8x8Pack (scalar)", repetitions, [indices, flipped, tileCount]() {
+            for (qint64 i = 0; i < tileCount; ++i)
+            {
+                ScalarTilePack(indices + i * 64, flipped + i * 32);
+            }
+            return tileCount;
+        });
+
+        results << Measure("ROMUtils::PackTiles4bpp", repetitions, [indices, flipped, tileCount]() {
+            ROMUtils::PackTiles4bpp(indices, flipped, static_cast<int>(tileCount));
+            return tileCount;
+        });
+
+        for (LevelComponents::Level *level : levels)
+        {
+            delete level;
+        }
+
+        // Save the current level with all of its layers recompressed
+        LevelComponents::Level *currentLevel = singleton->GetCurrentLevel();
+        QTemporaryDir saveDir;
+        if (currentLevel && saveDir.isValid())
+        {
+            QString savePath = saveDir.filePath("benchmark.gba");
+            results << Measure("ROMUtils::SaveLevel", repetitions, [currentLevel, savePath]() {
+                for (LevelComponents::Room *room : currentLevel->GetRooms())
+                {
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        LevelComponents::Layer *layer = room->GetLayer(i);
+                        if (layer->GetMappingType() == LevelComponents::LayerMap16) layer->SetDirty(true);
+                    }
+                }
+                return ROMUtils::SaveLevel(savePath) ? static_cast<qint64>(1) : static_cast<qint64>(-1);
+            });
+        }
+
+        QJsonObject document;
+        document["rom"] = QFileInfo(ROMUtils::ROMFileMetadata->FilePath).fileName();
+        document["rom_size"] = static_cast<double>(ROMUtils::ROMFileMetadata->Length);
+        document["qt_version"] = QString(qVersion());
+        document["benchmarks"] = results;
+        return QJsonDocument(document).toJson(QJsonDocument::Indented);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef BENCHMARKUTILS_H
+#define BENCHMARKUTILS_H
+
+#include <QByteArray>
+
+// Timings of the decode, render, compress and save hot paths over every vanilla level, tileset and entity
+// of the loaded ROM, emitted as JSON so that runs on different commits can be compared.
+namespace BenchmarkUtils
+{
+    QByteArray RunBenchmarks(int repetitions);
+}
+
+#endif // BENCHMARKUTILS_H
@@ -0,0 +1,357 @@
+#include "BulkExportUtils.h"
+#include "ChangeJournal.h"
+#include "ROMUtils.h"
+#include "WL4Constants.h"
+#include "LevelComponents/AsyncRoomRenderer.h"
+#include "LevelComponents/Level.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <functional>
+#include <memory>
+
+#ifndef WINDOW_INSTANCE_SINGLETON
+#define WINDOW_INSTANCE_SINGLETON
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+#endif
+
+namespace BulkExportUtils
+{
+    // Qt maps this PNG quality to zlib level 1, the dump should be fast rather than small
+    static const int PNGQuality = 80;
+
+    // Jobs queued per worker thread, the GUI thread waits before taking more snapshots
+    static const int QueuedJobsPerThread = 2;
+
+    // Writes the exported files from a thread pool. The number of queued jobs is capped, so the snapshots and
+    // images waiting for a worker never pile up while the GUI thread walks the levels.
+    class FileWriter
+    {
+    private:
+        QDir Directory;
+        QThreadPool Pool;
+        QSemaphore FreeSlots;
+        QMutex ResultMutex;
+        QStringList Errors;
+        QHash<QString, qint64> FileSizes; // by relative path
+
+        void AddError(QString path)
+        {
+            QMutexLocker locker(&ResultMutex);
+            Errors << path;
+        }
+
+        void AddFileSize(QString relativePath, qint64 size)
+        {
+            QMutexLocker locker(&ResultMutex);
+            FileSizes[relativePath] = size;
+        }
+
+        void Start(std::function<void()> work)
+        {
+            FreeSlots.acquire();
+            Pool.start(new LevelComponents::RoomRenderTask([this, work]() {
+                work();
+                FreeSlots.release();
+            }));
+        }
+
+    public:
+        FileWriter(QString directory) : Directory(directory)
+        {
+            FreeSlots.release(Pool.maxThreadCount() * QueuedJobsPerThread);
+        }
+
+        ~FileWriter() { Pool.waitForDone(); }
+
+        /// <summary>
+        /// Render an image on a worker thread and save it as a PNG file.
+        /// </summary>
+        /// <param name="relativePath">
+        /// The path of the file in the export directory.
+        /// </param>
+        /// <param name="render">
+        /// Draws the image, it must not read any editor object.
+        /// </param>
+        void SaveImage(QString relativePath, std::function<QImage ()> render)
+        {
+            QString path = Directory.filePath(relativePath);
+            Start([this, path, relativePath, render]() {
+                QImage image = render();
+                if (image.isNull() || !image.save(path, "PNG", PNGQuality))
+                    AddError(path);
+                else
+                    AddFileSize(relativePath, QFileInfo(path).size());
+            });
+        }
+
+        /// <summary>
+        /// Write raw data to a file on a worker thread.
+        /// </summary>
+        /// <param name="relativePath">
+        /// The path of the file in the export directory.
+        /// </param>
+        /// <param name="data">
+        /// The content of the file.
+        /// </param>
+        void SaveData(QString relativePath, QByteArray data)
+        {
+            QString path = Directory.filePath(relativePath);
+            Start([this, path, relativePath, data]() {
+                QFile file(path);
+                if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+                    AddError(path);
+                else
+                    AddFileSize(relativePath, data.size());
+            });
+        }
+
+        /// <summary>
+        /// Wait for every queued file to be written.
+        /// </summary>
+        /// <return>The paths of the files which could not be written.</return>
+        QStringList Finish()
+        {
+            Pool.waitForDone();
+            return Errors;
+        }
+
+        /// <summary>
+        /// Get the size of a written file, only valid after Finish().
+        /// </summary>
+        /// <return>The size in bytes, or -1 if the file was not written.</return>
+        qint64 GetFileSize(QString relativePath) { return FileSizes.value(relativePath, -1); }
+    };
+
+    /// <summary>
+    /// Draw a block of 4bpp tiles with a single palette.
+    /// </summary>
+    /// <param name="tileData">
+    /// The tiles, 32 bytes each, row by row.
+    /// </param>
+    /// <param name="palette">
+    /// The 16 colors of the tiles.
+    /// </param>
+    /// <param name="columns">
+    /// The number of tiles in a row.
+    /// </param>
+    /// <return>A Format_Indexed8 image of the tiles.</return>
+    static QImage RenderTiles4bpp(const QByteArray &tileData, const QVector<QRgb> &palette, int columns)
+    {
+        int tileCount = tileData.size() / 32;
+        int rows = (tileCount + columns - 1) / columns;
+        QImage image(8 * columns, 8 * rows, QImage::Format_Indexed8);
+        image.fill(0);
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(tileData.constData());
+        for (int tile = 0; tile < tileCount; ++tile)
+        {
+            int x = (tile % columns) * 8, y = (tile / columns) * 8;
+            for (int i = 0; i < 8; ++i)
+            {
+                unsigned char *line = image.scanLine(y + i) + x;
+                for (int j = 0; j < 4; ++j)
+                {
+                    unsigned char pixels = data[tile * 32 + i * 4 + j];
+                    line[j * 2] = pixels & 0xF;
+                    line[j * 2 + 1] = pixels >> 4;
+                }
+            }
+        }
+        QVector<QRgb> colorTable(16, 0);
+        for (int i = 0; i < 16 && i < palette.size(); ++i)
+        {
+            colorTable[i] = palette[i];
+        }
+        image.setColorTable(colorTable);
+        return image;
+    }
+
+    /// <summary>
+    /// Describe an exported file for the manifest.
+    /// </summary>
+    static QJsonObject ManifestEntry(QString path, QString type, int width, int height)
+    {
+        QJsonObject entry;
+        entry["path"] = path;
+        entry["type"] = type;
+        entry["width"] = width;
+        entry["height"] = height;
+        return entry;
+    }
+
+    /// <summary>
+    /// Export the graphics of the whole game to a directory.
+    /// </summary>
+    /// <remarks>
+    /// The levels are loaded one at a time on the GUI thread, which only takes a snapshot of every room and
+    /// hands it over to the worker threads. Tileset and entity set atlases are drawn on the GUI thread because
+    /// they read the live objects, only their PNG encoding is left to the workers. Room images stack the layers
+    /// by priority with the color blending of layer 0, like the editor shows them.
+    /// </remarks>
+    /// <param name="directory">
+    /// The directory to write to, it is created if needed. Existing files are overwritten.
+    /// </param>
+    /// <param name="succeeded">
+    /// Set to true if every file was written.
+    /// </param>
+    /// <return>A short report of the export.</return>
+    QString ExportAllGraphics(QString directory, bool *succeeded)
+    {
+        if (succeeded) *succeeded = false;
+        QDir dir(directory);
+        if (!dir.mkpath("."))
+        {
+            return QObject::tr("Cannot create the export directory: %1").arg(directory);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        QJsonArray files;
+        FileWriter writer(dir.absolutePath());
+
+        // Rooms, and the raw data of their Map16 layers
+        LevelComponents::Level *currentLevel = singleton->GetCurrentLevel();
+        for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
+        {
+            int passage = WL4Constants::VanillaLevelPassages[i], stage = WL4Constants::VanillaLevelStages[i];
+            LevelComponents::Level *level = nullptr, *loadedLevel = nullptr;
+            if (currentLevel && currentLevel->GetPassage() == passage && currentLevel->GetStage() == stage)
+            {
+                level = currentLevel;
+            }
+            else if ((level = ChangeJournal::FindEditedLevel(passage, stage)))
+            {
+                level->ResetGlobalInstances();
+            }
+            else
+            {
+                level = loadedLevel = new LevelComponents::Level(static_cast<enum LevelComponents::__passage>(passage),
+                                                                 static_cast<enum LevelComponents::__stage>(stage));
+            }
+
+            QString levelDir = QString("rooms/level_%1-%2").arg(passage).arg(stage);
+            dir.mkpath(levelDir);
+            std::vector<LevelComponents::Room *> rooms = level->GetRooms();
+            for (unsigned int roomId = 0; roomId < rooms.size(); ++roomId)
+            {
+                std::shared_ptr<struct LevelComponents::RoomRenderSnapshot> snapshot = LevelComponents::RoomRenderSnapshot::Create(rooms[roomId]);
+                QString roomPath = levelDir + QString("/room_%1").arg(roomId, 2, 16, QChar('0'));
+                writer.SaveImage(roomPath + ".png", [snapshot]() {
+                    return LevelComponents::AsyncRoomRenderer::RenderComposedImage(*snapshot, []() { return false; });
+                });
+                QJsonObject roomEntry = ManifestEntry(roomPath + ".png", "room", snapshot->SceneWidth, snapshot->SceneHeight);
+                roomEntry["passage"] = passage;
+                roomEntry["stage"] = stage;
+                roomEntry["room"] = static_cast<int>(roomId);
+                files << roomEntry;
+
+                for (int layerId = 0; layerId < 4; ++layerId)
+                {
+                    const struct LevelComponents::RoomRenderSnapshot::LayerSnapshot &layer = snapshot->Layers[layerId];
+                    if (layer.MappingType != LevelComponents::LayerMap16) continue;
+                    QString layerPath = roomPath + QString("_layer%1.bin").arg(layerId);
+                    writer.SaveData(layerPath, QByteArray(reinterpret_cast<const char *>(layer.LayerData.constData()),
+                                                          layer.LayerData.size() * sizeof(unsigned short)));
+                    QJsonObject layerEntry = ManifestEntry(layerPath, "layer", layer.Width, layer.Height);
+                    layerEntry["passage"] = passage;
+                    layerEntry["stage"] = stage;
+                    layerEntry["room"] = static_cast<int>(roomId);
+                    layerEntry["layer"] = layerId;
+                    files << layerEntry;
+                }
+            }
+            delete loadedLevel;
+        }
+
+        // Tilesets, with all of their palettes
+        dir.mkpath("tilesets");
+        for (unsigned int i = 0; i < sizeof(ROMUtils::singletonTilesets) / sizeof(ROMUtils::singletonTilesets[0]); ++i)
+        {
+            QImage image = ROMUtils::singletonTilesets[i]->RenderAllTile16Indexed(1);
+            QString path = QString("tilesets/tileset_%1.png").arg(i, 2, 16, QChar('0'));
+            writer.SaveImage(path, [image]() { return image; });
+            QJsonObject entry = ManifestEntry(path, "tileset", image.width(), image.height());
+            entry["id"] = static_cast<int>(i);
+            files << entry;
+        }
+
+        // Entity sets, with their first palette
+        dir.mkpath("entitysets");
+        for (unsigned int i = 0; i < sizeof(ROMUtils::entitiessets) / sizeof(ROMUtils::entitiessets[0]); ++i)
+        {
+            QImage image = ROMUtils::entitiessets[i]->RenderIndexed(0);
+            QString path = QString("entitysets/entityset_%1.png").arg(i, 2, 16, QChar('0'));
+            writer.SaveImage(path, [image]() { return image; });
+            QJsonObject entry = ManifestEntry(path, "entityset", image.width(), image.height());
+            entry["id"] = static_cast<int>(i);
+            files << entry;
+        }
+
+        // Wall paints, with the colored passage palette
+        dir.mkpath("wallpaints");
+        unsigned char *romData = ROMUtils::ROMFileMetadata->ROMDataPtr;
+        for (int passage = 0; passage < 6; ++passage)
+        {
+            for (int level = 0; level < 4; ++level)
+            {
+                QVector<QRgb> palette;
+                ROMUtils::LoadPalette(&palette, reinterpret_cast<unsigned short *>(romData + WL4Constants::WallPaintPalPassageColor +
+                                                                                 32 * 5 * passage + 32 * level), true);
+                QByteArray tileData;
+                int gfxOffset = WL4Constants::WallPaintGFXAddr + (1024 * 5) * passage + (5 * 32) * level;
+                for (int c = 0; c < 5; ++c)
+                {
+                    for (int r = 0; r < 5; ++r)
+                    {
+                        tileData.append(reinterpret_cast<const char *>(romData + gfxOffset + r * 32 + c * 1024), 32);
+                    }
+                }
+                QString path = QString("wallpaints/wallpaint_%1-%2.png").arg(passage).arg(level);
+                writer.SaveImage(path, [tileData, palette]() { return RenderTiles4bpp(tileData, palette, 5); });
+                QJsonObject entry = ManifestEntry(path, "wallpaint", 8 * 5, 8 * 5);
+                entry["passage"] = passage;
+                entry["level"] = level;
+                files << entry;
+            }
+        }
+
+        QStringList errors = writer.Finish();
+        int writtenFiles = files.size() - errors.size();
+        for (int i = 0; i < files.size(); ++i)
+        {
+            QJsonObject entry = files[i].toObject();
+            entry["bytes"] = writer.GetFileSize(entry["path"].toString());
+            files[i] = entry;
+        }
+        QJsonObject manifest;
+        manifest["rom"] = QFileInfo(ROMUtils::ROMFileMetadata->FilePath).fileName();
+        manifest["files"] = files;
+        manifest["failed"] = QJsonArray::fromStringList(errors);
+        QFile manifestFile(dir.filePath("manifest.json"));
+        if (!manifestFile.open(QIODevice::WriteOnly) || manifestFile.write(QJsonDocument(manifest).toJson(QJsonDocument::Indented)) < 0)
+        {
+            errors << manifestFile.fileName();
+        }
+        manifestFile.close();
+
+        QString result = QObject::tr("Exported %1 files to %2 in %3 ms.").arg(writtenFiles)
+                                                                          .arg(dir.absolutePath()).arg(timer.elapsed());
+        if (!errors.isEmpty())
+        {
+            result += "\n" + QObject::tr("Failed to write:") + "\n  " + errors.join("\n  ");
+        }
+        if (succeeded) *succeeded = errors.isEmpty();
+        return result;
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef BULKEXPORTUTILS_H
+#define BULKEXPORTUTILS_H
+
+#include <QString>
+
+// Dumps the graphics of the whole game in one go: every room of every vanilla level with the raw data of its
+// Map16 layers, and every tileset, entity set and wall paint, plus a manifest.json describing the files.
+// Rooms are rendered and all the files are encoded and written on a thread pool. Levels with unsaved edits
+// are exported as edited.
+namespace BulkExportUtils
+{
+    QString ExportAllGraphics(QString directory, bool *succeeded = nullptr);
+}
+
+#endif // BULKEXPORTUTILS_H
@@ -0,0 +1,218 @@
+#include "ChangeJournal.h"
+#include "LevelComponents/Level.h"
+#include "ROMUtils.h"
+
+#include <QObject>
+#include <QSet>
+#include <algorithm>
+
+namespace ChangeJournal
+{
+    // The first 0x11 entities are not saved as the other ones, SaveLevel skips them
+    static const int FirstSavedEntityId = 0x11;
+
+    static QSet<int> ChangedIds[AssetTypeCount];
+    static QVector<LevelComponents::Level *> EditedLevels;
+
+    /// <summary>
+    /// Record that a global asset was replaced or modified.
+    /// </summary>
+    /// <param name="type">
+    /// The type of the asset.
+    /// </param>
+    /// <param name="id">
+    /// The global id of the asset.
+    /// </param>
+    void RecordChange(enum AssetType type, int id)
+    {
+        ChangedIds[type].insert(id);
+    }
+
+    /// <summary>
+    /// Check if a global asset was modified since the last save.
+    /// </summary>
+    /// <param name="type">
+    /// The type of the asset.
+    /// </param>
+    /// <param name="id">
+    /// The global id of the asset.
+    /// </param>
+    bool IsChanged(enum AssetType type, int id)
+    {
+        return ChangedIds[type].contains(id);
+    }
+
+    /// <summary>
+    /// Get the ids of the assets of a type modified since the last save.
+    /// </summary>
+    /// <param name="type">
+    /// The type of the assets.
+    /// </param>
+    /// <return>The ids in ascending order, the order a sequential save writes them in.</return>
+    QVector<int> GetChanged(enum AssetType type)
+    {
+        QVector<int> ids;
+        ids.reserve(ChangedIds[type].size());
+        for (int id : ChangedIds[type])
+        {
+            if (type == EntityAsset && id < FirstSavedEntityId) continue;
+            ids.append(id);
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    /// <summary>
+    /// Keep a level with unsaved edits in memory when another level is loaded.
+    /// </summary>
+    /// <param name="level">
+    /// The level, the journal takes the ownership of it.
+    /// </param>
+    void KeepEditedLevel(LevelComponents::Level *level)
+    {
+        EditedLevels.append(level);
+    }
+
+    /// <summary>
+    /// Find a level kept with unsaved edits.
+    /// </summary>
+    /// <param name="passage">
+    /// The passage of the level.
+    /// </param>
+    /// <param name="stage">
+    /// The stage of the level.
+    /// </param>
+    /// <return>The level, still owned by the journal, or nullptr if it has no unsaved edits.</return>
+    LevelComponents::Level *FindEditedLevel(int passage, int stage)
+    {
+        for (LevelComponents::Level *level : EditedLevels)
+        {
+            if (level->GetPassage() == passage && level->GetStage() == stage) return level;
+        }
+        return nullptr;
+    }
+
+    /// <summary>
+    /// Take back a level kept with unsaved edits, to make it the current level again.
+    /// </summary>
+    /// <param name="passage">
+    /// The passage of the level.
+    /// </param>
+    /// <param name="stage">
+    /// The stage of the level.
+    /// </param>
+    /// <return>The level, now owned by the caller, or nullptr if it has no unsaved edits.</return>
+    LevelComponents::Level *TakeEditedLevel(int passage, int stage)
+    {
+        LevelComponents::Level *level = FindEditedLevel(passage, stage);
+        EditedLevels.removeOne(level);
+        return level;
+    }
+
+    /// <summary>
+    /// Get the levels kept with unsaved edits, in the order they were left.
+    /// </summary>
+    QVector<LevelComponents::Level *> GetEditedLevels()
+    {
+        return EditedLevels;
+    }
+
+    /// <summary>
+    /// Check if no global asset was modified and no level was kept since the last save.
+    /// </summary>
+    bool IsEmpty()
+    {
+        for (int i = 0; i < AssetTypeCount; ++i)
+        {
+            if (!ChangedIds[i].isEmpty()) return false;
+        }
+        return EditedLevels.isEmpty();
+    }
+
+    /// <summary>
+    /// Forget every recorded change and delete the kept levels, used after a successful save and when a ROM is loaded.
+    /// </summary>
+    void Clear()
+    {
+        for (int i = 0; i < AssetTypeCount; ++i)
+        {
+            ChangedIds[i].clear();
+        }
+        qDeleteAll(EditedLevels);
+        EditedLevels.clear();
+    }
+
+    /// <summary>
+    /// Describe what the next save will write, with an estimation of the size of every chunk.
+    /// </summary>
+    /// <remarks>
+    /// Layer data is estimated by its uncompressed size, the compressed chunk is usually a lot smaller.
+    /// </remarks>
+    /// <param name="currentLevel">
+    /// The current level, saved with the kept levels and the global assets, or nullptr.
+    /// </param>
+    /// <return>One line per asset, and the total.</return>
+    QString GetSavePreview(LevelComponents::Level *currentLevel)
+    {
+        QString result = QObject::tr("Save preview:") + "\n";
+        unsigned int total = 0;
+        auto addLine = [&result, &total](QString name, unsigned int bytes) {
+            result += QString("  %1: %2 bytes\n").arg(name).arg(bytes);
+            total += bytes;
+        };
+
+        for (int id : GetChanged(TilesetAsset))
+        {
+            LevelComponents::Tileset *tileset = ROMUtils::singletonTilesets[id];
+            addLine(QObject::tr("Tileset 0x%1").arg(id, 2, 16, QChar('0')),
+                    0x600 + tileset->GetfgGFXlen() + 0x300 + 16 * 16 * 2 + 0x300 * 8);
+        }
+        for (int id : GetChanged(EntityAsset))
+        {
+            LevelComponents::Entity *entity = ROMUtils::entities[id];
+            addLine(QObject::tr("Entity 0x%1").arg(id, 2, 16, QChar('0')),
+                    entity->GetTilesNum() * 32 + entity->GetPalNum() * 16 * 2);
+        }
+        for (int id : GetChanged(EntitySetAsset))
+        {
+            addLine(QObject::tr("Entity set 0x%1").arg(id, 2, 16, QChar('0')),
+                    ROMUtils::entitiessets[id]->GetEntityTable().size() * 2 + 2);
+        }
+        for (int id : GetChanged(AnimatedTileGroupAsset))
+        {
+            addLine(QObject::tr("Animated tile group 0x%1").arg(id, 2, 16, QChar('0')),
+                    ROMUtils::animatedTileGroups[id]->GetTotalFrameCount() * 4 * 32);
+        }
+
+        QVector<LevelComponents::Level *> levels = EditedLevels;
+        if (currentLevel) levels.prepend(currentLevel);
+        for (LevelComponents::Level *level : levels)
+        {
+            // The room headers and the door table are always written with the level
+            QString levelName = QObject::tr("Level %1-%2").arg(level->GetPassage()).arg(level->GetStage());
+            std::vector<LevelComponents::Room *> rooms = level->GetRooms();
+            addLine(levelName + QObject::tr(" room headers and doors"), rooms.size() * sizeof(struct LevelComponents::__RoomHeader) +
+                    (level->GetDoorListRef().size() + 1) * sizeof(struct LevelComponents::DoorEntry));
+            for (unsigned int roomId = 0; roomId < rooms.size(); ++roomId)
+            {
+                LevelComponents::Room *room = rooms[roomId];
+                for (int layerId = 0; layerId < 4; ++layerId)
+                {
+                    LevelComponents::Layer *layer = room->GetLayer(layerId);
+                    if (!layer->IsDirty() || layer->GetMappingType() != LevelComponents::LayerMap16) continue;
+                    addLine(levelName + QObject::tr(" room 0x%1 layer %2").arg(roomId, 2, 16, QChar('0')).arg(layerId),
+                            layer->GetLayerWidth() * layer->GetLayerHeight() * 2);
+                }
+                for (int difficulty = 0; difficulty < 3; ++difficulty)
+                {
+                    if (!room->GetEntityListDirty(difficulty)) continue;
+                    addLine(levelName + QObject::tr(" room 0x%1 entity list %2").arg(roomId, 2, 16, QChar('0')).arg(difficulty),
+                            (room->GetEntityListData(difficulty).size() + 1) * sizeof(struct LevelComponents::EntityRoomAttribute));
+                }
+            }
+        }
+
+        result += QObject::tr("Total: %1 bytes").arg(total);
+        return result;
+    }
+}
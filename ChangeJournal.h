@@ -0,0 +1,41 @@
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QString>
+#include <QVector>
+
+namespace LevelComponents
+{
+    class Level;
+}
+
+// Records which global assets were modified since the last save, so the save only generates chunks for those.
+// Every global operation records the ids of the assets it swaps, on execute and on undo, and a successful
+// SaveLevel clears the journal. The layers, entity lists and doors of a level keep their own dirty bools.
+// The journal also owns the levels with unsaved edits which are not the current level any more, SaveLevel
+// writes all of them together with the current level.
+// Only use it from the GUI thread.
+namespace ChangeJournal
+{
+    enum AssetType
+    {
+        TilesetAsset = 0,
+        EntityAsset,
+        EntitySetAsset,
+        AnimatedTileGroupAsset,
+        AssetTypeCount
+    };
+
+    void RecordChange(enum AssetType type, int id);
+    bool IsChanged(enum AssetType type, int id);
+    QVector<int> GetChanged(enum AssetType type);
+    void KeepEditedLevel(LevelComponents::Level *level);
+    LevelComponents::Level *FindEditedLevel(int passage, int stage);
+    LevelComponents::Level *TakeEditedLevel(int passage, int stage);
+    QVector<LevelComponents::Level *> GetEditedLevels();
+    bool IsEmpty();
+    void Clear();
+    QString GetSavePreview(LevelComponents::Level *currentLevel);
+}
+
+#endif // CHANGEJOURNAL_H
@@ -1,6 +1,9 @@
 #include "ChooseLevelDialog.h"
 #include "ui_ChooseLevelDialog.h"
 
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+
 ChooseLevelDialog::ChooseLevelDialog(struct DialogParams::PassageAndLevelIndex currentSelection, QWidget *parent) :
         QDialog(parent), ui(new Ui::ChooseLevelDialog)
 {
@@ -25,6 +28,10 @@ ChooseLevelDialog::ChooseLevelDialog(struct DialogParams::PassageAndLevelIndex c
         SelectItemID = currentSelection._LevelIndex;
     }
     ConfigureLevelComboBox(SelectItemID);
+
+    // The thumbnails are drawn in the background after the ROM is loaded, show them as they come in
+    connect(singleton->GetRoomThumbnailCache(), SIGNAL(ThumbnailReady(int, int, int)), this, SLOT(RoomThumbnailReady(int, int, int)));
+    PopulateRoomThumbnails();
 }
 
 ChooseLevelDialog::~ChooseLevelDialog() { delete ui; }
@@ -83,3 +90,40 @@ DialogParams::PassageAndLevelIndex ChooseLevelDialog::GetResult()
 
     return tmpRetStruct;
 }
+
+/// <summary>
+/// Show the thumbnails of the rooms of the selected level.
+/// </summary>
+void ChooseLevelDialog::PopulateRoomThumbnails()
+{
+    DialogParams::PassageAndLevelIndex selection = GetResult();
+    LevelComponents::RoomThumbnailCache *thumbnails = singleton->GetRoomThumbnailCache();
+    ui->listWidget_Rooms->clear();
+    for (int i = 0; i < thumbnails->GetRoomCount(selection._PassageIndex, selection._LevelIndex); ++i)
+    {
+        QPixmap thumbnail = thumbnails->GetThumbnail(selection._PassageIndex, selection._LevelIndex, i);
+        ui->listWidget_Rooms->addItem(new QListWidgetItem(QIcon(thumbnail), tr("Room %1").arg(i)));
+    }
+}
+
+/// <summary>
+/// Show the rooms of the newly selected level.
+/// </summary>
+void ChooseLevelDialog::on_comboBox_Level_currentIndexChanged(int index)
+{
+    (void) index;
+    PopulateRoomThumbnails();
+}
+
+/// <summary>
+/// Update the room list when a thumbnail of the selected level has been drawn.
+/// </summary>
+void ChooseLevelDialog::RoomThumbnailReady(int passage, int stage, int roomId)
+{
+    (void) roomId;
+    DialogParams::PassageAndLevelIndex selection = GetResult();
+    if (passage == selection._PassageIndex && stage == selection._LevelIndex)
+    {
+        PopulateRoomThumbnails();
+    }
+}
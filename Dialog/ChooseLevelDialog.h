@@ -28,10 +28,13 @@ public:
 
 private slots:
     void on_comboBox_Passage_currentTextChanged(const QString &arg1);
+    void on_comboBox_Level_currentIndexChanged(int index);
+    void RoomThumbnailReady(int passage, int stage, int roomId);
 
 private:
     Ui::ChooseLevelDialog *ui;
     void ConfigureLevelComboBox(int level);
+    void PopulateRoomThumbnails();
 
 public:
     DialogParams::PassageAndLevelIndex GetResult();
@@ -7,6 +7,7 @@
 #include "WL4EditorWindow.h"
 #include "WL4Constants.h"
 #include "FileIOUtils.h"
+#include "ChangeJournal.h"
 
 extern WL4EditorWindow *singleton;
 
@@ -628,6 +629,9 @@ bool GraphicManagerDialog::CheckEditability(int entryId)
 /// <summary>
 /// Generate entries from the current ROM's Tileset and Rooms data.
 /// </summary>
+/// <remarks>
+/// The current level and the levels kept with unsaved edits are read as edited, the other levels are loaded from the ROM.
+/// </remarks>
 void GraphicManagerDialog::GetVanillaGraphicEntriesFromROM()
 {
     // don't run this function if there is some graphic Entry exist(s).
@@ -639,10 +643,23 @@ void GraphicManagerDialog::GetVanillaGraphicEntriesFromROM()
     // loop through all the Rooms
     QVector<unsigned int> levelid_array = {0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 5, 5};
     QVector<unsigned int> roomid_array = {0, 2, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 4};
+    LevelComponents::Level *currentLevel = singleton->GetCurrentLevel();
     for (int i = 0; i < levelid_array.size(); i++)
     {
-        LevelComponents::Level *tmpLevel = new LevelComponents::Level(static_cast<LevelComponents::__passage>(levelid_array[i]),
-                                                                      static_cast<LevelComponents::__stage>(roomid_array[i]));
+        LevelComponents::Level *tmpLevel = nullptr, *loadedLevel = nullptr;
+        if (currentLevel && currentLevel->GetPassage() == levelid_array[i] && currentLevel->GetStage() == roomid_array[i])
+        {
+            tmpLevel = currentLevel;
+        }
+        else if ((tmpLevel = ChangeJournal::FindEditedLevel(levelid_array[i], roomid_array[i])))
+        {
+            tmpLevel->ResetGlobalInstances();
+        }
+        else
+        {
+            tmpLevel = loadedLevel = new LevelComponents::Level(static_cast<LevelComponents::__passage>(levelid_array[i]),
+                                                                static_cast<LevelComponents::__stage>(roomid_array[i]));
+        }
         for (int j = 0; j < tmpLevel->GetRooms().size(); j++)
         {
             LevelComponents::__RoomHeader header = tmpLevel->GetRooms()[j]->GetRoomHeader();
@@ -807,7 +824,7 @@ void GraphicManagerDialog::GetVanillaGraphicEntriesFromROM()
             }
         }
 
-        delete tmpLevel;
+        delete loadedLevel; // only the levels loaded here, the others are owned by the editor and the change journal
     }
 }
 
@@ -17,16 +17,18 @@ static QStringList TilesetNamesSet, LayerPrioritySet, AlphaBlendAttrsSet;
 static std::vector<int> BGLayerdataPtrs;
 
 // helper function
-unsigned short *RoomConfigDialog::ChangeLayerDimensions(int newWidth, int newHeight, int oldWidth, int oldHeight, unsigned short *oldData)
+QVector<unsigned short> RoomConfigDialog::ChangeLayerDimensions(int newWidth, int newHeight, int oldWidth, int oldHeight, const QVector<unsigned short> &oldData)
 {
-    if ((newWidth < 1 || newHeight < 1) || (oldData == nullptr)) return nullptr;
+    if ((newWidth < 1 || newHeight < 1) || oldData.isEmpty()) return QVector<unsigned short>();
+
+    // keep sharing the old data if the size did not change
+    if (newWidth == oldWidth && newHeight == oldHeight) return oldData;
 
-    unsigned short *tmpLayerData = new unsigned short[newWidth * newHeight];
     int boundX = qMin(oldWidth, newWidth), boundY = qMin(oldHeight, newHeight);
     unsigned short defaultValue = 0x0000;
 
     // init
-    memset(tmpLayerData, defaultValue, 2 * newWidth * newHeight);
+    QVector<unsigned short> tmpLayerData(newWidth * newHeight, defaultValue);
 
     // copy old data
     if (oldWidth > 0 && oldHeight > 0)
@@ -35,7 +37,7 @@ unsigned short *RoomConfigDialog::ChangeLayerDimensions(int newWidth, int newHei
         {
             for (int j = 0; j < boundX; ++j)
             {
-                tmpLayerData[i * newWidth + j] = oldData[i * oldWidth + j];
+                tmpLayerData[i * newWidth + j] = oldData.at(i * oldWidth + j);
             }
         }
     }
@@ -189,7 +191,7 @@ DialogParams::RoomConfigParams *RoomConfigDialog::GetConfigParams(DialogParams::
         configParams->LayerData[0] = ChangeLayerDimensions(configParams->Layer0Width, configParams->Layer0Height,
                                                           prevRoomParams->Layer0Width, prevRoomParams->Layer0Height, prevRoomParams->LayerData[0]);
     } else {
-        configParams->LayerData[0] = nullptr;
+        configParams->LayerData[0].clear();
     }
     configParams->LayerData[1] = ChangeLayerDimensions(configParams->RoomWidth, configParams->RoomHeight,
                                                       prevRoomParams->RoomWidth, prevRoomParams->RoomHeight, prevRoomParams->LayerData[1]);
@@ -197,7 +199,7 @@ DialogParams::RoomConfigParams *RoomConfigDialog::GetConfigParams(DialogParams::
         configParams->LayerData[2] = ChangeLayerDimensions(configParams->RoomWidth, configParams->RoomHeight,
                                                           prevRoomParams->RoomWidth, prevRoomParams->RoomHeight, prevRoomParams->LayerData[2]);
     } else {
-        configParams->LayerData[2] = nullptr;
+        configParams->LayerData[2].clear();
     }
 
     return configParams;
@@ -8,6 +8,7 @@
 #include <QLabel>
 #include <QPixmap>
 #include <QScrollBar>
+#include <QVector>
 
 #include "LevelComponents/Layer.h"
 #include "LevelComponents/Room.h"
@@ -20,27 +21,27 @@ namespace DialogParams
 {
     struct RoomConfigParams
     {
-        int CurrentTilesetIndex;
-        bool Layer0Alpha;
-        int LayerPriorityAndAlphaAttr;
-        int Layer0MappingTypeParam;
-        int Layer0DataPtr;
-        int Layer0Width;
-        int Layer0Height;
-        int RoomWidth;
-        int RoomHeight;
-        int Layer2MappingTypeParam;
+        int CurrentTilesetIndex = 0;
+        bool Layer0Alpha = false;
+        int LayerPriorityAndAlphaAttr = 0;
+        int Layer0MappingTypeParam = 0;
+        int Layer0DataPtr = 0;
+        int Layer0Width = 0;
+        int Layer0Height = 0;
+        int RoomWidth = 0;
+        int RoomHeight = 0;
+        int Layer2MappingTypeParam = 0;
 
-        bool BackgroundLayerEnable;
-        unsigned char BGLayerScrollFlag;
-        int BackgroundLayerDataPtr;
-        unsigned short *LayerData[3]; //always copy the layerdata, don't pass the pointer directly
-        unsigned char RasterType;
-        unsigned char Water;
-        unsigned short BGMVolume;
+        bool BackgroundLayerEnable = false;
+        unsigned char BGLayerScrollFlag = 0;
+        int BackgroundLayerDataPtr = 0;
+        QVector<unsigned short> LayerData[3]; // shared with the layers, copied only when one side is modified
+        unsigned char RasterType = 0;
+        unsigned char Water = 0;
+        unsigned short BGMVolume = 0;
 
         // Default constructor
-        RoomConfigParams() { memset(this, 0, sizeof(struct RoomConfigParams)); }
+        RoomConfigParams() {}
 
         // Construct this param struct using a Room object
         RoomConfigParams(LevelComponents::Room *room) :
@@ -61,8 +62,6 @@ namespace DialogParams
             for (int i = 0; i < 3; i++) {
                 if (room->GetLayer(i)->GetMappingType() == LevelComponents::LayerMap16) {
                     LayerData[i] = room->GetLayer(i)->CreateLayerDataCopy();
-                } else {
-                    LayerData[i] = nullptr;
                 }
             }
             if (BackgroundLayerEnable) {
@@ -72,15 +71,6 @@ namespace DialogParams
             }
             BGLayerScrollFlag = room->GetBGLayerScrollFlag();
         }
-
-        ~RoomConfigParams()
-        {
-            // new and delete by myself.
-            for (int i = 0; i < 3; i++)
-            {
-                if (LayerData[i]) delete[] LayerData[i];
-            }
-        }
     };
 } // namespace DialogParams
 
@@ -100,7 +90,7 @@ public:
     DialogParams::RoomConfigParams *GetConfigParams(DialogParams::RoomConfigParams *prevRoomParams);
 
     // helper functions
-    static unsigned short *ChangeLayerDimensions(int newWidth, int newHeight, int oldWidth, int oldHeight, unsigned short *oldData);
+    static QVector<unsigned short> ChangeLayerDimensions(int newWidth, int newHeight, int oldWidth, int oldHeight, const QVector<unsigned short> &oldData);
 
 private slots:
     void on_CheckBox_Layer0Alpha_stateChanged(int state);
@@ -326,14 +326,10 @@ void TilesetEditDialog::on_checkBox_BottomRightVFlip_toggled(bool checked)
 void TilesetEditDialog::RenderInitialization()
 {
     // draw pixmaps
-    QPixmap Tile8x8Pixmap(8 * 16, 0x600 / 2);
-    Tile8x8Pixmap.fill(Qt::transparent);
-    QPainter Tile8x8PixmapPainter(&Tile8x8Pixmap);
-    Tile8x8PixmapPainter.drawImage(0, 0, tilesetEditParams->newTileset->RenderAllTile8x8(0).toImage());
-    QPixmap Tile16Pixmap(16 * 8, 0x300 * 2);
-    Tile16Pixmap.fill(Qt::transparent);
-    QPainter Tile16PixmapPainter(&Tile16Pixmap);
-    Tile16PixmapPainter.drawImage(0, 0, tilesetEditParams->newTileset->RenderAllTile16(1).toImage());
+    Tile8x8MapImage = tilesetEditParams->newTileset->RenderAllTile8x8Indexed(0);
+    QPixmap Tile8x8Pixmap = QPixmap::fromImage(Tile8x8MapImage);
+    Tile16MapImage = tilesetEditParams->newTileset->RenderAllTile16Indexed(1);
+    QPixmap Tile16Pixmap = QPixmap::fromImage(Tile16MapImage);
 
     // draw palette Bar
     QPixmap PaletteBarpixmap(8 * 16, 16);
@@ -428,10 +424,8 @@ void TilesetEditDialog::ResetPaletteBarGraphicView(int paletteId)
 void TilesetEditDialog::ReRenderTile16Map()
 {
     // draw pixmaps
-    QPixmap Tile16Pixmap(16 * 8, 0x300 * 2);
-    Tile16Pixmap.fill(Qt::transparent);
-    QPainter Tile16PixmapPainter(&Tile16Pixmap);
-    Tile16PixmapPainter.drawImage(0, 0, tilesetEditParams->newTileset->RenderAllTile16(1).toImage());
+    Tile16MapImage = tilesetEditParams->newTileset->RenderAllTile16Indexed(1);
+    QPixmap Tile16Pixmap = QPixmap::fromImage(Tile16MapImage);
 
     // Set up scenes
     Tile16MAPScene->clear();
@@ -453,10 +447,8 @@ void TilesetEditDialog::ReRenderTile16Map()
 void TilesetEditDialog::ReRenderTile8x8Map(int paletteId)
 {
     // draw pixmaps
-    QPixmap Tile8x8Pixmap(8 * 16, 0x600 / 2);
-    Tile8x8Pixmap.fill(Qt::transparent);
-    QPainter Tile8x8PixmapPainter(&Tile8x8Pixmap);
-    Tile8x8PixmapPainter.drawImage(0, 0, tilesetEditParams->newTileset->RenderAllTile8x8(paletteId).toImage());
+    Tile8x8MapImage = tilesetEditParams->newTileset->RenderAllTile8x8Indexed(paletteId);
+    QPixmap Tile8x8Pixmap = QPixmap::fromImage(Tile8x8MapImage);
 
     // Set up scenes
     Tile8x8MAPScene->clear();
@@ -470,6 +462,20 @@ void TilesetEditDialog::ReRenderTile8x8Map(int paletteId)
     SelectionBox_Tile8x8->setVisible(false);
 }
 
+/// <summary>
+/// Recolor the Tile8x8 Map and the Tile16 Map after palette changes.
+/// </summary>
+/// <remarks>
+/// The tiles are not drawn again, only the color tables of the indexed atlases are replaced.
+/// </remarks>
+void TilesetEditDialog::RecolorTileMaps()
+{
+    Tile8x8MapImage.setColorTable(tilesetEditParams->newTileset->GetTile8x8AtlasColorTable(SelectedPaletteId));
+    Tile8x8mapping->setPixmap(QPixmap::fromImage(Tile8x8MapImage));
+    Tile16MapImage.setColorTable(tilesetEditParams->newTileset->GetTile16AtlasColorTable());
+    Tile16mapping->setPixmap(QPixmap::fromImage(Tile16MapImage));
+}
+
 /// <summary>
 /// Copy A Tile16 triggered by mouse drag and drop action
 /// </summary>
@@ -496,19 +502,17 @@ void TilesetEditDialog::CopyTile16AndUpdateGraphic(int from_Tile16, int To_Tile1
     {
         // Update Tile8x8 data in Tile16
         LevelComponents::Tile8x8* oldtile = from_tile16Data->GetTile8X8(i);
-        to_tile16Data->ResetTile8x8(oldtile,
-                                    i,
-                                    oldtile->GetIndex(),
-                                    oldtile->GetPaletteIndex(),
-                                    oldtile->GetFlipX(),
-                                    oldtile->GetFlipY());
+        tilesetEditParams->newTileset->ResetTile8x8(To_Tile16,
+                                                    oldtile,
+                                                    i,
+                                                    oldtile->GetIndex(),
+                                                    oldtile->GetPaletteIndex(),
+                                                    oldtile->GetFlipX(),
+                                                    oldtile->GetFlipY());
     }
 
     // Update Graphicview
-    QPixmap pm(Tile16mapping->pixmap());
-    LevelComponents::TileMap16 *newtile16 = tilesetEditParams->newTileset->GetMap16arrayPtr()[To_Tile16];
-    newtile16->DrawTile(&pm, (To_Tile16 & 7) << 4, (To_Tile16 >> 3) << 4);
-    Tile16mapping->setPixmap(pm);
+    ReRenderTile16s({To_Tile16});
 
     // Update UI
     ui->spinBox->setValue(To_Tile16);
@@ -560,13 +564,11 @@ void TilesetEditDialog::UpdateATile8x8ForSelectedTile16InTilesetData(int tile16I
     }
 
     // Update Data
-    LevelComponents::TileMap16* tile16Data = tilesetEditParams->newTileset->GetMap16arrayPtr()[tile16Id];
-    tile16Data->ResetTile8x8(tilesetEditParams->newTileset->GetTile8x8arrayPtr()[newTile8x8_Id], position & 3, newTile8x8_Id, new_paletteIndex, xflip, yflip);
+    LevelComponents::Tileset *tileset = tilesetEditParams->newTileset;
+    tileset->ResetTile8x8(tile16Id, tileset->GetTile8x8arrayPtr()[newTile8x8_Id], position & 3, newTile8x8_Id, new_paletteIndex, xflip, yflip);
 
     // Update Graphic
-    QPixmap pm(Tile16mapping->pixmap());
-    tilesetEditParams->newTileset->GetMap16arrayPtr()[tile16Id]->DrawTile(&pm, (tile16Id & 7) << 4, (tile16Id >> 3) << 4);
-    Tile16mapping->setPixmap(pm);
+    ReRenderTile16s({tile16Id});
 
     // update Info Textbox
     UpdateInfoTextBox();
@@ -588,24 +590,24 @@ void TilesetEditDialog::OverwriteATile8x8InTile8x8MapAndUpdateTile16Map(int posI
     if(tile != tilesetEditParams->newTileset->GetblankTile())
         delete tile;
     tile = new LevelComponents::Tile8x8(tiledata, tilesetEditParams->newTileset->GetPalettes());
+
+    // the Tileset also updates the Tile16s using this Tile8x8
     tilesetEditParams->newTileset->SetTile8x8(tile, posId);
+}
 
-    // update Tile16 map
-    for(int i = 0; i < 0x300; ++i)
+/// <summary>
+/// Re-render some Tile16s in the Tile16 Map, the other Tile16s are left untouched.
+/// </summary>
+/// <param name="tile16Ids">
+/// The ids of the Tile16s to re-render.
+/// </param>
+void TilesetEditDialog::ReRenderTile16s(const QVector<int> &tile16Ids)
+{
+    for (int tile16Id : tile16Ids)
     {
-        LevelComponents::TileMap16* tile16 = tilesetEditParams->newTileset->GetMap16arrayPtr()[i];
-        for(int j = 0; j < 4; ++j)
-        {
-            LevelComponents::Tile8x8* tmptile = tile16->GetTile8X8(j);
-            if(tmptile->GetIndex() == posId)
-            {
-                int pal = tmptile->GetPaletteIndex();
-                bool xflip = tmptile->GetFlipX();
-                bool yflip = tmptile->GetFlipY();
-                tile16->ResetTile8x8(tile, j, posId, pal, xflip, yflip);
-            }
-        }
+        tilesetEditParams->newTileset->DrawTile16Indexed(&Tile16MapImage, tile16Id, (tile16Id & 7) << 4, (tile16Id >> 3) << 4);
     }
+    Tile16mapping->setPixmap(QPixmap::fromImage(Tile16MapImage));
 }
 
 /// <summary>
@@ -740,8 +742,8 @@ void TilesetEditDialog::SetColor(int newcolorId)
                                        QString::number(color.green(), 10) + QString(", ") +
                                        QString::number(color.blue(), 10) + QString(")"));
 
-        ReRenderTile8x8Map(SelectedPaletteId);
-        ReRenderTile16Map();
+        RecolorTileMaps();
+        SetSelectedTile8x8(SelectedTile8x8, false);
     }
 }
 
@@ -755,11 +757,11 @@ void TilesetEditDialog::on_horizontalSlider_valueChanged(int value)
 {
     if(!HasInitialized) return;
     SelectedPaletteId = value;
-    ReRenderTile8x8Map(value);
+    RecolorTileMaps();
     ResetPaletteBarGraphicView(value);
     SetSelectedTile8x8(0, true);
     SetSelectedColorId(0);
-    ReRenderTile16Map();
+    SetSelectedTile16(0, true);
     ui->label_Tile8x8SetPaletteId->setText("0x" + QString::number(value, 16));
 }
 
@@ -947,8 +949,8 @@ void TilesetEditDialog::on_pushButton_ImportPalette_clicked()
         SelectedPaletteId);
     ResetPaletteBarGraphicView(SelectedPaletteId);
     SetSelectedColorId(0);
-    ReRenderTile8x8Map(SelectedPaletteId);
-    ReRenderTile16Map();
+    RecolorTileMaps();
+    SetSelectedTile8x8(SelectedTile8x8, false);
 }
 
 /// <summary>
@@ -1041,29 +1043,29 @@ void TilesetEditDialog::on_pushButton_ImportTile16Graphic_clicked()
                     int row_tile16 = i / Tile16_per_row / 4;
                     int col_tile16 = i / 2 - Tile16_per_row * (cur_row);
 
-                    LevelComponents::TileMap16* tile16Data = tmp_newTilesetPtr->GetMap16arrayPtr()[selTile16 + row_tile16 * 8 + col_tile16];
+                    int tile16Id = selTile16 + row_tile16 * 8 + col_tile16;
                     LevelComponents::Tile8x8* tile8x8_ptr = tmp_newTilesetPtr->GetTile8x8arrayPtr()[j + 0x40];
                     if (!result0)
                     {
-                        tile16Data->ResetTile8x8(tile8x8_ptr, position & 3, j + 0x40, selPalId, false, false);
+                        tmp_newTilesetPtr->ResetTile8x8(tile16Id, tile8x8_ptr, position & 3, j + 0x40, selPalId, false, false);
                         find_eqaul = true;
                         break;
                     }
                     else if (!result1)
                     {
-                        tile16Data->ResetTile8x8(tile8x8_ptr, position & 3, j + 0x40, selPalId, true, false);
+                        tmp_newTilesetPtr->ResetTile8x8(tile16Id, tile8x8_ptr, position & 3, j + 0x40, selPalId, true, false);
                         find_eqaul = true;
                         break;
                     }
                     else if (!result2)
                     {
-                        tile16Data->ResetTile8x8(tile8x8_ptr, position & 3, j + 0x40, selPalId, false, true);
+                        tmp_newTilesetPtr->ResetTile8x8(tile16Id, tile8x8_ptr, position & 3, j + 0x40, selPalId, false, true);
                         find_eqaul = true;
                         break;
                     }
                     else if (!result3)
                     {
-                        tile16Data->ResetTile8x8(tile8x8_ptr, position & 3, j + 0x40, selPalId, true, true);
+                        tmp_newTilesetPtr->ResetTile8x8(tile16Id, tile8x8_ptr, position & 3, j + 0x40, selPalId, true, true);
                         find_eqaul = true;
                         break;
                     }
@@ -1092,24 +1094,10 @@ void TilesetEditDialog::on_pushButton_ImportTile16Graphic_clicked()
 /// </return>
 QVector<int> TilesetEditDialog::FindUnusedPalettes()
 {
-    QVector<int> tmp = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
-    QVector<LevelComponents::TileMap16*> tile16array = tilesetEditParams->newTileset->GetMap16arrayPtr();
-    for (int i = 0; i < Tile16DefaultNum; i++)
-    {
-        LevelComponents::TileMap16* tile16 = tile16array[i];
-        for(int j = 0; j < 4; ++j)
-        {
-            int pal = tile16->GetTile8X8(j)->GetPaletteIndex();
-            if (tmp[pal] == pal)
-            {
-                tmp[pal] = -1; // we clean the used one from the tmp array
-            }
-        }
-    }
     QVector<int> result;
     for (int i = 0; i < 16; i++)
     {
-        if (tmp[i] == i)
+        if (!tilesetEditParams->newTileset->IsPaletteUsed(i))
         {
             result.push_back(i);
         }
@@ -1173,7 +1161,6 @@ void TilesetEditDialog::on_pushButton_CleanUpDuplicatedTile8x8_clicked()
             bool find_eqaul = false;
             bool xflip = false;
             bool yflip = false;
-            auto tile16array = tmp_newTilesetPtr->GetMap16arrayPtr();
             auto tile8x8array = tmp_newTilesetPtr->GetTile8x8arrayPtr();
 
             int find_tileid = j + 0x40;
@@ -1230,7 +1217,8 @@ void TilesetEditDialog::on_pushButton_CleanUpDuplicatedTile8x8_clicked()
                 }
 
                 // always replace the old_tileid instance with the find_tileid instance
-                for (int k = 0; k < Tile16DefaultNum; k++)
+                auto tile16array = tmp_newTilesetPtr->GetMap16arrayPtr();
+                for (int k : tmp_newTilesetPtr->GetTile16sUsingTile8x8(old_tileid))
                 {
                     for (int pos = 0; pos < 4; pos++)
                     {
@@ -1247,8 +1235,8 @@ void TilesetEditDialog::on_pushButton_CleanUpDuplicatedTile8x8_clicked()
                             {
                                 tmp_yflip = !yflip;
                             }
-                            tile16array[k]->ResetTile8x8(tile8x8array[find_tileid], pos, find_tileid,
-                                                         tile8->GetPaletteIndex(), tmp_xflip, tmp_yflip);
+                            tmp_newTilesetPtr->ResetTile8x8(k, tile8x8array[find_tileid], pos, find_tileid,
+                                                            tile8->GetPaletteIndex(), tmp_xflip, tmp_yflip);
                         }
                     }
                 }
@@ -1394,23 +1382,13 @@ void TilesetEditDialog::on_pushButton_CleanUpUnusedTile8x8_clicked()
     for(int i = existingTile8x8Num; i > 0; i--)
     {
         int old_tileid = i + 0x40;
-        auto tile16array = tmp_newTilesetPtr->GetMap16arrayPtr();
-        for (int k = 0; k < Tile16DefaultNum; k++)
+        if (tmp_newTilesetPtr->IsTile8x8Used(old_tileid))
         {
-            for (int pos = 0; pos < 4; pos++)
-            {
-                auto tile8 = tile16array[k]->GetTile8X8(pos);
-                if (tile8->GetIndex() == old_tileid)
-                {
-                    goto find_next_tile8x8;
-                }
-            }
+            continue;
         }
 
         // delete the Tile8x8 from the Tile8x8 set
         tilesetEditParams->newTileset->DelTile8x8(old_tileid);
-
-find_next_tile8x8: {} // do nothing here
     }
 
     // update graphicview
@@ -1430,19 +1408,11 @@ void TilesetEditDialog::on_pushButton_FindTile16ByItsUsingPaletteId_clicked()
                                           tr("WL4Editor"),
                                           tr("Input the (decimal) palette id to find the first Tile16 which uses the specified palette:"),
                                           0, 0, 15);
-    QVector<LevelComponents::TileMap16*> tile16array = tilesetEditParams->newTileset->GetMap16arrayPtr();
-    for (int i = 0; i < Tile16DefaultNum; i++)
+    QVector<int> tile16Ids = tilesetEditParams->newTileset->GetTile16sUsingPalette(palette_id);
+    if (tile16Ids.size())
     {
-        LevelComponents::TileMap16* tile16 = tile16array[i];
-        for(int j = 0; j < 4; ++j)
-        {
-            int pal = tile16->GetTile8X8(j)->GetPaletteIndex();
-            if (palette_id == pal)
-            {
-                SetSelectedTile16(i, true);
-                return;
-            }
-        }
+        SetSelectedTile16(tile16Ids.first(), true);
+        return;
     }
     QMessageBox::information(this, tr("WL4Editor"), tr("Cannot find any Tile16 using the palette id you specified."));
 }
@@ -111,6 +111,8 @@ private:
     QGraphicsPixmapItem *Tile16mapping = nullptr;
     QGraphicsScene *Tile8x8EditorScene = nullptr;
     QGraphicsPixmapItem *Tile8x8Editormapping = nullptr;
+    QImage Tile8x8MapImage; // Format_Indexed8 atlases, recolored by replacing their color tables
+    QImage Tile16MapImage;
 
     unsigned short SelectedTile8x8 = 0;
     unsigned short SelectedTile16 = 0;
@@ -133,6 +135,8 @@ private:
     void ResetPaletteBarGraphicView(int paletteId);
     void ReRenderTile16Map();
     void ReRenderTile8x8Map(int paletteId);
+    void RecolorTileMaps();
+    void ReRenderTile16s(const QVector<int> &tile16Ids);
     void UpdateATile8x8ForSelectedTile16InTilesetData(int tile16Id, int newTile8x8_Id, int position, int new_paletteIndex, bool xflip, bool yflip);
     void OverwriteATile8x8InTile8x8MapAndUpdateTile16Map(int posId, unsigned char *tiledata);
     void UpdateInfoTextBox();
@@ -1,6 +1,10 @@
 ﻿#include "OutputDockWidget.h"
 #include "ui_OutputDockWidget.h"
+#include "ProfilingUtils.h"
+#include <QFile>
+#include <QFileInfo>
 #include <QQmlEngine>
+#include <QTextStream>
 
 #ifndef WINDOW_INSTANCE_SINGLETON
 #define WINDOW_INSTANCE_SINGLETON
@@ -48,6 +52,8 @@ OutputDockWidget::OutputDockWidget(QWidget *parent) :
 /// </summary>
 QJSValue OutputDockWidget::ExecuteJSScript(QString scriptSourceCode, bool silenceFinishInfo)
 {
+    PROFILE_SCOPE("OutputDockWidget::ExecuteJSScript");
+
     // execute scripts and output
     QTextCursor logCursor = ui->textEdit_Output->textCursor();
     QJSValue result = jsEngine.evaluate(scriptSourceCode/*, windowFilePath()*/);
@@ -57,6 +63,11 @@ QJSValue OutputDockWidget::ExecuteJSScript(QString scriptSourceCode, bool silenc
             logCursor.insertText(result.toString(), errFormat);
             logCursor.insertBlock();
             logCursor.insertText(result.property("stack").toString(), errFormat);
+            if (consoleEcho)
+            {
+                QTextStream(stderr) << tr("Exception at line %1:\n").arg(result.property("lineNumber").toInt())
+                                    << result.toString() << Qt::endl << result.property("stack").toString() << Qt::endl;
+            }
     } else {
         if (!silenceFinishInfo) ui->textEdit_Output->append("Script processing finished.\n");
     }
@@ -65,6 +76,106 @@ QJSValue OutputDockWidget::ExecuteJSScript(QString scriptSourceCode, bool silenc
     return result;
 }
 
+/// <summary>
+/// Read a JS script file into the script cache, unless the cached one is still up to date.
+/// </summary>
+/// <param name="filePath">
+/// The path of the script file.
+/// </param>
+/// <returns>
+/// False if the file cannot be read.
+/// </returns>
+bool OutputDockWidget::LoadCachedJSFile(QString filePath)
+{
+    QFileInfo fileInfo(filePath);
+    if (filePath != cachedScriptFilePath || fileInfo.lastModified() != cachedScriptLastModified ||
+        fileInfo.size() != cachedScriptSize)
+    {
+        QFile file(filePath);
+        if (!file.open(QFile::ReadOnly | QFile::Text))
+        {
+            return false;
+        }
+        cachedScriptCode = QString::fromUtf8(file.readAll());
+        cachedScriptFilePath = filePath;
+        cachedScriptLastModified = fileInfo.lastModified();
+        cachedScriptSize = fileInfo.size();
+    }
+    return true;
+}
+
+/// <summary>
+/// Check if a JS script file calls any of the given functions.
+/// </summary>
+/// <remarks>
+/// This only looks for the names in the source, which is enough for the interface functions scripts call by name.
+/// </remarks>
+/// <param name="filePath">
+/// The path of the script file.
+/// </param>
+/// <param name="functionNames">
+/// The names of the functions to look for.
+/// </param>
+/// <returns>
+/// True if the script mentions any of the names, or if the file cannot be read.
+/// </returns>
+bool OutputDockWidget::CachedJSFileCalls(QString filePath, const QStringList &functionNames)
+{
+    if (!LoadCachedJSFile(filePath))
+    {
+        return true;
+    }
+    for (const QString &name : functionNames)
+    {
+        if (cachedScriptCode.contains(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// <summary>
+/// Execute a JS script file, read once and read again only when the file changes.
+/// </summary>
+/// <remarks>
+/// The script runs in the global scope like any other script, so its top-level variables and functions stay global.
+/// It can read the region it needs to redraw from the global dirtyX, dirtyY, dirtyWidth and dirtyHeight.
+/// </remarks>
+/// <param name="filePath">
+/// The path of the script file.
+/// </param>
+/// <param name="dirtyRegion">
+/// The region to redraw, in pixels.
+/// </param>
+/// <param name="silenceFinishInfo">
+/// Don't print the finish info if true.
+/// </param>
+QJSValue OutputDockWidget::ExecuteCachedJSFile(QString filePath, QRect dirtyRegion, bool silenceFinishInfo)
+{
+    PROFILE_SCOPE("OutputDockWidget::ExecuteCachedJSFile");
+
+    if (!LoadCachedJSFile(filePath))
+    {
+        return QJSValue();
+    }
+
+    QJSValue globalObject = jsEngine.globalObject();
+    globalObject.setProperty("dirtyX", dirtyRegion.x());
+    globalObject.setProperty("dirtyY", dirtyRegion.y());
+    globalObject.setProperty("dirtyWidth", dirtyRegion.width());
+    globalObject.setProperty("dirtyHeight", dirtyRegion.height());
+    QJSValue result = jsEngine.evaluate(cachedScriptCode, filePath);
+    if(result.isError()) {
+        ui->textEdit_Output->append(tr("Exception at line %1:\n").arg(result.property("lineNumber").toInt()) + result.toString());
+        ui->textEdit_Output->append(result.property("stack").toString());
+    } else {
+        if (!silenceFinishInfo) ui->textEdit_Output->append("Script processing finished.\n");
+    }
+    QQmlEngine::setObjectOwnership(interface, QQmlEngine::CppOwnership);
+    return result;
+}
+
 /// <summary>
 /// Deconstruct the instance of the OutputDockWidget.
 /// </summary>
@@ -82,6 +193,10 @@ OutputDockWidget::~OutputDockWidget()
 void OutputDockWidget::PrintString(QString str)
 {
     ui->textEdit_Output->append(str); // append function add a new paragraph to the textedit, no need to add an extra \n
+    if (consoleEcho)
+    {
+        QTextStream(stdout) << str << Qt::endl;
+    }
 }
 
 /// <summary>
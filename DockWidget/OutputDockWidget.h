@@ -3,8 +3,11 @@
 
 #include "ScriptInterface.h"
 #include "PCG/Graphics/TileUtils.h"
+#include <QDateTime>
 #include <QDockWidget>
 #include <QJSEngine>
+#include <QRect>
+#include <QStringList>
 
 namespace Ui {
 class OutputDockWidget;
@@ -17,11 +20,14 @@ class OutputDockWidget : public QDockWidget
 public:
     explicit OutputDockWidget(QWidget *parent = nullptr);
     QJSValue ExecuteJSScript(QString scriptSourceCode, bool silenceFinishInfo = false);
+    QJSValue ExecuteCachedJSFile(QString filePath, QRect dirtyRegion, bool silenceFinishInfo = false);
+    bool CachedJSFileCalls(QString filePath, const QStringList &functionNames);
     ~OutputDockWidget();
 
     // Functions
     void PrintString(QString str);
     void ClearTextEdit();
+    void SetConsoleEcho(bool enabled) { consoleEcho = enabled; }
 
 private slots:
     void on_pushButton_Execute_clicked();
@@ -30,6 +36,14 @@ private slots:
 private:
     Ui::OutputDockWidget *ui;
     QJSEngine jsEngine;
+    bool consoleEcho = false; // also write the output to stdout and stderr, used by batch jobs
+
+    // Script file read by ExecuteCachedJSFile, read again when the file changes
+    QString cachedScriptFilePath;
+    QDateTime cachedScriptLastModified;
+    qint64 cachedScriptSize = -1;
+    QString cachedScriptCode;
+    bool LoadCachedJSFile(QString filePath);
 
     // Qt meta object
     ScriptInterface *interface = nullptr;
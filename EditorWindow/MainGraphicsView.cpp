@@ -78,7 +78,7 @@ void MainGraphicsView::mousePressEvent(QMouseEvent *event)
 
                             // Do Operation (and update layer data)
                             int selectedLayer = singleton->GetEditModeWidgetPtr()->GetEditModeParams().selectedLayer;
-                            unsigned short *Layerdata = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->GetLayerData();
+                            const unsigned short *Layerdata = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->ReadLayerData();
                             int layerwidth = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->GetLayerWidth();
                             int layerheight = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->GetLayerHeight();
                             struct OperationParams *params = new struct OperationParams();
@@ -468,7 +468,7 @@ void MainGraphicsView::SetTiles(int tileX, int tileY)
         drawwidth = qMin(drawlayerwidth - tileX, drawwidth);
         drawheight = qMin(static_cast<int>(room->GetLayer0Height()) - tileY, drawheight);
     }
-    if (layer->GetLayerData()[selectedTileIndex] == selectedTile && drawwidth == 1 && drawheight == 1)
+    if (layer->ReadLayerData()[selectedTileIndex] == selectedTile && drawwidth == 1 && drawheight == 1)
         return;
     struct OperationParams *params = new struct OperationParams();
     params->type = ChangeTileOperation;
@@ -479,7 +479,7 @@ void MainGraphicsView::SetTiles(int tileX, int tileY)
         {
             params->tileChangeParams.push_back(
                 TileChangeParams::Create(tileX + i, tileY + j, selectedLayer, selectedTile + i + 8 * j,
-                                         layer->GetLayerData()[selectedTileIndex + i + j * drawlayerwidth]));
+                                         layer->ReadLayerData()[selectedTileIndex + i + j * drawlayerwidth]));
         }
     }
     ExecuteOperation(params);
@@ -506,7 +506,7 @@ void MainGraphicsView::CopyTile(int tileX, int tileY)
     } else {
         selectedTileIndex = tileX + tileY * room->GetLayer0Width();
     }
-    unsigned short placedTile = layer->GetLayerData()[selectedTileIndex];
+    unsigned short placedTile = layer->ReadLayerData()[selectedTileIndex];
     singleton->GetTile16DockWidgetPtr()->SetSelectedTile(placedTile, true);
 }
 
@@ -556,7 +556,7 @@ void MainGraphicsView::mouseReleaseEvent(QMouseEvent *event)
             selectedrectgraphic->setZValue(13);
             selectedrectgraphic->setVisible(true);
             // Update rectdata
-            unsigned short *Layerdata = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->GetLayerData();
+            const unsigned short *Layerdata = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->ReadLayerData();
             int layerwidth = singleton->GetCurrentRoom()->GetLayer(selectedLayer)->GetLayerWidth();
             for (int j = rectselectstartTileY; j < (rectselectstartTileY + rectheight); ++j)
             {
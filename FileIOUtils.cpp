@@ -5,6 +5,7 @@
 #include <QTextStream>
 #include <QColorDialog>
 #include "ROMUtils.h"
+#include "ROMReferenceIndex.h"
 #include "Dialog/SelectColorDialog.h"
 
 #include "WL4EditorWindow.h"
@@ -374,7 +375,8 @@ bool FileIOUtils::ImportTile8x8GfxData(QWidget *parent,
     }
 
     // nybble exchange not needed
-    // reset bytearray according to the palette bin file
+    // map every color index of the tiles to the index of the same color in the reference palette
+    unsigned char colorIndices[16];
     for(int i = 0; i < 16; ++i)
     {
         char colorIndex = 0;
@@ -405,33 +407,20 @@ bool FileIOUtils::ImportTile8x8GfxData(QWidget *parent,
             }
         }
 
-        // Replace the color[i] in tiledata with the correct id
-        for(int j = 0; j < tmptile8x8data.size(); ++j)
-        {
-            char tmpchr = tmptile8x8data[j];
-            char lower4bits, upper4bits;
-            upper4bits = (tmpchr >> 4) & 0xF;
-            lower4bits = tmpchr & 0xF;
-            if (lower4bits == i)
-            {
-                lower4bits = colorIndex;
-            }
-            else
-            {
-                lower4bits = tmptile8x8data_final[j] & 0xF;
-            }
-            if (upper4bits == i)
-            {
-                upper4bits = colorIndex;
-            }
-            else
-            {
-                upper4bits = (tmptile8x8data_final[j] >> 4) & 0xF;
-            }
-            tmptile8x8data_final[j] = (upper4bits << 4) | lower4bits;
-        }
+        colorIndices[i] = colorIndex;
     }
 
+    // reset bytearray according to the palette bin file, all the tiles are unpacked, remapped and packed at once
+    int tileCount = tmptile8x8data.size() / 32;
+    QByteArray pixelData(tileCount * 64, 0);
+    unsigned char *pixels = reinterpret_cast<unsigned char *>(pixelData.data());
+    ROMUtils::UnpackTiles4bpp(reinterpret_cast<const unsigned char *>(tmptile8x8data.constData()), pixels, tileCount, ROMUtils::TileNoFlip);
+    for(int j = 0; j < pixelData.size(); ++j)
+    {
+        pixels[j] = colorIndices[pixels[j]];
+    }
+    ROMUtils::PackTiles4bpp(pixels, reinterpret_cast<unsigned char *>(tmptile8x8data_final.data()), tileCount);
+
     TilesReplaceCallback(tmptile8x8data_final, parent);
     return true;
 }
@@ -448,6 +437,11 @@ QImage FileIOUtils::RenderBGColor(QImage image, QWidget *parent)
     color.setAlpha(0xFF);
     if(color.isValid())
     {
+        // setPixel() takes a color index on indexed images
+        if(image.format() == QImage::Format_Indexed8)
+        {
+            image = image.convertToFormat(QImage::Format_ARGB32);
+        }
         for (int j = 0; j < image.height(); ++j)
         {
             for (int k = 0; k < image.width(); ++k)
@@ -512,6 +506,7 @@ QString FileIOUtils::LoadROMFile(QString filePath)
         delete[] ROMUtils::ROMFileMetadata->ROMDataPtr;
     }
     ROMUtils::ROMFileMetadata->ROMDataPtr = (unsigned char *) ROMAddr;
+    ROMReferenceIndex::Invalidate();
 
     return "";
 }
@@ -47,13 +47,11 @@ namespace LevelComponents
         int GetTotalFrameCount() { return tile8x8Numcount / 4; }
         QVector<Tile8x8 *> GetRenderTile8x8s(bool switchIsOn, QVector<QRgb> *palettes);
         QByteArray GetTileData() {return tileData; }
-        bool IsNewAnimatedTile8x8Group() { return Changed; }
 
         // setters
         void SetAnimationType(unsigned int value) { animationtype = static_cast<enum TileAnimationType>(value); }
         void SetCountPerFrame(unsigned char _countPerFrame) { countPerFrame = _countPerFrame; }
         void SetTileData(QByteArray _tiledata) { if (!(_tiledata.size() % (32 * 4))) {tileData = _tiledata; tile8x8Numcount = _tiledata.size() / 32;} }
-        void SetChanged(bool change) { Changed = change; }
 
     private:
         unsigned short globalId = -1;
@@ -70,7 +68,6 @@ namespace LevelComponents
         unsigned char countPerFrame;
         int tile8x8Numcount = 0; // tile8x8Numcount = TotalFrameCount * 4
         QByteArray tileData;
-        bool Changed = false;
     };
 }
 
@@ -0,0 +1,265 @@
+#include "AnimatedTilePreview.h"
+#include "ROMUtils.h"
+
+#include <QPainter>
+
+namespace LevelComponents
+{
+    /// <summary>
+    /// Set up the animated tile preview on the rendered layers of a room.
+    /// </summary>
+    /// <remarks>
+    /// Every Map16 layer cell using an animated slot is cleared from its layer pixmap and drawn by a child item
+    /// of the layer item instead, so that a frame change only repaints those cells.
+    /// The animated tiles are played with the switch off, like the static rendering.
+    /// </remarks>
+    /// <param name="_tileset">
+    /// The tileset of the room.
+    /// </param>
+    /// <param name="layers">
+    /// The 4 layers of the room.
+    /// </param>
+    /// <param name="layerItems">
+    /// The rendered items of the 4 layers, in the graphics scene.
+    /// </param>
+    AnimatedTilePreview::AnimatedTilePreview(Tileset *_tileset, Layer *layers[4], QGraphicsPixmapItem *layerItems[4]) :
+            tileset(_tileset)
+    {
+        // Load the frames of the animated slots, and find the Tile16s using them
+        unsigned short *groupIds = tileset->GetAnimatedTileData(0);
+        QVector<unsigned short> tile16SlotMasks(Tile16DefaultNum, 0);
+        for (int slot = 0; slot < 16; ++slot)
+        {
+            AnimatedTile8x8Group *group = ROMUtils::animatedTileGroups[groupIds[slot] ? groupIds[slot] : 1];
+            QByteArray tileData = group->GetTileData();
+            int frameCount = qMin(group->GetTotalFrameCount(), tileData.size() / (4 * 32));
+            if (frameCount < 2 || group->GetAnimationType() == NoAnimation) continue;
+
+            struct AnimatedSlot &animatedSlot = Slots[slot];
+            animatedSlot.group = group;
+            animatedSlot.frameCount = frameCount;
+            animatedSlot.frame = FrameAt(group, frameCount, 0);
+            for (int i = 0; i < frameCount * 4; ++i)
+            {
+                animatedSlot.frameTiles.push_back(new Tile8x8((unsigned char *) tileData.data() + i * 32, tileset->GetPalettes()));
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int tile16Id : tileset->GetTile16sUsingTile8x8(slot * 4 + i))
+                {
+                    tile16SlotMasks[tile16Id] |= 1 << slot;
+                }
+            }
+        }
+
+        // Move the layer cells using animated slots to their own items
+        for (int layerId = 0; layerId < 4; ++layerId)
+        {
+            Layer *layer = layers[layerId];
+            if (!layerItems[layerId] || !layer->IsEnabled() || layer->GetMappingType() != LayerMap16) continue;
+            int width = layer->GetLayerWidth();
+            int cellCount = width * layer->GetLayerHeight();
+            const unsigned short *layerData = layer->ReadLayerData();
+            QPixmap clearedPixmap;
+            QPainter painter;
+            for (int i = 0; i < cellCount; ++i)
+            {
+                unsigned short tile16Id = layerData[i];
+                if (tile16Id >= Tile16DefaultNum || !tile16SlotMasks[tile16Id]) continue;
+                if (!LayerItems[layerId])
+                {
+                    LayerItems[layerId] = layerItems[layerId];
+                    OriginalLayerPixmaps[layerId] = layerItems[layerId]->pixmap();
+                    clearedPixmap = OriginalLayerPixmaps[layerId];
+                    painter.begin(&clearedPixmap);
+                    painter.setCompositionMode(QPainter::CompositionMode_Clear);
+                }
+                int x = (i % width) * 16, y = (i / width) * 16;
+                painter.fillRect(x, y, 16, 16, Qt::transparent);
+
+                QGraphicsPixmapItem *item = new QGraphicsPixmapItem(GetCellPixmap(tile16Id), layerItems[layerId]);
+                item->setPos(x, y);
+                for (int slot = 0; slot < 16; ++slot)
+                {
+                    if (tile16SlotMasks[tile16Id] & (1 << slot))
+                    {
+                        SlotCells[slot].push_back(Cells.size());
+                    }
+                }
+                Cells.push_back({item, tile16Id});
+            }
+            if (LayerItems[layerId])
+            {
+                painter.end();
+                layerItems[layerId]->setPixmap(clearedPixmap);
+            }
+        }
+        CellStamps.fill(0, Cells.size());
+    }
+
+    /// <summary>
+    /// Free the frame tiles of the animated slots.
+    /// </summary>
+    /// <remarks>
+    /// The graphics items are not touched, they belong to the graphics scene. Call Restore() first if the scene is still used.
+    /// </remarks>
+    AnimatedTilePreview::~AnimatedTilePreview()
+    {
+        for (struct AnimatedSlot &animatedSlot : Slots)
+        {
+            for (Tile8x8 *tile : animatedSlot.frameTiles)
+            {
+                delete tile;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Get the frame an animated tile group shows at a point in time.
+    /// </summary>
+    /// <param name="group">
+    /// The animated tile group.
+    /// </param>
+    /// <param name="frameCount">
+    /// The number of frames in the group.
+    /// </param>
+    /// <param name="gameFrame">
+    /// The number of game frames since the room was entered.
+    /// </param>
+    /// <return>The frame index.</return>
+    int AnimatedTilePreview::FrameAt(AnimatedTile8x8Group *group, int frameCount, qint64 gameFrame)
+    {
+        qint64 step = gameFrame / qMax(1, static_cast<int>(group->GetCountPerFrame()));
+        switch (group->GetAnimationType())
+        {
+        case Loop:
+            return step % frameCount;
+        case ReverseLoop:
+            return frameCount - 1 - step % frameCount;
+        case BackAndForth:
+        {
+            int position = step % (2 * frameCount - 2);
+            return position < frameCount ? position : 2 * frameCount - 2 - position;
+        }
+        case MinToMaxThenStop:
+            return qMin(step, static_cast<qint64>(frameCount - 1));
+        case StopAtMin:
+        case MaxToMinThenStop:
+            return qMax(frameCount - 1 - step, static_cast<qint64>(0));
+        default:
+            return 0;
+        }
+    }
+
+    /// <summary>
+    /// Get the pixmap of a Tile16 with the current frames of the animated slots it uses.
+    /// </summary>
+    /// <remarks>
+    /// The composed pixmaps are cached by Tile16 and frame combination, so a looping animation stops composing
+    /// after its first period.
+    /// </remarks>
+    /// <param name="tile16Id">
+    /// The id of the Tile16.
+    /// </param>
+    /// <return>The 16x16 pixmap.</return>
+    QPixmap AnimatedTilePreview::GetCellPixmap(unsigned short tile16Id)
+    {
+        TileMap16 *tile16 = tileset->GetMap16arrayPtr()[tile16Id];
+        Tile8x8 *tiles[4];
+        quint64 key = tile16Id;
+        for (int pos = 0; pos < 4; ++pos)
+        {
+            tiles[pos] = tile16->GetTile8X8(pos);
+            int index = tiles[pos]->GetIndex() & 0x3FF;
+            if (index < 64 && Slots[index >> 2].group)
+            {
+                const struct AnimatedSlot &animatedSlot = Slots[index >> 2];
+                tiles[pos] = animatedSlot.frameTiles[animatedSlot.frame * 4 + (index & 3)];
+                key |= static_cast<quint64>(animatedSlot.frame + 1) << (10 + pos * 9);
+            }
+        }
+        auto iter = FrameAtlas.constFind(key);
+        if (iter != FrameAtlas.constEnd())
+        {
+            return iter.value();
+        }
+
+        QImage image(16, 16, QImage::Format_ARGB32);
+        QPainter painter(&image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (int pos = 0; pos < 4; ++pos)
+        {
+            // The frame tiles carry no palette or flips, take them from the Tile16
+            Tile8x8 *original = tile16->GetTile8X8(pos);
+            Tile8x8 tile(tiles[pos]);
+            tile.SetPaletteIndex(original->GetPaletteIndex());
+            tile.SetFlipX(original->GetFlipX());
+            tile.SetFlipY(original->GetFlipY());
+            painter.drawImage((pos & 1) * 8, (pos >> 1) * 8, tile.RenderImage());
+        }
+        painter.end();
+        QPixmap pixmap = QPixmap::fromImage(image);
+        FrameAtlas.insert(key, pixmap);
+        return pixmap;
+    }
+
+    /// <summary>
+    /// Advance the animation, and redraw the cells of the slots whose frame changed.
+    /// </summary>
+    /// <param name="gameFrames">
+    /// The number of game frames (at 60 per second) elapsed since the last call.
+    /// </param>
+    void AnimatedTilePreview::Advance(int gameFrames)
+    {
+        GameFrame += gameFrames;
+
+        // Update all the slot frames first, a cell may use several slots
+        QVector<int> changedSlots;
+        for (int slot = 0; slot < 16; ++slot)
+        {
+            struct AnimatedSlot &animatedSlot = Slots[slot];
+            if (!animatedSlot.group) continue;
+            int frame = FrameAt(animatedSlot.group, animatedSlot.frameCount, GameFrame);
+            if (frame == animatedSlot.frame) continue;
+            animatedSlot.frame = frame;
+            changedSlots.push_back(slot);
+        }
+        if (changedSlots.isEmpty()) return;
+
+        ++Stamp;
+        for (int slot : changedSlots)
+        {
+            for (int cellIndex : SlotCells[slot])
+            {
+                if (CellStamps[cellIndex] == Stamp) continue;
+                CellStamps[cellIndex] = Stamp;
+                Cells[cellIndex].item->setPixmap(GetCellPixmap(Cells[cellIndex].tile16Id));
+            }
+        }
+    }
+
+    /// <summary>
+    /// Put the original layer pixmaps back and delete the cell items.
+    /// </summary>
+    void AnimatedTilePreview::Restore()
+    {
+        for (struct AnimatedCell &cell : Cells)
+        {
+            delete cell.item;
+        }
+        Cells.clear();
+        for (int layerId = 0; layerId < 4; ++layerId)
+        {
+            if (LayerItems[layerId])
+            {
+                LayerItems[layerId]->setPixmap(OriginalLayerPixmaps[layerId]);
+                LayerItems[layerId] = nullptr;
+            }
+        }
+        for (int slot = 0; slot < 16; ++slot)
+        {
+            SlotCells[slot].clear();
+        }
+        CellStamps.clear();
+    }
+}
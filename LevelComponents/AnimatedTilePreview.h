@@ -0,0 +1,60 @@
+#ifndef ANIMATEDTILEPREVIEW_H
+#define ANIMATEDTILEPREVIEW_H
+
+#include <QGraphicsPixmapItem>
+#include <QHash>
+#include <QPixmap>
+#include <QVector>
+
+#include "AnimatedTile8x8Group.h"
+#include "Layer.h"
+#include "Tileset.h"
+
+namespace LevelComponents
+{
+    // Plays the animated Tile8x8 slots of a room's tileset on its rendered Map16 layers.
+    // Only the layer cells using an animated slot are redrawn, from a cache of composed Tile16 frames.
+    class AnimatedTilePreview
+    {
+    private:
+        // The animated tile group loaded into one of the 16 animated slots (Tile8x8 ids slot * 4 to slot * 4 + 3)
+        struct AnimatedSlot
+        {
+            AnimatedTile8x8Group *group = nullptr;
+            QVector<Tile8x8 *> frameTiles; // 4 Tile8x8s per frame
+            int frameCount = 0;
+            int frame = 0;
+        };
+
+        // A layer cell using at least one animated slot, drawn by its own item over the cleared layer cell
+        struct AnimatedCell
+        {
+            QGraphicsPixmapItem *item;
+            unsigned short tile16Id;
+        };
+
+        Tileset *tileset;
+        struct AnimatedSlot Slots[16];
+        QVector<struct AnimatedCell> Cells;
+        QVector<int> SlotCells[16]; // indices into Cells
+        QVector<int> CellStamps;
+        int Stamp = 0;
+        QHash<quint64, QPixmap> FrameAtlas; // composed Tile16s by tile16 id and the frames of their 4 Tile8x8s
+        QGraphicsPixmapItem *LayerItems[4] = {nullptr, nullptr, nullptr, nullptr};
+        QPixmap OriginalLayerPixmaps[4];
+        qint64 GameFrame = 0;
+
+        static int FrameAt(AnimatedTile8x8Group *group, int frameCount, qint64 gameFrame);
+        QPixmap GetCellPixmap(unsigned short tile16Id);
+
+    public:
+        AnimatedTilePreview(Tileset *_tileset, Layer *layers[4], QGraphicsPixmapItem *layerItems[4]);
+        ~AnimatedTilePreview();
+        void Advance(int gameFrames);
+        void Restore();
+        bool IsEmpty() { return Cells.isEmpty(); }
+        QPixmap GetLayerPixmap(int layerId) { return LayerItems[layerId] ? OriginalLayerPixmaps[layerId] : QPixmap(); }
+    };
+} // namespace LevelComponents
+
+#endif // ANIMATEDTILEPREVIEW_H
@@ -0,0 +1,460 @@
+#include "AsyncRoomRenderer.h"
+#include "ROMUtils.h"
+
+#include <QCryptographicHash>
+#include <QHash>
+#include <QPainter>
+#include <cstring>
+#include <functional>
+
+namespace LevelComponents
+{
+    /// <summary>
+    /// Draw 4bpp Tile8x8 pixels to an ARGB image, the same way Tile8x8::RenderImage does.
+    /// </summary>
+    /// <param name="image">
+    /// The Format_ARGB32 image to draw to.
+    /// </param>
+    /// <param name="x">
+    /// The X position to draw the tile to.
+    /// </param>
+    /// <param name="y">
+    /// The Y position to draw the tile to.
+    /// </param>
+    /// <param name="pixels">
+    /// The 32 bytes of tile data.
+    /// </param>
+    /// <param name="palette">
+    /// The palette the tile is drawn with.
+    /// </param>
+    /// <param name="flipX">
+    /// Whether the tile is flipped horizontally.
+    /// </param>
+    /// <param name="flipY">
+    /// Whether the tile is flipped vertically.
+    /// </param>
+    static void DrawTile8x8(QImage &image, int x, int y, const unsigned char *pixels, const QVector<QRgb> &palette, bool flipX, bool flipY)
+    {
+        unsigned char colorIndices[64];
+        ROMUtils::UnpackTiles4bpp(pixels, colorIndices, 1, (flipX ? ROMUtils::TileFlipX : 0) | (flipY ? ROMUtils::TileFlipY : 0));
+        for (int i = 0; i < 8; ++i)
+        {
+            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y + i)) + x;
+            for (int j = 0; j < 8; ++j)
+            {
+                int colorIndex = colorIndices[i * 8 + j];
+                line[j] = colorIndex < palette.size() ? palette[colorIndex] : 0;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Get the average color of a square of an image, with the share of opaque pixels as alpha.
+    /// </summary>
+    static QRgb AverageColor(const QImage &image, int x, int y, int size)
+    {
+        int r = 0, g = 0, b = 0, count = 0;
+        for (int i = 0; i < size; ++i)
+        {
+            const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y + i)) + x;
+            for (int j = 0; j < size; ++j)
+            {
+                if (!qAlpha(line[j])) continue;
+                r += qRed(line[j]);
+                g += qGreen(line[j]);
+                b += qBlue(line[j]);
+                ++count;
+            }
+        }
+        if (!count) return 0;
+        return qRgba(r / count, g / count, b / count, count * 255 / (size * size));
+    }
+
+    /// <summary>
+    /// Construct the renderer with its own thread pool.
+    /// </summary>
+    /// <param name="parent">
+    /// The parent QObject.
+    /// </param>
+    AsyncRoomRenderer::AsyncRoomRenderer(QObject *parent) : QObject(parent), Generation(0)
+    {
+        // The workers emit from their own threads, the results are handled on the GUI thread
+        connect(this, SIGNAL(LayerRendered(int, int, QImage)), this, SLOT(OnLayerRendered(int, int, QImage)), Qt::QueuedConnection);
+        connect(this, SIGNAL(PreviewRendered(int, QImage)), this, SLOT(OnPreviewRendered(int, QImage)), Qt::QueuedConnection);
+    }
+
+    /// <summary>
+    /// Cancel the running jobs and wait for the workers to return.
+    /// </summary>
+    AsyncRoomRenderer::~AsyncRoomRenderer()
+    {
+        Cancel();
+        Pool.waitForDone();
+    }
+
+    /// <summary>
+    /// Copy everything needed to draw the layers of a room.
+    /// </summary>
+    /// <param name="room">
+    /// The room to copy. It is only read during this call.
+    /// </param>
+    /// <return>The snapshot, which can be shared with worker threads.</return>
+    std::shared_ptr<struct RoomRenderSnapshot> RoomRenderSnapshot::Create(Room *room)
+    {
+        std::shared_ptr<struct RoomRenderSnapshot> snapshot = std::make_shared<struct RoomRenderSnapshot>();
+
+        // Copy the tileset graphics
+        Tileset *tileset = room->GetTileset();
+        for (int i = 0; i < 16; ++i)
+        {
+            snapshot->Palettes[i] = tileset->GetPalettes()[i];
+        }
+        QVector<TileMap16 *> map16 = tileset->GetMap16arrayPtr();
+        snapshot->Tile16Pixels.resize(Tile16DefaultNum * 4 * 32);
+        snapshot->Tile16Attributes.resize(Tile16DefaultNum * 4);
+        for (int i = 0; i < Tile16DefaultNum * 4; ++i)
+        {
+            Tile8x8 *tile = map16[i >> 2]->GetTile8X8(i & 3);
+            memcpy(snapshot->Tile16Pixels.data() + i * 32, tile->CreateGraphicsData().constData(), 32);
+            snapshot->Tile16Attributes[i] = (tile->GetPaletteIndex() & 0xF) | (tile->GetFlipX() << 4) | (tile->GetFlipY() << 5);
+        }
+
+        // Draw the Tile16s once here, the layer and downscaled renders of the snapshot all share the atlas
+        snapshot->Tile16Atlas = QImage(16, Tile16DefaultNum * 16, QImage::Format_ARGB32);
+        const unsigned char *tile16Pixels = reinterpret_cast<const unsigned char *>(snapshot->Tile16Pixels.constData());
+        for (int i = 0; i < Tile16DefaultNum * 4; ++i)
+        {
+            unsigned char attributes = snapshot->Tile16Attributes[i];
+            DrawTile8x8(snapshot->Tile16Atlas, (i & 1) * 8, (i >> 2) * 16 + (i & 2) * 4, tile16Pixels + i * 32,
+                        snapshot->Palettes[attributes & 0xF], attributes & 0x10, attributes & 0x20);
+        }
+
+        // Copy the layers
+        bool hasTile8x8Layer = false;
+        for (int i = 0; i < 4; ++i)
+        {
+            Layer *layer = room->GetLayer(i);
+            if (!layer->IsEnabled() || layer->GetMappingType() == LayerDisabled || !layer->ReadLayerData()) continue;
+            struct RoomRenderSnapshot::LayerSnapshot &layerSnapshot = snapshot->Layers[i];
+            layerSnapshot.MappingType = layer->GetMappingType();
+            layerSnapshot.Width = layer->GetLayerWidth();
+            layerSnapshot.Height = layer->GetLayerHeight();
+            layerSnapshot.LayerData = layer->GetSharedLayerData(); // the editor copies it before its next change
+            hasTile8x8Layer |= layerSnapshot.MappingType == LayerTile8x8;
+        }
+        if (hasTile8x8Layer)
+        {
+            QVector<Tile8x8 *> tile8x8 = tileset->GetTile8x8arrayPtr();
+            snapshot->Tile8x8Pixels.fill(0, 0x400 * 32);
+            for (int i = 0; i < 0x400 && 0x200 + i < tile8x8.size(); ++i)
+            {
+                memcpy(snapshot->Tile8x8Pixels.data() + i * 32, tile8x8[0x200 + i]->CreateGraphicsData().constData(), 32);
+            }
+        }
+
+        // Same scene size and layer effects as Room::RenderGraphicsScene
+        snapshot->LayerPriorities = room->GetLayerPriorities();
+        snapshot->Layer0ColorBlending = room->IsLayer0ColorBlendingEnabled();
+        QVector<int> eva_evb = room->GetEVAAndEVB();
+        snapshot->EVA = eva_evb[0];
+        snapshot->EVB = eva_evb[1];
+        for (int i = 0; i < 3; ++i)
+        {
+            Layer *layer = room->GetLayer(i);
+            int unit = (i == 1 || layer->GetMappingType() != LayerTile8x8) ? 16 : 8;
+            snapshot->SceneWidth = qMax(snapshot->SceneWidth, unit * layer->GetLayerWidth());
+            snapshot->SceneHeight = qMax(snapshot->SceneHeight, unit * layer->GetLayerHeight());
+        }
+
+        return snapshot;
+    }
+
+    /// <summary>
+    /// Hash the content of the snapshot, two snapshots with the same hash render the same graphics.
+    /// </summary>
+    /// <return>The SHA-1 of the layers, tiles and palettes.</return>
+    QByteArray RoomRenderSnapshot::Hash() const
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        for (const struct LayerSnapshot &layer : Layers)
+        {
+            int header[3] = {layer.MappingType, layer.Width, layer.Height};
+            hash.addData(reinterpret_cast<const char *>(header), sizeof(header));
+            hash.addData(reinterpret_cast<const char *>(layer.LayerData.constData()), layer.LayerData.size() * sizeof(unsigned short));
+        }
+        hash.addData(reinterpret_cast<const char *>(LayerPriorities.constData()), LayerPriorities.size() * sizeof(int));
+        int effects[3] = {Layer0ColorBlending, EVA, EVB};
+        hash.addData(reinterpret_cast<const char *>(effects), sizeof(effects));
+        for (const QVector<QRgb> &palette : Palettes)
+        {
+            hash.addData(reinterpret_cast<const char *>(palette.constData()), palette.size() * sizeof(QRgb));
+        }
+        hash.addData(Tile16Pixels);
+        hash.addData(reinterpret_cast<const char *>(Tile16Attributes.constData()), Tile16Attributes.size());
+        hash.addData(Tile8x8Pixels);
+        return hash.result();
+    }
+
+    /// <summary>
+    /// Start rendering the layers of a room in the background, cancelling the previous render.
+    /// </summary>
+    /// <remarks>
+    /// A low resolution preview (one pixel per Tile16) is emitted by PreviewReady first, then the full layer
+    /// framebuffers by LayersReady. Both are emitted on the GUI thread, and only for the latest generation.
+    /// </remarks>
+    /// <param name="room">
+    /// The room to render. It is only read during this call.
+    /// </param>
+    /// <return>The generation of the new render.</return>
+    int AsyncRoomRenderer::Start(Room *room)
+    {
+        int generation = ++Generation;
+        std::shared_ptr<struct RoomRenderSnapshot> snapshot = RoomRenderSnapshot::Create(room);
+
+        RenderedLayers = QVector<QImage>(4);
+        PendingLayerCount = 4;
+        LayersDone = false;
+        Pool.start(new RoomRenderTask([this, snapshot, generation]() {
+            emit PreviewRendered(generation, RenderDownscaledImage(*snapshot, 1, [this, generation]() { return Generation != generation; }));
+        }));
+        for (int i = 0; i < 4; ++i)
+        {
+            Pool.start(new RoomRenderTask([this, snapshot, generation, i]() {
+                emit LayerRendered(generation, i, RenderLayerImage(*snapshot, i, [this, generation]() { return Generation != generation; }));
+            }));
+        }
+        return generation;
+    }
+
+    /// <summary>
+    /// Drop the results of the running render, its workers return at their next check.
+    /// </summary>
+    void AsyncRoomRenderer::Cancel()
+    {
+        ++Generation;
+        LayersDone = true;
+    }
+
+    /// <summary>
+    /// Draw the framebuffer of a layer, on a worker thread.
+    /// </summary>
+    /// <param name="snapshot">
+    /// The room snapshot.
+    /// </param>
+    /// <param name="layerId">
+    /// The layer to draw.
+    /// </param>
+    /// <param name="isCancelled">
+    /// Checked between rows of tiles, the drawing stops as soon as it returns true.
+    /// </param>
+    /// <return>The layer image, or a null image if the layer is disabled or the render was cancelled.</return>
+    QImage AsyncRoomRenderer::RenderLayerImage(const RoomRenderSnapshot &snapshot, int layerId, std::function<bool ()> isCancelled)
+    {
+        const struct RoomRenderSnapshot::LayerSnapshot &layer = snapshot.Layers[layerId];
+        if (layer.MappingType == LayerMap16)
+        {
+            const QImage &atlas = snapshot.Tile16Atlas;
+            QImage image(layer.Width * 16, layer.Height * 16, QImage::Format_ARGB32);
+            for (int y = 0; y < layer.Height; ++y)
+            {
+                if (isCancelled()) return QImage();
+                for (int x = 0; x < layer.Width; ++x)
+                {
+                    unsigned short tile16Id = layer.LayerData[y * layer.Width + x];
+                    for (int row = 0; row < 16; ++row)
+                    {
+                        uchar *line = image.scanLine(y * 16 + row) + x * 16 * sizeof(QRgb);
+                        if (tile16Id < Tile16DefaultNum)
+                            memcpy(line, atlas.constScanLine(tile16Id * 16 + row), 16 * sizeof(QRgb));
+                        else
+                            memset(line, 0, 16 * sizeof(QRgb));
+                    }
+                }
+            }
+            return image;
+        }
+        else if (layer.MappingType == LayerTile8x8)
+        {
+            const unsigned char *pixels = reinterpret_cast<const unsigned char *>(snapshot.Tile8x8Pixels.constData());
+            QImage image(layer.Width * 8, layer.Height * 8, QImage::Format_ARGB32);
+            for (int y = 0; y < layer.Height; ++y)
+            {
+                if (isCancelled()) return QImage();
+                for (int x = 0; x < layer.Width; ++x)
+                {
+                    unsigned short tileData = layer.LayerData[y * layer.Width + x];
+                    DrawTile8x8(image, x * 8, y * 8, pixels + (tileData & 0x3FF) * 32, snapshot.Palettes[(tileData >> 12) & 0xF],
+                                tileData & (1 << 10), tileData & (1 << 11));
+                }
+            }
+            return image;
+        }
+        return QImage();
+    }
+
+    /// <summary>
+    /// Draw the full size image of the room, on a worker thread.
+    /// </summary>
+    /// <remarks>
+    /// The layers are stacked by priority like in Room::RenderGraphicsScene, 8x8 tile layers repeat over the scene,
+    /// and layer 0 is color blended with the layers under it when the room's render effect asks for it.
+    /// </remarks>
+    /// <param name="snapshot">
+    /// The room snapshot.
+    /// </param>
+    /// <param name="isCancelled">
+    /// Checked between rows of tiles, the drawing stops as soon as it returns true.
+    /// </param>
+    /// <return>The image, or a null image if the drawing was cancelled.</return>
+    QImage AsyncRoomRenderer::RenderComposedImage(const RoomRenderSnapshot &snapshot, std::function<bool ()> isCancelled)
+    {
+        int width = qMax(1, snapshot.SceneWidth), height = qMax(1, snapshot.SceneHeight);
+        QImage image(width, height, QImage::Format_ARGB32);
+        image.fill(Qt::transparent);
+        for (int priority = 3; priority >= 0; --priority)
+        {
+            int layerId = snapshot.LayerPriorities.indexOf(priority);
+            if (layerId < 0) continue;
+            const struct RoomRenderSnapshot::LayerSnapshot &layer = snapshot.Layers[layerId];
+            if (layer.MappingType == LayerDisabled || !layer.Width || !layer.Height) continue;
+            QImage layerImage = RenderLayerImage(snapshot, layerId, isCancelled);
+            if (layerImage.isNull()) return QImage();
+
+            // Same blending as Room::AlphaBlend, where either pixel is transparent the top one shows unblended
+            bool blend = layerId == 0 && snapshot.Layer0ColorBlending && snapshot.EVB;
+            bool repeat = layer.MappingType == LayerTile8x8;
+            int layerWidth = repeat ? width : qMin(width, layerImage.width());
+            int layerHeight = repeat ? height : qMin(height, layerImage.height());
+            for (int y = 0; y < layerHeight; ++y)
+            {
+                const QRgb *source = reinterpret_cast<const QRgb *>(layerImage.constScanLine(y % layerImage.height()));
+                QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+                for (int x = 0; x < layerWidth; ++x)
+                {
+                    QRgb top = source[x % layerImage.width()];
+                    if (qAlpha(top) != 0xFF) continue;
+                    QRgb bottom = line[x];
+                    if (blend && qAlpha(bottom) == 0xFF)
+                    {
+                        top = qRgb(qMin(((snapshot.EVA * qRed(top)) >> 4) + ((snapshot.EVB * qRed(bottom)) >> 4), 255),
+                                   qMin(((snapshot.EVA * qGreen(top)) >> 4) + ((snapshot.EVB * qGreen(bottom)) >> 4), 255),
+                                   qMin(((snapshot.EVA * qBlue(top)) >> 4) + ((snapshot.EVB * qBlue(bottom)) >> 4), 255));
+                    }
+                    line[x] = top;
+                }
+            }
+        }
+        return image;
+    }
+
+    /// <summary>
+    /// Draw a low resolution image of the room, on a worker thread.
+    /// </summary>
+    /// <remarks>
+    /// Each pixel is the average color of a square block of the scene, the layers are stacked by priority
+    /// without alpha blending. 8x8 tile layers are sampled once per 8x8 tile at the lowest resolutions.
+    /// </remarks>
+    /// <param name="snapshot">
+    /// The room snapshot.
+    /// </param>
+    /// <param name="pixelsPerTile16">
+    /// The width of a Tile16 in the image, 1, 2, 4, 8 or 16.
+    /// </param>
+    /// <param name="isCancelled">
+    /// Checked between layers, the drawing stops as soon as it returns true.
+    /// </param>
+    /// <return>The image, or a null image if the drawing was cancelled.</return>
+    QImage AsyncRoomRenderer::RenderDownscaledImage(const RoomRenderSnapshot &snapshot, int pixelsPerTile16, std::function<bool ()> isCancelled)
+    {
+        int block = 16 / pixelsPerTile16;
+        int width = qMax(1, snapshot.SceneWidth / block), height = qMax(1, snapshot.SceneHeight / block);
+
+        // Average the blocks of every Tile16 once
+        const QImage &atlas = snapshot.Tile16Atlas;
+        int blocksPerTile16 = pixelsPerTile16 * pixelsPerTile16;
+        QVector<QRgb> tile16Colors(Tile16DefaultNum * blocksPerTile16);
+        for (int i = 0; i < tile16Colors.size(); ++i)
+        {
+            int tileBlock = i % blocksPerTile16;
+            tile16Colors[i] = AverageColor(atlas, (tileBlock % pixelsPerTile16) * block,
+                                           (i / blocksPerTile16) * 16 + (tileBlock / pixelsPerTile16) * block, block);
+        }
+
+        QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        const unsigned char *pixels = reinterpret_cast<const unsigned char *>(snapshot.Tile8x8Pixels.constData());
+        QImage tileImage(8, 8, QImage::Format_ARGB32);
+        int tile8x8Block = qMin(block, 8);
+        for (int priority = 3; priority >= 0; --priority)
+        {
+            int layerId = snapshot.LayerPriorities.indexOf(priority);
+            if (layerId < 0) continue;
+            const struct RoomRenderSnapshot::LayerSnapshot &layer = snapshot.Layers[layerId];
+            if (layer.MappingType == LayerDisabled || !layer.Width || !layer.Height) continue;
+            if (isCancelled()) return QImage();
+
+            QImage layerImage(width, height, QImage::Format_ARGB32);
+            layerImage.fill(Qt::transparent);
+            QHash<unsigned short, QVector<QRgb>> tile8x8Colors; // by tile data, 8x8 tiles come with any palette and flips
+            for (int y = 0; y < height; ++y)
+            {
+                QRgb *line = reinterpret_cast<QRgb *>(layerImage.scanLine(y));
+                int sceneY = y * block;
+                for (int x = 0; x < width; ++x)
+                {
+                    int sceneX = x * block;
+                    if (layer.MappingType == LayerMap16)
+                    {
+                        if (sceneX >= layer.Width * 16 || sceneY >= layer.Height * 16) continue;
+                        unsigned short tile16Id = layer.LayerData[(sceneY / 16) * layer.Width + sceneX / 16];
+                        int tileBlock = ((sceneY % 16) / block) * pixelsPerTile16 + (sceneX % 16) / block;
+                        line[x] = tile16Id < Tile16DefaultNum ? tile16Colors[tile16Id * blocksPerTile16 + tileBlock] : 0;
+                    }
+                    else
+                    {
+                        // 8x8 tile layers repeat over the scene
+                        unsigned short tileData = layer.LayerData[((sceneY / 8) % layer.Height) * layer.Width + (sceneX / 8) % layer.Width];
+                        auto iter = tile8x8Colors.find(tileData);
+                        if (iter == tile8x8Colors.end())
+                        {
+                            DrawTile8x8(tileImage, 0, 0, pixels + (tileData & 0x3FF) * 32, snapshot.Palettes[(tileData >> 12) & 0xF],
+                                        tileData & (1 << 10), tileData & (1 << 11));
+                            QVector<QRgb> colors;
+                            for (int i = 0; i < 64 / (tile8x8Block * tile8x8Block); ++i)
+                            {
+                                colors << AverageColor(tileImage, (i % (8 / tile8x8Block)) * tile8x8Block, (i / (8 / tile8x8Block)) * tile8x8Block, tile8x8Block);
+                            }
+                            iter = tile8x8Colors.insert(tileData, colors);
+                        }
+                        line[x] = iter.value()[((sceneY % 8) / tile8x8Block) * (8 / tile8x8Block) + (sceneX % 8) / tile8x8Block];
+                    }
+                }
+            }
+            painter.drawImage(0, 0, layerImage);
+        }
+        painter.end();
+        return image;
+    }
+
+    /// <summary>
+    /// Collect a finished layer framebuffer, and hand all of them over once the last one arrived.
+    /// </summary>
+    void AsyncRoomRenderer::OnLayerRendered(int generation, int layerId, QImage image)
+    {
+        if (generation != Generation || LayersDone) return;
+        RenderedLayers[layerId] = image;
+        if (--PendingLayerCount) return;
+        LayersDone = true;
+        emit LayersReady(generation, RenderedLayers);
+    }
+
+    /// <summary>
+    /// Hand over the preview, unless the full layers were faster.
+    /// </summary>
+    void AsyncRoomRenderer::OnPreviewRendered(int generation, QImage image)
+    {
+        if (generation != Generation || LayersDone || image.isNull()) return;
+        emit PreviewReady(generation, image);
+    }
+} // namespace LevelComponents
@@ -0,0 +1,90 @@
+#ifndef ASYNCROOMRENDERER_H
+#define ASYNCROOMRENDERER_H
+
+#include <QImage>
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "Room.h"
+
+namespace LevelComponents
+{
+    // Copy of everything needed to draw the layers of a room, taken on the GUI thread
+    // so that the worker threads never read the live Room, Layer or Tileset objects.
+    struct RoomRenderSnapshot
+    {
+        struct LayerSnapshot
+        {
+            enum LayerMappingType MappingType = LayerDisabled;
+            int Width = 0;
+            int Height = 0;
+            QVector<unsigned short> LayerData;
+        } Layers[4];
+        QVector<int> LayerPriorities;
+        bool Layer0ColorBlending = false;
+        int EVA = 16, EVB = 0; // color blending weights of layer 0 and of the layers under it, out of 16
+        int SceneWidth = 0;  // in pixels
+        int SceneHeight = 0; // in pixels
+        QVector<QRgb> Palettes[16];
+        QByteArray Tile16Pixels;                 // 4bpp pixels of the 4 Tile8x8s of every Tile16
+        QVector<unsigned char> Tile16Attributes; // palette | flipX << 4 | flipY << 5 of the 4 Tile8x8s of every Tile16
+        QByteArray Tile8x8Pixels;                // 4bpp pixels of the Tile8x8s usable by 8x8 tile layers
+        QImage Tile16Atlas;                      // every Tile16 drawn once, one under the other, only read by the workers
+
+        static std::shared_ptr<struct RoomRenderSnapshot> Create(Room *room);
+        QByteArray Hash() const;
+    };
+
+    // Runs one rendering function on a thread pool
+    class RoomRenderTask : public QRunnable
+    {
+    private:
+        std::function<void()> Work;
+
+    public:
+        RoomRenderTask(std::function<void()> work) : Work(work) {}
+        void run() { Work(); }
+    };
+
+    // Renders the layers of a room on worker threads. Every call to Start() begins a new generation,
+    // and the results of older generations are dropped as soon as they are noticed.
+    class AsyncRoomRenderer : public QObject
+    {
+        Q_OBJECT
+
+    private:
+        QThreadPool Pool;
+        std::atomic<int> Generation;
+        int PendingLayerCount = 0;
+        QVector<QImage> RenderedLayers;
+        bool LayersDone = true;
+
+
+    private slots:
+        void OnLayerRendered(int generation, int layerId, QImage image);
+        void OnPreviewRendered(int generation, QImage image);
+
+    signals:
+        void LayerRendered(int generation, int layerId, QImage image);
+        void PreviewRendered(int generation, QImage image);
+        void PreviewReady(int generation, QImage image);
+        void LayersReady(int generation, QVector<QImage> layers);
+
+    public:
+        AsyncRoomRenderer(QObject *parent = nullptr);
+        ~AsyncRoomRenderer();
+        int Start(Room *room);
+        void Cancel();
+        bool IsRendering() { return !LayersDone; }
+        static QImage RenderLayerImage(const RoomRenderSnapshot &snapshot, int layerId, std::function<bool ()> isCancelled);
+        static QImage RenderComposedImage(const RoomRenderSnapshot &snapshot, std::function<bool ()> isCancelled);
+        static QImage RenderDownscaledImage(const RoomRenderSnapshot &snapshot, int pixelsPerTile16, std::function<bool ()> isCancelled);
+    };
+} // namespace LevelComponents
+
+#endif // ASYNCROOMRENDERER_H
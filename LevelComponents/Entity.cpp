@@ -264,21 +264,21 @@ namespace LevelComponents
     /// </returns>
     QImage Entity::GetTileMap(const int palNum)
     {
-        // Render and return pixmap
+        // Render the color indices, the palette is applied through the color table
         int rowNum = tile8x8data.size() >> 5; // tile8x8data.size() / 32
-        QPixmap pixmap(8 * 32, 8 * rowNum);
-        pixmap.fill(Qt::transparent);
+        QImage image(8 * 32, 8 * rowNum, QImage::Format_Indexed8);
+        image.fill(0);
 
         // drawing
         for (int i = 0; i < rowNum; ++i)
         {
             for (int j = 0; j < 32; ++j)
             {
-                tile8x8data[i * 32 + j]->SetPaletteIndex(palNum);
-                tile8x8data[i * 32 + j]->DrawTile(&pixmap, j * 8, i * 8);
+                tile8x8data[i * 32 + j]->DrawTileIndexed(&image, j * 8, i * 8, 0);
             }
         }
-        return pixmap.toImage();
+        image.setColorTable(Tile8x8::IndexedColorTable(palettes, palNum, 1));
+        return image;
     }
 
     /// <summary>
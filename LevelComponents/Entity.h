@@ -70,8 +70,6 @@ namespace LevelComponents
         void DeleteTilesAndPaletteByOneRow(int palID);
         void SwapPalettes(int palID_1, int palID_2);
         Tile8x8 *GetBlankTile() { return blankTile; }
-        void SetChanged(bool change) { Changed = change; }
-        bool IsNewEntity() { return Changed; }
 
     private:
         QVector<QRgb> palettes[16]; //i don't want to do some memory management here, so i just set it to be 16
@@ -80,7 +78,6 @@ namespace LevelComponents
         int EntityGlobalID = 0;
         int EntityPaletteNum = 0;
         QVector<OAMTile *> OAMTiles;
-        bool Changed = false;
 
         void LoadSubPalettes(int paletteNum, int paletteSetPtr, int startPaletteId = 0);
         void LoadSpritesTiles(int tileaddress, int datalength);
@@ -29,7 +29,6 @@ namespace LevelComponents
             k++;
         } while (1);
         ResetPalettes();
-        InitTile8x8array();
     }
 
     /// <summary>
@@ -42,7 +41,6 @@ namespace LevelComponents
     {
         this->EntityinfoTable = entitySet.GetEntityTable();
         ResetPalettes();
-        InitTile8x8array();
     }
 
     /// <summary>
@@ -50,14 +48,7 @@ namespace LevelComponents
     /// </summary>
     EntitySet::~EntitySet()
     {
-        for (int i = 0; i < TilesDefaultNum; ++i)
-        {
-            if (tile8x8array[i] != blankTile)
-            {
-                delete tile8x8array[i];
-            }
-        }
-        delete blankTile;
+        // The VRAM layout only references the tiles of the entities, there is nothing to free
     }
 
     /// <summary>
@@ -96,39 +87,62 @@ namespace LevelComponents
     /// Palette number used to render the current entityset.
     /// </param>
     QPixmap EntitySet::GetPixmap(const int palNum)
+    {
+        return QPixmap::fromImage(RenderIndexed(palNum));
+    }
+
+    /// <summary>
+    /// Render the whole Entityset using one palette as a Format_Indexed8 image.
+    /// </summary>
+    /// <remarks>
+    /// The tiles are drawn straight from the entities through the VRAM layout, without copying them.
+    /// Unlike a pixmap, the image can be handed over to a worker thread.
+    /// </remarks>
+    /// <param name="palNum">
+    /// Palette number used to render the current entityset.
+    /// </param>
+    QImage EntitySet::RenderIndexed(const int palNum)
     {
         // Initialize the palettes
         ResetPalettes();
-        ResetTile8x8Array();
+        ResetVRAMLayout();
 
-        // Render and return pixmap
-        QPixmap pixmap(8 * 32, 8 * 32);
-        pixmap.fill(Qt::transparent);
+        // Color indices 0 - 15 are the palette, 16 is left transparent for the blank tiles
+        QImage image(8 * 32, 8 * 32, QImage::Format_Indexed8);
+        QVector<QRgb> colorTable = Tile8x8::IndexedColorTable(palettes, palNum, 1);
+        colorTable.push_back(0);
+        image.setColorTable(colorTable);
+        image.fill(16);
 
         // drawing
         for (int i = 0; i < 32; ++i)
         {
             for (int j = 0; j < 32; ++j)
             {
-                if (tile8x8array[i * 32 + j] == blankTile) continue;
-                tile8x8array[i * 32 + j]->SetPaletteIndex(palNum);
-                tile8x8array[i * 32 + j]->DrawTile(&pixmap, j * 8, i * 8);
+                const struct EntitySetVRAMTile &vramTile = VRAMLayout[i * 32 + j];
+                if (!vramTile.entity) continue;
+                vramTile.entity->GetTile8x8array()[vramTile.tileId]->DrawTileIndexed(&image, j * 8, i * 8, 0);
             }
         }
-        return pixmap;
+        return image;
     }
 
     /// <summary>
-    /// Initialize tile8x8array.
+    /// Get an entity of this entity set, preferring the extra entities being edited in the sprites editor.
     /// </summary>
-    void EntitySet::InitTile8x8array()
+    /// <param name="entityGlobalId">
+    /// Entity global id.
+    /// </param>
+    Entity *EntitySet::GetEntity(int entityGlobalId)
     {
-        blankTile = Tile8x8::CreateBlankTile(palettes);
-        tile8x8array = new Tile8x8* [TilesDefaultNum];
-        for (int i = 0; i < TilesDefaultNum; ++i)
+        for (int i = 0; i < extraEntities.size(); ++i)
         {
-            tile8x8array[i] = blankTile;
+            if (entityGlobalId == extraEntities[i]->GetEntityGlobalID())
+            {
+                return extraEntities[i];
+            }
         }
+        return ROMUtils::entities[entityGlobalId];
     }
 
     /// <summary>
@@ -160,15 +174,7 @@ namespace LevelComponents
             int tmpEntityPalOffset = EntityinfoTable[localEntityId].paletteOffset;
             ++localEntityId;
 
-            Entity *curEntity = ROMUtils::entities[tmpEntityGlobalId];
-            for (int i = 0; i < extraEntities.size(); ++i)
-            {
-                if (tmpEntityGlobalId == extraEntities[i]->GetEntityGlobalID())
-                {
-                    curEntity = extraEntities[i];
-                    break;
-                }
-            }
+            Entity *curEntity = GetEntity(tmpEntityGlobalId);
             int tmpEntityPalNum = curEntity->GetPalNum();
             offset = tmpEntityPalNum + tmpEntityPalOffset + 8;
             if (offset > 15)
@@ -201,26 +207,38 @@ namespace LevelComponents
     }
 
     /// <summary>
-    /// Re-Initialize tile8x8array and delete the old ones.
+    /// Point a range of VRAM slots to the tiles of an entity.
     /// </summary>
-    void EntitySet::ResetTile8x8Array()
+    /// <param name="entity">
+    /// The entity whose tiles are loaded, its first tile goes to firstTileId.
+    /// </param>
+    /// <param name="firstTileId">
+    /// The first VRAM slot.
+    /// </param>
+    /// <param name="endTileId">
+    /// The VRAM slot after the last one, slots past the tiles of the entity are left blank.
+    /// </param>
+    void EntitySet::LoadEntityTiles(Entity *entity, int firstTileId, int endTileId)
     {
-        // Clean up and re-initialize the 8x8 tiles and set all the tiles to blank tiles
-        for (int i = (0x20 * 4); i < TilesDefaultNum; ++i)
+        int tileNum = entity->GetTilesNum();
+        for (int i = firstTileId; i < endTileId; ++i)
         {
-            if (tile8x8array[i] != blankTile)
-            {
-                delete tile8x8array[i];
-                tile8x8array[i] = blankTile;
-            }
+            struct EntitySetVRAMTile &vramTile = VRAMLayout[i];
+            vramTile.entity = i - firstTileId < tileNum ? entity : nullptr;
+            vramTile.tileId = i - firstTileId;
         }
+    }
+
+    /// <summary>
+    /// Re-Initialize the VRAM layout from the entity table.
+    /// </summary>
+    void EntitySet::ResetVRAMLayout()
+    {
+        // Set all the tiles to blank tiles
+        VRAMLayout.fill(EntitySetVRAMTile(), TilesDefaultNum);
+
         // Load universal sprites
-        QVector<Tile8x8 *> tmptilesarray = ROMUtils::entities[6]->GetSpriteTiles(palettes);
-        for (int i = (0x20 * 4); i < (0x20 * 16); ++i)
-        {
-            tile8x8array[i] = tmptilesarray[i - 0x20 * 4];
-            tile8x8array[i]->SetIndex(i);
-        }
+        LoadEntityTiles(ROMUtils::entities[6], 0x20 * 4, 0x20 * 16);
         int offset = 16; // 2 rows count 1 in the offset, keep the loading progress the same as palette loading
         int localEntityId = 0; // used to contain the current entity being loaded tiles
         bool overwriteBoxtiles = false;
@@ -231,18 +249,7 @@ namespace LevelComponents
             int tmpEntityPalOffset = EntityinfoTable[localEntityId].paletteOffset;
             ++localEntityId;
 
-            Entity *curEntity = ROMUtils::entities[tmpEntityGlobalId];
-            for (int i = 0; i < extraEntities.size(); ++i)
-            {
-                if (tmpEntityGlobalId == extraEntities[i]->GetEntityGlobalID())
-                {
-                    curEntity = extraEntities[i];
-                    break;
-                }
-            }
-            tmptilesarray.clear();
-            tmptilesarray = curEntity->GetSpriteTiles(palettes);
-
+            Entity *curEntity = GetEntity(tmpEntityGlobalId);
             int tmpEntityPalNum = curEntity->GetPalNum();
             offset = 2 * (tmpEntityPalNum + tmpEntityPalOffset) + 16;
             if (offset > 31)
@@ -252,26 +259,13 @@ namespace LevelComponents
                 // TODO: deal with exception
                 continue;
             }
-            for (int i = (0x20 * (tmpEntityPalOffset * 2 + 16)); i < (0x20 * offset); ++i) // load specified sprites' tiles
-            {
-                // sometimes sprites' tiles will overwrite each other
-                if (tile8x8array[i] != blankTile)
-                {
-                    delete tile8x8array[i];
-                }
-                tile8x8array[i] = tmptilesarray[i - 0x20 * (tmpEntityPalOffset * 2 + 16)];
-                tile8x8array[i]->SetIndex(i);
-            }
+            // sometimes sprites' tiles will overwrite each other
+            LoadEntityTiles(curEntity, 0x20 * (tmpEntityPalOffset * 2 + 16), 0x20 * offset);
         } while(EntityinfoTable.size() > localEntityId);
         if(!overwriteBoxtiles)
         {
-            tmptilesarray.clear();
-            tmptilesarray = ROMUtils::entities[0]->GetSpriteTiles(palettes);
-            for (int i = (0x20 * 15 * 2); i < (0x20 * 16 * 2); ++i) // load treasure boxes tiles
-            {
-                tile8x8array[i] = tmptilesarray[i - 0x20 * 15 * 2];
-                tile8x8array[i]->SetIndex(i);
-            }
+            // load treasure boxes tiles
+            LoadEntityTiles(ROMUtils::entities[0], 0x20 * 15 * 2, 0x20 * 16 * 2);
         }
     }
 
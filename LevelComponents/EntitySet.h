@@ -15,6 +15,13 @@ namespace LevelComponents
         int paletteOffset;
     };
 
+    // One 8x8 tile slot of the sprite VRAM, referencing the entity tile loaded there instead of a copy of it
+    struct EntitySetVRAMTile
+    {
+        Entity *entity = nullptr; // nullptr if the slot is blank
+        int tileId = 0;           // index into the tiles of the entity
+    };
+
     class EntitySet
     {
     public:
@@ -27,24 +34,22 @@ namespace LevelComponents
         void ClearEntityLoadTable() { EntityinfoTable.clear(); }
         void EntityLoadTablePushBack(EntitySetinfoTableElement newelement) {if(EntityinfoTable.size() < 0x1F) EntityinfoTable.push_back(newelement); }
         QPixmap GetPixmap(const int palNum);
+        QImage RenderIndexed(const int palNum);
         void SetExtraEntities(QVector<LevelComponents::Entity*> newEntities) { extraEntities = newEntities; }
         void ClearExtraEntities() { extraEntities.clear(); }
-        void SetChanged(bool change) { Changed = change; }
-        bool IsNewEntitySet() { return Changed; }
 
     private:
         int EntitySetID; // from 0 to 89 inclusive in theory(??), but only from 0 to 82 inclusive are available
         QVector<EntitySetinfoTableElement> EntityinfoTable; // max item number 0x20
         QVector<QRgb> palettes[16];
-        Tile8x8 **tile8x8array = nullptr;
-        Tile8x8 *blankTile = nullptr;
-        bool Changed = false;
+        QVector<EntitySetVRAMTile> VRAMLayout; // 32 x 32 tiles
 
         QVector<LevelComponents::Entity*> extraEntities; // only used in sprites editor
 
-        void InitTile8x8array();
+        Entity *GetEntity(int entityGlobalId);
         void ResetPalettes();
-        void ResetTile8x8Array();
+        void ResetVRAMLayout();
+        void LoadEntityTiles(Entity *entity, int firstTileId, int endTileId);
     };
 } // namespace LevelComponents
 
@@ -1,5 +1,6 @@
 ﻿#include "Layer.h"
 #include "ROMUtils.h"
+#include "ProfilingUtils.h"
 
 #include <cassert>
 #include <cstring>
@@ -26,6 +27,7 @@ namespace LevelComponents
         {
             return;
         }
+        unsigned short *data = nullptr;
 
         // Get the layer dimensions
         if (mappingType == LayerMap16)
@@ -34,8 +36,7 @@ namespace LevelComponents
             Height = ROMUtils::ROMFileMetadata->ROMDataPtr[layerDataPtr + 1];
 
             // Get the layer data
-            LayerData =
-                reinterpret_cast<unsigned short *>(ROMUtils::LayerRLEDecompress(layerDataPtr + 2, Width * Height * 2));
+            data = reinterpret_cast<unsigned short *>(ROMUtils::LayerRLEDecompress(layerDataPtr + 2, Width * Height * 2));
         }
         else if (mappingType == LayerTile8x8)
         {
@@ -44,54 +45,56 @@ namespace LevelComponents
             Height = (1 + ((ROMUtils::ROMFileMetadata->ROMDataPtr[layerDataPtr] >> 1) & 1)) << 5;
 
             // Get the layer data
-            LayerData =
-                reinterpret_cast<unsigned short *>(ROMUtils::LayerRLEDecompress(layerDataPtr + 1, Width * Height * 2));
+            data = reinterpret_cast<unsigned short *>(ROMUtils::LayerRLEDecompress(layerDataPtr + 1, Width * Height * 2));
 
             // Rearrange tile data for dimension type 1
             //   1 2 3 4 5 6      1 2 3 A B C
             //   7 8 9 A B C  =>  4 5 6 D E F
             //   D E F G H I      7 8 9 G H I
-            if (ROMUtils::ROMFileMetadata->ROMDataPtr[layerDataPtr] == 1)
+            if (data && ROMUtils::ROMFileMetadata->ROMDataPtr[layerDataPtr] == 1)
             {
                 unsigned short *rearranged = new unsigned short[Width * Height];
                 for (int j = 0; j < 32; ++j)
                 {
                     for (int k = 0; k < 32; ++k)
                     {
-                        rearranged[(j << 6) + k] = LayerData[(j << 5) + k];
-                        rearranged[(j << 6) + k + 32] = LayerData[(j << 5) + k + 1024];
+                        rearranged[(j << 6) + k] = data[(j << 5) + k];
+                        rearranged[(j << 6) + k + 32] = data[(j << 5) + k + 1024];
                     }
                 }
-                unsigned short *tmp = LayerData;
-                LayerData = rearranged;
-                delete[] tmp;
+                delete[] data;
+                data = rearranged;
             }
         }
 
         // Was layer decompression successful?
-        if (!LayerData)
+        if (!data)
+        {
             std::cout << "Failed to decompress layer data: " << (layerDataPtr + 1) << std::endl;
+            return;
+        }
+        LayerData.resize(Width * Height);
+        memcpy(LayerData.data(), data, Width * Height * 2);
+        delete[] data;
+        DataVersion = RenderedLayerCache::ROMLayerVersion(layerDataPtr, mappingType);
     }
 
     /// <summary>
-    /// Deep copy constructor for Layer.
+    /// Copy constructor for Layer.
     /// </summary>
+    /// <remarks>
+    /// The layer data is shared with the source Layer until one of them writes to it, so copying is cheap.
+    /// The Tile8x8 objects of a 0x20 layer are not copied, they are created again by the next RenderLayer call.
+    /// </remarks>
     /// <param name="layer">
-    /// The Layer object to deep copy from.
+    /// The Layer object to copy from.
     /// </param>
     Layer::Layer(Layer &layer) :
             MappingType(layer.MappingType), Enabled(layer.Enabled), Width(layer.Width), Height(layer.Height),
-            LayerPriority(layer.LayerPriority), dirty(layer.dirty), DataPtr(layer.DataPtr)
+            LayerData(layer.LayerData), DataVersion(layer.DataVersion), LayerPriority(layer.LayerPriority), dirty(layer.dirty), DataPtr(layer.DataPtr)
     {
-        int layerDataSize = Width * Height * 2;
-        LayerData = (unsigned short *) malloc(layerDataSize);
-        memcpy(LayerData, layer.LayerData, layerDataSize);
-        if (MappingType == LayerMappingType::LayerTile8x8)
-            foreach (Tile *tile, layer.tiles)
-                tiles.push_back(new Tile8x8((Tile8x8 *) tile));
-        else // Map16 tiles are not deep copied
-            foreach (Tile *tile, layer.tiles)
-                tiles.push_back(tile);
+        if (MappingType == LayerMap16) // Map16 tiles are not deep copied
+            tiles = layer.tiles;
     }
 
     /// <summary>
@@ -99,10 +102,8 @@ namespace LevelComponents
     /// </summary>
     Layer::~Layer()
     {
-        if (!LayerData)
-            return;
+        delete[] PrecompressedData;
         DeconstructTiles();
-        delete[] LayerData;
     }
 
     /// <summary>
@@ -111,8 +112,8 @@ namespace LevelComponents
     void Layer::ResetData()
     {
         dirty = Enabled = true;
-        memset(LayerData, 0, 2 * Width * Height);
-        dirty = true;
+        LayerData.fill(0, Width * Height);
+        DataVersion = RenderedLayerCache::NewVersion();
     }
 
     /// <summary>
@@ -140,11 +141,16 @@ namespace LevelComponents
     /// <param name="tileset">
     /// The tileset defining the tiles that will be drawn on the layer graphics.
     /// </param>
+    /// <param name="prerendered">
+    /// The layer graphics if they were already drawn by AsyncRoomRenderer, only the tiles are created then.
+    /// </param>
     /// <return>
     /// A QPixmap of the fully rendered layer, including transparency.
     /// </return>
-    QPixmap Layer::RenderLayer(Tileset *tileset)
+    QPixmap Layer::RenderLayer(Tileset *tileset, const QImage &prerendered)
     {
+        PROFILE_SCOPE("Layer::RenderLayer");
+
         // Set the units we are drawing in (depending on the Tile type)
         int units = -1;
         switch (MappingType)
@@ -173,7 +179,7 @@ namespace LevelComponents
             QVector<TileMap16 *> map16 = tileset->GetMap16arrayPtr();
             for (int i = 0; i < Width * Height; ++i)
             {
-                tiles[i] = map16[LayerData[i]];
+                tiles[i] = map16[LayerData.at(i)];
             }
         }
         else if (MappingType == LayerTile8x8)
@@ -188,7 +194,7 @@ namespace LevelComponents
             QVector<Tile8x8 *> tile8x8 = tileset->GetTile8x8arrayPtr();
             for (int i = 0; i < Width * Height; ++i)
             {
-                unsigned short tileData = LayerData[i];
+                unsigned short tileData = LayerData.at(i);
                 Tile8x8 *newTile = new Tile8x8(tile8x8[0x200 + (tileData & 0x3FF)]);
                 newTile->SetFlipX((tileData & (1 << 10)) != 0);
                 newTile->SetFlipY((tileData & (1 << 11)) != 0);
@@ -197,6 +203,22 @@ namespace LevelComponents
             }
         }
 
+        // Use the framebuffer drawn in the background from a snapshot of this layer, if there is one
+        QByteArray cacheKey = RenderedLayerCache::LayerKey(this, tileset);
+        if (!prerendered.isNull() && prerendered.width() == Width * units && prerendered.height() == Height * units)
+        {
+            QPixmap layerPixmap = QPixmap::fromImage(prerendered);
+            RenderedLayerCache::Insert(cacheKey, layerPixmap);
+            return layerPixmap;
+        }
+
+        // Or the pixmap drawn the last time this layer data was rendered with this tileset, possibly by another view
+        QPixmap cachedPixmap;
+        if (RenderedLayerCache::Find(cacheKey, &cachedPixmap))
+        {
+            return cachedPixmap;
+        }
+
         // Initialize the QPixmap with transparency
         QPixmap layerPixmap(Width * units, Height * units);
         layerPixmap.fill(Qt::transparent);
@@ -210,6 +232,8 @@ namespace LevelComponents
                 t->DrawTile(&layerPixmap, j * units, i * units);
             }
         }
+        PROFILE_COUNT("layer tiles drawn", Width * Height);
+        RenderedLayerCache::Insert(cacheKey, layerPixmap);
 
         return layerPixmap;
     }
@@ -236,6 +260,8 @@ namespace LevelComponents
     {
         dirty = true;
         int index = X + Y * Width;
+        if (index >= static_cast<int>(tiles.size()))
+            return; // the tiles of a copied layer are only created by RenderLayer
         if (MappingType == LayerMap16)
         {
             // If map16 type, then just copy the map16 tile object from the tileset
@@ -260,7 +286,7 @@ namespace LevelComponents
     /// </summary>
     void Layer::SetDisabled()
     {
-        if (!LayerData)
+        if (LayerData.isEmpty())
             return;
         if (MappingType ==
             LayerTile8x8) // If this is mapping type tile8x8, then the tiles are heap copies of tileset tiles.
@@ -276,8 +302,9 @@ namespace LevelComponents
             tiles.clear();
         }
 
-        delete[] LayerData;
-        LayerData = nullptr;
+        LayerData.clear();
+        DataVersion = RenderedLayerCache::NewVersion();
+        tiles.clear();
         MappingType = LayerDisabled;
         Enabled = false;
         dirty = true;
@@ -295,17 +322,34 @@ namespace LevelComponents
     /// </returns>
     unsigned char *Layer::GetCompressedLayerData(unsigned int *dataSize)
     {
+        if (PrecompressedData)
+        {
+            unsigned char *data = PrecompressedData;
+            *dataSize = PrecompressedSize;
+            PrecompressedData = nullptr;
+            return data;
+        }
         QVector<unsigned short> data;
         for (int i = 0; i < Height; i++)
         {
             for (int j = 0; j < Width; j++)
             {
-                data.append(LayerData[j + i * Width]);
+                data.append(LayerData.at(j + i * Width));
             }
         }
         return CompressLayerData(data, MappingType, Width, Height, dataSize);
     }
 
+    /// <summary>
+    /// Compress the layer data ahead of time, so that the next GetCompressedLayerData call returns it directly.
+    /// This only touches this Layer, so different layers can be compressed on worker threads.
+    /// </summary>
+    void Layer::PrecompressLayerData()
+    {
+        DiscardPrecompressedLayerData();
+        PrecompressedData = GetCompressedLayerData(&PrecompressedSize);
+    }
+
     /// <summary>
     /// Create and returned compressed layer data (on the heap)
     /// can be used without creating Layer instance
@@ -343,6 +387,7 @@ namespace LevelComponents
             tmpLayerData = rearranged;
         }
         unsigned int compressedSize = ROMUtils::LayerRLECompress(width * height, tmpLayerData, &dataBuffer);
+        PROFILE_COUNT("layer bytes compressed", compressedSize);
         delete[] rearranged;
         unsigned int sizeInfoLen = mappingType == LayerMap16 ? 2 : 1;
         unsigned char *dataChunk = new unsigned char[sizeInfoLen + compressedSize];
@@ -1,10 +1,13 @@
 ﻿#ifndef LAYER_H
 #define LAYER_H
 
+#include "RenderedLayerCache.h"
 #include "Tile.h"
 #include "Tileset.h"
 
+#include <QImage>
 #include <QPixmap>
+#include <QVector>
 
 namespace LevelComponents
 {
@@ -22,37 +25,50 @@ namespace LevelComponents
         bool Enabled = false;
         std::vector<Tile *> tiles;
         int Width = 0, Height = 0;
-        unsigned short *LayerData = nullptr;
+        QVector<unsigned short> LayerData;
+        unsigned int DataVersion = 0; // changed by every write to LayerData, kept by copies
         int LayerPriority = 0;
         bool dirty = false;
         unsigned int DataPtr; // this pointer does not include the 0x8000000 bit
+        unsigned char *PrecompressedData = nullptr; // owned until taken by GetCompressedLayerData
+        unsigned int PrecompressedSize = 0;
         void DeconstructTiles();
 
     public:
         Layer(int layerDataPtr, enum LayerMappingType mappingType);
         Layer(Layer &layer);
-        QPixmap RenderLayer(Tileset *tileset);
+        QPixmap RenderLayer(Tileset *tileset, const QImage &prerendered = QImage());
         int GetLayerWidth() { return Width; }
         int GetLayerHeight() { return Height; }
         enum LayerMappingType GetMappingType() { return MappingType; }
-        unsigned short *GetLayerData() { return LayerData; }
-        unsigned short *CreateLayerDataCopy()
+        // The layer data is implicitly shared between copies of the Layer, the undo history and the room snapshots.
+        // GetLayerData() makes this copy the only owner before returning a writable pointer, use ReadLayerData() to only read.
+        unsigned short *GetLayerData()
         {
-            if (MappingType != LayerMap16) return nullptr;
-            unsigned short *datacopy = new unsigned short[Width * Height];
-            memcpy(datacopy, LayerData, 2 * Width * Height);
-            return datacopy;
+            DataVersion = RenderedLayerCache::NewVersion();
+            return LayerData.isEmpty() ? nullptr : LayerData.data();
         }
-        void SetLayerData(unsigned short *ptr) { LayerData = ptr; }
+        const unsigned short *ReadLayerData() const { return LayerData.isEmpty() ? nullptr : LayerData.constData(); }
+        QVector<unsigned short> CreateLayerDataCopy()
+        {
+            if (MappingType != LayerMap16) return QVector<unsigned short>();
+            return LayerData;
+        }
+        QVector<unsigned short> GetSharedLayerData() { return LayerData; }
+        void SetLayerData(const QVector<unsigned short> &data) { LayerData = data; DataVersion = RenderedLayerCache::NewVersion(); }
+        unsigned int GetDataVersion() { return DataVersion; }
         void SetTileData(unsigned short id, unsigned char x, unsigned char y)
         {
             if((x + y * Width) < (Width * Height))
+            {
                 LayerData[x + y * Width] = id;
+                DataVersion = RenderedLayerCache::NewVersion();
+            }
         }
         unsigned short GetTileData(unsigned char x, unsigned char y)
         {
             if((x + y * Width) < (Width * Height))
-                return LayerData[x + y * Width];
+                return LayerData.at(x + y * Width);
             return 0xFFFF; // TODO
         }
         int GetLayerPriority() { return LayerPriority; }
@@ -61,26 +77,28 @@ namespace LevelComponents
         std::vector<Tile *> GetTiles() { return tiles; }
         bool IsEnabled() { return Enabled; }
         void SetDisabled();
-        void SetWidthHeightData(int layerWidth, int layerHeight, unsigned short *data)
+        void SetWidthHeightData(int layerWidth, int layerHeight, const QVector<unsigned short> &data)
         {
             if (layerWidth < 1 || layerHeight < 1) return;
             SetDisabled();
             MappingType = LayerMap16;
             Enabled = true;
             Width = layerWidth; Height = layerHeight;
-            LayerData = new unsigned short[Width * Height];
-            if (data != nullptr)
+            DataVersion = RenderedLayerCache::NewVersion();
+            if (data.size() == Width * Height)
             {
-                memcpy(LayerData, data, 2 * Width * Height);
+                LayerData = data;
             }
             else
             {
-                memset(LayerData, 0, 2 * Width * Height);
+                LayerData.fill(0, Width * Height);
             }
         }
         bool IsDirty() { return dirty; }
         void SetDirty(bool _dirty) { dirty = _dirty; }
         unsigned char *GetCompressedLayerData(unsigned int *dataSize);
+        void PrecompressLayerData();
+        void DiscardPrecompressedLayerData() { delete[] PrecompressedData; PrecompressedData = nullptr; }
         ~Layer();
         unsigned int GetDataPtr() { return DataPtr; }
         // don't use it before save level and reset layer pointer
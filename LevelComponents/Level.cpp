@@ -313,6 +313,22 @@ namespace LevelComponents
         }
     }
 
+    /// <summary>
+    /// Point every room at the current global Tileset and EntitySet instances again.
+    /// </summary>
+    /// <remarks>
+    /// Global operations only update the rooms of the current level, a level kept with unsaved edits
+    /// must be reset before it is drawn or becomes the current level again.
+    /// </remarks>
+    void Level::ResetGlobalInstances()
+    {
+        for (Room *room : rooms)
+        {
+            room->ResetTileSet();
+            room->SetCurrentEntitySet(room->GetCurrentEntitySetID());
+        }
+    }
+
     /// <summary>
     /// Swap 2 Room instances in the Level, also rearrange the Door data.
     /// </summary>
@@ -0,0 +1,116 @@
+#include "RenderedLayerCache.h"
+#include "Layer.h"
+#include "ProfilingUtils.h"
+
+#include <QCache>
+#include <QHash>
+#include <atomic>
+
+namespace LevelComponents
+{
+    namespace RenderedLayerCache
+    {
+        // Rendered pixmaps by key, the cost is counted in KB
+        static QCache<QByteArray, QPixmap> Pixmaps(256 * 1024);
+
+        // Versions of the layers loaded from the ROM data, by data pointer and mapping type
+        static QHash<qint64, unsigned int> ROMLayerVersions;
+
+        static std::atomic<unsigned int> LastVersion(0);
+
+        /// <summary>
+        /// Get a version number which was never used before.
+        /// </summary>
+        /// <return>The version number.</return>
+        unsigned int NewVersion()
+        {
+            return ++LastVersion;
+        }
+
+        /// <summary>
+        /// Get the version of a layer decompressed from the ROM data.
+        /// </summary>
+        /// <remarks>
+        /// Every Layer constructed from the same data pointer gets the same version, so a room preview loaded again
+        /// from the ROM can use the pixmaps drawn the last time. The versions are forgotten by Clear().
+        /// </remarks>
+        /// <param name="layerDataPtr">
+        /// Pointer to the beginning of the layer data.
+        /// </param>
+        /// <param name="mappingType">
+        /// The mapping type for the layer.
+        /// </param>
+        /// <return>The version of the layer data.</return>
+        unsigned int ROMLayerVersion(int layerDataPtr, int mappingType)
+        {
+            qint64 key = (static_cast<qint64>(layerDataPtr) << 8) | mappingType;
+            auto iter = ROMLayerVersions.constFind(key);
+            if (iter != ROMLayerVersions.constEnd())
+            {
+                return iter.value();
+            }
+            unsigned int version = NewVersion();
+            ROMLayerVersions.insert(key, version);
+            return version;
+        }
+
+        /// <summary>
+        /// Get the cache key of a layer drawn with a tileset.
+        /// </summary>
+        /// <param name="layer">
+        /// The layer to draw.
+        /// </param>
+        /// <param name="tileset">
+        /// The tileset defining the tiles of the layer.
+        /// </param>
+        /// <return>The key.</return>
+        QByteArray LayerKey(Layer *layer, Tileset *tileset)
+        {
+            return QByteArray("layer:") + QByteArray::number(layer->GetDataVersion()) + ':' +
+                   QByteArray::number(tileset->GetVersion());
+        }
+
+        /// <summary>
+        /// Look up a rendered pixmap.
+        /// </summary>
+        /// <param name="key">
+        /// The key of the pixmap.
+        /// </param>
+        /// <param name="pixmap">
+        /// Set to the cached pixmap if there is one.
+        /// </param>
+        /// <return>True if the pixmap was found.</return>
+        bool Find(const QByteArray &key, QPixmap *pixmap)
+        {
+            QPixmap *cached = Pixmaps.object(key);
+            PROFILE_COUNT(cached ? "rendered layer cache hits" : "rendered layer cache misses", 1);
+            if (!cached) return false;
+            *pixmap = *cached;
+            return true;
+        }
+
+        /// <summary>
+        /// Store a rendered pixmap, the least recently used pixmaps are dropped when the cache is full.
+        /// </summary>
+        /// <param name="key">
+        /// The key of the pixmap.
+        /// </param>
+        /// <param name="pixmap">
+        /// The pixmap. It is implicitly shared, so the caller can keep using it.
+        /// </param>
+        void Insert(const QByteArray &key, const QPixmap &pixmap)
+        {
+            if (pixmap.isNull()) return;
+            Pixmaps.insert(key, new QPixmap(pixmap), qMax(1, pixmap.width() * pixmap.height() * 4 / 1024));
+        }
+
+        /// <summary>
+        /// Forget every pixmap and ROM layer version, used when the ROM data is loaded or saved.
+        /// </summary>
+        void Clear()
+        {
+            Pixmaps.clear();
+            ROMLayerVersions.clear();
+        }
+    } // namespace RenderedLayerCache
+} // namespace LevelComponents
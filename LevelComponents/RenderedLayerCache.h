@@ -0,0 +1,27 @@
+#ifndef RENDEREDLAYERCACHE_H
+#define RENDEREDLAYERCACHE_H
+
+#include <QByteArray>
+#include <QPixmap>
+
+namespace LevelComponents
+{
+    class Layer;
+    class Tileset;
+
+    // Process-wide cache of rendered layer pixmaps, shared by the main graphics view, the door config dialog
+    // and the room config previews. Layers and tilesets carry a version which changes with every modification
+    // and is kept by their copies, so a room is only drawn again after one of them was edited.
+    // Only use it from the GUI thread.
+    namespace RenderedLayerCache
+    {
+        unsigned int NewVersion();
+        unsigned int ROMLayerVersion(int layerDataPtr, int mappingType);
+        QByteArray LayerKey(Layer *layer, Tileset *tileset);
+        bool Find(const QByteArray &key, QPixmap *pixmap);
+        void Insert(const QByteArray &key, const QPixmap &pixmap);
+        void Clear();
+    } // namespace RenderedLayerCache
+} // namespace LevelComponents
+
+#endif // RENDEREDLAYERCACHE_H
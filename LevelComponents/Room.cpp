@@ -7,6 +7,9 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <QDataStream>
+#include <QGraphicsLineItem>
+#include <QHash>
 #include <QPainter>
 #include <QFont>
 #include <iostream>
@@ -18,6 +21,114 @@ extern WL4EditorWindow *singleton;
 
 namespace LevelComponents
 {
+    // Pre-rendered extra hint glyphs: one 16x16 cell per event id hint, followed by one per terrain id hint.
+    // The cells have the size of a Tile16, so redrawing a tile never leaves pixels of a glyph on its neighbours.
+    struct HintGlyphAtlas
+    {
+        QByteArray settingsKey;
+        QPixmap atlas;
+        int eventGlyphCount = 0;
+    };
+
+    // Map16 tile id -> (event id hint index + 1) | (terrain id hint index + 1) << 8, 0 meaning no hint
+    struct HintLookupTable
+    {
+        QByteArray settingsKey;
+        QByteArray eventTable;
+        QByteArray terrainTable;
+        QVector<unsigned short> lut;
+    };
+
+    /// <summary>
+    /// Serialize every setting the extra hints depend on, used to tell when the cached tables are outdated.
+    /// </summary>
+    static QByteArray HintSettingsKey()
+    {
+        QByteArray key;
+        QDataStream stream(&key, QIODevice::WriteOnly);
+        stream << SettingsUtils::projectSettings::extraEventIDhintboxcolor
+               << SettingsUtils::projectSettings::extraEventIDhinteventids
+               << SettingsUtils::projectSettings::extraEventIDhintChars
+               << SettingsUtils::projectSettings::extraTerrainIDhintboxcolor
+               << SettingsUtils::projectSettings::extraTerrainIDhintTerrainids
+               << SettingsUtils::projectSettings::extraTerrainIDhintChars
+               << singleton->font().family();
+        return key;
+    }
+
+    /// <summary>
+    /// Get the hint lookup table of a tileset, it is rebuilt when the tileset's event or terrain table or the settings change.
+    /// </summary>
+    static const unsigned short *GetHintLookupTable(Tileset *tileset, const QByteArray &settingsKey)
+    {
+        static QHash<Tileset *, struct HintLookupTable> tables;
+        QByteArray eventTable = QByteArray::fromRawData(reinterpret_cast<const char *>(tileset->GetEventTablePtr()), 0x300 * 2);
+        QByteArray terrainTable = QByteArray::fromRawData(reinterpret_cast<const char *>(tileset->GetTerrainTypeIDTablePtr()), 0x300);
+        struct HintLookupTable &table = tables[tileset];
+        if (table.lut.size() != 0x300 || table.settingsKey != settingsKey ||
+            table.eventTable != eventTable || table.terrainTable != terrainTable)
+        {
+            table.settingsKey = settingsKey;
+            table.eventTable = QByteArray(eventTable.constData(), eventTable.size());
+            table.terrainTable = QByteArray(terrainTable.constData(), terrainTable.size());
+            table.lut.resize(0x300);
+            unsigned short *eventtable = tileset->GetEventTablePtr();
+            unsigned char *terraintable = tileset->GetTerrainTypeIDTablePtr();
+            for (int i = 0; i < 0x300; ++i)
+            {
+                int eventHint = SettingsUtils::projectSettings::extraEventIDhinteventids.indexOf(eventtable[i]) + 1;
+                int terrainHint = SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.indexOf(terraintable[i]) + 1;
+                table.lut[i] = static_cast<unsigned short>((eventHint & 0xFF) | ((terrainHint & 0xFF) << 8));
+            }
+        }
+        return table.lut.constData();
+    }
+
+    /// <summary>
+    /// Get the glyph atlas for the extra hints, it is re-rendered when the settings change.
+    /// </summary>
+    static const struct HintGlyphAtlas &GetHintGlyphAtlas(const QByteArray &settingsKey)
+    {
+        static struct HintGlyphAtlas glyphs;
+        if (glyphs.settingsKey == settingsKey && !glyphs.atlas.isNull())
+        {
+            return glyphs;
+        }
+        const QVector<int> &eventids = SettingsUtils::projectSettings::extraEventIDhinteventids;
+        const QVector<int> &terrainids = SettingsUtils::projectSettings::extraTerrainIDhintTerrainids;
+        glyphs.settingsKey = settingsKey;
+        glyphs.eventGlyphCount = eventids.size();
+        glyphs.atlas = QPixmap(16 * qMax(1, eventids.size() + terrainids.size()), 16);
+        glyphs.atlas.fill(Qt::transparent);
+
+        QPainter painter(&glyphs.atlas);
+        painter.setFont(QFont(singleton->font().family(), 12));
+        auto drawGlyph = [&painter](int cell, const QColor &color, const QStringList &hintchars, int n) {
+            QPen pen = QPen(QBrush(color), 2);
+            pen.setJoinStyle(Qt::MiterJoin);
+            painter.setPen(pen);
+            painter.setClipRect(16 * cell, 0, 16, 16);
+            if (n >= hintchars.size() || hintchars[n].isEmpty())
+            {
+                painter.drawRect(16 * cell + 4, 4, 8, 8);
+            }
+            else
+            {
+                painter.drawText(16 * cell + 4, 16, hintchars[n]);
+            }
+        };
+        for (int n = 0; n < eventids.size(); ++n)
+        {
+            drawGlyph(n, SettingsUtils::projectSettings::extraEventIDhintboxcolor, SettingsUtils::projectSettings::extraEventIDhintChars, n);
+        }
+        for (int n = 0; n < terrainids.size(); ++n)
+        {
+            drawGlyph(eventids.size() + n, SettingsUtils::projectSettings::extraTerrainIDhintboxcolor,
+                      SettingsUtils::projectSettings::extraTerrainIDhintChars, n);
+        }
+        return glyphs;
+    }
+
     /// <summary>
     /// Construct a new empty Room object.
     /// </summary>
@@ -181,8 +292,9 @@ namespace LevelComponents
             EntityList[i] = room->GetEntityListData(i);
         }
 
-        // Copy Entityset's and Entities' pointers
+        // Copy Entityset's and Entities' pointers, and the entity sprites rendered so far
         SetCurrentEntitySet(CurrentEntitySetID);
+        EntitySprites = room->EntitySprites;
     }
 
     /// <summary>
@@ -218,6 +330,7 @@ namespace LevelComponents
     void Room::SetCurrentEntitySet(int _currentEntitySetID)
     {
         ClearCurrentEntityListSource();
+        EntitySprites.clear();
         currentEntitySet = ROMUtils::entitiessets[_currentEntitySetID];
         CurrentEntitySetID = _currentEntitySetID;
         for (int i = 0; i < 17; ++i)
@@ -256,6 +369,7 @@ namespace LevelComponents
         {
             delete layers[i];
         }
+        delete animatedTilePreview;
     }
 
     /// <summary>
@@ -314,6 +428,10 @@ namespace LevelComponents
         {
         case FullRender:
         {
+            // The animated tile preview items are deleted along with the old scene
+            delete animatedTilePreview;
+            animatedTilePreview = nullptr;
+
             // Create a graphics scene with the layers added in order of priority
             if (scene)
             {
@@ -327,9 +445,25 @@ namespace LevelComponents
 
             // Render the 4 layers in the order of their priority
             QVector<bool> LayersCurrentVisibility = singleton->GetLayersVisibilityArray();
+
+            // The blended layer 0 depends on the layers under it and on their visibility
+            QByteArray alphaCacheKey;
+            QPixmap alphaCachedPixmap;
+            bool alphaCached = false;
+            if (Layer0ColorBlending && (eva_evb[1] != 0))
+            {
+                alphaCacheKey = "alpha:" + QByteArray::number(RoomHeader.RenderEffect);
+                for (int i = 0; i < 4; ++i)
+                {
+                    alphaCacheKey += ':' + RenderedLayerCache::LayerKey(layers[i], tileset) + (LayersCurrentVisibility[i] ? "v" : "h");
+                }
+                alphaCached = RenderedLayerCache::Find(alphaCacheKey, &alphaCachedPixmap);
+            }
             for (int i = 0; i < 4; ++i)
             {
-                QPixmap pixmap = drawLayers[i]->layer->RenderLayer(tileset);
+                int layerIndex = drawLayers[i]->index;
+                QPixmap pixmap = drawLayers[i]->layer->RenderLayer(tileset, layerIndex < renderParams->prerenderedLayers.size() ?
+                                                                    renderParams->prerenderedLayers[layerIndex] : QImage());
                 // If this is a layer composed of 8x8 tiles, then repeat the layer in X and Y to the size of the other
                 // layers
                 if (drawLayers[i]->layer->GetMappingType() == LayerTile8x8)
@@ -360,22 +494,29 @@ namespace LevelComponents
                     // If this is a pass for a layer under the alpha layer, draw the rendered layer to the EVA component
                     // image
                     if ((3 - i) > layerpriorities[0] && LayersCurrentVisibility[drawLayers[i]->index])
-                        alphaPainter.drawImage(0, 0, RenderedLayers[drawLayers[i]->index]->pixmap().toImage());
+                    {
+                        if (!alphaCached)
+                            alphaPainter.drawImage(0, 0, RenderedLayers[drawLayers[i]->index]->pixmap().toImage());
+                    }
                     else if ((3 - i) == layerpriorities[0])
                     {
                         // Blend the EVA and EVB pixels for the new layer
                         Z--;
-                        QImage imageA = RenderedLayers[0]->pixmap().toImage();
-                        QImage imageB = alphaPixmap.toImage();
+                        if (!alphaCached)
+                        {
+                            QImage imageA = RenderedLayers[0]->pixmap().toImage();
+                            QImage imageB = alphaPixmap.toImage();
+                            alphaCachedPixmap = QPixmap::fromImage(AlphaBlend(eva_evb[0],
+                                                                              eva_evb[1],
+                                                                              sceneHeight,
+                                                                              sceneWidth,
+                                                                              imageA,
+                                                                              imageB));
+                            RenderedLayerCache::Insert(alphaCacheKey, alphaCachedPixmap);
+                        }
 
                         // Add the alpha pixmap above the non-blended layer 0, but below the next one to be rendered
-                        QGraphicsPixmapItem *alphaItem = scene->addPixmap(
-                                    QPixmap::fromImage(AlphaBlend(eva_evb[0],
-                                                                  eva_evb[1],
-                                                                  sceneHeight,
-                                                                  sceneWidth,
-                                                                  imageA,
-                                                                  imageB)));
+                        QGraphicsPixmapItem *alphaItem = scene->addPixmap(alphaCachedPixmap);
                         alphaItem->setZValue(Z);
                         Z += 2;
                         EntityLayerZValue[i] = Z - 1;
@@ -389,358 +530,74 @@ namespace LevelComponents
             // Fall through to ElementsLayersUpdate section
         case ElementsLayersUpdate:
         {
-            // Render entity layer
-            QPixmap *EntityPixmap[4];
-            QPainter *EntityPainter[4];
-            for (int i = 0; i < 4; ++i)
-            {
-                EntityPixmap[i] = new QPixmap(sceneWidth, sceneHeight);
-                EntityPixmap[i]->fill(Qt::transparent);
-                EntityPainter[i] = new QPainter(EntityPixmap[i]);
-            }
-            currentDifficulty = renderParams->mode.selectedDifficulty;
-            for (int i = 0; i < (int) EntityList[currentDifficulty].size(); ++i)
-            {
-                unsigned char EntityID = EntityList[currentDifficulty].at(i).EntityID;
-                // TODO this continue statement may not be addressing the underlying problem,
-                // if it is at all possible for out-of-range entity IDs to reach this point
-                if ((unsigned int) EntityID > currentEntityListSource.size() - 1)
-                    continue;
-                Entity *currententity = currentEntityListSource[EntityID];
-
-                // use OAM data to get x and y offset to render sprites
-                QVector<unsigned short> nakedOAMdata = LevelComponents::Entity::GetDefaultOAMData(currententity->GetEntityGlobalID());
-                LevelComponents::EntityPositionalOffset position =
-                    LevelComponents::Entity::GetEntityPositionalOffset(nakedOAMdata);
-
-                // Use an alternative method to render the Entity in a not-so-bad place
-                if (Layer0ColorBlending && !eva_evb[1])
-                {
-                    int tmppriority = (layerpriorities[1]) > (layerpriorities[2])
-                                          ? layerpriorities[1]
-                                          : layerpriorities[2];
-                    EntityPainter[tmppriority]->drawImage(
-                        16 * EntityList[currentDifficulty][i].XPos + position.XOffset + 8,
-                        16 * EntityList[currentDifficulty][i].YPos + position.YOffset + 16,
-                        currententity->Render());
-                }
-                else if (Layer0ColorBlending && eva_evb[1])
-                {
-                    EntityPainter[layerpriorities[0]]->drawImage(
-                                16 * EntityList[currentDifficulty][i].XPos + position.XOffset + 8,
-                                16 * EntityList[currentDifficulty][i].YPos + position.YOffset + 16,
-                                currententity->Render());
-                }
-                else
-                {
-                    EntityPainter[layerpriorities[1] + 1]->drawImage(
-                                16 * EntityList[currentDifficulty][i].XPos + position.XOffset + 8,
-                                16 * EntityList[currentDifficulty][i].YPos + position.YOffset + 16,
-                                currententity->Render());
-                }
-            }
-            for (int i = 0; i < 4; ++i)
-            {
-                QGraphicsPixmapItem *EntityItem;
-                if (!RenderedLayers[8 + i] || renderParams->type == FullRender)
-                {
-                    EntityItem = scene->addPixmap(*EntityPixmap[i]);
-                    EntityItem->setZValue(EntityLayerZValue[i]);
-                    RenderedLayers[8 + i] = EntityItem;
-                }
-                else
-                {
-                    RenderedLayers[8 + i]->setPixmap(*EntityPixmap[i]);
-                }
-                delete EntityPainter[i];
-                delete EntityPixmap[i];
-            }
-
-            // Reset Z value
-            Z = (Layer0ColorBlending && eva_evb[1]) ? 9 : 8;
-
-            // Render door layer
-            QPixmap doorPixmap(sceneWidth, sceneHeight);
-            doorPixmap.fill(Qt::transparent);
-            QPainter doorPainter(&doorPixmap);
-            QPen DoorPen = QPen(QBrush(SettingsUtils::projectSettings::doorboxcolor), 2);
-            DoorPen.setJoinStyle(Qt::MiterJoin);
-            doorPainter.setPen(DoorPen);
-            for (unsigned int i = 0; i < renderParams->localDoors.size(); i++)
-            {
-                struct DoorEntry &currentDoor = renderParams->localDoors[i];
-                int doorX = currentDoor.x1 * 16;
-                int doorY = currentDoor.y1 * 16;
-                int doorWidth = (qAbs(currentDoor.x1 - currentDoor.x2) + 1) * 16;
-                int doorHeight = (qAbs(currentDoor.y1 - currentDoor.y2) + 1) * 16;
-                if (i == renderParams->SelectedDoorID)
-                {
-                    QPen DoorPen2 = QPen(QBrush(SettingsUtils::projectSettings::doorboxcolorselected), 2);
-                    DoorPen2.setJoinStyle(Qt::MiterJoin);
-                    doorPainter.setPen(DoorPen2);
-                    doorPainter.drawRect(doorX, doorY, doorWidth, doorHeight);
-                    doorPainter.fillRect(doorX + 1, doorY + 1, doorWidth - 2, doorHeight - 2,
-                                         SettingsUtils::projectSettings::doorboxcolorselected_filling);
-                    doorPainter.setPen(DoorPen);
-                }
-                else
-                {
-                    doorPainter.drawRect(doorX, doorY, doorWidth, doorHeight);
-                    doorPainter.fillRect(doorX + 1, doorY + 1, doorWidth - 2, doorHeight - 2, SettingsUtils::projectSettings::doorboxcolor_filling);
-                }
-            }
-            QGraphicsPixmapItem *doorpixmapItem;
-            if (!RenderedLayers[5] || renderParams->type == FullRender)
-            {
-                doorpixmapItem = scene->addPixmap(doorPixmap);
-                doorpixmapItem->setZValue(Z++);
-                RenderedLayers[5] = doorpixmapItem;
-            }
-            else
-            {
-                RenderedLayers[5]->setPixmap(doorPixmap);
-            }
-
-            // Render camera box layer
-            QPixmap CameraLimitationPixmap(sceneWidth, sceneHeight);
-            CameraLimitationPixmap.fill(Qt::transparent);
-            QPainter CameraLimitationPainter(&CameraLimitationPixmap);
-            CameraLimitationPainter.setRenderHint(QPainter::Antialiasing);
-            QPen CameraLimitationPen = QPen(QBrush(SettingsUtils::projectSettings::cameraboxcolor), 2);
-            QPen CameraLimitationPen2 = QPen(QBrush(SettingsUtils::projectSettings::cameraboxcolor_extended), 2);
-            CameraLimitationPen.setJoinStyle(Qt::MiterJoin);
-            CameraLimitationPen2.setJoinStyle(Qt::MiterJoin);
-            CameraLimitationPainter.setPen(CameraLimitationPen);
-
-            if (CameraControlType == LevelComponents::FixedY)
-            {
-                // Use Wario original position when getting out of a door to figure out the Camera Limitator Y position
-                // CameraY and WarioYPos here are 4 times the real values
-                int CameraY = 0x80 - 32;
-                int WarioYPos = renderParams->localDoors[0].GetWarioOriginalPosition_x4().y(); // Use the first door in the data
-                if (WarioYPos > 0x260)
-                {
-                    do
-                    {
-                        CameraY += 0x240;
-                    } while (WarioYPos > (CameraY + 0x280));
-                }
-
-                // Force the value to be normal
-                CameraY = CameraY / 4;
-
-                // Get the first Camera limitator Y value
-                while (CameraY > 0xA0)
-                {
-                    CameraY -= 0x90;
-                }
-
-                // Draw Camera Limitation
-                while ((CameraY + 0xA0) < layer1height * 16)
-                {
-                    CameraLimitationPainter.drawRect(0x20, CameraY, layer1width * 16 - 0x40, 0xA0);
-                    CameraY += 0x90;
-                }
-            }
-            else if (CameraControlType == LevelComponents::Vertical_Seperated)
-            {
-                if (layer1height >= 14)
-                {
-                    if (layer1height < 18)
-                    {
-                        CameraLimitationPainter.drawRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0x40);
-                    }
-                    else
-                    {
-                        CameraLimitationPainter.drawRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0xE0);
-                        CameraLimitationPainter.drawRect(0x20, layer1height * 16 - 0x100, layer1width * 16 - 0x40,
-                                                         0xE0);
-                    }
-                }
-            }
-            else if (CameraControlType == LevelComponents::NoLimit)
-            {
-                CameraLimitationPainter.drawRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0x40);
-            }
-            else if (CameraControlType == LevelComponents::HasControlAttrs)
+            // Create the overlay containers once per scene, the element items are their children
+            if (!RenderedLayers[4] || renderParams->type == FullRender)
             {
-                for (unsigned int i = 0; i < CameraControlRecords.size(); i++)
+                ClearElementItems();
+                for (int i = 0; i < 4; ++i)
                 {
-                    CameraLimitationPainter.drawRect(16 * ((int) CameraControlRecords[i]->x1) + 1,
-                                                     16 * ((int) CameraControlRecords[i]->y1) + 1,
-                                                     16 * (qMin((int) CameraControlRecords[i]->x2, layer1width - 3) -
-                                                           (int) CameraControlRecords[i]->x1 + 1) -
-                                                         2,
-                                                     16 * (qMin((int) CameraControlRecords[i]->y2, layer1height - 3) -
-                                                           (int) CameraControlRecords[i]->y1 + 1) -
-                                                         2);
-                    if (CameraControlRecords[i]->x3 != (unsigned char) '\xFF')
-                    {
-                        // Draw a box around the block which triggers the camera box, and a line connecting it
-                        CameraLimitationPainter.drawRect(16 * ((int) CameraControlRecords[i]->x3) + 2,
-                                                         16 * ((int) CameraControlRecords[i]->y3) + 2, 12, 12);
-                        CameraLimitationPainter.drawLine(
-                            16 * ((int) CameraControlRecords[i]->x1) + 1, 16 * ((int) CameraControlRecords[i]->y1) + 1,
-                            16 * ((int) CameraControlRecords[i]->x3) + 2, 16 * ((int) CameraControlRecords[i]->y3) + 2);
-                        CameraLimitationPainter.setPen(CameraLimitationPen2);
-                        int SetNum[4] = { (int) CameraControlRecords[i]->x1, (int) CameraControlRecords[i]->x2,
-                                          (int) CameraControlRecords[i]->y1, (int) CameraControlRecords[i]->y2 };
-                        int k = (int) CameraControlRecords[i]->ChangeValueOffset;
-                        SetNum[k] = (int) CameraControlRecords[i]->ChangedValue;
-                        CameraLimitationPainter.drawRect(16 * SetNum[0], 16 * SetNum[2],
-                                                         16 * (qMin(SetNum[1], layer1width - 3) - SetNum[0] + 1),
-                                                         16 * (qMin(SetNum[3], layer1height - 3) - SetNum[2] + 1));
-                        CameraLimitationPainter.setPen(CameraLimitationPen);
-                    }
+                    RenderedLayers[8 + i] = scene->addPixmap(QPixmap());
+                    RenderedLayers[8 + i]->setZValue(EntityLayerZValue[i]);
                 }
-            }
-            else
-            {
-                // TODO other camera control type
-            }
-            QGraphicsPixmapItem *CameraLimitationpixmapItem;
-            if (!RenderedLayers[6] || renderParams->type == FullRender)
-            {
-                CameraLimitationpixmapItem = scene->addPixmap(CameraLimitationPixmap);
-                CameraLimitationpixmapItem->setZValue(Z++);
-                RenderedLayers[6] = CameraLimitationpixmapItem;
-            }
-            else
-            {
-                RenderedLayers[6]->setPixmap(CameraLimitationPixmap);
+                Z = (Layer0ColorBlending && eva_evb[1]) ? 9 : 8;
+                RenderedLayers[5] = scene->addPixmap(QPixmap());
+                RenderedLayers[5]->setZValue(Z++);
+                RenderedLayers[6] = scene->addPixmap(QPixmap());
+                RenderedLayers[6]->setZValue(Z++);
+                RenderedLayers[4] = scene->addPixmap(QPixmap());
+                RenderedLayers[4]->setZValue(Z++);
+                RenderedLayers[12] = scene->addPixmap(QPixmap());
+                RenderedLayers[12]->setZValue(Z++);
             }
 
-            // Render Entities Boxes used for selecting
-            QPixmap EntityBoxPixmap(sceneWidth, sceneHeight);
-            EntityBoxPixmap.fill(Qt::transparent);
-            QPainter EntityBoxPainter(&EntityBoxPixmap);
-            QPen EntityBoxPen = QPen(QBrush(SettingsUtils::projectSettings::entityboxcolor), 2);
-            EntityBoxPen.setJoinStyle(Qt::MiterJoin);
-            EntityBoxPainter.setPen(EntityBoxPen);
-            for (int i = 0; i < (int) EntityList[currentDifficulty].size(); ++i)
+            // All the entities go into one of the entity layers, depending on the render effect
+            int entityLayerSlot;
+            if (Layer0ColorBlending && !eva_evb[1])
             {
-                if (i == renderParams->SelectedEntityID)
-                {
-                    QPen EntityBoxPen2 = QPen(QBrush(SettingsUtils::projectSettings::entityboxcolorselected), 2);
-                    EntityBoxPen2.setJoinStyle(Qt::MiterJoin);
-                    EntityBoxPainter.setPen(EntityBoxPen2);
-                    EntityBoxPainter.drawRect(16 * EntityList[currentDifficulty][i].XPos,
-                                              16 * EntityList[currentDifficulty][i].YPos, 16, 16);
-                    EntityBoxPainter.setPen(EntityBoxPen);
-                }
-                else
-                {
-                    EntityBoxPainter.drawRect(16 * EntityList[currentDifficulty][i].XPos,
-                                              16 * EntityList[currentDifficulty][i].YPos, 16, 16);
-                }
+                // Use an alternative method to render the Entity in a not-so-bad place
+                entityLayerSlot = qMax(layerpriorities[1], layerpriorities[2]);
             }
-            // Test: Render EntitySet Tiles in the front of the Layer RenderedLayers[4]
-            // EntityBoxPainter.drawPixmap(0, 0, currentEntitySet->GetPixmap(9));
-            QGraphicsPixmapItem *EntityBoxpixmapItem;
-            if (!RenderedLayers[4] || renderParams->type == FullRender)
+            else if (Layer0ColorBlending && eva_evb[1])
             {
-                EntityBoxpixmapItem = scene->addPixmap(EntityBoxPixmap);
-                EntityBoxpixmapItem->setZValue(Z++);
-                RenderedLayers[4] = EntityBoxpixmapItem;
+                entityLayerSlot = layerpriorities[0];
             }
             else
             {
-                RenderedLayers[4]->setPixmap(EntityBoxPixmap);
+                entityLayerSlot = layerpriorities[1] + 1;
             }
 
-            // Extra hint layer
-            QPixmap extrahintPixmap(sceneWidth, sceneHeight);
-            extrahintPixmap.fill(Qt::transparent);
-            QPainter extrahintPainter(&extrahintPixmap);
-            QPen extrahintBoxPen = QPen(QBrush(SettingsUtils::projectSettings::extraEventIDhintboxcolor), 2);
-            extrahintBoxPen.setJoinStyle(Qt::MiterJoin);
-            extrahintPainter.setPen(extrahintBoxPen);
-            extrahintPainter.setFont(QFont(singleton->font().family(), 12));
-            unsigned short *Layer1data = layers[1]->GetLayerData();
-            unsigned short *eventtable = tileset->GetEventTablePtr();
-            unsigned char *terraintable = tileset->GetTerrainTypeIDTablePtr();
-
-            // event id hint
-            for (uint j = 0; j < layer1height; ++j)
+            // Only the items whose element or selection state changed are touched
+            currentDifficulty = renderParams->mode.selectedDifficulty;
+            QRectF elementsDirtyRect;
+            bool entitiesChanged = UpdateEntityItems(entityLayerSlot, renderParams->SelectedEntityID, elementsDirtyRect);
+            bool doorsChanged = UpdateDoorItems(renderParams->localDoors, renderParams->SelectedDoorID, elementsDirtyRect);
+            UpdateCameraItems(renderParams->localDoors, layer1width, layer1height, elementsDirtyRect);
+
+            // The extra hints only depend on the layers, so element changes only need the custom hint script
+            // to run again if it reads the changed elements. None of the hints depend on the selection.
+            const QString &hintScriptPath = SettingsUtils::projectSettings::customHintRenderJSFilePath;
+            bool hintScriptReadsChanges = hintScriptPath.length() && (entitiesChanged || doorsChanged) &&
+                singleton->GetOutputWidgetPtr()->CachedJSFileCalls(hintScriptPath,
+                    (entitiesChanged ? QStringList({"GetEntityListData", "GetEntityListSource", "PrintEntityDefaultOAMData"}) : QStringList()) +
+                    (doorsChanged ? QStringList({"GetCurRoomAllDoorsRangeData"}) : QStringList()));
+            if (renderParams->type == FullRender)
             {
-                for (uint i = 0; i < layer1width; ++i)
-                {
-                    int eventID_val = eventtable[Layer1data[j * layer1width + i]];
-                    if (auto it = std::find(SettingsUtils::projectSettings::extraEventIDhinteventids.begin(),
-                                  SettingsUtils::projectSettings::extraEventIDhinteventids.end(), eventID_val);
-                        it != SettingsUtils::projectSettings::extraEventIDhinteventids.end())
-                    {
-                        int n = it - SettingsUtils::projectSettings::extraEventIDhinteventids.begin();
-                        if (auto hintchar = SettingsUtils::projectSettings::extraEventIDhintChars[n]; hintchar.isEmpty())
-                        {
-                            extrahintPainter.drawRect(16 * i + 4, 16 * j + 4, 8, 8);
-                        }
-                        else
-                        {
-                            extrahintPainter.drawText(16 * i + 4, 16 * j + 16, hintchar);
-                        }
-                    }
-                }
-            }
+                // Extra hint layer
+                QPixmap extrahintPixmap(sceneWidth, sceneHeight);
+                extrahintPixmap.fill(Qt::transparent);
+                DrawExtraHints(extrahintPixmap, nullptr);
+                RenderedLayers[12]->setPixmap(extrahintPixmap);
 
-            // terrain id hint
-            for (int n = 0; n < 3; n++)
-            {
-                if (layers[n]->GetMappingType() == LevelComponents::LayerMappingType::LayerMap16)
+                // render custom hint, the script is compiled once and recompiled only when the file changes
+                if (SettingsUtils::projectSettings::customHintRenderJSFilePath.length())
                 {
-                    int w = layers[n]->GetLayerWidth();
-                    int h = layers[n]->GetLayerHeight();
-                    unsigned short *LayerNdata = layers[n]->GetLayerData();
-                    for (uint j = 0; j < h; ++j)
-                    {
-                        for (uint i = 0; i < w; ++i)
-                        {
-                            int terrainID_val = terraintable[LayerNdata[j * w + i]];
-                            if (auto it = std::find(SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.begin(),
-                                          SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.end(), terrainID_val);
-                                it != SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.end())
-                            {
-                                int n = it - SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.begin();
-
-                                QPen extrahintBoxPen2 = QPen(QBrush(SettingsUtils::projectSettings::extraTerrainIDhintboxcolor), 2);
-                                extrahintBoxPen2.setJoinStyle(Qt::MiterJoin);
-                                extrahintPainter.setPen(extrahintBoxPen2);
-                                if (auto hintchar = SettingsUtils::projectSettings::extraTerrainIDhintChars[n]; hintchar.isEmpty())
-                                {
-                                    extrahintPainter.drawRect(16 * i + 4, 16 * j + 4, 8, 8);
-                                }
-                                else
-                                {
-                                    extrahintPainter.drawText(16 * i + 4, 16 * j + 16, hintchar);
-                                }
-                                extrahintPainter.setPen(extrahintBoxPen);
-                            }
-                        }
-                    }
+                    singleton->GetOutputWidgetPtr()->ExecuteCachedJSFile(SettingsUtils::projectSettings::customHintRenderJSFilePath,
+                                                                         QRect(0, 0, sceneWidth, sceneHeight), true);
                 }
             }
-
-            QGraphicsPixmapItem *extrahintpixmapItem;
-            if (!RenderedLayers[12] || renderParams->type == FullRender)
-            {
-                extrahintpixmapItem = scene->addPixmap(extrahintPixmap);
-                extrahintpixmapItem->setZValue(Z++);
-                RenderedLayers[12] = extrahintpixmapItem;
-            }
-            else
+            else if (hintScriptReadsChanges)
             {
-                RenderedLayers[12]->setPixmap(extrahintPixmap);
-            }
-
-            // render custom hint
-            if (SettingsUtils::projectSettings::customHintRenderJSFilePath.length())
-            {
-                QFile file(SettingsUtils::projectSettings::customHintRenderJSFilePath);
-                if (file.open(QFile::ReadOnly | QFile::Text))
-                {
-                    QString code = QString::fromUtf8(file.readAll());
-                    singleton->GetOutputWidgetPtr()->ExecuteJSScript(code, true);
-                }
+                RedrawHintRegion(elementsDirtyRect.toAlignedRect());
             }
         }
 
@@ -844,6 +701,12 @@ namespace LevelComponents
             // Set the new QPixmap for the graphics item on the QGraphicsScene
             item->setPixmap(pm);
 
+            // The patched pixmap is the rendered layer for the new layer data, unless it is an 8x8 layer repeated over the scene
+            if (pm.width() == lw * units && pm.height() == layer->GetLayerHeight() * units)
+            {
+                RenderedLayerCache::Insert(RenderedLayerCache::LayerKey(layer, tileset), pm);
+            }
+
             // Update alpha layer
             if (Layer0ColorBlending && (eva_evb[1] != 0))
             {
@@ -927,63 +790,7 @@ namespace LevelComponents
             // Extra hint layer
             QGraphicsPixmapItem *extrahintpixmapitem = RenderedLayers[12];
             QPixmap extrahintPixmapTemp = extrahintpixmapitem->pixmap();
-            QPainter extrahintPainterTemp(&extrahintPixmapTemp);
-            extrahintPainterTemp.setCompositionMode(QPainter::CompositionMode_Source);
-            QPen extrahintBoxPen = QPen(QBrush(SettingsUtils::projectSettings::extraEventIDhintboxcolor), 2);
-            extrahintBoxPen.setJoinStyle(Qt::MiterJoin);
-            extrahintPainterTemp.setPen(extrahintBoxPen);
-            extrahintPainterTemp.setFont(QFont(singleton->font().family(), 12));
-            for(auto iter: renderParams->tilechangelist) {
-                // change event id hint boxes
-                int eventidtmp = tileset->GetEventTablePtr()[iter.tileID];
-                bool haseventid = false;
-                if (auto it = std::find(SettingsUtils::projectSettings::extraEventIDhinteventids.begin(),
-                              SettingsUtils::projectSettings::extraEventIDhinteventids.end(), eventidtmp);
-                    it != SettingsUtils::projectSettings::extraEventIDhinteventids.end())
-                {
-                    int n = it - SettingsUtils::projectSettings::extraEventIDhinteventids.begin();
-                    if (auto hintchar = SettingsUtils::projectSettings::extraEventIDhintChars[n]; hintchar.isEmpty())
-                    {
-                        extrahintPainterTemp.drawRect(16 * iter.tileX, 16 * iter.tileY + 4, 8, 8);
-                    }
-                    else
-                    {
-                        extrahintPainterTemp.drawText(16 * iter.tileX + 4, 16 * iter.tileY + 16, hintchar);
-                    }
-                    haseventid = true;
-                } else {
-                    extrahintPainterTemp.fillRect(16 * iter.tileX, 16 * iter.tileY, 16, 16, Qt::transparent);
-                }
-
-                // change terrain id hint boxes
-                unsigned char terrainidtmp = tileset->GetTerrainTypeIDTablePtr()[iter.tileID];
-                if (auto it = std::find(SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.begin(),
-                                        SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.end(), terrainidtmp);
-                              it != SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.end())
-                {
-                    int n = it - SettingsUtils::projectSettings::extraTerrainIDhintTerrainids.begin();
-
-                    QPen extrahintBoxPen2tmp = QPen(QBrush(SettingsUtils::projectSettings::extraTerrainIDhintboxcolor), 2);
-                    extrahintBoxPen2tmp.setJoinStyle(Qt::MiterJoin);
-                    extrahintPainterTemp.setPen(extrahintBoxPen2tmp);
-                    if (auto hintchar = SettingsUtils::projectSettings::extraTerrainIDhintChars[n]; hintchar.isEmpty())
-                    {
-                        extrahintPainterTemp.drawRect(16 * iter.tileX + 4, 16 * iter.tileY + 4, 8, 8);
-                    }
-                    else
-                    {
-                        extrahintPainterTemp.drawText(16 * iter.tileX + 4, 16 * iter.tileY + 16, hintchar);
-                    }
-                    extrahintPainterTemp.setPen(extrahintBoxPen);
-                } else {
-                    // don't clear the hint draw for the event id
-                    if (!haseventid)
-                    {
-                        extrahintPainterTemp.fillRect(16 * iter.tileX, 16 * iter.tileY, 16, 16, Qt::transparent);
-                    }
-                }
-
-            }
+            DrawExtraHints(extrahintPixmapTemp, &renderParams->tilechangelist);
             extrahintpixmapitem->setPixmap(extrahintPixmapTemp);
         }
         return scene;
@@ -1623,9 +1430,82 @@ namespace LevelComponents
         if(!RenderedLayers[layerId])
             return QPixmap();
 
+        // Animated cells are cleared from the layer pixmap while the animated tiles are played
+        if (animatedTilePreview && layerId < 4)
+        {
+            QPixmap originalPixmap = animatedTilePreview->GetLayerPixmap(layerId);
+            if (!originalPixmap.isNull())
+                return originalPixmap.copy(x * 16, y * 16, w * 16, h * 16);
+        }
         return RenderedLayers[layerId]->pixmap().copy(x * 16, y * 16, w * 16, h * 16);
     }
 
+    /// <summary>
+    /// Start playing the animated tiles on the rendered layers of the room.
+    /// </summary>
+    void Room::StartAnimatedTilePreview()
+    {
+        if (animatedTilePreview || !RenderedLayers[0]) return;
+        animatedTilePreview = new AnimatedTilePreview(tileset, layers, RenderedLayers);
+    }
+
+    /// <summary>
+    /// Stop playing the animated tiles and put back the static layer pixmaps.
+    /// </summary>
+    void Room::StopAnimatedTilePreview()
+    {
+        if (!animatedTilePreview) return;
+        animatedTilePreview->Restore();
+        delete animatedTilePreview;
+        animatedTilePreview = nullptr;
+    }
+
+    /// <summary>
+    /// Clear and redraw the hint layer inside a region, leaving the rest of the layer as it is.
+    /// </summary>
+    /// <remarks>
+    /// The region is widened to whole Tile16s, in which the extra hints are redrawn. Then the custom hint script runs
+    /// with the region as its dirty rect, and only the part of its result inside the region is kept.
+    /// </remarks>
+    /// <param name="region">
+    /// The region to redraw, in pixels.
+    /// </param>
+    void Room::RedrawHintRegion(QRect region)
+    {
+        QPixmap hintPixmap = RenderedLayers[12]->pixmap();
+        region = QRect(QPoint(16 * (region.left() / 16), 16 * (region.top() / 16)),
+                       QPoint(16 * (region.right() / 16) + 15, 16 * (region.bottom() / 16) + 15)) & hintPixmap.rect();
+        if (region.isEmpty()) return;
+
+        // DrawExtraHints clears the tiles it is given before drawing them
+        QVector<struct Tileinfo> tiles;
+        for (int y = region.top() / 16; y <= region.bottom() / 16; ++y)
+        {
+            for (int x = region.left() / 16; x <= region.right() / 16; ++x)
+            {
+                struct Tileinfo tile;
+                tile.tileX = x;
+                tile.tileY = y;
+                tiles.push_back(tile);
+            }
+        }
+        DrawExtraHints(hintPixmap, &tiles);
+        RenderedLayers[12]->setPixmap(hintPixmap);
+
+        if (SettingsUtils::projectSettings::customHintRenderJSFilePath.length())
+        {
+            singleton->GetOutputWidgetPtr()->ExecuteCachedJSFile(SettingsUtils::projectSettings::customHintRenderJSFilePath,
+                                                                 region, true);
+
+            // The script may submit a whole layer, only its dirty region replaces the old hints
+            QPainter painter(&hintPixmap);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawPixmap(region, RenderedLayers[12]->pixmap(), region);
+            painter.end();
+            RenderedLayers[12]->setPixmap(hintPixmap);
+        }
+    }
+
     void Room::SetHintLayerPixmap(QPixmap newHintLayerPixmap)
     {
         if (RenderedLayers[12])
@@ -1633,4 +1513,409 @@ namespace LevelComponents
             RenderedLayers[12]->setPixmap(newHintLayerPixmap);
         }
     }
+
+    /// <summary>
+    /// Forget the element overlay items, used when they are deleted along with their graphics scene.
+    /// </summary>
+    void Room::ClearElementItems()
+    {
+        EntityItems.clear();
+        EntityItemKeys.clear();
+        EntityBoxItems.clear();
+        DoorItems.clear();
+        CameraItems.clear();
+        CameraItemsSignature.clear();
+        RenderedSelectedEntityID = -1;
+        RenderedSelectedDoorID = ~0u;
+    }
+
+    /// <summary>
+    /// Get the rendered sprite of an entity type of the current entity set.
+    /// </summary>
+    /// <remarks>
+    /// Every entity type is rendered once per entity set, and again only if its Entity instance was replaced
+    /// or its custom OAM data in the project settings changed.
+    /// </remarks>
+    /// <param name="localEntityId">
+    /// The index of the entity in currentEntityListSource.
+    /// </param>
+    /// <returns>
+    /// The sprite and its offset from the entity position.
+    /// </returns>
+    const struct Room::EntitySprite &Room::GetEntitySprite(int localEntityId)
+    {
+        if (EntitySprites.size() != (int) currentEntityListSource.size())
+        {
+            EntitySprites.resize(currentEntityListSource.size());
+        }
+        struct EntitySprite &sprite = EntitySprites[localEntityId];
+        Entity *entity = currentEntityListSource[localEntityId];
+        auto customOAMdata = SettingsUtils::projectSettings::cusomOAMdata.find(entity->GetEntityGlobalID());
+        bool hasCustomOAMdata = customOAMdata != SettingsUtils::projectSettings::cusomOAMdata.end();
+        if (sprite.entity != entity || sprite.hasCustomOAMdata != hasCustomOAMdata ||
+            (hasCustomOAMdata && sprite.customOAMdata != customOAMdata->second))
+        {
+            // use OAM data to get x and y offset to render sprites
+            QVector<unsigned short> nakedOAMdata = LevelComponents::Entity::GetDefaultOAMData(entity->GetEntityGlobalID());
+            LevelComponents::EntityPositionalOffset position = LevelComponents::Entity::GetEntityPositionalOffset(nakedOAMdata);
+            sprite.entity = entity;
+            sprite.hasCustomOAMdata = hasCustomOAMdata;
+            sprite.customOAMdata = hasCustomOAMdata ? customOAMdata->second : QVector<unsigned short>();
+            sprite.pixmap = QPixmap::fromImage(entity->Render());
+            sprite.offset = QPoint(position.XOffset, position.YOffset);
+        }
+        return sprite;
+    }
+
+    /// <summary>
+    /// Update the entity sprite and entity box items for the current difficulty.
+    /// Only the entities which were added, removed, moved or changed are re-rendered.
+    /// </summary>
+    /// <param name="layerSlot">
+    /// The entity layer (RenderedLayers[8 + layerSlot]) the entity sprites are drawn in.
+    /// </param>
+    /// <param name="selectedEntityID">
+    /// The index of the selected entity in the current entity list, or -1.
+    /// </param>
+    /// <param name="dirtyRect">
+    /// Extended by the scene bounds of the changed entities, before and after the change.
+    /// </param>
+    /// <returns>
+    /// True if any entity changed, false if at most the selection changed.
+    /// </returns>
+    bool Room::UpdateEntityItems(int layerSlot, int selectedEntityID, QRectF &dirtyRect)
+    {
+        bool changed = false;
+        std::vector<struct EntityRoomAttribute> &entityList = EntityList[currentDifficulty];
+
+        // Remove the items of deleted entities
+        while (EntityItems.size() > entityList.size())
+        {
+            dirtyRect |= EntityItems.back()->sceneBoundingRect() | EntityBoxItems.back()->sceneBoundingRect();
+            delete EntityItems.back();
+            delete EntityBoxItems.back();
+            EntityItems.pop_back();
+            EntityBoxItems.pop_back();
+            EntityItemKeys.pop_back();
+            changed = true;
+        }
+
+        QPen EntityBoxPen = QPen(QBrush(SettingsUtils::projectSettings::entityboxcolor), 2);
+        EntityBoxPen.setJoinStyle(Qt::MiterJoin);
+        QPen EntityBoxPen2 = QPen(QBrush(SettingsUtils::projectSettings::entityboxcolorselected), 2);
+        EntityBoxPen2.setJoinStyle(Qt::MiterJoin);
+        for (int i = 0; i < (int) entityList.size(); ++i)
+        {
+            bool newItem = i >= (int) EntityItems.size();
+            if (newItem)
+            {
+                EntityItems.push_back(new QGraphicsPixmapItem(RenderedLayers[8 + layerSlot]));
+                EntityBoxItems.push_back(new QGraphicsRectItem(RenderedLayers[4]));
+                EntityItemKeys.push_back({nullptr, layerSlot, 0, 0});
+            }
+
+            // TODO out-of-range entity IDs only get a box, this may not be addressing the underlying problem
+            unsigned char EntityID = entityList[i].EntityID;
+            Entity *currententity = (unsigned int) EntityID < currentEntityListSource.size() ? currentEntityListSource[EntityID] : nullptr;
+            const struct EntitySprite *sprite = currententity ? &GetEntitySprite(EntityID) : nullptr;
+            struct RenderedEntityKey key = {currententity, layerSlot, entityList[i].XPos, entityList[i].YPos};
+            struct RenderedEntityKey &oldKey = EntityItemKeys[i];
+            if (newItem || key.entity != oldKey.entity || key.layerSlot != oldKey.layerSlot ||
+                key.XPos != oldKey.XPos || key.YPos != oldKey.YPos)
+            {
+                QGraphicsPixmapItem *entityItem = EntityItems[i];
+                dirtyRect |= entityItem->sceneBoundingRect() | EntityBoxItems[i]->sceneBoundingRect();
+                if (newItem || key.entity != oldKey.entity)
+                {
+                    entityItem->setPixmap(sprite ? sprite->pixmap : QPixmap());
+                }
+                if (key.layerSlot != oldKey.layerSlot)
+                {
+                    entityItem->setParentItem(RenderedLayers[8 + layerSlot]);
+                }
+                if (sprite)
+                {
+                    entityItem->setPos(16 * key.XPos + sprite->offset.x() + 8, 16 * key.YPos + sprite->offset.y() + 16);
+                }
+                EntityBoxItems[i]->setRect(16 * key.XPos, 16 * key.YPos, 16, 16);
+                dirtyRect |= entityItem->sceneBoundingRect() | EntityBoxItems[i]->sceneBoundingRect();
+                oldKey = key;
+                changed = true;
+            }
+
+            // Only the boxes whose selection state changes get a new pen
+            if (newItem || i == selectedEntityID || i == RenderedSelectedEntityID)
+            {
+                EntityBoxItems[i]->setPen(i == selectedEntityID ? EntityBoxPen2 : EntityBoxPen);
+            }
+        }
+        RenderedSelectedEntityID = selectedEntityID;
+        return changed;
+    }
+
+    /// <summary>
+    /// Update the door box items of the Room.
+    /// </summary>
+    /// <param name="localDoors">
+    /// The doors of the Room.
+    /// </param>
+    /// <param name="selectedDoorID">
+    /// The local id of the selected door, or ~0u.
+    /// </param>
+    /// <param name="dirtyRect">
+    /// Extended by the scene bounds of the changed doors, before and after the change.
+    /// </param>
+    /// <returns>
+    /// True if any door changed, false if at most the selection changed.
+    /// </returns>
+    bool Room::UpdateDoorItems(QVector<struct DoorEntry> &localDoors, unsigned int selectedDoorID, QRectF &dirtyRect)
+    {
+        bool changed = false;
+        while (DoorItems.size() > (size_t) localDoors.size())
+        {
+            dirtyRect |= DoorItems.back()->sceneBoundingRect();
+            delete DoorItems.back();
+            DoorItems.pop_back();
+            changed = true;
+        }
+
+        QPen DoorPen = QPen(QBrush(SettingsUtils::projectSettings::doorboxcolor), 2);
+        DoorPen.setJoinStyle(Qt::MiterJoin);
+        QPen DoorPen2 = QPen(QBrush(SettingsUtils::projectSettings::doorboxcolorselected), 2);
+        DoorPen2.setJoinStyle(Qt::MiterJoin);
+        for (unsigned int i = 0; i < (unsigned int) localDoors.size(); i++)
+        {
+            bool newItem = i >= DoorItems.size();
+            if (newItem)
+            {
+                DoorItems.push_back(new QGraphicsRectItem(RenderedLayers[5]));
+            }
+            struct DoorEntry &currentDoor = localDoors[i];
+            QRectF doorRect(currentDoor.x1 * 16, currentDoor.y1 * 16,
+                            (qAbs(currentDoor.x1 - currentDoor.x2) + 1) * 16,
+                            (qAbs(currentDoor.y1 - currentDoor.y2) + 1) * 16);
+            if (newItem || DoorItems[i]->rect() != doorRect)
+            {
+                dirtyRect |= DoorItems[i]->sceneBoundingRect();
+                DoorItems[i]->setRect(doorRect);
+                dirtyRect |= DoorItems[i]->sceneBoundingRect();
+                changed = true;
+            }
+            if (newItem || i == selectedDoorID || i == RenderedSelectedDoorID)
+            {
+                bool selected = i == selectedDoorID;
+                DoorItems[i]->setPen(selected ? DoorPen2 : DoorPen);
+                DoorItems[i]->setBrush(selected ? SettingsUtils::projectSettings::doorboxcolorselected_filling
+                                                : SettingsUtils::projectSettings::doorboxcolor_filling);
+            }
+        }
+        RenderedSelectedDoorID = selectedDoorID;
+        return changed;
+    }
+
+    /// <summary>
+    /// Rebuild the camera box items of the Room if the camera settings changed since the last update.
+    /// </summary>
+    /// <param name="localDoors">
+    /// The doors of the Room, the first one decides the boxes of FixedY camera control.
+    /// </param>
+    /// <param name="layer1width">
+    /// The width of layer 1. (unit: Tile16)
+    /// </param>
+    /// <param name="layer1height">
+    /// The height of layer 1. (unit: Tile16)
+    /// </param>
+    /// <param name="dirtyRect">
+    /// Extended by the scene bounds of the old and the new camera boxes if they are rebuilt.
+    /// </param>
+    /// <returns>
+    /// True if the camera boxes were rebuilt.
+    /// </returns>
+    bool Room::UpdateCameraItems(QVector<struct DoorEntry> &localDoors, int layer1width, int layer1height, QRectF &dirtyRect)
+    {
+        // Use Wario original position when getting out of a door to figure out the Camera Limitator Y position
+        // CameraY and WarioYPos here are 4 times the real values
+        int WarioYPos = (CameraControlType == LevelComponents::FixedY && localDoors.size()) ?
+            localDoors[0].GetWarioOriginalPosition_x4().y() : 0; // Use the first door in the data
+
+        // Everything the camera boxes depend on
+        QByteArray signature;
+        signature.append((char) CameraControlType);
+        signature.append(reinterpret_cast<const char *>(&layer1width), sizeof(layer1width));
+        signature.append(reinterpret_cast<const char *>(&layer1height), sizeof(layer1height));
+        signature.append(reinterpret_cast<const char *>(&WarioYPos), sizeof(WarioYPos));
+        signature.append(SettingsUtils::projectSettings::cameraboxcolor.name(QColor::HexArgb).toLatin1());
+        signature.append(SettingsUtils::projectSettings::cameraboxcolor_extended.name(QColor::HexArgb).toLatin1());
+        if (CameraControlType == LevelComponents::HasControlAttrs)
+        {
+            for (struct __CameraControlRecord *record : CameraControlRecords)
+            {
+                signature.append(reinterpret_cast<const char *>(record), sizeof(struct __CameraControlRecord));
+            }
+        }
+        if (signature == CameraItemsSignature) return false;
+        CameraItemsSignature = signature;
+        for (QGraphicsItem *item : CameraItems)
+        {
+            dirtyRect |= item->sceneBoundingRect();
+            delete item;
+        }
+        CameraItems.clear();
+
+        QPen CameraLimitationPen = QPen(QBrush(SettingsUtils::projectSettings::cameraboxcolor), 2);
+        QPen CameraLimitationPen2 = QPen(QBrush(SettingsUtils::projectSettings::cameraboxcolor_extended), 2);
+        CameraLimitationPen.setJoinStyle(Qt::MiterJoin);
+        CameraLimitationPen2.setJoinStyle(Qt::MiterJoin);
+        auto addRect = [this](int x, int y, int w, int h, const QPen &pen) {
+            QGraphicsRectItem *item = new QGraphicsRectItem(x, y, w, h, RenderedLayers[6]);
+            item->setPen(pen);
+            CameraItems.push_back(item);
+        };
+
+        if (CameraControlType == LevelComponents::FixedY)
+        {
+            int CameraY = 0x80 - 32;
+            if (WarioYPos > 0x260)
+            {
+                do
+                {
+                    CameraY += 0x240;
+                } while (WarioYPos > (CameraY + 0x280));
+            }
+
+            // Force the value to be normal
+            CameraY = CameraY / 4;
+
+            // Get the first Camera limitator Y value
+            while (CameraY > 0xA0)
+            {
+                CameraY -= 0x90;
+            }
+
+            // Draw Camera Limitation
+            while ((CameraY + 0xA0) < layer1height * 16)
+            {
+                addRect(0x20, CameraY, layer1width * 16 - 0x40, 0xA0, CameraLimitationPen);
+                CameraY += 0x90;
+            }
+        }
+        else if (CameraControlType == LevelComponents::Vertical_Seperated)
+        {
+            if (layer1height >= 14)
+            {
+                if (layer1height < 18)
+                {
+                    addRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0x40, CameraLimitationPen);
+                }
+                else
+                {
+                    addRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0xE0, CameraLimitationPen);
+                    addRect(0x20, layer1height * 16 - 0x100, layer1width * 16 - 0x40, 0xE0, CameraLimitationPen);
+                }
+            }
+        }
+        else if (CameraControlType == LevelComponents::NoLimit)
+        {
+            addRect(0x20, 0x20, layer1width * 16 - 0x40, layer1height * 16 - 0x40, CameraLimitationPen);
+        }
+        else if (CameraControlType == LevelComponents::HasControlAttrs)
+        {
+            for (unsigned int i = 0; i < CameraControlRecords.size(); i++)
+            {
+                struct __CameraControlRecord *record = CameraControlRecords[i];
+                addRect(16 * ((int) record->x1) + 1,
+                        16 * ((int) record->y1) + 1,
+                        16 * (qMin((int) record->x2, layer1width - 3) - (int) record->x1 + 1) - 2,
+                        16 * (qMin((int) record->y2, layer1height - 3) - (int) record->y1 + 1) - 2,
+                        CameraLimitationPen);
+                if (record->x3 != (unsigned char) '\xFF')
+                {
+                    // Draw a box around the block which triggers the camera box, and a line connecting it
+                    addRect(16 * ((int) record->x3) + 2, 16 * ((int) record->y3) + 2, 12, 12, CameraLimitationPen);
+                    QGraphicsLineItem *line = new QGraphicsLineItem(
+                        16 * ((int) record->x1) + 1, 16 * ((int) record->y1) + 1,
+                        16 * ((int) record->x3) + 2, 16 * ((int) record->y3) + 2, RenderedLayers[6]);
+                    line->setPen(CameraLimitationPen);
+                    CameraItems.push_back(line);
+                    int SetNum[4] = { (int) record->x1, (int) record->x2, (int) record->y1, (int) record->y2 };
+                    int k = (int) record->ChangeValueOffset;
+                    SetNum[k] = (int) record->ChangedValue;
+                    addRect(16 * SetNum[0], 16 * SetNum[2],
+                            16 * (qMin(SetNum[1], layer1width - 3) - SetNum[0] + 1),
+                            16 * (qMin(SetNum[3], layer1height - 3) - SetNum[2] + 1),
+                            CameraLimitationPen2);
+                }
+            }
+        }
+        else
+        {
+            // TODO other camera control type
+        }
+        for (QGraphicsItem *item : CameraItems)
+        {
+            dirtyRect |= item->sceneBoundingRect();
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// Draw the extra event id and terrain id hints into the hint layer pixmap.
+    /// </summary>
+    /// <remarks>
+    /// Hints are looked up per Map16 tile id in the tileset's hint lookup table and copied from the glyph atlas.
+    /// </remarks>
+    /// <param name="hintPixmap">
+    /// The hint layer pixmap to draw to, it must be transparent when drawing the whole Room.
+    /// </param>
+    /// <param name="changedTiles">
+    /// The tiles whose hints are cleared and redrawn, or nullptr to draw the whole Room.
+    /// </param>
+    void Room::DrawExtraHints(QPixmap &hintPixmap, const QVector<struct Tileinfo> *changedTiles)
+    {
+        QByteArray settingsKey = HintSettingsKey();
+        const unsigned short *lut = GetHintLookupTable(tileset, settingsKey);
+        const struct HintGlyphAtlas &glyphs = GetHintGlyphAtlas(settingsKey);
+        QPainter painter(&hintPixmap);
+
+        // event id hints come from layer 1, terrain id hints from the Map16 layers among 0 - 2
+        auto hintAt = [this, lut](int layerId, int x, int y) -> unsigned short {
+            Layer *layer = layers[layerId];
+            if (layer->GetMappingType() != LevelComponents::LayerMap16 || x >= layer->GetLayerWidth() || y >= layer->GetLayerHeight())
+                return 0;
+            unsigned short tileId = layer->ReadLayerData()[y * layer->GetLayerWidth() + x];
+            return tileId < 0x300 ? lut[tileId] : 0;
+        };
+        auto drawEventHint = [&](int x, int y) {
+            if (int n = hintAt(1, x, y) & 0xFF)
+                painter.drawPixmap(16 * x, 16 * y, glyphs.atlas, 16 * (n - 1), 0, 16, 16);
+        };
+        auto drawTerrainHint = [&](int layerId, int x, int y) {
+            if (int n = hintAt(layerId, x, y) >> 8)
+                painter.drawPixmap(16 * x, 16 * y, glyphs.atlas, 16 * (glyphs.eventGlyphCount + n - 1), 0, 16, 16);
+        };
+
+        if (!changedTiles)
+        {
+            for (int j = 0; j < layers[1]->GetLayerHeight(); ++j)
+                for (int i = 0; i < layers[1]->GetLayerWidth(); ++i)
+                    drawEventHint(i, j);
+            for (int n = 0; n < 3; n++)
+                for (int j = 0; j < layers[n]->GetLayerHeight(); ++j)
+                    for (int i = 0; i < layers[n]->GetLayerWidth(); ++i)
+                        drawTerrainHint(n, i, j);
+            return;
+        }
+
+        for (const struct Tileinfo &tile : *changedTiles)
+        {
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.fillRect(16 * tile.tileX, 16 * tile.tileY, 16, 16, Qt::transparent);
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            drawEventHint(tile.tileX, tile.tileY);
+            for (int n = 0; n < 3; n++)
+            {
+                drawTerrainHint(n, tile.tileX, tile.tileY);
+            }
+        }
+    }
 } // namespace LevelComponents
@@ -1,6 +1,7 @@
 #ifndef ROOM_H
 #define ROOM_H
 
+#include "AnimatedTilePreview.h"
 #include "LevelDoorVector.h"
 #include "Entity.h"
 #include "Layer.h"
@@ -8,6 +9,7 @@
 #include "DockWidget/EditModeDockWidget.h"
 
 #include <QGraphicsPixmapItem>
+#include <QGraphicsRectItem>
 #include <QGraphicsScene>
 #include <algorithm> // find
 #include <vector>
@@ -103,6 +105,7 @@ namespace LevelComponents
         int SelectedEntityID = -1;
         struct Ui::EditModeParams mode = {};
         QVector<struct DoorEntry> localDoors;
+        QVector<QImage> prerenderedLayers; // FullRender only, layer framebuffers drawn in the background (null images are rendered here)
         RenderUpdateParams(enum RenderUpdateType _type) : type(_type) {}
     };
 
@@ -129,6 +132,17 @@ namespace LevelComponents
         std::vector<struct EntityRoomAttribute> EntityList[3]; // HMode = 0, NMode = 1, SHMode = 2
         bool EntityListDirty[3];
         std::vector<Entity *> currentEntityListSource; // Initialize Entities here
+
+        // Sprite and position offset of every entity type of currentEntityListSource, rendered on first use
+        struct EntitySprite
+        {
+            Entity *entity = nullptr;
+            bool hasCustomOAMdata = false;
+            QVector<unsigned short> customOAMdata; // the project's custom OAM data the sprite was rendered with
+            QPixmap pixmap;
+            QPoint offset;
+        };
+        QVector<struct EntitySprite> EntitySprites;
         int currentDifficulty = 1;
         Layer *layers[4];
         Tileset *tileset;
@@ -136,6 +150,24 @@ namespace LevelComponents
             *RenderedLayers[13]; // L0 - 3, E(Entities boxes), D(Door boxes), C(Camera boxes), A (alpha blending, may not exist), E0 - 3, custom hint
         bool IsCopy = false;
 
+        // Element overlay items, children of RenderedLayers[4], [5], [6] and [8 - 11] which are updated one by one
+        struct RenderedEntityKey
+        {
+            Entity *entity;
+            int layerSlot;
+            unsigned char XPos;
+            unsigned char YPos;
+        };
+        std::vector<QGraphicsPixmapItem *> EntityItems;
+        std::vector<struct RenderedEntityKey> EntityItemKeys;
+        std::vector<QGraphicsRectItem *> EntityBoxItems;
+        std::vector<QGraphicsRectItem *> DoorItems;
+        std::vector<QGraphicsItem *> CameraItems;
+        QByteArray CameraItemsSignature;
+        int RenderedSelectedEntityID = -1;
+        unsigned int RenderedSelectedDoorID = ~0u;
+        AnimatedTilePreview *animatedTilePreview = nullptr; // only exists while the animated tiles are played
+
         // Helper functions
         void FreeDrawLayers();
         void ClearCurrentEntityListSource();
@@ -144,6 +176,13 @@ namespace LevelComponents
         QVector<int> RenderEffectParamToLayerPriorities(unsigned char render_effect);
         QVector<int> RenderEffectParamToEVAAndEVB(unsigned char render_effect);
         bool GetLayer0ColorBlending(unsigned char render_effect) {return render_effect > 7; }
+        void ClearElementItems();
+        const struct EntitySprite &GetEntitySprite(int localEntityId);
+        bool UpdateEntityItems(int layerSlot, int selectedEntityID, QRectF &dirtyRect);
+        bool UpdateDoorItems(QVector<struct DoorEntry> &localDoors, unsigned int selectedDoorID, QRectF &dirtyRect);
+        bool UpdateCameraItems(QVector<struct DoorEntry> &localDoors, int layer1width, int layer1height, QRectF &dirtyRect);
+        void DrawExtraHints(QPixmap &hintPixmap, const QVector<struct Tileinfo> *changedTiles);
+        void RedrawHintRegion(QRect region);
 
     public:
         // Object construction
@@ -175,6 +214,8 @@ namespace LevelComponents
         enum __CameraControlType GetCameraControlType() { return CameraControlType; }
         std::vector<Entity *> GetCurrentEntityListSource() { return currentEntityListSource; }
         int GetCurrentEntitySetID() { return CurrentEntitySetID; }
+        QVector<int> GetLayerPriorities() { return RenderEffectParamToLayerPriorities(RoomHeader.RenderEffect); }
+        QVector<int> GetEVAAndEVB() { return RenderEffectParamToEVAAndEVB(RoomHeader.RenderEffect); }
         bool GetEntityListDirty(int difficulty) { return EntityListDirty[difficulty]; }
         std::vector<struct EntityRoomAttribute> GetEntityListData(int difficulty) { return EntityList[difficulty]; }
         unsigned int GetLayer1Height() { return layers[1]->GetLayerHeight(); }
@@ -249,6 +290,12 @@ namespace LevelComponents
         QPixmap GetLayerPixmap(int layerId, int x, int y, int w, int h);
         QPixmap GetHintLayerPixmap() {return RenderedLayers[12]->pixmap();}
         void SetHintLayerPixmap(QPixmap newHintLayerPixmap);
+
+        // Animated tile preview
+        void StartAnimatedTilePreview();
+        void StopAnimatedTilePreview();
+        void AdvanceAnimatedTilePreview(int gameFrames) { if (animatedTilePreview) animatedTilePreview->Advance(gameFrames); }
+        bool IsAnimatedTilePreviewActive() { return animatedTilePreview != nullptr; }
     };
 } // namespace LevelComponents
 
@@ -0,0 +1,232 @@
+#include "RoomThumbnailCache.h"
+#include "ChangeJournal.h"
+#include "WL4Constants.h"
+
+#ifndef WINDOW_INSTANCE_SINGLETON
+#define WINDOW_INSTANCE_SINGLETON
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+#endif
+
+namespace LevelComponents
+{
+    /// <summary>
+    /// Construct an empty thumbnail cache.
+    /// </summary>
+    /// <param name="parent">
+    /// The parent QObject.
+    /// </param>
+    RoomThumbnailCache::RoomThumbnailCache(QObject *parent) : QObject(parent), Generation(0)
+    {
+        // Thumbnails are drawn one at a time, they should not compete with the room renders of the editor
+        Pool.setMaxThreadCount(1);
+        WalkTimer.setInterval(0);
+        connect(&WalkTimer, SIGNAL(timeout()), this, SLOT(WalkNextLevel()));
+        CurrentLevelTimer.setSingleShot(true);
+        CurrentLevelTimer.setInterval(1000);
+        connect(&CurrentLevelTimer, SIGNAL(timeout()), this, SLOT(UpdateCurrentLevel()));
+        connect(this, SIGNAL(RoomHashed(int, quint64, int, QByteArray)), this, SLOT(OnRoomHashed(int, quint64, int, QByteArray)),
+                Qt::QueuedConnection);
+        connect(this, SIGNAL(ThumbnailRendered(int, QByteArray, QImage)), this, SLOT(OnThumbnailRendered(int, QByteArray, QImage)),
+                Qt::QueuedConnection);
+    }
+
+    /// <summary>
+    /// Drop the pending thumbnails and wait for the worker to return.
+    /// </summary>
+    RoomThumbnailCache::~RoomThumbnailCache()
+    {
+        Clear();
+        Pool.waitForDone();
+    }
+
+    /// <summary>
+    /// Forget every thumbnail, used when another ROM is loaded.
+    /// </summary>
+    void RoomThumbnailCache::Clear()
+    {
+        ++Generation;
+        WalkTimer.stop();
+        CurrentLevelTimer.stop();
+        RoomHashes.clear();
+        RoomCounts.clear();
+        Thumbnails.clear();
+        PendingHashes.clear();
+        HashingSnapshots.clear();
+    }
+
+    /// <summary>
+    /// Check every room of every level in the background, one level per event loop pass.
+    /// </summary>
+    /// <remarks>
+    /// Levels other than the current one are loaded from the ROM data. Only rooms whose snapshot hash
+    /// has no thumbnail yet are drawn.
+    /// </remarks>
+    void RoomThumbnailCache::Refresh()
+    {
+        WalkIndex = 0;
+        WalkTimer.start();
+    }
+
+    /// <summary>
+    /// Check the rooms of a level, from the current level or a level kept with unsaved edits, or else from the ROM data.
+    /// </summary>
+    /// <param name="passage">
+    /// The passage of the level.
+    /// </param>
+    /// <param name="stage">
+    /// The stage of the level.
+    /// </param>
+    void RoomThumbnailCache::RefreshLevel(int passage, int stage)
+    {
+        Level *currentLevel = singleton->GetCurrentLevel();
+        if (currentLevel && currentLevel->GetPassage() == passage && currentLevel->GetStage() == stage)
+        {
+            UpdateLevel(currentLevel);
+            return;
+        }
+        if (Level *editedLevel = ChangeJournal::FindEditedLevel(passage, stage))
+        {
+            editedLevel->ResetGlobalInstances();
+            UpdateLevel(editedLevel);
+            return;
+        }
+        Level *level = new Level(static_cast<enum __passage>(passage), static_cast<enum __stage>(stage));
+        UpdateLevel(level);
+        delete level;
+    }
+
+    /// <summary>
+    /// Check the current level again after the edits stopped for a moment.
+    /// </summary>
+    void RoomThumbnailCache::InvalidateCurrentLevel()
+    {
+        CurrentLevelTimer.start();
+    }
+
+    /// <summary>
+    /// Get the thumbnail of a room.
+    /// </summary>
+    /// <param name="passage">
+    /// The passage of the level.
+    /// </param>
+    /// <param name="stage">
+    /// The stage of the level.
+    /// </param>
+    /// <param name="roomId">
+    /// The room in the level.
+    /// </param>
+    /// <return>The thumbnail, or a null pixmap if it is not drawn yet. ThumbnailReady is emitted once it is.</return>
+    QPixmap RoomThumbnailCache::GetThumbnail(int passage, int stage, int roomId)
+    {
+        return Thumbnails.value(RoomHashes.value(Key(passage, stage, roomId)));
+    }
+
+    /// <summary>
+    /// Check the next level of the background walk.
+    /// </summary>
+    void RoomThumbnailCache::WalkNextLevel()
+    {
+        if (WalkIndex >= WL4Constants::VanillaLevelCount)
+        {
+            WalkTimer.stop();
+            return;
+        }
+        RefreshLevel(WL4Constants::VanillaLevelPassages[WalkIndex], WL4Constants::VanillaLevelStages[WalkIndex]);
+        ++WalkIndex;
+    }
+
+    /// <summary>
+    /// Check the rooms of the current level.
+    /// </summary>
+    void RoomThumbnailCache::UpdateCurrentLevel()
+    {
+        if (Level *currentLevel = singleton->GetCurrentLevel())
+        {
+            UpdateLevel(currentLevel);
+        }
+    }
+
+    /// <summary>
+    /// Take snapshots of the rooms of a level, and hash them on the worker thread.
+    /// </summary>
+    /// <remarks>
+    /// Only the snapshots are taken on the GUI thread, OnRoomHashed decides which thumbnails to draw.
+    /// </remarks>
+    /// <param name="level">
+    /// The level to check. It is only read during this call.
+    /// </param>
+    void RoomThumbnailCache::UpdateLevel(Level *level)
+    {
+        int passage = level->GetPassage(), stage = level->GetStage();
+        std::vector<Room *> rooms = level->GetRooms();
+        RoomCounts[Key(passage, stage, 0)] = static_cast<int>(rooms.size());
+        int generation = Generation;
+        for (int roomId = 0; roomId < static_cast<int>(rooms.size()); ++roomId)
+        {
+            std::shared_ptr<struct RoomRenderSnapshot> snapshot = RoomRenderSnapshot::Create(rooms[roomId]);
+            quint64 key = Key(passage, stage, roomId);
+            int serial = ++HashingSerial;
+            HashingSnapshots[key] = qMakePair(serial, snapshot);
+            Pool.start(new RoomRenderTask([this, snapshot, generation, key, serial]() {
+                if (Generation != generation) return;
+                emit RoomHashed(generation, key, serial, snapshot->Hash());
+            }));
+        }
+    }
+
+    /// <summary>
+    /// Store the hash of a room computed by the worker, and draw its thumbnail if it is missing.
+    /// </summary>
+    /// <remarks>
+    /// The hash is dropped if the room was snapshot again since, the newer snapshot is being hashed.
+    /// </remarks>
+    void RoomThumbnailCache::OnRoomHashed(int generation, quint64 key, int serial, QByteArray hash)
+    {
+        if (generation != Generation) return;
+        auto hashing = HashingSnapshots.find(key);
+        if (hashing == HashingSnapshots.end() || hashing->first != serial) return;
+        std::shared_ptr<struct RoomRenderSnapshot> snapshot = hashing->second;
+        HashingSnapshots.erase(hashing);
+
+        QByteArray oldHash = RoomHashes.value(key);
+        if (oldHash == hash) return;
+        RoomHashes[key] = hash;
+
+        // Drop the old thumbnail if no room uses it anymore
+        if (!oldHash.isEmpty() && RoomHashes.key(oldHash, ~0ull) == ~0ull)
+        {
+            Thumbnails.remove(oldHash);
+        }
+
+        if (Thumbnails.contains(hash))
+        {
+            emit ThumbnailReady(KeyPassage(key), KeyStage(key), KeyRoomId(key));
+        }
+        else if (!PendingHashes.contains(hash))
+        {
+            PendingHashes.insert(hash);
+            Pool.start(new RoomRenderTask([this, snapshot, hash, generation]() {
+                QImage image = AsyncRoomRenderer::RenderDownscaledImage(*snapshot, PixelsPerTile16,
+                                                                        [this, generation]() { return Generation != generation; });
+                emit ThumbnailRendered(generation, hash, image);
+            }));
+        }
+    }
+
+    /// <summary>
+    /// Store a thumbnail drawn by the worker, and tell which rooms it belongs to.
+    /// </summary>
+    void RoomThumbnailCache::OnThumbnailRendered(int generation, QByteArray hash, QImage image)
+    {
+        if (generation != Generation) return;
+        PendingHashes.remove(hash);
+        QList<quint64> keys = RoomHashes.keys(hash);
+        if (image.isNull() || keys.isEmpty()) return;
+        Thumbnails[hash] = QPixmap::fromImage(image);
+        for (quint64 key : keys)
+        {
+            emit ThumbnailReady(KeyPassage(key), KeyStage(key), KeyRoomId(key));
+        }
+    }
+} // namespace LevelComponents
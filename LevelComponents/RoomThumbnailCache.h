@@ -0,0 +1,72 @@
+#ifndef ROOMTHUMBNAILCACHE_H
+#define ROOMTHUMBNAILCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+
+#include "AsyncRoomRenderer.h"
+#include "Level.h"
+
+namespace LevelComponents
+{
+    // Downscaled pictures of every room of every level, for the level and room pickers.
+    // Thumbnails are stored by the hash of the room snapshot they were drawn from, so a room is only
+    // drawn again when its layers, tileset or palettes changed.
+    class RoomThumbnailCache : public QObject
+    {
+        Q_OBJECT
+
+    private:
+        QHash<quint64, QByteArray> RoomHashes;    // by Key(passage, stage, roomId)
+        QHash<quint64, int> RoomCounts;           // by Key(passage, stage, 0)
+        QHash<QByteArray, QPixmap> Thumbnails;    // by room snapshot hash
+        QSet<QByteArray> PendingHashes;
+        QHash<quint64, QPair<int, std::shared_ptr<struct RoomRenderSnapshot>>> HashingSnapshots; // by Key, with serial
+        int HashingSerial = 0;
+        QThreadPool Pool;
+        std::atomic<int> Generation;
+        QTimer WalkTimer;
+        int WalkIndex = 0;
+        QTimer CurrentLevelTimer;
+
+        static quint64 Key(int passage, int stage, int roomId)
+        {
+            return (static_cast<quint64>(passage) << 48) | (static_cast<quint64>(stage) << 32) | static_cast<quint32>(roomId);
+        }
+        static int KeyPassage(quint64 key) { return static_cast<int>(key >> 48); }
+        static int KeyStage(quint64 key) { return static_cast<int>((key >> 32) & 0xFFFF); }
+        static int KeyRoomId(quint64 key) { return static_cast<int>(key & 0xFFFFFFFF); }
+        void UpdateLevel(Level *level);
+
+    private slots:
+        void WalkNextLevel();
+        void UpdateCurrentLevel();
+        void OnRoomHashed(int generation, quint64 key, int serial, QByteArray hash);
+        void OnThumbnailRendered(int generation, QByteArray hash, QImage image);
+
+    signals:
+        void RoomHashed(int generation, quint64 key, int serial, QByteArray hash);
+        void ThumbnailRendered(int generation, QByteArray hash, QImage image);
+        void ThumbnailReady(int passage, int stage, int roomId);
+
+    public:
+        static const int PixelsPerTile16 = 2;
+
+        RoomThumbnailCache(QObject *parent = nullptr);
+        ~RoomThumbnailCache();
+        void Clear();
+        void Refresh();
+        void RefreshLevel(int passage, int stage);
+        void InvalidateCurrentLevel();
+        QPixmap GetThumbnail(int passage, int stage, int roomId);
+        int GetRoomCount(int passage, int stage) { return RoomCounts.value(Key(passage, stage, 0)); }
+    };
+} // namespace LevelComponents
+
+#endif // ROOMTHUMBNAILCACHE_H
@@ -7,26 +7,69 @@
 #include <QPoint>
 #include <QTransform>
 
+#include <cstring>
 #include <iostream>
 
-//#define NOCACHE
-
 namespace LevelComponents
 {
-    QHash<QImageW *, int> Tile8x8::ImageDataCache;
+    QHash<QByteArray, Tile8x8Pixels *> Tile8x8Pixels::Store;
+    QMutex Tile8x8Pixels::StoreMutex;
 
     /// <summary>
-    /// Construct an instance of Tile8x8 with uninitialized data. (private constructor)
+    /// Return the interned copy of some tile pixel data, adding it to the store if it is not there yet.
     /// </summary>
-    /// <param name="_palettes">
-    /// Entire palette for the tileset this tile is a part of.
+    /// <param name="data">
+    /// 32 bytes of tile graphic data in uncompressed GBA format.
+    /// </param>
+    /// <returns>
+    /// The shared pixel data, with one more reference.
+    /// </returns>
+    Tile8x8Pixels *Tile8x8Pixels::Intern(const unsigned char *data)
+    {
+        QByteArray key(reinterpret_cast<const char *>(data), 32);
+        QMutexLocker locker(&StoreMutex);
+        Tile8x8Pixels *&pixels = Store[key];
+        if (!pixels)
+        {
+            pixels = new Tile8x8Pixels;
+            memcpy(pixels->Data, data, 32);
+        }
+        return Retain(pixels);
+    }
+
+    /// <summary>
+    /// Drop a reference to interned pixel data, and remove it from the store when no tile uses it anymore.
+    /// </summary>
+    /// <remarks>
+    /// The last reference is dropped under the store mutex, so Intern cannot hand out the pixels while they are deleted.
+    /// </remarks>
+    /// <param name="pixels">
+    /// The pixel data to release.
     /// </param>
-    Tile8x8::Tile8x8(QVector<QRgb> *_palettes) :
-            Tile(TileType8x8), palettes(_palettes), ImageData(new QImageW(8, 8, QImage::Format_Indexed8))
+    void Tile8x8Pixels::Release(Tile8x8Pixels *pixels)
     {
-        ImageData->setColorTable(palettes[paletteIndex]);
+        QMutexLocker locker(&StoreMutex);
+        assert(pixels->References.loadRelaxed() > 0 /* Interned tile pixels with 0 references */);
+        if (!pixels->References.deref())
+        {
+            Store.remove(QByteArray::fromRawData(reinterpret_cast<const char *>(pixels->Data), 32));
+            delete pixels;
+        }
     }
 
+    /// <summary>
+    /// Construct an instance of Tile8x8 from interned pixel data. (private constructor)
+    /// </summary>
+    /// <param name="_palettes">
+    /// Entire palette for the tileset this tile is a part of.
+    /// </param>
+    /// <param name="_pixels">
+    /// The interned pixel data, the new tile takes over the reference.
+    /// </param>
+    Tile8x8::Tile8x8(QVector<QRgb> *_palettes, Tile8x8Pixels *_pixels) :
+            Tile(TileType8x8), palettes(_palettes), Pixels(_pixels)
+    {}
+
     /// <summary>
     /// Copy constructor for Tile8x8, used only in current Tileset
     /// </summary>
@@ -34,12 +77,7 @@ namespace LevelComponents
     /// Another Tile8x8 to copy image data from.
     /// </param>
     Tile8x8::Tile8x8(Tile8x8 *other) :
-        Tile(TileType8x8), palettes(other->palettes),
-#ifndef NOCACHE
-        ImageData(GetCachedImageData(other->ImageData)),
-#else
-        ImageData(new QImageW(other->ImageData->copy())),
-#endif
+        Tile(TileType8x8), palettes(other->palettes), Pixels(Tile8x8Pixels::Retain(other->Pixels)),
         index(other->index), paletteIndex(other->paletteIndex), FlipX(other->FlipX), FlipY(other->FlipY)
     {}
 
@@ -50,12 +88,7 @@ namespace LevelComponents
     /// Another Tile8x8 to copy image data from.
     /// </param>
     Tile8x8::Tile8x8(Tile8x8 *other, QVector<QRgb> *_palettes) :
-        Tile(TileType8x8), palettes(_palettes),
-#ifndef NOCACHE
-        ImageData(GetCachedImageData(other->ImageData)),
-#else
-        ImageData(new QImageW(other->ImageData->copy())),
-#endif
+        Tile(TileType8x8), palettes(_palettes), Pixels(Tile8x8Pixels::Retain(other->Pixels)),
         index(other->index), paletteIndex(other->paletteIndex), FlipX(other->FlipX), FlipY(other->FlipY)
     {}
 
@@ -63,7 +96,7 @@ namespace LevelComponents
     /// Construct an instance of Tile8x8.
     /// </summary>
     /// <remarks>
-    /// This constructor will attempt to match the image data to a cached QImage
+    /// The pixel data is shared with every other tile with the same pixels.
     /// </remarks>
     /// <param name="dataPtr">
     /// Pointer to the beginning of the tile graphic data.
@@ -71,39 +104,15 @@ namespace LevelComponents
     /// <param name="_palettes">
     /// Entire palette for the tileset this tile is a part of.
     /// </param>
-    /// <param name="loadFromTmpROM">
-    /// Ture when load from a temp ROM.
-    /// </param>
-    Tile8x8::Tile8x8(int dataPtr, QVector<QRgb> *_palettes) : Tile8x8(_palettes)
-    {
-        // Initialize the QImage data from ROM
-        unsigned char *FileDataPtr = ROMUtils::ROMFileMetadata->ROMDataPtr;
-        for (int i = 0; i < 8; ++i)
-        {
-            for (int j = 0; j < 4; ++j)
-            {
-                unsigned char val = FileDataPtr[dataPtr + i * 4 + j];
-                ImageData->setPixel(j * 2, i, (unsigned char) (val & 0xF));
-                ImageData->setPixel(j * 2 + 1, i, (unsigned char) ((val >> 4) & 0xF));
-            }
-        }
-
-#ifndef NOCACHE
-        // Cache the QImage
-        QImageW *cached = GetCachedImageData(ImageData);
-        if (cached != ImageData)
-        {
-            delete ImageData;
-            ImageData = cached;
-        }
-#endif
-    }
+    Tile8x8::Tile8x8(int dataPtr, QVector<QRgb> *_palettes) :
+        Tile8x8(_palettes, Tile8x8Pixels::Intern(ROMUtils::ROMFileMetadata->ROMDataPtr + dataPtr))
+    {}
 
     /// <summary>
     /// Construct an instance of Tile8x8.
     /// </summary>
     /// <remarks>
-    /// This constructor will attempt to match the image data to a cached QImage
+    /// The pixel data is shared with every other tile with the same pixels.
     /// </remarks>
     /// <param name="data">
     /// Pointer to the beginning of the tile graphic data.
@@ -111,40 +120,16 @@ namespace LevelComponents
     /// <param name="_palettes">
     /// Entire palette for the tileset this tile is a part of.
     /// </param>
-    Tile8x8::Tile8x8(unsigned char *data, QVector<QRgb> *_palettes) : Tile8x8(_palettes)
-    {
-        // Initialize the QImage data from data
-        for (int i = 0; i < 8; ++i)
-        {
-            for (int j = 0; j < 4; ++j)
-            {
-                unsigned char val = data[i * 4 + j];
-                ImageData->setPixel(j * 2, i, (unsigned char) (val & 0xF));
-                ImageData->setPixel(j * 2 + 1, i, (unsigned char) ((val >> 4) & 0xF));
-            }
-        }
-
-#ifndef NOCACHE
-        // Cache the QImage
-        QImageW *cached = GetCachedImageData(ImageData);
-        if (cached != ImageData)
-        {
-            delete ImageData;
-            ImageData = cached;
-        }
-#endif
-    }
+    Tile8x8::Tile8x8(unsigned char *data, QVector<QRgb> *_palettes) :
+        Tile8x8(_palettes, Tile8x8Pixels::Intern(data))
+    {}
 
     /// <summary>
-    /// Deconstruct the Tile8x8 and clean up its instance objects on the heap.
+    /// Deconstruct the Tile8x8 and release its pixel data.
     /// </summary>
     Tile8x8::~Tile8x8()
     {
-#ifndef NOCACHE
-        DeleteCachedImageData(ImageData);
-#else
-        delete ImageData;
-#endif
+        Tile8x8Pixels::Release(Pixels);
     }
 
     /// <summary>
@@ -158,26 +143,8 @@ namespace LevelComponents
     /// </return>
     Tile8x8 *Tile8x8::CreateBlankTile(QVector<QRgb> *_palettes)
     {
-        Tile8x8 *t = new Tile8x8(_palettes);
-        for (int i = 0; i < 8; ++i)
-        {
-            for (int j = 0; j < 8; ++j)
-            {
-                t->ImageData->setPixel(i, j, 0);
-            }
-        }
-
-#ifndef NOCACHE
-        // Cache the QImage
-        QImageW *cached = GetCachedImageData(t->ImageData);
-        if (cached != t->ImageData)
-        {
-            delete t->ImageData;
-            t->ImageData = cached;
-        }
-#endif
-
-        return t;
+        unsigned char blank[32] = {0};
+        return new Tile8x8(_palettes, Tile8x8Pixels::Intern(blank));
     }
 
     /// <summary>
@@ -199,10 +166,107 @@ namespace LevelComponents
     {
         QPainter painter(layerPixmap);
         painter.setCompositionMode(QPainter::CompositionMode_Source);
-        ImageData->setColorTable(palettes[paletteIndex]);
-        QImage tileImage = ImageData->mirrored(FlipX, FlipY);
         QPoint drawDestination(x, y);
-        painter.drawImage(drawDestination, tileImage);
+        painter.drawImage(drawDestination, RenderImage());
+    }
+
+    /// <summary>
+    /// Render the tile with its current palette and flips.
+    /// </summary>
+    /// <remarks>
+    /// The image is kept and returned again until the palette colors or the flips change, so drawing the same tile
+    /// over and over does not allocate. A copy of the palette shares its data, comparing it is free until it is edited.
+    /// </remarks>
+    /// <returns>
+    /// An 8x8 ARGB image of the tile.
+    /// </returns>
+    QImage Tile8x8::RenderImage()
+    {
+        const QVector<QRgb> &palette = palettes[paletteIndex];
+        int flips = (FlipX ? ROMUtils::TileFlipX : 0) | (FlipY ? ROMUtils::TileFlipY : 0);
+        if (flips == RenderedFlips && palette == RenderedPalette)
+        {
+            return RenderedImage;
+        }
+
+        // Reuse the old image, scanLine only detaches it when a caller still holds the previous render
+        if (RenderedImage.isNull()) RenderedImage = QImage(8, 8, QImage::Format_ARGB32);
+        unsigned char colorIndices[64];
+        ROMUtils::UnpackTiles4bpp(Pixels->Data, colorIndices, 1, flips);
+        for (int i = 0; i < 8; ++i)
+        {
+            QRgb *line = reinterpret_cast<QRgb *>(RenderedImage.scanLine(i));
+            for (int j = 0; j < 8; ++j)
+            {
+                int colorIndex = colorIndices[i * 8 + j];
+                line[j] = colorIndex < palette.size() ? palette[colorIndex] : 0;
+            }
+        }
+        RenderedPalette = palette;
+        RenderedFlips = flips;
+        return RenderedImage;
+    }
+
+    /// <summary>
+    /// Write the color indices of this tile into a Format_Indexed8 image.
+    /// </summary>
+    /// <remarks>
+    /// Each pixel becomes (paletteBank * 16 + color index), so the image can be recolored by only changing its color table.
+    /// </remarks>
+    /// <param name="indexedImage">
+    /// The Format_Indexed8 image the tile will be written to.
+    /// </param>
+    /// <param name="x">
+    /// The X position to draw the tile to.
+    /// </param>
+    /// <param name="y">
+    /// The Y position to draw the tile to.
+    /// </param>
+    /// <param name="paletteBank">
+    /// The palette bank written in the high nibble of every pixel.
+    /// </param>
+    void Tile8x8::DrawTileIndexed(QImage *indexedImage, int x, int y, int paletteBank)
+    {
+        unsigned char bank = (paletteBank & 0xF) << 4;
+        unsigned char colorIndices[64];
+        ROMUtils::UnpackTiles4bpp(Pixels->Data, colorIndices, 1, (FlipX ? ROMUtils::TileFlipX : 0) | (FlipY ? ROMUtils::TileFlipY : 0));
+        for (int i = 0; i < 8; ++i)
+        {
+            unsigned char *line = indexedImage->scanLine(y + i) + x;
+            for (int j = 0; j < 8; ++j)
+            {
+                line[j] = bank | colorIndices[i * 8 + j];
+            }
+        }
+    }
+
+    /// <summary>
+    /// Build the color table for images written by DrawTileIndexed.
+    /// </summary>
+    /// <param name="palettes">
+    /// Entire palette group of the tileset or entity.
+    /// </param>
+    /// <param name="firstPaletteId">
+    /// The palette used as bank 0 of the color table.
+    /// </param>
+    /// <param name="paletteNum">
+    /// How many palettes to put into the table, 1 for a single palette atlas and 16 for a mixed palette atlas.
+    /// </param>
+    /// <returns>
+    /// A color table with 16 entries per palette, missing colors are transparent.
+    /// </returns>
+    QVector<QRgb> Tile8x8::IndexedColorTable(QVector<QRgb> *palettes, int firstPaletteId, int paletteNum)
+    {
+        QVector<QRgb> colorTable(16 * paletteNum, 0);
+        for (int i = 0; i < paletteNum; ++i)
+        {
+            const QVector<QRgb> &palette = palettes[firstPaletteId + i];
+            for (int j = 0; j < 16 && j < palette.size(); ++j)
+            {
+                colorTable[16 * i + j] = palette[j];
+            }
+        }
+        return colorTable;
     }
 
     /// <summary>
@@ -214,17 +278,6 @@ namespace LevelComponents
     void Tile8x8::SetPaletteIndex(int index)
     {
         paletteIndex = index;
-        QImageW *newImage = new QImageW(*ImageData);
-        newImage->setColorTable(palettes[paletteIndex]);
-        ImageData = newImage;
-#ifndef NOCACHE
-        QImageW *cached = GetCachedImageData(ImageData);
-        if (cached != ImageData)
-        {
-            delete ImageData;
-            ImageData = cached;
-        }
-#endif
     }
 
 
@@ -327,55 +380,6 @@ namespace LevelComponents
         TileData[pos]->SetPaletteIndex(new_paletteIndex);
     }
 
-    /// <summary>
-    /// Cache and/or return the cached copy of existing image data in the global cache.
-    /// </summary>
-    /// <param name="image">
-    /// The image data to attempt to obtain a cached copy for.
-    /// </param>
-    /// <returns>
-    /// The original image if not cached yet, or the already cached image.
-    /// </returns>
-    QImageW *Tile8x8::GetCachedImageData(QImageW *image)
-    {
-        if (ImageDataCache.value(image, 0))
-        {
-            ++ImageDataCache[image];
-            return ImageDataCache.find(image).key();
-        }
-        else
-        {
-            ImageDataCache[image] = 1;
-            return image;
-        }
-    }
-
-    /// <summary>
-    /// Delete an image reference from the cache.
-    /// If there is more than 1 reference in the cache, only decrement the reference count.
-    /// If there is only one copy in the cache, actually remove the data from it as well.
-    /// </summary>
-    /// <param name="image">
-    /// The image data to remove from the cache.
-    /// </param>
-    void Tile8x8::DeleteCachedImageData(QImageW *image)
-    {
-        int references = ImageDataCache.value(image, 0);
-        if (references > 1)
-        {
-            --ImageDataCache[image];
-        }
-        else if (references == 1)
-        {
-            ImageDataCache.take(image);
-            delete image;
-        }
-        else
-        {
-            assert(0 /* Cached QImage with 0 references */);
-        }
-    }
-
     /// <summary>
     /// Get the two byte corresponding to the tile8 in ROM.
     /// </summary>
@@ -407,17 +411,7 @@ namespace LevelComponents
     /// </returns>
     QByteArray Tile8x8::CreateGraphicsData()
     {
-        QByteArray arr(32, 0);
-        for(int i = 0; i < 8; ++i)
-        {
-            for(int j = 0; j < 4; ++j)
-            {
-                char val = static_cast<char>(ImageData->pixelIndex(j << 1, i));
-                val |= ImageData->pixelIndex((j << 1) + 1, i) << 4;
-                arr[(i << 2) + j] = val;
-            }
-        }
-        return arr;
+        return QByteArray(reinterpret_cast<const char *>(Pixels->Data), 32);
     }
 
 } // namespace LevelComponents
@@ -1,10 +1,12 @@
 #ifndef TILE_H
 #define TILE_H
 
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
 #include <QPainter>
 
-#define ROT(X) (((X) << 13) | ((X) >> 19))
-
 namespace LevelComponents
 {
     enum TileType
@@ -26,90 +28,40 @@ namespace LevelComponents
         virtual ~Tile() {}
     };
 
-    class QImageW : public QImage
+    // The 4bpp pixel data of an 8x8 tile, interned by content and shared by every Tile8x8 with identical pixels.
+    // Palette and flips are bound when the tile is drawn.
+    // The store is guarded by a mutex and the count is atomic, so tiles may be created and deleted on any thread.
+    class Tile8x8Pixels
     {
     public:
-        QImageW(int W, int H, QImage::Format F) : QImage(W, H, F) {}
-        QImageW(const QImageW &img) : QImage(img) {}
-        QImageW(QImage img) : QImage(img) {}
-        ~QImageW() {}
+        unsigned char Data[32]; // uncompressed GBA format, the low nibble is the left pixel
 
-        /// <summary>
-        /// Inline equality comparison functionality to provide O(1) performance for QHash
-        /// </summary>
-        /// <param name="other">
-        /// The first image to compare.
-        /// </param>
-        /// <returns>
-        /// True if the image data of this image and the other one are equal.
-        /// </returns>
-        inline bool operator==(const QImageW &other)
-        {
-            QVector<QRgb> pal1 = colorTable();
-            QVector<QRgb> pal2 = other.colorTable();
-            if (pal1.size() != pal2.size())
-            {
-                return false;
-            }
-            for (int i = 0; i < pal1.size(); ++i)
-            {
-                if (pal1[i] != pal2[i])
-                {
-                    return false;
-                }
-            }
-            int size1 = width() * height();
-            int size2 = other.width() * other.height();
-            if (size1 != size2)
-            {
-                return false;
-            }
-            QImageW *ptr = (QImageW *) &other;
-            return !memcmp(data_ptr(), ptr->data_ptr(), size1);
-        }
+        static Tile8x8Pixels *Intern(const unsigned char *data);
+        static Tile8x8Pixels *Retain(Tile8x8Pixels *pixels) { pixels->References.ref(); return pixels; }
+        static void Release(Tile8x8Pixels *pixels);
+        static int StoreSize() { QMutexLocker locker(&StoreMutex); return Store.size(); }
 
-        /// <summary>
-        /// Inline hashing functionality to provide O(1) performance for QHash
-        /// </summary>
-        /// <param name="img">
-        /// The image to hash.
-        /// </param>
-        /// <param name="seed">
-        /// The seed value for hashing the image.
-        /// </param>
-        /// <returns>
-        /// A hash value for the QImage.
-        /// </returns>
-        inline uint qHash(const QImageW *img, uint seed)
-        {
-            for (QRgb rgb : img->colorTable())
-            {
-                seed = ROT(seed ^ (uint) rgb);
-            }
-            const int bytes = img->width() * img->height() * img->depth() / 32;
-            unsigned int *data = (unsigned int *) img->constBits();
-            for (int i = 0; i < bytes; ++i)
-            {
-                seed = ROT(seed ^ data[i]);
-            }
-            return seed;
-        }
+    private:
+        QAtomicInt References;
+        static QHash<QByteArray, Tile8x8Pixels *> Store;
+        static QMutex StoreMutex;
     };
 
     class Tile8x8 : public Tile
     {
     private:
-        Tile8x8(QVector<QRgb> *_palettes);
+        Tile8x8(QVector<QRgb> *_palettes, Tile8x8Pixels *_pixels);
         QVector<QRgb> *palettes;
-        QImageW *ImageData;
+        Tile8x8Pixels *Pixels;
         int index = 0;
         int paletteIndex = 0;
         bool FlipX = false;
         bool FlipY = false;
 
-        static QImageW *GetCachedImageData(QImageW *image);
-        static QHash<QImageW *, int> ImageDataCache;
-        static void DeleteCachedImageData(QImageW *image);
+        // The last image rendered by RenderImage, with the palette and flips it was rendered with
+        QImage RenderedImage;
+        QVector<QRgb> RenderedPalette;
+        int RenderedFlips = -1;
 
     public:
         Tile8x8(int dataPtr, QVector<QRgb> *_palettes);
@@ -117,6 +69,9 @@ namespace LevelComponents
         Tile8x8(Tile8x8 *other);
         Tile8x8(Tile8x8 *other, QVector<QRgb> *_palettes);
         void DrawTile(QPixmap *layerPixmap, int x, int y);
+        QImage RenderImage();
+        void DrawTileIndexed(QImage *indexedImage, int x, int y, int paletteBank);
+        static QVector<QRgb> IndexedColorTable(QVector<QRgb> *palettes, int firstPaletteId, int paletteNum);
         static Tile8x8 *CreateBlankTile(QVector<QRgb> *_palettes);
         void SetIndex(int _index) {index=_index;}
         int GetIndex() {return index;};
@@ -1,6 +1,7 @@
 ﻿#include "Tileset.h"
 #include "ROMUtils.h"
 
+#include <algorithm>
 #include <iostream>
 #include <QPixmap>
 
@@ -111,6 +112,7 @@ namespace LevelComponents
             }
             map16array.push_back(new TileMap16(tiles[0], tiles[1], tiles[2], tiles[3]));
         }
+        BuildMap16UserIndex();
 
         // Get pointer to the map16 event table
         Map16EventTable = new unsigned short[Tile16DefaultNum];
@@ -149,7 +151,6 @@ namespace LevelComponents
         map16ptr(old_tileset->map16ptr)
     {
         (void) __TilesetID;
-        newtileset = true;
 
         //Save the ROM pointer into the tileset object
         this->tilesetPtr = old_tileset->getTilesetPtr();
@@ -217,6 +218,7 @@ namespace LevelComponents
             }
             map16array.push_back(new TileMap16(tiles[0], tiles[1], tiles[2], tiles[3]));
         }
+        BuildMap16UserIndex();
 
         hasconstructed = true;
     }
@@ -232,6 +234,7 @@ namespace LevelComponents
     /// </param>
     void Tileset::SetAnimatedTile(int tile8x8groupId, int tile8x8group2Id, int SwitchId, int startTile8x8Id)
     {
+        Version = RenderedLayerCache::NewVersion();
         // load the animated tile no. 0 will make the WL4Editor render some jank onto the Layer.
         // we set the id to 1 to make it looks similar to the game's runetime vram
         if (!tile8x8groupId) tile8x8groupId = 1;
@@ -252,21 +255,23 @@ namespace LevelComponents
         // Update Tile16 data
         if(hasconstructed)
         {
-            for (int i = 0; i < Tile16DefaultNum; ++i)
+            QVector<unsigned short> slots;
+            for (int i = 0; i < 4; ++i)
             {
-                for (int j = 0; j < 4; ++j)
+                for (unsigned short slot : Tile8x8Users[(startTile8x8Id & ~3) + i])
                 {
-                    Tile8x8 *tile = map16array[i]->GetTile8X8(j);
-                    if((tile->GetIndex() >> 2) == (startTile8x8Id >> 2))
-                    {
-                        int index = tile->GetIndex() & 0x3FF;
-                        bool FlipX = tile->GetFlipX();
-                        bool FlipY = tile->GetFlipY();
-                        int paletteIndex = tile->GetPaletteIndex();
-                        map16array[i]->ResetTile8x8(tile8x8array[index], j, index, paletteIndex, FlipX, FlipY);
-                    }
+                    slots.push_back(slot);
                 }
             }
+            for (unsigned short slot : slots)
+            {
+                Tile8x8 *tile = map16array[slot >> 2]->GetTile8X8(slot & 3);
+                int index = tile->GetIndex() & 0x3FF;
+                bool FlipX = tile->GetFlipX();
+                bool FlipY = tile->GetFlipY();
+                int paletteIndex = tile->GetPaletteIndex();
+                ResetTile8x8(slot >> 2, tile8x8array[index], slot & 3, index, paletteIndex, FlipX, FlipY);
+            }
         }
     }
 
@@ -307,10 +312,42 @@ namespace LevelComponents
     /// Render the tileset by Tile8 as a pixmap.
     /// </summary>
     QPixmap Tileset::RenderAllTile8x8(int paletteId)
+    {
+        return QPixmap::fromImage(RenderAllTile8x8Indexed(paletteId));
+    }
+
+    /// <summary>
+    /// Render the tileset by Tile16 as a pixmap.
+    /// </summary>
+    /// <param name="columns">
+    /// The number of columns to divide the graphics into.
+    /// </param>
+    /// <returns>
+    /// The tileset rendered at a pixmap.
+    /// </returns>
+    QPixmap Tileset::RenderAllTile16(int columns)
+    {
+        return QPixmap::fromImage(RenderAllTile16Indexed(columns));
+    }
+
+    /// <summary>
+    /// Render the tileset by Tile8 as a Format_Indexed8 image.
+    /// </summary>
+    /// <remarks>
+    /// Every pixel holds a color index of a single palette, so switching palettes or editing a color
+    /// only needs a new color table from GetTile8x8AtlasColorTable().
+    /// </remarks>
+    /// <param name="paletteId">
+    /// The palette put into the color table of the returned image.
+    /// </param>
+    /// <returns>
+    /// The tileset rendered as an indexed image.
+    /// </returns>
+    QImage Tileset::RenderAllTile8x8Indexed(int paletteId)
     {
         int lineNum = Tile8x8DefaultNum / 16;
-        QPixmap pixmap(8 * 16, 8 * lineNum);
-        pixmap.fill(Qt::transparent);
+        QImage image(8 * 16, 8 * lineNum, QImage::Format_Indexed8);
+        image.fill(0);
 
         // drawing
         for (int i = 0; i < lineNum; ++i)
@@ -318,28 +355,31 @@ namespace LevelComponents
             for (int j = 0; j < 16; ++j)
             {
                 if (tile8x8array[i * 16 + j] == blankTile) continue;
-                tile8x8array[i * 16 + j]->SetPaletteIndex(paletteId);
-                tile8x8array[i * 16 + j]->DrawTile(&pixmap, j * 8, i * 8);
+                tile8x8array[i * 16 + j]->DrawTileIndexed(&image, j * 8, i * 8, 0);
             }
         }
-        return pixmap;
+        image.setColorTable(GetTile8x8AtlasColorTable(paletteId));
+        return image;
     }
 
     /// <summary>
-    /// Render the tileset by Tile16 as a pixmap.
+    /// Render the tileset by Tile16 as a Format_Indexed8 image.
     /// </summary>
+    /// <remarks>
+    /// Every pixel holds (palette id * 16 + color index), so editing a color
+    /// only needs a new color table from GetTile16AtlasColorTable().
+    /// </remarks>
     /// <param name="columns">
     /// The number of columns to divide the graphics into.
     /// </param>
     /// <returns>
-    /// The tileset rendered at a pixmap.
+    /// The tileset rendered as an indexed image.
     /// </returns>
-    QPixmap Tileset::RenderAllTile16(int columns)
+    QImage Tileset::RenderAllTile16Indexed(int columns)
     {
-        // Initialize the pixmap with transparency
         int tileCountY = 96 / columns;
-        QPixmap pixmap(8 * 16 * columns, 16 * tileCountY);
-        pixmap.fill(Qt::transparent);
+        QImage image(8 * 16 * columns, 16 * tileCountY, QImage::Format_Indexed8);
+        image.fill(0);
 
         // Iterate by 8-tile wide column, then row, then tile horizontally within column
         for (int c = 0; c < columns; ++c)
@@ -348,11 +388,37 @@ namespace LevelComponents
             {
                 for (int j = 0; j < 8; ++j)
                 {
-                    map16array[(c * tileCountY + i) * 8 + j]->DrawTile(&pixmap, (c * 8 + j) * 16, i * 16);
+                    DrawTile16Indexed(&image, (c * tileCountY + i) * 8 + j, (c * 8 + j) * 16, i * 16);
                 }
             }
         }
-        return pixmap;
+        image.setColorTable(GetTile16AtlasColorTable());
+        return image;
+    }
+
+    /// <summary>
+    /// Write one Tile16 into an image made by RenderAllTile16Indexed.
+    /// </summary>
+    /// <param name="indexedImage">
+    /// The Format_Indexed8 image the Tile16 will be written to.
+    /// </param>
+    /// <param name="tile16Id">
+    /// The id of the Tile16 to write.
+    /// </param>
+    /// <param name="x">
+    /// The X position to draw the Tile16 to.
+    /// </param>
+    /// <param name="y">
+    /// The Y position to draw the Tile16 to.
+    /// </param>
+    void Tileset::DrawTile16Indexed(QImage *indexedImage, int tile16Id, int x, int y)
+    {
+        TileMap16 *tile16 = map16array[tile16Id];
+        for (int k = 0; k < 4; ++k)
+        {
+            Tile8x8 *tile = tile16->GetTile8X8(k);
+            tile->DrawTileIndexed(indexedImage, x + ((k & 1) << 3), y + ((k >> 1) << 3), tile->GetPaletteIndex());
+        }
     }
 
     /// <summary>
@@ -403,6 +469,7 @@ namespace LevelComponents
     /// </param>
     void Tileset::DelTile8x8(int tile8x8Id)
     {
+        Version = RenderedLayerCache::NewVersion();
         LevelComponents::Tile8x8* tile = tile8x8array[tile8x8Id];
         if(tile == blankTile)
             return;
@@ -414,27 +481,135 @@ namespace LevelComponents
         tile8x8array[0x40 + fgGFXlen / 32] = blankTile;
         fgGFXlen -= 32;
 
-        // update Tile16 map
-        for(int i = 0; i < Tile16DefaultNum; ++i)
+        // update Tile16 map, only the slots using the deleted tile or the tiles after it need to change
+        QVector<unsigned short> slots;
+        for(int i = tile8x8Id; i < Tile8x8DefaultNum; ++i)
         {
-            LevelComponents::TileMap16* tile16 = map16array[i];
-            for(int j = 0; j < 4; ++j)
+            for(unsigned short slot : Tile8x8Users[i])
             {
-                LevelComponents::Tile8x8* tmptile = tile16->GetTile8X8(j);
-                int oldid = tmptile->GetIndex();
-                int pal = tmptile->GetPaletteIndex();
-                bool xflip = tmptile->GetFlipX();
-                bool yflip = tmptile->GetFlipY();
-                if(oldid > tile8x8Id)
-                {
-                    tile16->ResetTile8x8(tile8x8array[oldid - 1], j, oldid - 1, pal, xflip, yflip);
-                }
-                else if(oldid == tile8x8Id)
-                {
-                    tile16->ResetTile8x8(tile8x8array[0x40], j, 0x40, 0, false, false);
-                }
+                slots.push_back(slot);
+            }
+        }
+        for(unsigned short slot : slots)
+        {
+            LevelComponents::Tile8x8* tmptile = map16array[slot >> 2]->GetTile8X8(slot & 3);
+            int oldid = tmptile->GetIndex();
+            int pal = tmptile->GetPaletteIndex();
+            bool xflip = tmptile->GetFlipX();
+            bool yflip = tmptile->GetFlipY();
+            if(oldid > tile8x8Id)
+            {
+                ResetTile8x8(slot >> 2, tile8x8array[oldid - 1], slot & 3, oldid - 1, pal, xflip, yflip);
             }
+            else
+            {
+                ResetTile8x8(slot >> 2, tile8x8array[0x40], slot & 3, 0x40, 0, false, false);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Replace a Tile8x8 in the Tile8x8 set, and refresh the Tile16s using it.
+    /// </summary>
+    /// <remarks>
+    /// The old Tile8x8 is not deleted here.
+    /// </remarks>
+    /// <param name="newtile">
+    /// The new Tile8x8.
+    /// </param>
+    /// <param name="tileId">
+    /// The id of the Tile8x8 to replace.
+    /// </param>
+    void Tileset::SetTile8x8(Tile8x8 *newtile, int tileId)
+    {
+        Version = RenderedLayerCache::NewVersion();
+        tile8x8array[tileId] = newtile;
+        QSet<unsigned short> slots = Tile8x8Users[tileId];
+        for(unsigned short slot : slots)
+        {
+            Tile8x8 *tmptile = map16array[slot >> 2]->GetTile8X8(slot & 3);
+            ResetTile8x8(slot >> 2, newtile, slot & 3, tileId, tmptile->GetPaletteIndex(), tmptile->GetFlipX(), tmptile->GetFlipY());
+        }
+    }
+
+    /// <summary>
+    /// Change one of the Tile8x8 in a Tile16 and keep the Tile8x8 and palette reverse index up to date.
+    /// </summary>
+    /// <remarks>
+    /// Always use this instead of TileMap16::ResetTile8x8 for the Tile16s of a Tileset.
+    /// </remarks>
+    /// <param name="tile16Id">
+    /// The id of the Tile16 to change.
+    /// </param>
+    /// <param name="other">
+    /// an Tile8x8 used as copy referance
+    /// </param>
+    /// <param name="position">
+    /// The position (TileMap16::TILE8_TOPLEFT : 0, TileMap16::TILE8_TOPLEFT : 1, TileMap16::TILE8_BOTTOMLEFT : 2, TileMap16::TILE8_BOTTOMRIGHT : 3)
+    /// </param>
+    /// <param name="new_index">
+    /// new index of tile8x8
+    /// </param>
+    /// <param name="new_paletteIndex">
+    /// set a new palette index
+    /// </param>
+    /// <param name="xflip">
+    /// set xflip bit
+    /// </param>
+    /// <param name="yflip">
+    /// set yflip bit
+    /// </param>
+    void Tileset::ResetTile8x8(int tile16Id, Tile8x8 *other, int position, int new_index, int new_paletteIndex, bool xflip, bool yflip)
+    {
+        Version = RenderedLayerCache::NewVersion();
+        unsigned short slot = (tile16Id << 2) | (position & 3);
+        Tile8x8 *oldtile = map16array[tile16Id]->GetTile8X8(position);
+        Tile8x8Users[oldtile->GetIndex() & 0x3FF].remove(slot);
+        PaletteUsers[oldtile->GetPaletteIndex() & 0xF].remove(slot);
+
+        map16array[tile16Id]->ResetTile8x8(other, position, new_index, new_paletteIndex, xflip, yflip);
+
+        Tile8x8Users[new_index & 0x3FF].insert(slot);
+        PaletteUsers[new_paletteIndex & 0xF].insert(slot);
+    }
+
+    /// <summary>
+    /// Build the Tile8x8 and palette reverse index from all the Tile16s.
+    /// </summary>
+    void Tileset::BuildMap16UserIndex()
+    {
+        Tile8x8Users = QVector<QSet<unsigned short>>(Tile8x8DefaultNum);
+        for (int i = 0; i < 16; ++i)
+        {
+            PaletteUsers[i].clear();
+        }
+        for (int i = 0; i < Tile16DefaultNum; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                Tile8x8 *tile = map16array[i]->GetTile8X8(j);
+                Tile8x8Users[tile->GetIndex() & 0x3FF].insert((i << 2) | j);
+                PaletteUsers[tile->GetPaletteIndex() & 0xF].insert((i << 2) | j);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Turn a set of Map16 slots from the reverse index into Tile16 ids.
+    /// </summary>
+    /// <returns>
+    /// The ids of the Tile16s, sorted and without duplicates.
+    /// </returns>
+    QVector<int> Tileset::SlotsToTile16Ids(const QSet<unsigned short> &slots)
+    {
+        QVector<int> result;
+        for (unsigned short slot : slots)
+        {
+            result.push_back(slot >> 2);
         }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
     }
 
     /// <summary>
@@ -5,8 +5,10 @@
 #define Tile16DefaultNum 0x300
 
 #include <QColor>
+#include <QSet>
 #include <QVector>
 
+#include "RenderedLayerCache.h"
 #include "Tile.h"
 
 namespace LevelComponents
@@ -26,9 +28,15 @@ namespace LevelComponents
         unsigned char *Map16TerrainTypeIDTable = nullptr;
         unsigned short *TilesetPaletteData = nullptr;
         bool hasconstructed = false;
-        bool newtileset = false;
+        unsigned int Version = RenderedLayerCache::NewVersion(); // changed by every modification of the graphics
         int paletteAddress, fgGFXptr, fgGFXlen, bgGFXptr, bgGFXlen, map16ptr;
 
+        // Reverse index of the Map16 slots (tile16 id * 4 + position) using each Tile8x8 id and each palette id
+        QVector<QSet<unsigned short>> Tile8x8Users;
+        QSet<unsigned short> PaletteUsers[16];
+        void BuildMap16UserIndex();
+        static QVector<int> SlotsToTile16Ids(const QSet<unsigned short> &slots);
+
     public:
         Tileset(int tilesetPtr, int __TilesetID, bool IsloadFromTmpROM = false);
         Tileset(Tileset *old_tileset, int __TilesetID);
@@ -38,12 +46,27 @@ namespace LevelComponents
         QVector<Tile8x8 *> GetTile8x8arrayPtr() { return tile8x8array; }
         QVector<TileMap16 *> GetMap16arrayPtr() { return map16array; }
         QVector<QRgb> *GetPalettes() { return palettes; }
-        void SetColor(int paletteId, int colorId, QRgb newcolor) { palettes[paletteId][colorId] = newcolor; }
-        void SetTile8x8(Tile8x8 *newtile, int tileId) { tile8x8array[tileId] = newtile; }
+        void SetColor(int paletteId, int colorId, QRgb newcolor)
+        {
+            palettes[paletteId][colorId] = newcolor;
+            Version = RenderedLayerCache::NewVersion();
+        }
+        unsigned int GetVersion() { return Version; }
+        void SetTile8x8(Tile8x8 *newtile, int tileId);
+        void ResetTile8x8(int tile16Id, Tile8x8 *other, int position, int new_index, int new_paletteIndex, bool xflip, bool yflip);
+        QVector<int> GetTile16sUsingTile8x8(int tileId) { return SlotsToTile16Ids(Tile8x8Users[tileId]); }
+        QVector<int> GetTile16sUsingPalette(int paletteId) { return SlotsToTile16Ids(PaletteUsers[paletteId]); }
+        bool IsTile8x8Used(int tileId) { return !Tile8x8Users[tileId].isEmpty(); }
+        bool IsPaletteUsed(int paletteId) { return !PaletteUsers[paletteId].isEmpty(); }
         ~Tileset();
         QPixmap RenderAllTile8x8(int paletteId);
         QPixmap RenderAllTile16(int columns);
         QPixmap RenderTile8x8(int tileId, int paletteId);
+        QImage RenderAllTile8x8Indexed(int paletteId);
+        QImage RenderAllTile16Indexed(int columns);
+        void DrawTile16Indexed(QImage *indexedImage, int tile16Id, int x, int y);
+        QVector<QRgb> GetTile8x8AtlasColorTable(int paletteId) { return Tile8x8::IndexedColorTable(palettes, paletteId, 1); }
+        QVector<QRgb> GetTile16AtlasColorTable() { return Tile8x8::IndexedColorTable(palettes, 0, 16); }
         int GetUniversalSpritesTilesPalettePtr() { return UniversalSpritesTilesPalettePtr; }
 
         unsigned char *GetTerrainTypeIDTablePtr() { return Map16TerrainTypeIDTable; }
@@ -65,8 +88,6 @@ namespace LevelComponents
         int GetPaletteAddr() { return paletteAddress; }
         void SetPaletteAddr(int new_paletteAddress) { paletteAddress = new_paletteAddress; }
         void ReGeneratePaletteData();
-        void SetChanged(bool changed) {newtileset = changed;}
-        bool IsNewTileset() {return newtileset; }
         Tile8x8 *GetblankTile() { return blankTile; }
 
         void DelTile8x8(int tile8x8Id);
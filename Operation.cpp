@@ -1,4 +1,5 @@
 ﻿#include "Operation.h"
+#include "ChangeJournal.h"
 #include "WL4EditorWindow.h"
 
 #include <deque>
@@ -143,6 +144,7 @@ void PerformOperation(struct OperationParams *operation)
         int roomnum = singleton->GetCurrentLevel()->GetRooms().size();
         int tilesetId = operation->newTilesetEditParams->currentTilesetIndex;
         ROMUtils::singletonTilesets[tilesetId] = operation->newTilesetEditParams->newTileset;
+        ChangeJournal::RecordChange(ChangeJournal::TilesetAsset, tilesetId);
         for(int i = 0; i < roomnum; ++i)
         {
             if(singleton->GetCurrentLevel()->GetRooms()[i]->GetTilesetID() == tilesetId)
@@ -160,7 +162,8 @@ void PerformOperation(struct OperationParams *operation)
             singleton->GetTile16DockWidgetPtr()->SetTileset(tilesetId);
             singleton->RenderScreenFull();
         }
-        singleton->SetUnsavedChanges(true);
+        singleton->GetRoomThumbnailCache()->Refresh(); // rooms of other levels may use the Tileset too
+        singleton->SetUnsavedChanges(true, false);
     }
     if (operation->SpritesSpritesetChange)
     {
@@ -168,10 +171,12 @@ void PerformOperation(struct OperationParams *operation)
         for (LevelComponents::Entity *entityIter: operation->newSpritesAndSetParam->entities)
         {
             ROMUtils::entities[entityIter->GetEntityGlobalID()] = entityIter;
+            ChangeJournal::RecordChange(ChangeJournal::EntityAsset, entityIter->GetEntityGlobalID());
         }
         for (LevelComponents::EntitySet *entitySetIter: operation->newSpritesAndSetParam->entitySets)
         {
             ROMUtils::entitiessets[entitySetIter->GetEntitySetId()] = entitySetIter;
+            ChangeJournal::RecordChange(ChangeJournal::EntitySetAsset, entitySetIter->GetEntitySetId());
         }
 
         // Update Rooms's Entities and Entitysets in CurrentLevel
@@ -184,7 +189,7 @@ void PerformOperation(struct OperationParams *operation)
 
         singleton->ResetEntitySetDockWidget();
         singleton->RenderScreenFull();
-        singleton->SetUnsavedChanges(true);
+        singleton->SetUnsavedChanges(true, false);
     }
     if (operation->AnimatedTileGroupChange)
     {
@@ -192,6 +197,7 @@ void PerformOperation(struct OperationParams *operation)
         for (LevelComponents::AnimatedTile8x8Group *&animatedTileGroupIter : operation->newAnimatedTileEditParam->animatedTileGroups)
         {
             ROMUtils::animatedTileGroups[animatedTileGroupIter->GetGlobalID()] = animatedTileGroupIter;
+            ChangeJournal::RecordChange(ChangeJournal::AnimatedTileGroupAsset, animatedTileGroupIter->GetGlobalID());
         }
 
         // Update all the Tilesets using the current ROMUtils::animatedTileGroups instances
@@ -202,7 +208,7 @@ void PerformOperation(struct OperationParams *operation)
 
         singleton->GetTile16DockWidgetPtr()->SetTileset(singleton->GetCurrentRoom()->GetTilesetID());
         singleton->RenderScreenFull();
-        singleton->SetUnsavedChanges(true);
+        singleton->SetUnsavedChanges(true, false);
     }
 }
 
@@ -337,6 +343,7 @@ void BackTrackOperation(struct OperationParams *operation)
         int roomnum = singleton->GetCurrentLevel()->GetRooms().size();
         int tilesetId = operation->lastTilesetEditParams->currentTilesetIndex;
         ROMUtils::singletonTilesets[tilesetId] = operation->lastTilesetEditParams->newTileset;
+        ChangeJournal::RecordChange(ChangeJournal::TilesetAsset, tilesetId);
         for(int i = 0; i < roomnum; ++i)
         {
             if(singleton->GetCurrentLevel()->GetRooms()[i]->GetTilesetID() == tilesetId)
@@ -354,6 +361,7 @@ void BackTrackOperation(struct OperationParams *operation)
             singleton->GetTile16DockWidgetPtr()->SetTileset(tilesetId);
             singleton->RenderScreenFull();
         }
+        singleton->GetRoomThumbnailCache()->Refresh();
         CurrentTilesetOperationId = operationIndexGlobal;
 
         // hint to show undo operation
@@ -365,10 +373,12 @@ void BackTrackOperation(struct OperationParams *operation)
         for (LevelComponents::Entity *entityIter: operation->lastSpritesAndSetParam->entities)
         {
             ROMUtils::entities[entityIter->GetEntityGlobalID()] = entityIter;
+            ChangeJournal::RecordChange(ChangeJournal::EntityAsset, entityIter->GetEntityGlobalID());
         }
         for (LevelComponents::EntitySet *entitySetIter: operation->lastSpritesAndSetParam->entitySets)
         {
             ROMUtils::entitiessets[entitySetIter->GetEntitySetId()] = entitySetIter;
+            ChangeJournal::RecordChange(ChangeJournal::EntitySetAsset, entitySetIter->GetEntitySetId());
         }
 
         // Update Rooms's Entities and Entitysets in CurrentLevel
@@ -381,7 +391,7 @@ void BackTrackOperation(struct OperationParams *operation)
 
         singleton->GetEntitySetDockWidgetPtr()->ResetEntitySet(singleton->GetCurrentRoom());
         singleton->RenderScreenFull();
-        singleton->SetUnsavedChanges(true);
+        singleton->SetUnsavedChanges(true, false);
         CurrentSpritestuffOperationId = operationIndexGlobal;
 
         // hint to show undo operation
@@ -393,6 +403,7 @@ void BackTrackOperation(struct OperationParams *operation)
         for (LevelComponents::AnimatedTile8x8Group *&animatedTileGroupIter : operation->lastAnimatedTileEditParam->animatedTileGroups)
         {
             ROMUtils::animatedTileGroups[animatedTileGroupIter->GetGlobalID()] = animatedTileGroupIter;
+            ChangeJournal::RecordChange(ChangeJournal::AnimatedTileGroupAsset, animatedTileGroupIter->GetGlobalID());
         }
 
         // Update all the Tilesets using the current ROMUtils::animatedTileGroups instances
@@ -403,7 +414,7 @@ void BackTrackOperation(struct OperationParams *operation)
 
         singleton->GetTile16DockWidgetPtr()->SetTileset(singleton->GetCurrentRoom()->GetTilesetID());
         singleton->RenderScreenFull();
-        singleton->SetUnsavedChanges(true);
+        singleton->SetUnsavedChanges(true, false);
         CurrentAnimatedTileGroupOperationId = operationIndexGlobal;
     }
 }
@@ -433,7 +444,7 @@ static void ExecuteOperationImpl(struct OperationParams *operation, std::deque<s
         operationHist.pop_front();
     }
     operationHist.push_front(operation);
-    singleton->SetUnsavedChanges(true);
+    singleton->SetUnsavedChanges(true, &operationHist != &operationHistoryGlobal);
 }
 
 /// <summary>
@@ -552,7 +563,7 @@ static void RedoOperationImpl(std::deque<struct OperationParams *> &operationHis
         PerformOperation(operationHist[--(*operationIdx)]);
 
         // Performing a "redo" will make unsaved changes
-        singleton->SetUnsavedChanges(true);
+        singleton->SetUnsavedChanges(true, &operationHist != &operationHistoryGlobal);
     }
     else
     {
@@ -721,68 +732,6 @@ void DeleteUndoHistoryGlobal()
     CurrentAnimatedTileGroupOperationId = 0;
 }
 
-/// <summary>
-/// Reset all the changes bools can be found through the whole history
-/// </summary>
-/// <remarks>
-/// Sometimes the history saved the vanilla elements' data and we make some changes to it and save changes
-/// now the current changed bool of the element is false and the first corresponding element in the history is false too
-/// all the others corresponding elements' changed bools are true
-/// usual undo and redo won't cause problems, but on the second or the third save
-/// when the current element are marked unchanged, the save process cannot detect it.
-/// So we have to always make it that only the current element changed bool to be false, and all the others be true.
-/// call this function every time when finishing saving level
-/// </remarks>
-void ResetChangedBoolsThroughHistory()
-{
-    for (unsigned int j = 0; j < operationHistoryGlobal.size(); ++j) // from old to new
-    {
-        // no need to exclude the current elements, they will be set changed bool to false in the SaveLevel function
-        // so call this function before that part
-        if (operationHistoryGlobal[j]->TilesetChange)
-        {
-            operationHistoryGlobal[j]->newTilesetEditParams->newTileset->SetChanged(true);
-            operationHistoryGlobal[j]->lastTilesetEditParams->newTileset->SetChanged(true);
-        }
-        else if (operationHistoryGlobal[j]->SpritesSpritesetChange)
-        {
-            if (operationHistoryGlobal[j]->newSpritesAndSetParam)
-            {
-                for (LevelComponents::Entity *entityIter: operationHistoryGlobal[j]->newSpritesAndSetParam->entities)
-                {
-                    entityIter->SetChanged(true);
-                }
-                for (LevelComponents::EntitySet *entitySetIter: operationHistoryGlobal[j]->newSpritesAndSetParam->entitySets)
-                {
-                    entitySetIter->SetChanged(true);
-                }
-            }
-            if (operationHistoryGlobal[j]->lastSpritesAndSetParam)
-            {
-                for (LevelComponents::Entity *entityIter: operationHistoryGlobal[j]->lastSpritesAndSetParam->entities)
-                {
-                    entityIter->SetChanged(true);
-                }
-                for (LevelComponents::EntitySet *entitySetIter: operationHistoryGlobal[j]->lastSpritesAndSetParam->entitySets)
-                {
-                    entitySetIter->SetChanged(true);
-                }
-            }
-        }
-        else if (operationHistoryGlobal[j]->AnimatedTileGroupChange)
-        {
-            for (LevelComponents::AnimatedTile8x8Group *&animtedTileGroupIter: operationHistoryGlobal[j]->lastAnimatedTileEditParam->animatedTileGroups)
-            {
-                animtedTileGroupIter->SetChanged(true);
-            }
-            for (LevelComponents::AnimatedTile8x8Group *&animtedTileGroupIter: operationHistoryGlobal[j]->newAnimatedTileEditParam->animatedTileGroups)
-            {
-                animtedTileGroupIter->SetChanged(true);
-            }
-        }
-    }
-}
-
 /// <summary>
 /// Reset all the global elements operation indexes
 /// </summary>
@@ -183,7 +183,6 @@ void RedoOperationGlobal();
 void ResetUndoHistory();
 void ResetRoomUndoHistory(int currentRoomId);
 void DeleteUndoHistoryGlobal();
-void ResetChangedBoolsThroughHistory();
 void ResetGlobalElementOperationIndexes();
 
 
@@ -1,12 +1,22 @@
 #include "PatchUtils.h"
 #include "ROMUtils.h"
 #include "FileIOUtils.h"
+#include "ProfilingUtils.h"
 #include <QVector>
 #include <QDir>
 #include <QFile>
 #include <SettingsUtils.h>
 #include <QProcess>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QSet>
+#include <QThread>
+#include <atomic>
 #include <cstring>
+#include <thread>
+#include <vector>
 #include "WL4EditorWindow.h"
 
 #define PATCH_CHUNK_VERSION 0
@@ -37,9 +47,31 @@ struct CompileEntry {
     enum PatchType Type;
 };
 
+// Result of compiling a single patch entry on a worker thread
+struct CompileResult {
+    QString Output;
+    qint64 ElapsedMs = 0;
+    bool CacheHit = false;
+};
+
+// Flags passed to the toolchain. These are also hashed into the compile cache key,
+// so changing them invalidates every cached artifact.
+static const QStringList GCCFlags = {
+    "-MMD", "-MP", "-MF", "-g", "-Wall", "-mcpu=arm7tdmi", "-mtune=arm7tdmi",
+    "-fomit-frame-pointer", "-ffast-math", "-mthumb", "-mthumb-interwork", "-O2",
+    "-mlong-calls", "-S"
+};
+static const QStringList ASFlags = { "-mthumb" };
+
+#define PATCH_CACHE_DIR "patch_cache"
+#define PATCH_CACHE_MAX_AGE_DAYS 30
+#define PATCH_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
 extern WL4EditorWindow *singleton;
 
 static QRegularExpression entryFunctionSymbolRegex("^\\s*[a-zA-Z\\_]{1}[0-9a-zA-Z\\_]*\\s*$");
+static const QRegularExpression quotedIncludeRegex("^\\s*[#.]\\s*include\\s*\"([^\"]+)\"",
+                                                   QRegularExpression::MultilineOption);
 #define ENTRY_FUNCTION_SYMBOL "@EntryFunctionSymbol"
 
 /// <summary>
@@ -243,19 +275,16 @@ static QString CompileCFile(QString cfile)
 {
     if(!cfile.endsWith(".c"))
     {
-        QString msg = QString(QT_TR_NOOP("C file does not have correct extension (should be .c): ")) + cfile;
-        singleton->GetOutputWidgetPtr()->PrintString(msg);
-        return msg;
+        // This runs on a compile worker thread, so the caller reports the message
+        return QString(QT_TR_NOOP("C file does not have correct extension (should be .c): ")) + cfile;
     }
 
     // Create args
     QString outfile(cfile);
     REPLACE_EXT(outfile, ".c", ".s");
     QString executable(QString(PatchUtils::EABI_INSTALLATION) + "/" + EABI_GCC);
-    QStringList args;
-    args << "-MMD" << "-MP" << "-MF" << "-g" << "-Wall" << "-mcpu=arm7tdmi" << "-mtune=arm7tdmi" <<
-        "-fomit-frame-pointer" << "-ffast-math" << "-mthumb" << "-mthumb-interwork" << "-O2" <<
-        "-mlong-calls" << "-S" << cfile << "-o" << outfile;
+    QStringList args(GCCFlags);
+    args << cfile << "-o" << outfile;
 
     // Run GCC
     return RunProcess(executable, args);
@@ -274,17 +303,16 @@ static QString AssembleSFile(QString sfile)
 {
     if(!sfile.endsWith(".s"))
     {
-        QString msg = QString(QT_TR_NOOP("ASM file does not have correct extension (should be .s): ")) + sfile;
-        singleton->GetOutputWidgetPtr()->PrintString(msg);
-        return msg;
+        // This runs on a compile worker thread, so the caller reports the message
+        return QString(QT_TR_NOOP("ASM file does not have correct extension (should be .s): ")) + sfile;
     }
 
     // Create args
     QString outfile(sfile);
     REPLACE_EXT(outfile, ".s", ".o");
     QString executable(QString(PatchUtils::EABI_INSTALLATION) + "/" + EABI_AS);
-    QStringList args;
-    args << "-mthumb" << sfile << "-o" << outfile;
+    QStringList args(ASFlags);
+    args << sfile << "-o" << outfile;
 
     // Run AS
     return RunProcess(executable, args);
@@ -465,21 +493,222 @@ static QString CreatePatchListChunkData(QVector<struct PatchEntryItem> &entries)
     return contents;
 }
 
+/// <summary>
+/// Add the contents of a source file and the files it includes with quoted includes to a hash.
+/// </summary>
+/// <remarks>
+/// Only the contents and the include names as written go into the hash, so moving a project does not change it.
+/// </remarks>
+/// <param name="hash">
+/// The hash to add the file contents to.
+/// </param>
+/// <param name="filePath">
+/// The absolute path of the source file.
+/// </param>
+/// <param name="visited">
+/// Files which have already been hashed, used to break include cycles.
+/// </param>
+static void HashSourceFile(QCryptographicHash &hash, QString filePath, QSet<QString> &visited)
+{
+    if(visited.contains(filePath)) return;
+    visited.insert(filePath);
+
+    QFile file(filePath);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        // Missing include paths are resolved by the toolchain, the include name is already in the key
+        hash.addData("missing", 7);
+        return;
+    }
+    QByteArray contents = file.readAll();
+    file.close();
+    hash.addData(QByteArray::number(contents.size()));
+    hash.addData(contents);
+
+    QDir dir = QFileInfo(filePath).dir();
+    QRegularExpressionMatchIterator iter = quotedIncludeRegex.globalMatch(QString::fromUtf8(contents));
+    while(iter.hasNext())
+    {
+        QString include = iter.next().captured(1);
+        hash.addData(include.toUtf8());
+        HashSourceFile(hash, QDir::cleanPath(dir.absoluteFilePath(include)), visited);
+    }
+}
+
+/// <summary>
+/// Get the version banners of the compiler and the assembler.
+/// </summary>
+/// <remarks>
+/// The toolchain only runs once per installation path during a session.
+/// </remarks>
+/// <returns>
+/// The output of --version of both tools.
+/// </returns>
+static QString GetToolchainVersion()
+{
+    static QString versionInstallation, version;
+    if(version.isEmpty() || versionInstallation != PatchUtils::EABI_INSTALLATION)
+    {
+        version.clear();
+        for(const char *tool : {EABI_GCC, EABI_AS})
+        {
+            QProcess process;
+            process.start(QString(PatchUtils::EABI_INSTALLATION) + "/" + tool, QStringList("--version"));
+            process.waitForFinished();
+            version += QString(process.readAllStandardOutput());
+        }
+        versionInstallation = PatchUtils::EABI_INSTALLATION;
+    }
+    return version;
+}
+
+/// <summary>
+/// Get the compile cache key of a patch source file.
+/// </summary>
+/// <remarks>
+/// The key covers the contents of the source and its quoted includes, the toolchain version and the toolchain flags.
+/// </remarks>
+/// <param name="type">
+/// The type of the patch entry.
+/// </param>
+/// <param name="filename">
+/// The absolute path of the patch source file.
+/// </param>
+/// <param name="toolchainVersion">
+/// The result of GetToolchainVersion.
+/// </param>
+/// <returns>
+/// The hex string of the cache key.
+/// </returns>
+static QString GetCompileCacheKey(enum PatchType type, QString filename, QString toolchainVersion)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(toolchainVersion.toUtf8());
+    hash.addData(QByteArray::number(static_cast<int>(type)));
+    if(type != PatchType::Assembly)
+    {
+        hash.addData(GCCFlags.join(' ').toUtf8());
+    }
+    hash.addData(ASFlags.join(' ').toUtf8());
+    QSet<QString> visited;
+    HashSourceFile(hash, filename, visited);
+    return QString(hash.result().toHex());
+}
+
+/// <summary>
+/// Copy the artifacts of a patch entry between the cache and the patch source directory.
+/// </summary>
+/// <remarks>
+/// Every file is written to a temporary file which is then renamed over the destination, so a concurrent
+/// compile never sees a partly written artifact.
+/// </remarks>
+/// <param name="from">
+/// The list of files to copy from.
+/// </param>
+/// <param name="to">
+/// The list of files to copy to, which are overwritten if they exist.
+/// </param>
+/// <returns>
+/// True if all the files were copied.
+/// </returns>
+static bool CopyCompileArtifacts(const QStringList &from, const QStringList &to)
+{
+    for(int i = 0; i < from.size(); ++i)
+    {
+        if(!QFile::exists(from[i])) return false;
+    }
+    for(int i = 0; i < from.size(); ++i)
+    {
+        QFile source(from[i]);
+        QSaveFile destination(to[i]);
+        if(!source.open(QIODevice::ReadOnly) || !destination.open(QIODevice::WriteOnly)) return false;
+        if(destination.write(source.readAll()) != source.size() || !destination.commit()) return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Remove the compile cache artifacts which were not used for a while, then the least recently used ones
+/// until the cache fits its size cap.
+/// </summary>
+/// <remarks>
+/// Artifacts are touched on every cache hit, so their modification time is the time they were last used.
+/// </remarks>
+/// <param name="cacheDir">
+/// The compile cache directory.
+/// </param>
+static void PruneCompileCache(QString cacheDir)
+{
+    QFileInfoList files = QDir(cacheDir).entryInfoList(QDir::Files, QDir::Time); // newest first
+    QDateTime oldest = QDateTime::currentDateTime().addDays(-PATCH_CACHE_MAX_AGE_DAYS);
+    qint64 totalSize = 0;
+    for(const QFileInfo &file : files)
+    {
+        if(file.lastModified() < oldest || totalSize + file.size() > PATCH_CACHE_MAX_SIZE)
+        {
+            QFile::remove(file.absoluteFilePath());
+            continue;
+        }
+        totalSize += file.size();
+    }
+}
+
 /// <summary>
 /// Compile a patch entry file
 /// </summary>
+/// <remarks>
+/// This function is run on the compile worker threads, so it must not touch any UI.
+/// </remarks>
 /// <param name="entry">
 /// The patch entry to compile.
 /// </param>
+/// <param name="cacheDir">
+/// The compile cache directory, or empty to always compile.
+/// </param>
+/// <param name="toolchainVersion">
+/// The result of GetToolchainVersion, part of the cache key.
+/// </param>
+/// <param name="cacheHit">
+/// Set to true if the artifacts were taken from the compile cache.
+/// </param>
 /// <returns>
 /// The error string if compilation failed, or empty if successful.
 /// </returns>
-static QString CompilePatchEntry(const struct PatchEntryItem &entry)
+static QString CompilePatchEntry(const struct PatchEntryItem &entry, QString cacheDir, QString toolchainVersion, bool *cacheHit)
 {
+    *cacheHit = false;
     if(entry.PatchType == PatchType::Binary) return "";
     QString filename = FileIOUtils::RelativeFilePathToAbsoluteFilePath(entry.FileName);
     if (!filename.size()) return "";
 
+    // Figure out which artifacts this entry produces next to its source file
+    const char *sourceExt = entry.PatchType == PatchType::Assembly ? ".s" : ".c";
+    QStringList artifacts, cachedArtifacts;
+    if(cacheDir.size() && filename.endsWith(sourceExt))
+    {
+        QString base(filename);
+        base.chop(strlen(sourceExt));
+        QString cacheBase = cacheDir + GetCompileCacheKey(entry.PatchType, filename, toolchainVersion);
+        if(entry.PatchType != PatchType::Assembly)
+        {
+            artifacts << base + ".s";
+            cachedArtifacts << cacheBase + ".s";
+        }
+        artifacts << base + ".o";
+        cachedArtifacts << cacheBase + ".o";
+
+        if(CopyCompileArtifacts(cachedArtifacts, artifacts))
+        {
+            // Keep the artifacts from being pruned as unused
+            for(const QString &cachedArtifact : cachedArtifacts)
+            {
+                QFile(cachedArtifact).setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+            }
+            *cacheHit = true;
+            return "";
+        }
+    }
+
     QString output;
     switch(entry.PatchType)
     {
@@ -498,6 +727,12 @@ static QString CompilePatchEntry(const struct PatchEntryItem &entry)
         break;
     default:;
     }
+
+    // A failure to populate the cache only means this entry is compiled again next time
+    if(artifacts.size())
+    {
+        CopyCompileArtifacts(artifacts, cachedArtifacts);
+    }
     return ""; // success
 }
 
@@ -552,23 +787,76 @@ static QString LinkAndExtractEntry(const struct PatchEntryItem &entry,
 /// <summary>
 /// Compile files in a list of patches to save to the ROM.
 /// </summary>
+/// <remarks>
+/// Entries are compiled concurrently on up to QThread::idealThreadCount() threads.
+/// Object files of unchanged sources are restored from the compile cache next to the ROM, which is pruned
+/// to PATCH_CACHE_MAX_SIZE bytes of artifacts used in the last PATCH_CACHE_MAX_AGE_DAYS days.
+/// </remarks>
 /// <param name="entries">
 /// The patch entries to compile.
 /// </param>
 /// <returns>
-/// The error string if compilation failed, or empty if successful.
+/// The error string of the first failed entry in list order, or empty if successful.
 /// </returns>
 static QString CompilePatchEntries(QVector<struct PatchEntryItem> &entries)
 {
+    const QVector<struct PatchEntryItem> &constEntries = entries;
+    int entryCount = constEntries.size();
+    if(!entryCount) return "";
+
+    QString cacheDir = QFileInfo(ROMUtils::ROMFileMetadata->FilePath).dir().path() + "/" PATCH_CACHE_DIR "/";
+    if(!QDir().mkpath(cacheDir))
+    {
+        singleton->GetOutputWidgetPtr()->PrintString(QT_TR_NOOP("Cannot create patch cache folder, compiling without cache."));
+        cacheDir = "";
+    }
+    QString toolchainVersion = cacheDir.size() ? GetToolchainVersion() : QString();
+
+    // Each worker pulls the next uncompiled entry until the list is exhausted
+    std::vector<struct CompileResult> results(entryCount);
+    std::atomic<int> nextEntry(0);
+    auto compileWorker = [&]() {
+        int i;
+        while((i = nextEntry++) < entryCount)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            results[i].Output = CompilePatchEntry(constEntries[i], cacheDir, toolchainVersion, &results[i].CacheHit);
+            results[i].ElapsedMs = timer.elapsed();
+        }
+    };
+    int threadCount = qBound(1, QThread::idealThreadCount(), entryCount);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(compileWorker);
+    }
+    for(std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    if(cacheDir.size())
+    {
+        PruneCompileCache(cacheDir);
+    }
+
+    // Report timings from the UI thread
     QString output;
-    for(const struct PatchEntryItem &entry : entries)
+    for(int i = 0; i < entryCount; ++i)
     {
-        if((output = CompilePatchEntry(entry)) != "")
+        const struct PatchEntryItem &entry = constEntries[i];
+        if(entry.PatchType == PatchType::Binary || !entry.FileName.size()) continue;
+        if(results[i].Output != "")
         {
-            return output;
+            singleton->GetOutputWidgetPtr()->PrintString(results[i].Output);
+            if(output == "") output = results[i].Output;
+            continue;
         }
+        singleton->GetOutputWidgetPtr()->PrintString(
+            QString(results[i].CacheHit ? QT_TR_NOOP("Patch up to date: %1 (%2 ms)") : QT_TR_NOOP("Patch compiled: %1 (%2 ms)"))
+                .arg(entry.FileName).arg(results[i].ElapsedMs));
     }
-    return "";
+    return output;
 }
 
 /// <summary>
@@ -681,6 +969,7 @@ namespace PatchUtils
     /// </returns>
     QString SavePatchesToROM(QVector<PatchEntryItem> entries)
     {
+        PROFILE_SCOPE("PatchUtils::SavePatchesToROM");
         QString compileErrorMsg = CompilePatchEntries(entries);
         if(compileErrorMsg != "") return compileErrorMsg;
 
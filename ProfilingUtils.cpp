@@ -0,0 +1,199 @@
+#include "ProfilingUtils.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+
+namespace ProfilingUtils
+{
+    struct TimerStats
+    {
+        qint64 Calls = 0;
+        qint64 TotalNs = 0;
+        qint64 MaxNs = 0;
+    };
+
+    struct TraceEvent
+    {
+        const char *Name;
+        qint64 StartNs;
+        qint64 DurationNs;
+        int ThreadId;
+    };
+
+    // Old trace events are dropped after this many, the aggregated timings keep counting
+    static const int MaxTraceEvents = 100000;
+
+    static QMutex Mutex;
+    static QElapsedTimer Clock;
+    static QHash<QString, struct TimerStats> Timers;
+    static QHash<QString, qint64> Counters;
+    static QVector<struct TraceEvent> TraceEvents;
+    static QHash<Qt::HANDLE, int> ThreadIds;
+
+    /// <summary>
+    /// Get the nanoseconds elapsed since the first profiled event.
+    /// </summary>
+    static qint64 Now()
+    {
+        QMutexLocker locker(&Mutex);
+        if (!Clock.isValid())
+        {
+            Clock.start();
+        }
+        return Clock.nsecsElapsed();
+    }
+
+    /// <summary>
+    /// Start timing a scope.
+    /// </summary>
+    /// <param name="name">
+    /// The name the time is recorded under. It must be a string literal, it is kept for the trace events.
+    /// </param>
+    ScopedTimer::ScopedTimer(const char *name) : Name(name), StartNs(Now()) {}
+
+    /// <summary>
+    /// Record the time spent in the scope.
+    /// </summary>
+    ScopedTimer::~ScopedTimer()
+    {
+        qint64 duration = Now() - StartNs;
+        QMutexLocker locker(&Mutex);
+        struct TimerStats &stats = Timers[Name];
+        stats.Calls++;
+        stats.TotalNs += duration;
+        stats.MaxNs = qMax(stats.MaxNs, duration);
+
+        // Number the threads in the order they are first seen, to keep the trace readable
+        Qt::HANDLE thread = QThread::currentThreadId();
+        if (!ThreadIds.contains(thread))
+        {
+            ThreadIds[thread] = ThreadIds.size() + 1;
+        }
+        if (TraceEvents.size() >= MaxTraceEvents)
+        {
+            TraceEvents.remove(0, MaxTraceEvents / 2);
+        }
+        TraceEvents.append({Name, StartNs, duration, ThreadIds[thread]});
+    }
+
+    /// <summary>
+    /// Check if the profiling macros were compiled in.
+    /// </summary>
+    bool IsEnabled()
+    {
+#ifdef WL4EDITOR_PROFILING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// Add a value to a named counter.
+    /// </summary>
+    /// <param name="name">
+    /// The name of the counter.
+    /// </param>
+    /// <param name="value">
+    /// The value to add.
+    /// </param>
+    void AddCount(const char *name, qint64 value)
+    {
+        QMutexLocker locker(&Mutex);
+        Counters[name] += value;
+    }
+
+    /// <summary>
+    /// Clear all the recorded timings, counters and trace events.
+    /// </summary>
+    void Reset()
+    {
+        QMutexLocker locker(&Mutex);
+        Timers.clear();
+        Counters.clear();
+        TraceEvents.clear();
+        ThreadIds.clear();
+        Clock.invalidate();
+    }
+
+    /// <summary>
+    /// Summarize the recorded timings and counters as text.
+    /// </summary>
+    /// <return>One line per timer, sorted by total time, followed by one line per counter.</return>
+    QString GetReport()
+    {
+        if (!IsEnabled())
+        {
+            return QT_TR_NOOP("Profiling is disabled in this build.");
+        }
+        QMutexLocker locker(&Mutex);
+        QStringList names = Timers.keys();
+        std::sort(names.begin(), names.end(), [](const QString &a, const QString &b) {
+            return Timers[a].TotalNs > Timers[b].TotalNs;
+        });
+        QString report = QString("%1 %2 %3 %4\n").arg(QString("Timer"), -32).arg(QString("Calls"), 8).arg(QString("Total ms"), 12).arg(QString("Max ms"), 12);
+        for (const QString &name : names)
+        {
+            const struct TimerStats &stats = Timers[name];
+            report += QString("%1 %2 %3 %4\n").arg(name, -32).arg(stats.Calls, 8)
+                          .arg(stats.TotalNs / 1e6, 12, 'f', 3).arg(stats.MaxNs / 1e6, 12, 'f', 3);
+        }
+        QStringList counterNames = Counters.keys();
+        std::sort(counterNames.begin(), counterNames.end());
+        report += QString("\n%1 %2\n").arg(QString("Counter"), -32).arg(QString("Total"), 12);
+        for (const QString &name : counterNames)
+        {
+            report += QString("%1 %2\n").arg(name, -32).arg(Counters[name], 12);
+        }
+        return report;
+    }
+
+    /// <summary>
+    /// Export the recorded trace events in the Chrome trace event format.
+    /// </summary>
+    /// <remarks>
+    /// The result can be opened with chrome://tracing or Perfetto. Counters are added as counter events at the end.
+    /// </remarks>
+    /// <return>The trace as a JSON document.</return>
+    QByteArray GetChromeTrace()
+    {
+        QMutexLocker locker(&Mutex);
+        QJsonArray events;
+        qint64 lastNs = 0;
+        for (const struct TraceEvent &traceEvent : TraceEvents)
+        {
+            QJsonObject event;
+            event["name"] = traceEvent.Name;
+            event["ph"] = "X";
+            event["ts"] = traceEvent.StartNs / 1e3;
+            event["dur"] = traceEvent.DurationNs / 1e3;
+            event["pid"] = 1;
+            event["tid"] = traceEvent.ThreadId;
+            events << event;
+            lastNs = qMax(lastNs, traceEvent.StartNs + traceEvent.DurationNs);
+        }
+        for (auto iter = Counters.constBegin(); iter != Counters.constEnd(); ++iter)
+        {
+            QJsonObject event;
+            QJsonObject args;
+            args["value"] = static_cast<double>(iter.value());
+            event["name"] = iter.key();
+            event["ph"] = "C";
+            event["ts"] = lastNs / 1e3;
+            event["pid"] = 1;
+            event["args"] = args;
+            events << event;
+        }
+        QJsonObject trace;
+        trace["traceEvents"] = events;
+        return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+    }
+}
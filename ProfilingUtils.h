@@ -0,0 +1,40 @@
+#ifndef PROFILINGUTILS_H
+#define PROFILINGUTILS_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+// Scoped timers and counters around the editor's slow paths.
+// Remove WL4EDITOR_PROFILING from DEFINES in WL4Editor.pro to compile all of them out.
+#ifdef WL4EDITOR_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfilingUtils::ScopedTimer PROFILE_CONCAT(profileScopedTimer, __LINE__)(name)
+#define PROFILE_COUNT(name, value) ProfilingUtils::AddCount(name, value)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, value)
+#endif
+
+namespace ProfilingUtils
+{
+    // Records the time between its construction and destruction under a name
+    class ScopedTimer
+    {
+    private:
+        const char *Name;
+        qint64 StartNs;
+
+    public:
+        ScopedTimer(const char *name);
+        ~ScopedTimer();
+    };
+
+    bool IsEnabled();
+    void AddCount(const char *name, qint64 value);
+    void Reset();
+    QString GetReport();
+    QByteArray GetChromeTrace();
+}
+
+#endif // PROFILINGUTILS_H
@@ -0,0 +1,430 @@
+#include "ROMReferenceIndex.h"
+#include "ROMUtils.h"
+#include "WL4Constants.h"
+
+#include <QHash>
+#include <QMultiHash>
+#include <QSet>
+#include <map>
+#include <vector>
+
+namespace ROMReferenceIndex
+{
+    typedef std::multimap<unsigned int, struct Reference> ReferenceMap;
+
+    // All the references in the ROM, ordered by the address they point at
+    static ReferenceMap ReferencesByTarget;
+
+    // The references created by each owner, so an owner can be rescanned on its own
+    static QHash<quint64, std::vector<ReferenceMap::iterator>> ReferencesByOwner;
+
+    // The owners of each pointer location, used to find the owners affected by a save
+    static QMultiHash<unsigned int, quint64> OwnersByPointerAddress;
+
+    // The ROM data the index was built from
+    static const unsigned char *IndexedROMDataPtr = nullptr;
+    static unsigned int IndexedROMLength = 0;
+    static bool IndexValid = false;
+
+    /// <summary>
+    /// Get the key identifying an owner of references.
+    /// </summary>
+    static quint64 OwnerKey(enum ReferenceOwnerType ownerType, int ownerId)
+    {
+        return (static_cast<quint64>(ownerType) << 32) | static_cast<unsigned int>(ownerId);
+    }
+
+    /// <summary>
+    /// Read a pointer from the ROM without going through ROMUtils::PointerFromData.
+    /// </summary>
+    /// <remarks>
+    /// Malformed pointers are skipped silently, since the index scans every table in the ROM.
+    /// </remarks>
+    /// <param name="pointerAddress">
+    /// The address of the pointer in the ROM.
+    /// </param>
+    /// <param name="target">
+    /// Output of the address being pointed at.
+    /// </param>
+    /// <returns>
+    /// True if the pointer is a valid ROM pointer.
+    /// </returns>
+    static bool ReadPointer(unsigned int pointerAddress, unsigned int *target)
+    {
+        unsigned int length = ROMUtils::ROMFileMetadata->Length;
+        if (pointerAddress + 4 > length) return false;
+        unsigned int value = *reinterpret_cast<unsigned int *>(ROMUtils::ROMFileMetadata->ROMDataPtr + pointerAddress);
+        if ((value & 0xF8000000) != 0x8000000) return false;
+        value &= 0x7FFFFFF;
+        if (value >= length) return false;
+        *target = value;
+        return true;
+    }
+
+    /// <summary>
+    /// Read a pointer from the ROM and add it to the index if it is valid.
+    /// </summary>
+    /// <returns>
+    /// True if the pointer was added.
+    /// </returns>
+    static bool AddReference(unsigned int pointerAddress, enum ReferenceType type, enum ReferenceOwnerType ownerType,
+                             int ownerId, int roomId = -1, int subId = -1, unsigned int info = 0)
+    {
+        struct Reference reference;
+        if (!ReadPointer(pointerAddress, &reference.TargetAddress)) return false;
+        reference.PointerAddress = pointerAddress;
+        reference.Type = type;
+        reference.OwnerType = ownerType;
+        reference.OwnerId = ownerId;
+        reference.RoomId = roomId;
+        reference.SubId = subId;
+        reference.Info = info;
+
+        quint64 key = OwnerKey(ownerType, ownerId);
+        ReferencesByOwner[key].push_back(ReferencesByTarget.insert({reference.TargetAddress, reference}));
+        if (!OwnersByPointerAddress.contains(pointerAddress, key))
+        {
+            OwnersByPointerAddress.insert(pointerAddress, key);
+        }
+        return true;
+    }
+
+    /// <summary>
+    /// Remove all the references created by an owner.
+    /// </summary>
+    static void RemoveOwner(quint64 key)
+    {
+        auto owner = ReferencesByOwner.find(key);
+        if (owner == ReferencesByOwner.end()) return;
+        for (ReferenceMap::iterator &iter : owner.value())
+        {
+            OwnersByPointerAddress.remove(iter->second.PointerAddress, key);
+            ReferencesByTarget.erase(iter);
+        }
+        ReferencesByOwner.erase(owner);
+    }
+
+    /// <summary>
+    /// Index the tables of a level: room headers, doors, camera control records and level names.
+    /// </summary>
+    /// <param name="levelId">
+    /// The level id, used as the index of the level in the room data table.
+    /// </param>
+    static void ScanLevel(int levelId)
+    {
+        unsigned char *ROMData = ROMUtils::ROMFileMetadata->ROMDataPtr;
+        unsigned int length = ROMUtils::ROMFileMetadata->Length;
+        bool tablesScanned = false;
+        for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
+        {
+            unsigned int levelOffset = WL4Constants::VanillaLevelPassages[i] * 24 + WL4Constants::VanillaLevelStages[i] * 4;
+            unsigned int levelHeaderIndex = ROMUtils::IntFromData(WL4Constants::LevelHeaderIndexTable + levelOffset);
+            unsigned int levelHeaderPointer = WL4Constants::LevelHeaderTable + levelHeaderIndex * 12;
+            if (levelHeaderPointer + 12 > length || ROMData[levelHeaderPointer] != levelId) continue;
+            AddReference(WL4Constants::LevelNamePointerTable + levelOffset, LevelName, LevelOwner, levelId);
+            AddReference(WL4Constants::LevelNameJPointerTable + levelOffset, LevelNameJ, LevelOwner, levelId);
+            if (tablesScanned) continue;
+            tablesScanned = true;
+
+            // Room headers
+            unsigned int roomTableAddress;
+            if (!AddReference(WL4Constants::RoomDataTable + levelId * 4, LevelRoomHeaderTable, LevelOwner, levelId)) continue;
+            ReadPointer(WL4Constants::RoomDataTable + levelId * 4, &roomTableAddress);
+            int roomCount = ROMData[levelHeaderPointer + 1];
+            for (int roomId = 0; roomId < roomCount; ++roomId)
+            {
+                unsigned int roomHeaderAddress = roomTableAddress + roomId * 0x2C;
+                if (roomHeaderAddress + 0x2C > length) break;
+                for (int layerId = 0; layerId < 4; ++layerId)
+                {
+                    unsigned int mappingType = ROMData[roomHeaderAddress + layerId + 1] & 0x30;
+                    if (!mappingType) continue;
+                    AddReference(roomHeaderAddress + 8 + layerId * 4, RoomLayerData, LevelOwner, levelId, roomId, layerId, mappingType);
+                }
+                for (int difficulty = 0; difficulty < 3; ++difficulty)
+                {
+                    AddReference(roomHeaderAddress + 28 + difficulty * 4, RoomEntityList, LevelOwner, levelId, roomId, difficulty);
+                }
+            }
+
+            // Doors and camera control records
+            AddReference(WL4Constants::DoorTable + levelId * 4, LevelDoorTable, LevelOwner, levelId);
+            unsigned int cameraPointerTable;
+            if (AddReference(WL4Constants::CameraControlPointerTable + levelId * 4, LevelCameraPointerTable, LevelOwner, levelId) &&
+                ReadPointer(WL4Constants::CameraControlPointerTable + levelId * 4, &cameraPointerTable))
+            {
+                for (int j = 0; j < 16; ++j)
+                {
+                    unsigned int record;
+                    if (!ReadPointer(cameraPointerTable + j * 4, &record) || record == WL4Constants::CameraRecordSentinel) break;
+                    AddReference(cameraPointerTable + j * 4, LevelCameraRecord, LevelOwner, levelId, ROMData[record]);
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Index the data pointers in a tileset's entry in the tileset data table.
+    /// </summary>
+    static void ScanTileset(int tilesetId)
+    {
+        unsigned int tilesetPtr = WL4Constants::TilesetDataTable + tilesetId * 36;
+        AddReference(tilesetPtr, TilesetFGTile8x8Data, TilesetOwner, tilesetId);
+        AddReference(tilesetPtr + 8, TilesetPalette, TilesetOwner, tilesetId);
+        AddReference(tilesetPtr + 12, TilesetBGTile8x8Data, TilesetOwner, tilesetId);
+        AddReference(tilesetPtr + 20, TilesetMap16Data, TilesetOwner, tilesetId);
+        AddReference(tilesetPtr + 24, TilesetMap16TerrainType, TilesetOwner, tilesetId);
+        AddReference(tilesetPtr + 28, TilesetMap16EventTable, TilesetOwner, tilesetId);
+    }
+
+    /// <summary>
+    /// Index the data pointers of an entity. Only entities from 0x11 have their own graphics.
+    /// </summary>
+    static void ScanEntity(int entityGlobalId)
+    {
+        if (entityGlobalId < 0x11) return;
+        AddReference(WL4Constants::EntityTilesetPointerTable + 4 * (entityGlobalId - 0x10), EntityTile8x8Data, EntityOwner, entityGlobalId);
+        AddReference(WL4Constants::EntityPalettePointerTable + 4 * (entityGlobalId - 0x10), EntityPalette, EntityOwner, entityGlobalId);
+    }
+
+    /// <summary>
+    /// Index the info table pointer of an entity set.
+    /// </summary>
+    static void ScanEntitySet(int entitySetId)
+    {
+        AddReference(WL4Constants::EntitySetInfoPointerTable + entitySetId * 4, EntitySetInfoTable, EntitySetOwner, entitySetId);
+    }
+
+    /// <summary>
+    /// Index the tile data pointer of an animated tile group header.
+    /// </summary>
+    static void ScanAnimatedTileGroup(int groupId)
+    {
+        AddReference(WL4Constants::AnimatedTileHeaderTable + groupId * 8 + 4, AnimatedTileGroupTile8x8Data, AnimatedTileGroupOwner, groupId);
+    }
+
+    /// <summary>
+    /// Index all the references of a single owner.
+    /// </summary>
+    static void ScanOwner(quint64 key)
+    {
+        int ownerId = static_cast<int>(key & 0xFFFFFFFF);
+        switch (static_cast<enum ReferenceOwnerType>(key >> 32))
+        {
+        case LevelOwner:
+            ScanLevel(ownerId);
+            break;
+        case TilesetOwner:
+            ScanTileset(ownerId);
+            break;
+        case EntityOwner:
+            ScanEntity(ownerId);
+            break;
+        case EntitySetOwner:
+            ScanEntitySet(ownerId);
+            break;
+        case AnimatedTileGroupOwner:
+            ScanAnimatedTileGroup(ownerId);
+            break;
+        }
+    }
+
+    /// <summary>
+    /// Rebuild the whole index from the raw header tables of the current ROM.
+    /// </summary>
+    static void Build()
+    {
+        ReferencesByTarget.clear();
+        ReferencesByOwner.clear();
+        OwnersByPointerAddress.clear();
+
+        QSet<int> levelIds;
+        for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
+        {
+            unsigned int levelOffset = WL4Constants::VanillaLevelPassages[i] * 24 + WL4Constants::VanillaLevelStages[i] * 4;
+            unsigned int levelHeaderIndex = ROMUtils::IntFromData(WL4Constants::LevelHeaderIndexTable + levelOffset);
+            unsigned int levelHeaderPointer = WL4Constants::LevelHeaderTable + levelHeaderIndex * 12;
+            if (levelHeaderPointer >= ROMUtils::ROMFileMetadata->Length) continue;
+            levelIds.insert(ROMUtils::ROMFileMetadata->ROMDataPtr[levelHeaderPointer]);
+        }
+        for (int levelId : levelIds)
+        {
+            ScanLevel(levelId);
+        }
+        for (unsigned int i = 0; i < sizeof(ROMUtils::singletonTilesets) / sizeof(ROMUtils::singletonTilesets[0]); ++i)
+        {
+            ScanTileset(i);
+        }
+        for (unsigned int i = 0; i < sizeof(ROMUtils::entities) / sizeof(ROMUtils::entities[0]); ++i)
+        {
+            ScanEntity(i);
+        }
+        for (unsigned int i = 0; i < sizeof(ROMUtils::entitiessets) / sizeof(ROMUtils::entitiessets[0]); ++i)
+        {
+            ScanEntitySet(i);
+        }
+        for (unsigned int i = 0; i < sizeof(ROMUtils::animatedTileGroups) / sizeof(ROMUtils::animatedTileGroups[0]); ++i)
+        {
+            ScanAnimatedTileGroup(i);
+        }
+
+        IndexedROMDataPtr = ROMUtils::ROMFileMetadata->ROMDataPtr;
+        IndexedROMLength = ROMUtils::ROMFileMetadata->Length;
+        IndexValid = true;
+    }
+
+    /// <summary>
+    /// Build the index if it does not describe the ROM currently loaded.
+    /// </summary>
+    static void EnsureBuilt()
+    {
+        if (!IndexValid ||
+            IndexedROMDataPtr != ROMUtils::ROMFileMetadata->ROMDataPtr ||
+            IndexedROMLength != ROMUtils::ROMFileMetadata->Length)
+        {
+            Build();
+        }
+    }
+
+    /// <summary>
+    /// Find all the pointers in the ROM header tables which point at an address.
+    /// </summary>
+    /// <param name="address">
+    /// The address to look up, with or without the 0x8000000 bit.
+    /// </param>
+    /// <returns>
+    /// The references to the address, in no particular order.
+    /// </returns>
+    QVector<struct Reference> FindReferencesTo(unsigned int address)
+    {
+        EnsureBuilt();
+        QVector<struct Reference> result;
+        auto range = ReferencesByTarget.equal_range(address & 0x7FFFFFF);
+        for (auto iter = range.first; iter != range.second; ++iter)
+        {
+            result.append(iter->second);
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// Find all the pointers in the ROM header tables which point into an address range.
+    /// </summary>
+    /// <param name="beginAddress">
+    /// The first address of the range.
+    /// </param>
+    /// <param name="endAddress">
+    /// The address after the end of the range.
+    /// </param>
+    /// <returns>
+    /// The references into the range, ordered by target address.
+    /// </returns>
+    QVector<struct Reference> FindReferencesInRange(unsigned int beginAddress, unsigned int endAddress)
+    {
+        EnsureBuilt();
+        QVector<struct Reference> result;
+        auto end = ReferencesByTarget.lower_bound(endAddress & 0x7FFFFFF);
+        for (auto iter = ReferencesByTarget.lower_bound(beginAddress & 0x7FFFFFF); iter != end; ++iter)
+        {
+            result.append(iter->second);
+        }
+        return result;
+    }
+
+    /// <summary>
+    /// Check if any pointer in the ROM header tables points at an address.
+    /// </summary>
+    bool IsReferenced(unsigned int address)
+    {
+        EnsureBuilt();
+        return ReferencesByTarget.find(address & 0x7FFFFFF) != ReferencesByTarget.end();
+    }
+
+    /// <summary>
+    /// Drop the index, it is rebuilt on the next query.
+    /// </summary>
+    void Invalidate()
+    {
+        IndexValid = false;
+        IndexedROMDataPtr = nullptr;
+        ReferencesByTarget.clear();
+        ReferencesByOwner.clear();
+        OwnersByPointerAddress.clear();
+    }
+
+    /// <summary>
+    /// Update the index after ROMUtils::SaveFile replaced the ROM data.
+    /// </summary>
+    /// <remarks>
+    /// Only the owners of rewritten pointers, and the owners pointing at invalidated chunks, are rescanned.
+    /// </remarks>
+    /// <param name="previousROMDataPtr">
+    /// The ROM data before the save. If the index was not built from it, the index is dropped instead.
+    /// </param>
+    /// <param name="rewrittenPointerAddresses">
+    /// The locations in the main ROM where the save wrote a chunk pointer.
+    /// </param>
+    /// <param name="invalidatedAddresses">
+    /// The data addresses of the chunks invalidated by the save.
+    /// </param>
+    void UpdateAfterSave(const unsigned char *previousROMDataPtr,
+                         const QVector<unsigned int> &rewrittenPointerAddresses,
+                         const QVector<unsigned int> &invalidatedAddresses)
+    {
+        if (!IndexValid) return;
+        if (IndexedROMDataPtr != previousROMDataPtr)
+        {
+            Invalidate();
+            return;
+        }
+
+        QSet<quint64> dirtyOwners;
+        for (unsigned int pointerAddress : rewrittenPointerAddresses)
+        {
+            for (quint64 key : OwnersByPointerAddress.values(pointerAddress))
+            {
+                dirtyOwners.insert(key);
+            }
+        }
+        for (unsigned int address : invalidatedAddresses)
+        {
+            auto range = ReferencesByTarget.equal_range(address & 0x7FFFFFF);
+            for (auto iter = range.first; iter != range.second; ++iter)
+            {
+                dirtyOwners.insert(OwnerKey(iter->second.OwnerType, iter->second.OwnerId));
+            }
+        }
+
+        IndexedROMDataPtr = ROMUtils::ROMFileMetadata->ROMDataPtr;
+        IndexedROMLength = ROMUtils::ROMFileMetadata->Length;
+        for (quint64 key : dirtyOwners)
+        {
+            RemoveOwner(key);
+            ScanOwner(key);
+        }
+    }
+
+    /// <summary>
+    /// Rescan the owners of pointers which were changed outside of the chunk pointer rewriting in ROMUtils::SaveFile.
+    /// </summary>
+    /// <param name="pointerAddresses">
+    /// The locations in the main ROM of the changed pointers.
+    /// </param>
+    void RefreshPointers(const QVector<unsigned int> &pointerAddresses)
+    {
+        if (!IndexValid || IndexedROMDataPtr != ROMUtils::ROMFileMetadata->ROMDataPtr) return;
+        QSet<quint64> dirtyOwners;
+        for (unsigned int pointerAddress : pointerAddresses)
+        {
+            for (quint64 key : OwnersByPointerAddress.values(pointerAddress))
+            {
+                dirtyOwners.insert(key);
+            }
+        }
+        for (quint64 key : dirtyOwners)
+        {
+            RemoveOwner(key);
+            ScanOwner(key);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef ROMREFERENCEINDEX_H
+#define ROMREFERENCEINDEX_H
+
+#include <QVector>
+
+namespace ROMReferenceIndex
+{
+    // The kinds of global objects which own the pointers in the ROM
+    enum ReferenceOwnerType
+    {
+        LevelOwner             = 0,
+        TilesetOwner           = 1,
+        EntityOwner            = 2,
+        EntitySetOwner         = 3,
+        AnimatedTileGroupOwner = 4
+    };
+
+    // The kinds of data a pointer in the ROM points at
+    enum ReferenceType
+    {
+        LevelRoomHeaderTable         = 0,
+        LevelDoorTable               = 1,
+        LevelCameraPointerTable      = 2,
+        LevelCameraRecord            = 3,
+        LevelName                    = 4,
+        LevelNameJ                   = 5,
+        RoomLayerData                = 6,
+        RoomEntityList               = 7,
+        TilesetFGTile8x8Data         = 8,
+        TilesetPalette               = 9,
+        TilesetBGTile8x8Data         = 10,
+        TilesetMap16Data             = 11,
+        TilesetMap16TerrainType      = 12,
+        TilesetMap16EventTable       = 13,
+        EntityTile8x8Data            = 14,
+        EntityPalette                = 15,
+        EntitySetInfoTable           = 16,
+        AnimatedTileGroupTile8x8Data = 17
+    };
+
+    // A single pointer found in the ROM
+    struct Reference
+    {
+        unsigned int TargetAddress;  // the address being pointed at, without the 0x8000000 bit
+        unsigned int PointerAddress; // where the pointer itself is stored in the ROM
+        enum ReferenceType Type;
+        enum ReferenceOwnerType OwnerType;
+        int OwnerId;                 // level id, tileset id, global entity id, entity set id or animated tile group id
+        int RoomId = -1;             // the room id for room layer and entity list references
+        int SubId = -1;              // layer id for room layers, difficulty for entity lists
+        unsigned int Info = 0;       // layer mapping type for room layers
+    };
+
+    // Queries, the index is built from the current ROM on first use
+    QVector<struct Reference> FindReferencesTo(unsigned int address);
+    QVector<struct Reference> FindReferencesInRange(unsigned int beginAddress, unsigned int endAddress);
+    bool IsReferenced(unsigned int address);
+
+    // Maintenance
+    void Invalidate();
+    void UpdateAfterSave(const unsigned char *previousROMDataPtr,
+                         const QVector<unsigned int> &rewrittenPointerAddresses,
+                         const QVector<unsigned int> &invalidatedAddresses);
+    void RefreshPointers(const QVector<unsigned int> &pointerAddresses);
+}
+
+#endif // ROMREFERENCEINDEX_H
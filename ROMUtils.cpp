@@ -1,18 +1,28 @@
 ﻿#include "ROMUtils.h"
+#include "AssortedGraphicUtils.h"
+#include "ChangeJournal.h"
 #include "Compress.h"
 #include "Operation.h"
 #include <QFile>
 #include <QTranslator>
 #include "WL4EditorWindow.h"
 #include "PatchUtils.h"
+#include "ProfilingUtils.h"
+#include "ROMReferenceIndex.h"
 #include "SettingsUtils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QThread>
 #include <cassert>
 #include <iostream>
+#include <thread>
 #include <QtDebug>
 
 extern WL4EditorWindow *singleton;
@@ -53,7 +63,8 @@ namespace ROMUtils
     struct ROMFileMetadata TempROMMetadata;
     struct ROMFileMetadata *ROMFileMetadata;
 
-    unsigned int SaveDataIndex;
+    // Per thread, so that save chunks can be generated on worker threads and renumbered deterministically afterwards
+    thread_local unsigned int SaveDataIndex;
     LevelComponents::AnimatedTile8x8Group *animatedTileGroups[270];
     LevelComponents::Tileset *singletonTilesets[92];
     LevelComponents::EntitySet *entitiessets[90];
@@ -177,15 +188,7 @@ namespace ROMUtils
     /// </param>
     void Tile8x8DataXFlip(unsigned char *source, unsigned char *destination)
     {
-        for (int col = 0; col < 8; col++)
-        {
-            for (int row = 0; row < 4; row++)
-            {
-                unsigned char curByte = source[col * 4 + row];
-                curByte = ((curByte & 0xF) << 4) | ((curByte & 0xF0) >> 4);
-                destination[col * 4 + (3 - row)] = curByte;
-            }
-        }
+        FlipTiles4bpp(source, destination, 1, TileFlipX);
     }
 
     /// <summary>
@@ -199,9 +202,127 @@ namespace ROMUtils
     /// </param>
     void Tile8x8DataYFlip(unsigned char *source, unsigned char *destination)
     {
-        for (int col = 0; col < 8; col++)
+        FlipTiles4bpp(source, destination, 1, TileFlipY);
+    }
+
+    // The tile codec works on whole rows: a row of 8 pixels is one 32-bit word in 4bpp and one 64-bit word
+    // as color indices, loaded in the little-endian order the GBA data is stored in.
+
+    /// <summary>
+    /// Mirror a row of 4bpp pixels: reverse its bytes, then swap the two pixels of every byte.
+    /// </summary>
+    static inline uint32_t XFlipTileRow(uint32_t row)
+    {
+        row = EndianReverse(row);
+        return ((row & 0x0F0F0F0F) << 4) | ((row >> 4) & 0x0F0F0F0F);
+    }
+
+    /// <summary>
+    /// Spread a row of 4bpp pixels to one color index per byte.
+    /// </summary>
+    static inline uint64_t UnpackTileRow(uint32_t row)
+    {
+        uint64_t pixels = row;
+        pixels = (pixels | (pixels << 16)) & 0x0000FFFF0000FFFFULL;
+        pixels = (pixels | (pixels << 8)) & 0x00FF00FF00FF00FFULL;
+        return (pixels & 0x000F000F000F000FULL) | ((pixels << 4) & 0x0F000F000F000F00ULL);
+    }
+
+    /// <summary>
+    /// Gather a row of color indices, one per byte, to 4bpp pixels.
+    /// </summary>
+    static inline uint32_t PackTileRow(uint64_t pixels)
+    {
+        pixels &= 0x0F0F0F0F0F0F0F0FULL;
+        pixels = (pixels | (pixels >> 4)) & 0x00FF00FF00FF00FFULL;
+        pixels = (pixels | (pixels >> 8)) & 0x0000FFFF0000FFFFULL;
+        return static_cast<uint32_t>(pixels | (pixels >> 16));
+    }
+
+    /// <summary>
+    /// Flip several Tile8x8s of 4bpp graphic data.
+    /// </summary>
+    /// <param name="source">
+    /// The tiles to read, 32 bytes each.
+    /// </param>
+    /// <param name="destination">
+    /// The buffer to write the flipped tiles to, it can be the source buffer.
+    /// </param>
+    /// <param name="tileCount">
+    /// The number of tiles.
+    /// </param>
+    /// <param name="flips">
+    /// A combination of TileFlip values.
+    /// </param>
+    void FlipTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount, int flips)
+    {
+        for (int tile = 0; tile < tileCount; ++tile)
+        {
+            uint32_t rows[8];
+            memcpy(rows, source + tile * 32, sizeof(rows));
+            for (int i = 0; i < 8; ++i)
+            {
+                uint32_t row = rows[(flips & TileFlipY) ? 7 - i : i];
+                if (flips & TileFlipX) row = XFlipTileRow(row);
+                memcpy(destination + tile * 32 + i * 4, &row, 4);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Convert several Tile8x8s of 4bpp graphic data to color indices, one byte per pixel.
+    /// </summary>
+    /// <param name="source">
+    /// The tiles to read, 32 bytes each.
+    /// </param>
+    /// <param name="destination">
+    /// The buffer to write the color indices to, 64 bytes per tile, row by row.
+    /// </param>
+    /// <param name="tileCount">
+    /// The number of tiles.
+    /// </param>
+    /// <param name="flips">
+    /// A combination of TileFlip values, applied while converting.
+    /// </param>
+    void UnpackTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount, int flips)
+    {
+        for (int tile = 0; tile < tileCount; ++tile)
         {
-            memcpy(&destination[col * 4], &source[(7 - col) * 4], 4 * sizeof(unsigned char));
+            uint32_t rows[8];
+            memcpy(rows, source + tile * 32, sizeof(rows));
+            for (int i = 0; i < 8; ++i)
+            {
+                uint32_t row = rows[(flips & TileFlipY) ? 7 - i : i];
+                if (flips & TileFlipX) row = XFlipTileRow(row);
+                uint64_t pixels = UnpackTileRow(row);
+                memcpy(destination + tile * 64 + i * 8, &pixels, 8);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Convert several Tile8x8s of color indices, one byte per pixel, to 4bpp graphic data.
+    /// </summary>
+    /// <param name="source">
+    /// The color indices to read, 64 bytes per tile, row by row. Only the low nybble of every byte is used.
+    /// </param>
+    /// <param name="destination">
+    /// The buffer to write the tiles to, 32 bytes each.
+    /// </param>
+    /// <param name="tileCount">
+    /// The number of tiles.
+    /// </param>
+    void PackTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount)
+    {
+        for (int tile = 0; tile < tileCount; ++tile)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                uint64_t pixels;
+                memcpy(&pixels, source + tile * 64 + i * 8, 8);
+                uint32_t row = PackTileRow(pixels);
+                memcpy(destination + tile * 32 + i * 4, &row, 4);
+            }
         }
     }
 
@@ -249,14 +370,14 @@ namespace ROMUtils
          */
         int offset = 0; // should be in range of [0, 0x3FF]
         QVector<unsigned short> output;
-        while (offset < 0x3FF)
+        while (offset < 0x400)
         {
             unsigned short curChar = screenCharData[offset];
             int num_dup = 0;
             int num_AddByOne = 0;
             for (int i = 1; i < 32; ++i) // type = 1
             {
-                if ((curChar != screenCharData[offset + i]) || ((offset + i) == 0x3FF))
+                if (((offset + i) == 0x400) || (curChar != screenCharData[offset + i]))
                 {
                     break;
                 }
@@ -264,7 +385,7 @@ namespace ROMUtils
             }
             for (int i = 1; i < 32; ++i) // type = 0
             {
-                if (((curChar + i) != screenCharData[offset + i]) || ((offset + i) == 0x3FF))
+                if (((offset + i) == 0x400) || ((curChar + i) != screenCharData[offset + i]))
                 {
                     break;
                 }
@@ -284,13 +405,9 @@ skip_append_output_1:
             }
             else // num_dup < num_AddByOne, type = 1
             {
-                if (skipzeros && !curChar)
-                {
-                    goto skip_append_output_2;
-                }
+                // a run counting up from zero is not all zeros, so it cannot be skipped
                 output << ((((offset & 0x3FF) << 5) | num_AddByOne) & 0x7FFF);
                 output << curChar;
-skip_append_output_2:
                 offset += num_AddByOne + 1;
             }
         }
@@ -315,13 +432,33 @@ skip_append_output_2:
     /// </param>
     /// <return>A pointer to decompressed data.</return>
     unsigned short *UnPackScreen(uint32_t address)
+    {
+        // check if address is an odd number
+        if (address & 1)
+        {
+            singleton->GetOutputWidgetPtr()->PrintString(QT_TR_NOOP("Error in ROMUtils::UnPackScreen(int address): input parameter 'address' should be an odd number."));
+            unsigned short *dst = new unsigned short[32 * 32];
+            memset(dst, 0, 32 * 32 * sizeof(unsigned short));
+            return dst;
+        }
+        return UnPackScreen((const unsigned short *)(ROMFileMetadata->ROMDataPtr + address));
+    }
+
+    /// <summary>
+    /// Decompress a whole screen of character data from a buffer.
+    /// </summary>
+    /// <param name="src">
+    /// The compressed character data, terminated by 0x0000.
+    /// </param>
+    /// <return>A pointer to decompressed data.</return>
+    unsigned short *UnPackScreen(const unsigned short *src)
     {
         // directly modified from disassembled rom's code, C code generated by IDA pro
-        unsigned short *v2, *src;
+        const unsigned short *v2;
         unsigned short i;
         unsigned short *dst = new unsigned short[32 * 32];
         unsigned short *v5;
-        unsigned short *v6;
+        const unsigned short *v6;
         unsigned short v7;
         unsigned short j;
         unsigned short v9;
@@ -330,13 +467,7 @@ skip_append_output_2:
 
         memset(dst, 0, 32 * 32 * sizeof(unsigned short));
 
-        // check if address is an odd number
-        if (address & 1)
-        {
-            singleton->GetOutputWidgetPtr()->PrintString(QT_TR_NOOP("Error in ROMUtils::UnPackScreen(int address): input parameter 'address' should be an odd number."));
-            return dst;
-        }
-        v2 = src = (unsigned short *)(ROMFileMetadata->ROMDataPtr + address);
+        v2 = src;
         for (i = *src; *v2; i = *v2)
         {
             v5 = (dst + ((i >> 5) & 0x3FF));
@@ -392,17 +523,36 @@ skip_append_output_2:
     /// <return>A pointer to decompressed data.</return>
     unsigned char *LayerRLEDecompress(int address, size_t outputSize)
     {
+        return LayerRLEDecompress(ROMFileMetadata->ROMDataPtr + address, outputSize);
+    }
+
+    /// <summary>
+    /// Decompress run-length encoded layer data from a buffer.
+    /// </summary>
+    /// <remarks>
+    /// The return unsigned char * is on the heap, delete it after using.
+    /// </remarks>
+    /// <param name="data">
+    /// The compressed data.
+    /// </param>
+    /// <param name="outputSize">
+    /// The predicted size of the output data.(unit: Byte)
+    /// </param>
+    /// <return>A pointer to decompressed data.</return>
+    unsigned char *LayerRLEDecompress(const unsigned char *data, size_t outputSize)
+    {
+        int address = 0;
         unsigned char *OutputLayerData = new unsigned char[outputSize];
         int runData;
 
         for (int i = 0; i < 2; i++)
         {
             unsigned char *dst = OutputLayerData + i;
-            if (ROMFileMetadata->ROMDataPtr[address++] == 1)
+            if (data[address++] == 1)
             {
                 while (1)
                 {
-                    int ctrl = ROMFileMetadata->ROMDataPtr[address++];
+                    int ctrl = data[address++];
                     if (!ctrl)
                     {
                         break;
@@ -420,7 +570,7 @@ skip_append_output_2:
                         runData = ctrl & 0x7F;
                         for (int j = 0; j < runData; j++)
                         {
-                            dst[2 * j] = ROMFileMetadata->ROMDataPtr[address];
+                            dst[2 * j] = data[address];
                         }
                         address++;
                     }
@@ -429,7 +579,7 @@ skip_append_output_2:
                         runData = ctrl;
                         for (int j = 0; j < runData; j++)
                         {
-                            dst[2 * j] = ROMFileMetadata->ROMDataPtr[address + j];
+                            dst[2 * j] = data[address + j];
                         }
                         address += runData;
                     }
@@ -441,7 +591,7 @@ skip_append_output_2:
             {
                 while (1)
                 {
-                    int ctrl = (static_cast<int>(ROMFileMetadata->ROMDataPtr[address]) << 8) | ROMFileMetadata->ROMDataPtr[address + 1];
+                    int ctrl = (static_cast<int>(data[address]) << 8) | data[address + 1];
                     address += 2; // offset + 2
                     if (!ctrl)
                     {
@@ -460,7 +610,7 @@ skip_append_output_2:
                         runData = ctrl & 0x7FFF;
                         for (int j = 0; j < runData; j++)
                         {
-                            dst[2 * j] = ROMFileMetadata->ROMDataPtr[address];
+                            dst[2 * j] = data[address];
                         }
                         address++;
                     }
@@ -469,7 +619,7 @@ skip_append_output_2:
                         runData = ctrl;
                         for (int j = 0; j < runData; j++)
                         {
-                            dst[2 * j] = ROMFileMetadata->ROMDataPtr[address + j];
+                            dst[2 * j] = data[address + j];
                         }
                         address += runData;
                     }
@@ -498,7 +648,7 @@ skip_append_output_2:
     /// unsigned char pointer to the compressed layer data.
     /// </param>
     /// <return>the length of compressed data.</return>
-    unsigned int LayerRLECompress(unsigned int _layersize, unsigned short *LayerData,
+    unsigned int LayerRLECompress(unsigned int _layersize, const unsigned short *LayerData,
                                   unsigned char **OutputCompressedData)
     {
         // Separate short data into char arrays
@@ -730,6 +880,7 @@ skip_append_output_2:
     /// </returns>
     QVector<struct FreeSpaceRegion> FindAllFreeSpaceInROM(unsigned char *ROMData, unsigned int ROMLength)
     {
+        PROFILE_SCOPE("ROMUtils::FindAllFreeSpaceInROM");
         QVector<struct FreeSpaceRegion> freeSpace;
         unsigned int startAddr = WL4Constants::AvailableSpaceBeginningInROM;
         unsigned int freeSpaceStart = startAddr;
@@ -774,6 +925,7 @@ skip_append_output_2:
         {
             freeSpace.append({freeSpaceStart, startAddr - freeSpaceStart});
         }
+        PROFILE_COUNT("free space regions scanned", freeSpace.size());
         return freeSpace;
     }
 
@@ -858,6 +1010,8 @@ skip_append_output_2:
         std::function<ChunkAllocationStatus (unsigned char *, FreeSpaceRegion, SaveData*, bool, int*)> ChunkAllocator,
         std::function<QString (unsigned char*, std::map<int, int>)> PostProcessingCallback)
     {
+        PROFILE_SCOPE("ROMUtils::SaveFile");
+
         // Finding space for the chunks can be done faster if the chunks are ordered by size
         unsigned char *TempFile = (unsigned char *) malloc(ROMFileMetadata->Length);
         unsigned int TempLength = ROMFileMetadata->Length;
@@ -895,6 +1049,7 @@ skip_append_output_2:
         QVector<struct FreeSpaceRegion> freeSpaceRegions;
         QVector<struct SaveData> chunksToAdd;
         std::map<int, int> indexToChunkPtr;
+        QVector<unsigned int> rewrittenPointers; // pointer locations in main ROM, used to update the reference index
         bool success = false;
         bool resizerom = false; // act as a trigger to reset index in ChunkAllocator
 
@@ -1030,6 +1185,10 @@ allocationComplete:
             default:;
             }
 
+            if(!chunk.dest_index)
+            {
+                rewrittenPointers.append(chunk.ptr_addr);
+            }
             unsigned char *ptrLoc = chunk.dest_index ?
                 // Source pointer is in another chunk
                 chunksToAdd[chunkIDtoIndex[chunk.dest_index]].data + chunk.ptr_addr
@@ -1180,8 +1339,12 @@ allocationComplete:
             // Set the CurrentFile to the copied CurrentFile data
             auto temp = ROMFileMetadata->ROMDataPtr;
             ROMFileMetadata->ROMDataPtr = TempFile;
-            delete[] temp;
             ROMFileMetadata->Length = TempLength;
+            ROMReferenceIndex::UpdateAfterSave(temp, rewrittenPointers, invalidationChunks);
+            delete[] temp;
+
+            // The layers at the old data pointers may have been replaced
+            LevelComponents::RenderedLayerCache::Clear();
         }
 
         // Set that there are no changes to the ROM now (so no save prompt is given)
@@ -1205,64 +1368,408 @@ error:      free(TempFile); // free up temporary file if there was a processing
     }
 
     /// <summary>
-    /// Save the currently loaded level to the ROM file.
+    /// A pointer to a save chunk which is redirected to identical data instead of allocating a new chunk.
     /// </summary>
-    /// <param name="filePath">
-    /// The file name to use when saving the ROM.
+    struct ChunkRedirect
+    {
+        unsigned int ptr_addr;
+        unsigned int dest_index;   // same meaning as in SaveData
+        unsigned int target_addr;  // data address of an identical chunk already in the ROM, or 0
+        unsigned int target_index; // index of an identical chunk saved in the same pass, used if target_addr is 0
+    };
+
+    /// <summary>
+    /// Leaf chunk types which contain no pointers and are never modified in place, so identical copies may be shared.
+    /// </summary>
+    static bool IsShareableChunkType(enum SaveDataChunkType chunkType)
+    {
+        switch (chunkType)
+        {
+        case SaveDataChunkType::LayerChunkType:
+        case SaveDataChunkType::EntityListChunk:
+        case SaveDataChunkType::TilesetForegroundTile8x8DataChunkType:
+        case SaveDataChunkType::TilesetMap16EventTableChunkType:
+        case SaveDataChunkType::TilesetMap16TerrainChunkType:
+        case SaveDataChunkType::TilesetMap16DataChunkType:
+        case SaveDataChunkType::TilesetPaletteDataChunkType:
+        case SaveDataChunkType::EntityTile8x8DataChunkType:
+        case SaveDataChunkType::EntityPaletteDataChunkType:
+        case SaveDataChunkType::EntitySetLoadTableChunkType:
+        case SaveDataChunkType::AnimatedTileGroupTile8x8DataChunkType:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /// <summary>
+    /// Content key for chunk deduplication: type and size in the low 32 bits, a hash of the data in the high 32 bits.
+    /// </summary>
+    static quint64 ChunkContentKey(enum SaveDataChunkType chunkType, const unsigned char *data, unsigned int size)
+    {
+        quint64 hash = static_cast<unsigned int>(qHashBits(data, size));
+        return (hash << 32) | (static_cast<quint64>(chunkType) << 24) | (size & 0xFFFFFF);
+    }
+
+    /// <summary>
+    /// Check if the valid chunk whose data starts at dataAddr in the current ROM holds exactly the given content.
+    /// </summary>
+    static bool ChunkContentEquals(unsigned int dataAddr, enum SaveDataChunkType chunkType, const unsigned char *data, unsigned int size)
+    {
+        unsigned char *ROMData = ROMFileMetadata->ROMDataPtr;
+        if (dataAddr < WL4Constants::AvailableSpaceBeginningInROM + 12 || dataAddr + size > ROMFileMetadata->Length) return false;
+        if (!ValidRATS(ROMData + dataAddr - 12)) return false;
+        if (ROMData[dataAddr - 4] != chunkType) return false;
+        if (GetChunkDataLength(dataAddr - 12) != size) return false;
+        return !memcmp(ROMData + dataAddr, data, size);
+    }
+
+    /// <summary>
+    /// Remove save chunks whose content is identical to a chunk already in the ROM, or to another chunk in the same save.
+    /// The pointers to removed chunks are returned as redirects, to be applied in the post-processing step of the save.
+    /// </summary>
+    /// <param name="chunks">
+    /// The chunks which will be allocated. Deduplicated chunks are removed and their data freed.
+    /// </param>
+    /// <param name="invalidationChunks">
+    /// The chunks which will be invalidated. Chunks in the ROM which become shared are removed from it.
     /// </param>
     /// <returns>
-    /// True if the save was successful.
+    /// The pointer redirects for the removed chunks.
     /// </returns>
-    bool SaveLevel(QString filePath)
+    static QVector<struct ChunkRedirect> DeduplicateSaveChunks(QVector<struct SaveData> &chunks, QVector<unsigned int> &invalidationChunks)
     {
-        SaveDataIndex = 1;
-        QVector<struct SaveData> chunks;
+        QVector<struct ChunkRedirect> redirects;
+
+        // Content index of the shareable chunks already in the ROM
+        QMultiHash<quint64, unsigned int> ROMChunksByContent;
+        unsigned char *ROMData = ROMFileMetadata->ROMDataPtr;
+        QVector<unsigned int> chunkAddrs = FindAllChunksInROM(ROMData, ROMFileMetadata->Length,
+            WL4Constants::AvailableSpaceBeginningInROM, SaveDataChunkType::InvalidationChunk, true);
+        for (unsigned int chunkAddr : chunkAddrs)
+        {
+            enum SaveDataChunkType chunkType = static_cast<enum SaveDataChunkType>(ROMData[chunkAddr + 8]);
+            if (!IsShareableChunkType(chunkType)) continue;
+            unsigned int size = GetChunkDataLength(chunkAddr);
+            ROMChunksByContent.insert(ChunkContentKey(chunkType, ROMData + chunkAddr + 12, size), chunkAddr + 12);
+        }
 
-        // Get save chunks for the level
-        LevelComponents::Level *currentLevel = singleton->GetCurrentLevel();
-        int levelHeaderOffset = WL4Constants::LevelHeaderIndexTable + currentLevel->GetPassage() * 24 + currentLevel->GetStage() * 4;
-        int levelHeaderIndex = ROMUtils::IntFromData(levelHeaderOffset);
-        int levelHeaderPointer = WL4Constants::LevelHeaderTable + levelHeaderIndex * 12;
-        if(!currentLevel->GetSaveChunks(chunks))
+        // Chunks which contain pointers to other chunks must keep their own allocation
+        QSet<unsigned int> parentIndices;
+        for (const struct SaveData &chunk : chunks)
         {
-            return false;
+            if (chunk.dest_index) parentIndices.insert(chunk.dest_index);
+        }
+
+        QVector<struct SaveData> keptChunks;
+        QHash<quint64, int> keptChunksByContent;
+        for (struct SaveData &chunk : chunks)
+        {
+            if (!IsShareableChunkType(chunk.ChunkType) || parentIndices.contains(chunk.index) || !chunk.size)
+            {
+                keptChunks.append(chunk);
+                continue;
+            }
+            quint64 key = ChunkContentKey(chunk.ChunkType, chunk.data, chunk.size);
+
+            // Prefer the chunk's own old data, then any identical chunk already in the ROM
+            unsigned int target = 0;
+            if (ChunkContentEquals(chunk.old_chunk_addr, chunk.ChunkType, chunk.data, chunk.size))
+            {
+                target = chunk.old_chunk_addr;
+            }
+            else
+            {
+                for (unsigned int dataAddr : ROMChunksByContent.values(key))
+                {
+                    if (ChunkContentEquals(dataAddr, chunk.ChunkType, chunk.data, chunk.size))
+                    {
+                        target = dataAddr;
+                        break;
+                    }
+                }
+            }
+            if (target)
+            {
+                redirects.append({chunk.ptr_addr, chunk.dest_index, target, 0});
+                invalidationChunks.removeAll(target);
+                free(chunk.data);
+                continue;
+            }
+
+            // Then an identical chunk which is written in this save
+            auto sameContent = keptChunksByContent.constFind(key);
+            if (sameContent != keptChunksByContent.constEnd())
+            {
+                const struct SaveData &original = keptChunks[sameContent.value()];
+                if (original.ChunkType == chunk.ChunkType && original.size == chunk.size &&
+                    !memcmp(original.data, chunk.data, chunk.size))
+                {
+                    redirects.append({chunk.ptr_addr, chunk.dest_index, 0, original.index});
+                    free(chunk.data);
+                    continue;
+                }
+            }
+            keptChunksByContent.insert(key, keptChunks.size());
+            keptChunks.append(chunk);
         }
+        chunks = keptChunks;
+        return redirects;
+    }
 
-        // Get Global instances chunks
-        for(int i = 0; i < (sizeof(ROMUtils::animatedTileGroups)) / sizeof(ROMUtils::animatedTileGroups[0]); i++)
+    /// <summary>
+    /// Drop the chunks from the invalidation list which are still pointed to by data that stays in the ROM after the save.
+    /// With deduplication, an old chunk replaced by one owner may be shared by other owners.
+    /// </summary>
+    /// <param name="invalidationChunks">
+    /// The chunks which will be invalidated.
+    /// </param>
+    /// <param name="rewrittenPointers">
+    /// Locations in the main ROM of every pointer the save rewrites.
+    /// </param>
+    static void KeepSharedChunks(QVector<unsigned int> &invalidationChunks, const QSet<unsigned int> &rewrittenPointers)
+    {
+        // Replacing a level's room header table or camera pointer table also drops the pointers stored in the old table
+        QSet<int> replacedRoomTables, replacedCameraTables;
+        for (unsigned int pointerAddr : rewrittenPointers)
         {
-            if(animatedTileGroups[i]->IsNewAnimatedTile8x8Group())
+            unsigned int oldTarget = IntFromData(pointerAddr) & 0x7FFFFFF;
+            for (const struct ROMReferenceIndex::Reference &ref : ROMReferenceIndex::FindReferencesTo(oldTarget))
             {
-                GenerateAnimatedTileGroupChunks(i, chunks);
+                if (ref.PointerAddress != pointerAddr || ref.OwnerType != ROMReferenceIndex::LevelOwner) continue;
+                if (ref.Type == ROMReferenceIndex::LevelRoomHeaderTable) replacedRoomTables.insert(ref.OwnerId);
+                if (ref.Type == ROMReferenceIndex::LevelCameraPointerTable) replacedCameraTables.insert(ref.OwnerId);
             }
         }
-        for(int i = 0; i < (sizeof(ROMUtils::singletonTilesets)) / sizeof(ROMUtils::singletonTilesets[0]); ++i)
+
+        // The chunks being invalidated disappear along with the pointers inside them
+        QVector<struct FreeSpaceRegion> invalidatedRanges;
+        for (unsigned int dataAddr : invalidationChunks)
         {
-            if(singletonTilesets[i]->IsNewTileset())
+            if (dataAddr < WL4Constants::AvailableSpaceBeginningInROM + 12 ||
+                !ValidRATS(ROMFileMetadata->ROMDataPtr + dataAddr - 12)) continue;
+            invalidatedRanges.append({dataAddr, GetChunkDataLength(dataAddr - 12)});
+        }
+
+        auto isDropped = [&](const struct ROMReferenceIndex::Reference &ref) {
+            if (rewrittenPointers.contains(ref.PointerAddress)) return true;
+            if (ref.OwnerType == ROMReferenceIndex::LevelOwner)
             {
-                GenerateTilesetSaveChunks(i, chunks);
+                if ((ref.Type == ROMReferenceIndex::RoomLayerData || ref.Type == ROMReferenceIndex::RoomEntityList) &&
+                    replacedRoomTables.contains(ref.OwnerId)) return true;
+                if (ref.Type == ROMReferenceIndex::LevelCameraRecord && replacedCameraTables.contains(ref.OwnerId)) return true;
             }
+            for (const struct FreeSpaceRegion &range : invalidatedRanges)
+            {
+                if (ref.PointerAddress >= range.addr && ref.PointerAddress < range.addr + range.size) return true;
+            }
+            return false;
+        };
+
+        QVector<unsigned int> result;
+        for (unsigned int dataAddr : invalidationChunks)
+        {
+            QVector<struct ROMReferenceIndex::Reference> refs = ROMReferenceIndex::FindReferencesTo(dataAddr);
+            if (std::all_of(refs.begin(), refs.end(), isDropped))
+            {
+                result.append(dataAddr);
+            }
+        }
+        invalidationChunks = result;
+    }
+
+    /// <summary>
+    /// Prepare the independent parts of a level save on a pool of worker threads.
+    /// </summary>
+    /// <remarks>
+    /// Every dirty Map16 layer of the levels is compressed ahead of Room::GetSaveChunks, and the chunks of every
+    /// changed animated tile group, tileset, entity and entity set are generated. Each job only reads and writes its
+    /// own asset. Every job numbers its chunks from 1 with its thread's SaveDataIndex, so the numbers don't depend on
+    /// which thread ran which job, and the caller renumbers them with RenumberJobChunks.
+    /// The SaveDataIndex of the calling thread is left unchanged.
+    /// </remarks>
+    /// <param name="levels">
+    /// The levels whose layers are compressed.
+    /// </param>
+    /// <param name="jobChunks">
+    /// Receives the global instances chunks of every job, in the order of a sequential save.
+    /// </param>
+    static void RunSaveJobsInParallel(const QVector<LevelComponents::Level *> &levels, QVector<QVector<struct SaveData>> &jobChunks)
+    {
+        std::vector<std::function<void (QVector<struct SaveData> &)>> jobs;
+        for(LevelComponents::Level *level : levels)
+        {
+            for(LevelComponents::Room *room : level->GetRooms())
+            {
+                for(int i = 0; i < 4; ++i)
+                {
+                    LevelComponents::Layer *layer = room->GetLayer(i);
+                    if(layer->IsDirty() && layer->GetMappingType() == LevelComponents::LayerMap16)
+                    {
+                        jobs.push_back([layer](QVector<struct SaveData> &) { layer->PrecompressLayerData(); });
+                    }
+                }
+            }
+        }
+        for(int i : ChangeJournal::GetChanged(ChangeJournal::AnimatedTileGroupAsset))
+        {
+            jobs.push_back([i](QVector<struct SaveData> &out) { GenerateAnimatedTileGroupChunks(i, out); });
+        }
+        for(int i : ChangeJournal::GetChanged(ChangeJournal::TilesetAsset))
+        {
+            jobs.push_back([i](QVector<struct SaveData> &out) { GenerateTilesetSaveChunks(i, out); });
+        }
+        for(int i : ChangeJournal::GetChanged(ChangeJournal::EntityAsset)) // the first 0x11 sprites are not listed, they should be addressed differently
+        {
+            jobs.push_back([i](QVector<struct SaveData> &out) { GenerateEntitySaveChunks(i, out); });
         }
-        for(int i = 0x11; i < (sizeof(ROMUtils::entities)) / sizeof(ROMUtils::entities[0]); ++i) // we skip the first 0x10 sprites, they should be addressed differently
+        for(int i : ChangeJournal::GetChanged(ChangeJournal::EntitySetAsset))
         {
-            if(entities[i]->IsNewEntity())
+            jobs.push_back([i](QVector<struct SaveData> &out) { GenerateEntitySetSaveChunks(i, out); });
+        }
+        int jobCount = static_cast<int>(jobs.size());
+        if(!jobCount) return;
+
+        // Each worker pulls the next job until the list is exhausted
+        QVector<QVector<struct SaveData>> results(jobCount);
+        std::atomic<int> nextJob(0);
+        auto saveWorker = [&]() {
+            unsigned int callerIndex = SaveDataIndex;
+            int i;
+            while((i = nextJob++) < jobCount)
             {
-                GenerateEntitySaveChunks(i, chunks);
+                SaveDataIndex = 1;
+                jobs[i](results[i]);
             }
+            SaveDataIndex = callerIndex;
+        };
+        int threadCount = qBound(1, QThread::idealThreadCount(), jobCount);
+        std::vector<std::thread> threads;
+        for(int i = 1; i < threadCount; ++i)
+        {
+            threads.emplace_back(saveWorker);
         }
-        for(int i = 0; i < (sizeof(ROMUtils::entitiessets)) / sizeof(ROMUtils::entitiessets[0]); ++i)
+        saveWorker();
+        for(std::thread &thread : threads)
+        {
+            thread.join();
+        }
+
+        jobChunks = results;
+    }
+
+    /// <summary>
+    /// Give the chunks of the parallel save jobs their final indices, in job order.
+    /// </summary>
+    /// <remarks>
+    /// The job-local indices, including the dest_index of chunks pointed to from another chunk of the same job,
+    /// are mapped to consecutive indices taken from SaveDataIndex. The result only depends on the job order.
+    /// </remarks>
+    /// <param name="jobChunks">
+    /// The chunks of every job, numbered from 1 within each job.
+    /// </param>
+    /// <param name="chunks">
+    /// Receives the renumbered chunks.
+    /// </param>
+    static void RenumberJobChunks(QVector<QVector<struct SaveData>> &jobChunks, QVector<struct SaveData> &chunks)
+    {
+        for(QVector<struct SaveData> &job : jobChunks)
         {
-            if(entitiessets[i]->IsNewEntitySet())
+            QHash<unsigned int, unsigned int> newIndex;
+            for(const struct SaveData &chunk : job)
             {
-                GenerateEntitySetSaveChunks(i, chunks);
+                newIndex[chunk.index] = SaveDataIndex++;
+            }
+            for(struct SaveData &chunk : job)
+            {
+                chunk.index = newIndex[chunk.index];
+                if(chunk.dest_index)
+                {
+                    Q_ASSERT(newIndex.contains(chunk.dest_index));
+                    chunk.dest_index = newIndex[chunk.dest_index];
+                }
+                chunks.append(chunk);
             }
         }
+    }
 
-        // Isolate the room header chunk for post-processing
-        struct SaveData roomHeaderChunk = *std::find_if(chunks.begin(), chunks.end(), [](const struct SaveData &chunk) {
-            return chunk.ChunkType == SaveDataChunkType::RoomHeaderChunkType;
-        });
+    // The parts of a level save which are only known once its chunks are generated or allocated
+    struct LevelSaveState
+    {
+        LevelComponents::Level *level;
+        int levelHeaderPointer;
+        unsigned int roomHeaderChunkIndex;
         unsigned int roomHeaderInROM;
+    };
+
+    /// <summary>
+    /// Save the currently loaded level, and every level kept with unsaved edits, to the ROM file.
+    /// </summary>
+    /// <remarks>
+    /// The chunks of all the levels and of the changed global instances go through a single allocation pass and a
+    /// single write of the file, so the fixed cost of a save is only paid once however many levels were edited.
+    /// </remarks>
+    /// <param name="filePath">
+    /// The file name to use when saving the ROM.
+    /// </param>
+    /// <returns>
+    /// True if the save was successful.
+    /// </returns>
+    bool SaveLevel(QString filePath)
+    {
+        PROFILE_SCOPE("ROMUtils::SaveLevel");
+        SaveDataIndex = 1;
+        QVector<struct SaveData> chunks;
+        QVector<LevelComponents::Level *> levels = ChangeJournal::GetEditedLevels();
+        levels.prepend(singleton->GetCurrentLevel());
+        PROFILE_COUNT("saved levels", levels.size());
+
+        // Compress dirty layers and generate the global instances chunks on worker threads
+        QVector<QVector<struct SaveData>> globalChunks;
+        RunSaveJobsInParallel(levels, globalChunks);
+
+        // Get save chunks for the levels
+        QVector<struct LevelSaveState> levelStates;
+        for(LevelComponents::Level *level : levels)
+        {
+            int levelHeaderOffset = WL4Constants::LevelHeaderIndexTable + level->GetPassage() * 24 + level->GetStage() * 4;
+            int levelHeaderIndex = ROMUtils::IntFromData(levelHeaderOffset);
+            int firstChunk = chunks.size();
+            if(!level->GetSaveChunks(chunks))
+            {
+                for(struct SaveData &chunk : chunks)
+                {
+                    free(chunk.data);
+                }
+                for(QVector<struct SaveData> &job : globalChunks)
+                {
+                    for(struct SaveData &chunk : job)
+                    {
+                        free(chunk.data);
+                    }
+                }
+                for(LevelComponents::Level *discardedLevel : levels)
+                {
+                    for(LevelComponents::Room *room : discardedLevel->GetRooms())
+                    {
+                        for(int i = 0; i < 4; ++i)
+                        {
+                            room->GetLayer(i)->DiscardPrecompressedLayerData();
+                        }
+                    }
+                }
+                return false;
+            }
+
+            // Isolate the room header chunk for post-processing
+            auto roomHeaderChunk = std::find_if(chunks.begin() + firstChunk, chunks.end(), [](const struct SaveData &chunk) {
+                return chunk.ChunkType == SaveDataChunkType::RoomHeaderChunkType;
+            });
+            levelStates.append({level, WL4Constants::LevelHeaderTable + levelHeaderIndex * 12, roomHeaderChunk->index, 0});
+        }
+
+        // Global instances chunks follow the level chunks, numbered in the same order as a sequential save
+        RenumberJobChunks(globalChunks, chunks);
 
         QVector<unsigned int> invalidationChunks;
         QVector<struct SaveData> addedChunks;
@@ -1282,7 +1789,24 @@ error:      free(TempFile); // free up temporary file if there was a processing
             }
         }
 
+        // Share identical data instead of writing it again, and keep old chunks alive while something still points to them
+        QVector<struct ChunkRedirect> redirects = DeduplicateSaveChunks(addedChunks, invalidationChunks);
+        QSet<unsigned int> rewrittenPointers;
+        QVector<unsigned int> redirectedPointers;
+        for (const struct SaveData &chunk : addedChunks)
+        {
+            if (!chunk.dest_index) rewrittenPointers.insert(chunk.ptr_addr);
+        }
+        for (const struct ChunkRedirect &redirect : redirects)
+        {
+            if (redirect.dest_index) continue;
+            rewrittenPointers.insert(redirect.ptr_addr);
+            redirectedPointers.append(redirect.ptr_addr);
+        }
+        KeepSharedChunks(invalidationChunks, rewrittenPointers);
+
         // Save the level
+        PROFILE_COUNT("save chunks", addedChunks.size());
         AllocateChunksFromListInit(addedChunks);
         bool ret = SaveFile(filePath, invalidationChunks,
 
@@ -1292,61 +1816,63 @@ error:      free(TempFile); // free up temporary file if there was a processing
 
             // PostProcessingCallback
 
-            [levelHeaderPointer, currentLevel, roomHeaderChunk, &roomHeaderInROM]
+            [&levelStates, &redirects]
             (unsigned char *TempFile, std::map<int, int> indexToChunkPtr)
             {
-                // Capture pointer to new room header location
-                roomHeaderInROM = static_cast<unsigned int>(indexToChunkPtr[roomHeaderChunk.index] + 12);
+                // Point the deduplicated chunks' pointers at the shared data
+                for (const struct ChunkRedirect &redirect : redirects)
+                {
+                    unsigned int pointerAddr = redirect.dest_index ?
+                        indexToChunkPtr[redirect.dest_index] + 12 + redirect.ptr_addr : redirect.ptr_addr;
+                    unsigned int target = redirect.target_addr ?
+                        redirect.target_addr : indexToChunkPtr[redirect.target_index] + 12;
+                    *(unsigned int *) (TempFile + pointerAddr) = target | 0x8000000;
+                }
 
-                // Write the level header to the ROM
-                memcpy(TempFile + levelHeaderPointer, currentLevel->GetLevelHeader(), sizeof(struct LevelComponents::__LevelHeader));
+                for(struct LevelSaveState &levelState : levelStates)
+                {
+                    // Capture pointer to new room header location
+                    levelState.roomHeaderInROM = static_cast<unsigned int>(indexToChunkPtr[levelState.roomHeaderChunkIndex] + 12);
+
+                    // Write the level header to the ROM
+                    memcpy(TempFile + levelState.levelHeaderPointer, levelState.level->GetLevelHeader(), sizeof(struct LevelComponents::__LevelHeader));
+                }
 
                 // Write Tileset data length and animtated tiles info
-                for(int i = 0; i < (sizeof(ROMUtils::singletonTilesets)) / sizeof(ROMUtils::singletonTilesets[0]); ++i)
+                for(int i : ChangeJournal::GetChanged(ChangeJournal::TilesetAsset))
                 {
-                    if(singletonTilesets[i]->IsNewTileset())
-                    {
-                        // Save Animated Tile info table
-                        unsigned short *AnimatedTileInfoTable = singletonTilesets[i]->GetAnimatedTileData(0);
-                        memcpy(TempFile + i * 32 + WL4Constants::AnimatedTileIdTableSwitchOff, (unsigned char*)AnimatedTileInfoTable, 32);
-                        unsigned short *AnimatedTileInfoTable2 = singletonTilesets[i]->GetAnimatedTileData(1);
-                        memcpy(TempFile + i * 32 + WL4Constants::AnimatedTileIdTableSwitchOn, (unsigned char*)AnimatedTileInfoTable2, 32);
-                        unsigned char *AnimatedTileSwitchInfoTable = singletonTilesets[i]->GetAnimatedTileSwitchTable();
-                        memcpy(TempFile + i * 16 + WL4Constants::AnimatedTileSwitchInfoTable, (unsigned char*)AnimatedTileSwitchInfoTable, 16);
-
-                        // Reset bgGFXLen, bgGFXptr and fgGBXLen
-                        int tilesetPtr = singletonTilesets[i]->getTilesetPtr();
-                        int fgGFXLenaddr = singletonTilesets[i]->GetfgGFXlen();
-                        *(int *) (TempFile + tilesetPtr + 4) = fgGFXLenaddr;
-                        unsigned int bgGFXdataaddr = singletonTilesets[i]->GetbgGFXptr();
-                        *(unsigned int *) (TempFile + tilesetPtr + 12) = bgGFXdataaddr | 0x800'0000;
-                        int bgGFXLenaddr = singletonTilesets[i]->GetbgGFXlen();
-                        *(int *) (TempFile + tilesetPtr + 16) = bgGFXLenaddr;
-                        // don't needed, because this is done in the following internal pointers reset code
-                        // singletonTilesets[i]->SetChanged(false);
-                    }
+                    // Save Animated Tile info table
+                    unsigned short *AnimatedTileInfoTable = singletonTilesets[i]->GetAnimatedTileData(0);
+                    memcpy(TempFile + i * 32 + WL4Constants::AnimatedTileIdTableSwitchOff, (unsigned char*)AnimatedTileInfoTable, 32);
+                    unsigned short *AnimatedTileInfoTable2 = singletonTilesets[i]->GetAnimatedTileData(1);
+                    memcpy(TempFile + i * 32 + WL4Constants::AnimatedTileIdTableSwitchOn, (unsigned char*)AnimatedTileInfoTable2, 32);
+                    unsigned char *AnimatedTileSwitchInfoTable = singletonTilesets[i]->GetAnimatedTileSwitchTable();
+                    memcpy(TempFile + i * 16 + WL4Constants::AnimatedTileSwitchInfoTable, (unsigned char*)AnimatedTileSwitchInfoTable, 16);
+
+                    // Reset bgGFXLen, bgGFXptr and fgGBXLen
+                    int tilesetPtr = singletonTilesets[i]->getTilesetPtr();
+                    int fgGFXLenaddr = singletonTilesets[i]->GetfgGFXlen();
+                    *(int *) (TempFile + tilesetPtr + 4) = fgGFXLenaddr;
+                    unsigned int bgGFXdataaddr = singletonTilesets[i]->GetbgGFXptr();
+                    *(unsigned int *) (TempFile + tilesetPtr + 12) = bgGFXdataaddr | 0x800'0000;
+                    int bgGFXLenaddr = singletonTilesets[i]->GetbgGFXlen();
+                    *(int *) (TempFile + tilesetPtr + 16) = bgGFXLenaddr;
                 }
 
                 // Write Sprite data length info
-                for(int i = 0x11; i < (sizeof(ROMUtils::entities)) / sizeof(ROMUtils::entities[0]); ++i) // we skip the first 0x10 sprites, they should be addressed differently
+                for(int i : ChangeJournal::GetChanged(ChangeJournal::EntityAsset))
                 {
-                    if(entities[i]->IsNewEntity())
-                    {
-                        *(unsigned int *) (TempFile + WL4Constants::EntityTilesetLengthTable + 4 * (i - 0x10)) = entities[i]->GetPalNum() * (32 * 32 * 2);
-                    }
+                    *(unsigned int *) (TempFile + WL4Constants::EntityTilesetLengthTable + 4 * (i - 0x10)) = entities[i]->GetPalNum() * (32 * 32 * 2);
                 }
 
                 // Write the Animated Tile Group param bytes into their header table
-                for(int i = 0; i < (sizeof(ROMUtils::animatedTileGroups)) / sizeof(ROMUtils::animatedTileGroups[0]); i++)
+                for(int i : ChangeJournal::GetChanged(ChangeJournal::AnimatedTileGroupAsset))
                 {
                     int animatedTileGroupHeaderAddr = WL4Constants::AnimatedTileHeaderTable + i * 8;
-                    if(animatedTileGroups[i]->IsNewAnimatedTile8x8Group())
-                    {
-                        *(TempFile + animatedTileGroupHeaderAddr) = animatedTileGroups[i]->GetAnimationType();
-                        *(TempFile + animatedTileGroupHeaderAddr + 1) = animatedTileGroups[i]->GetCountPerFrame();
-                        *(TempFile + animatedTileGroupHeaderAddr + 2) = animatedTileGroups[i]->GetTotalFrameCount();
-                        *(TempFile + animatedTileGroupHeaderAddr + 3) = 0;  // keep the unused byte 0 for now
-                    }
+                    *(TempFile + animatedTileGroupHeaderAddr) = animatedTileGroups[i]->GetAnimationType();
+                    *(TempFile + animatedTileGroupHeaderAddr + 1) = animatedTileGroups[i]->GetCountPerFrame();
+                    *(TempFile + animatedTileGroupHeaderAddr + 2) = animatedTileGroups[i]->GetTotalFrameCount();
+                    *(TempFile + animatedTileGroupHeaderAddr + 3) = 0;  // keep the unused byte 0 for now
                 }
 
                 return QString("");
@@ -1354,16 +1880,17 @@ error:      free(TempFile); // free up temporary file if there was a processing
         );
 
         if(!ret) return false;
+        ROMReferenceIndex::RefreshPointers(redirectedPointers);
 
         // Set the new internal data pointers for LevelComponents objects, and mark dirty objects as clean
         // --------------------------------------------------------------------
-        // Rooms instances internal pointers reset
+        // Rooms instances internal pointers reset, the kept levels are deleted with the journal below
         // TODO: move out the unset dirty code, it is headache to do all of them here
-        // TODO: code needs to be changed if we are going to support saving all the changes in the whole ROM, every level, i mean
+        LevelComponents::Level *currentLevel = levelStates[0].level;
         std::vector<LevelComponents::Room*> rooms = currentLevel->GetRooms();
         for(unsigned int i = 0; i < rooms.size(); ++i)
         {
-            unsigned int newroomheaderAddr = roomHeaderInROM + i * sizeof(struct LevelComponents::__RoomHeader);
+            unsigned int newroomheaderAddr = levelStates[0].roomHeaderInROM + i * sizeof(struct LevelComponents::__RoomHeader);
             struct LevelComponents::__RoomHeader *roomHeader = (struct LevelComponents::__RoomHeader*)
                 (ROMFileMetadata->ROMDataPtr + newroomheaderAddr);
             unsigned int *layerDataPtrs = (unsigned int*) &roomHeader->Layer0Data;
@@ -1384,46 +1911,17 @@ error:      free(TempFile); // free up temporary file if there was a processing
             room->SetRoomHeaderAddr(newroomheaderAddr);
         }
 
-        // global history changed bool reset
-        ResetChangedBoolsThroughHistory();
-
         // Tilesets instances internal pointers reset
-        for(int i = 0; i < (sizeof(ROMUtils::singletonTilesets)) / sizeof(ROMUtils::singletonTilesets[0]); ++i)
-        {
-            if(singletonTilesets[i]->IsNewTileset())
-            {
-                int tilesetPtr = singletonTilesets[i]->getTilesetPtr();
-                singletonTilesets[i]->SetfgGFXptr(ROMUtils::PointerFromData(tilesetPtr));
-                singletonTilesets[i]->SetPaletteAddr(ROMUtils::PointerFromData(tilesetPtr + 8));
-                singletonTilesets[i]->Setmap16ptr(ROMUtils::PointerFromData(tilesetPtr + 0x14));
-                singletonTilesets[i]->SetChanged(false);
-            }
-        }
-
-        // Entities and Entitysets members reset
-        for(int i = 0x11; i < (sizeof(ROMUtils::entities)) / sizeof(ROMUtils::entities[0]); ++i) // we skip the first 0x10 sprites, they should be addressed differently
+        for(int i : ChangeJournal::GetChanged(ChangeJournal::TilesetAsset))
         {
-            if(entities[i]->IsNewEntity())
-            {
-                entities[i]->SetChanged(false);
-            }
-        }
-        for(int i = 0; i < (sizeof(ROMUtils::entitiessets)) / sizeof(ROMUtils::entitiessets[0]); ++i)
-        {
-            if(entitiessets[i]->IsNewEntitySet())
-            {
-                entitiessets[i]->SetChanged(false);
-            }
+            int tilesetPtr = singletonTilesets[i]->getTilesetPtr();
+            singletonTilesets[i]->SetfgGFXptr(ROMUtils::PointerFromData(tilesetPtr));
+            singletonTilesets[i]->SetPaletteAddr(ROMUtils::PointerFromData(tilesetPtr + 8));
+            singletonTilesets[i]->Setmap16ptr(ROMUtils::PointerFromData(tilesetPtr + 0x14));
         }
 
-        // animated Tile Group members set
-        for(int i = 0; i < (sizeof(ROMUtils::animatedTileGroups)) / sizeof(ROMUtils::animatedTileGroups[0]); i++)
-        {
-            if(animatedTileGroups[i]->IsNewAnimatedTile8x8Group())
-            {
-                ROMUtils::animatedTileGroups[i]->SetChanged(false);
-            }
-        }
+        // Every global instance and kept level is saved now, undo and redo will record them again
+        ChangeJournal::Clear();
         // --------------------------------------------------------------------
         return true;
     }
@@ -1647,6 +2145,302 @@ error:      free(TempFile); // free up temporary file if there was a processing
         return result;
     }
 
+    // A planned relocation of a chunk during defragmentation. Addresses point at the RATS tag
+    struct ChunkMove
+    {
+        unsigned int oldAddr;
+        unsigned int newAddr;
+        unsigned int sizeWithHeader;
+    };
+
+    // A pointer to rewrite after the chunks have been moved
+    struct PointerRewrite
+    {
+        unsigned int pointerAddr; // location of the pointer after the chunks have been moved
+        unsigned int newTarget;
+    };
+
+    /// <summary>
+    /// Check if chunks of a type may be moved by the defragmenter.
+    /// </summary>
+    /// <remarks>
+    /// Patch and assorted graphic chunks are referenced by address from text lists and hook code,
+    /// which are not tracked by the reference index, so they are never moved.
+    /// Layer and tileset palette chunks may be referenced from the assorted graphic list as text too,
+    /// DefragmentSaveData pins the chunks of the addresses found in that list.
+    /// </remarks>
+    static bool IsRelocatableChunkType(enum SaveDataChunkType chunkType)
+    {
+        switch(chunkType)
+        {
+        case SaveDataChunkType::RoomHeaderChunkType:
+        case SaveDataChunkType::DoorChunkType:
+        case SaveDataChunkType::LayerChunkType:
+        case SaveDataChunkType::LevelNameChunkType:
+        case SaveDataChunkType::EntityListChunk:
+        case SaveDataChunkType::CameraPointerTableType:
+        case SaveDataChunkType::CameraBoundaryChunkType:
+        case SaveDataChunkType::TilesetForegroundTile8x8DataChunkType:
+        case SaveDataChunkType::TilesetMap16EventTableChunkType:
+        case SaveDataChunkType::TilesetMap16TerrainChunkType:
+        case SaveDataChunkType::TilesetMap16DataChunkType:
+        case SaveDataChunkType::TilesetPaletteDataChunkType:
+        case SaveDataChunkType::EntityTile8x8DataChunkType:
+        case SaveDataChunkType::EntityPaletteDataChunkType:
+        case SaveDataChunkType::EntitySetLoadTableChunkType:
+        case SaveDataChunkType::AnimatedTileGroupTile8x8DataChunkType:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // A word in the ROM which looks like a pointer into the save data area
+    struct PointerWord
+    {
+        unsigned int target; // without the 0x8000000 bit
+        unsigned int pointerAddr;
+    };
+
+    /// <summary>
+    /// Find every aligned word in the ROM which looks like a pointer into the save data area.
+    /// </summary>
+    /// <remarks>
+    /// This finds the pointers the reference index doesn't know about, such as the ones written by patches,
+    /// along with some data which merely looks like a pointer. Both pin the chunk they point into.
+    /// </remarks>
+    /// <returns>
+    /// The pointer words, ordered by target address.
+    /// </returns>
+    static QVector<struct PointerWord> FindPointerWords(const unsigned char *ROMData, unsigned int ROMLength)
+    {
+        QVector<struct PointerWord> words;
+        for(unsigned int addr = 0; addr + 4 <= ROMLength; addr += 4)
+        {
+            unsigned int word = *reinterpret_cast<const unsigned int*>(ROMData + addr);
+            unsigned int target = word & 0x1FFFFFF;
+            if((word & 0xFE000000) == 0x8000000 && target >= WL4Constants::AvailableSpaceBeginningInROM && target < ROMLength)
+            {
+                words.append({target, addr});
+            }
+        }
+        std::sort(words.begin(), words.end(),
+            [](const struct PointerWord &a, const struct PointerWord &b) {return a.target < b.target;});
+        return words;
+    }
+
+    /// <summary>
+    /// Find the address a ROM location ends up at after the planned chunk moves.
+    /// </summary>
+    /// <param name="moves">
+    /// The planned moves, ordered by old address.
+    /// </param>
+    /// <param name="addr">
+    /// The address before the chunks are moved.
+    /// </param>
+    static unsigned int TranslateMovedAddress(const QVector<struct ChunkMove> &moves, unsigned int addr)
+    {
+        auto iter = std::upper_bound(moves.begin(), moves.end(), addr,
+            [](unsigned int a, const struct ChunkMove &move) {return a < move.oldAddr;});
+        if(iter == moves.begin()) return addr;
+        --iter;
+        if(addr < iter->oldAddr + iter->sizeWithHeader)
+        {
+            return addr - iter->oldAddr + iter->newAddr;
+        }
+        return addr;
+    }
+
+    /// <summary>
+    /// Compact the save data area by sliding chunks towards the beginning of the area,
+    /// then rewrite all the main ROM and chunk-to-chunk pointers to the moved chunks.
+    /// </summary>
+    /// <remarks>
+    /// A chunk is only moved if its type is relocatable, the reference index knows at least one pointer into it,
+    /// every pointer-like word in the ROM which points into it is one of those known and rewritable pointers,
+    /// and no entry of the assorted graphic list references it by its text address. If that list cannot be
+    /// parsed, nothing is moved. Everything else is pinned in place and the chunks after it are compacted up to it.
+    /// The caller must reload the ROM after a successful save, since the loaded LevelComponents keep old addresses.
+    /// </remarks>
+    /// <param name="dryRun">
+    /// Only report what would be done, without saving the ROM.
+    /// </param>
+    /// <param name="saved">
+    /// Optional output, set to true if the defragmented ROM was saved.
+    /// </param>
+    /// <returns>
+    /// The defragmentation report.
+    /// </returns>
+    QString DefragmentSaveData(bool dryRun, bool *saved)
+    {
+        if(saved) *saved = false;
+        unsigned char *ROMData = ROMFileMetadata->ROMDataPtr;
+        unsigned int ROMLength = ROMFileMetadata->Length;
+        QVector<unsigned int> chunks = FindAllChunksInROM(
+            ROMData,
+            ROMLength,
+            WL4Constants::AvailableSpaceBeginningInROM,
+            SaveDataChunkType::InvalidationChunk,
+            true
+        );
+        QVector<struct FreeSpaceRegion> freeSpace = FindAllFreeSpaceInROM(ROMData, ROMLength);
+        unsigned int totalFreeSpace = 0, largestFreeSpace = 0;
+        for(auto fs : freeSpace)
+        {
+            totalFreeSpace += fs.size;
+            largestFreeSpace = qMax(largestFreeSpace, fs.size);
+        }
+
+        // Plan the moves. Chunks are visited in address order, so every chunk slides into space freed before it
+        QVector<struct PointerWord> pointerWords = FindPointerWords(ROMData, ROMLength);
+        QVector<unsigned int> textAddresses;
+        bool textAddressesKnown = AssortedGraphicUtils::GetReferencedSaveDataAddressesFromROM(textAddresses);
+        std::sort(textAddresses.begin(), textAddresses.end());
+        QVector<struct ChunkMove> moves;
+        QVector<struct PointerRewrite> rewrites;
+        QVector<struct FreeSpaceRegion> placed; // final location of every chunk, reusing the region struct
+        unsigned int cursor = WL4Constants::AvailableSpaceBeginningInROM;
+        unsigned int movedBytes = 0, holeCountAfter = 0;
+        unsigned int pinnedByType = 0, pinnedUnreferenced = 0, pinnedUnknownPointers = 0, pinnedByTextAddresses = 0;
+        for(unsigned int chunkAddr : chunks)
+        {
+            unsigned int sizeWithHeader = GetChunkDataLength(chunkAddr) + 12;
+            unsigned int chunkEnd = chunkAddr + sizeWithHeader;
+            enum SaveDataChunkType chunkType = static_cast<enum SaveDataChunkType>(ROMData[chunkAddr + 8]);
+            bool relocatable = chunkType < CHUNK_TYPE_COUNT && IsRelocatableChunkType(chunkType);
+            auto textAddress = std::lower_bound(textAddresses.begin(), textAddresses.end(), chunkAddr);
+            if(!relocatable)
+            {
+                pinnedByType++;
+            }
+            else if(!textAddressesKnown || (textAddress != textAddresses.end() && *textAddress < chunkEnd))
+            {
+                // The assorted graphic list would keep pointing at the old address
+                relocatable = false;
+                pinnedByTextAddresses++;
+            }
+            else
+            {
+                QVector<struct ROMReferenceIndex::Reference> references =
+                    ROMReferenceIndex::FindReferencesInRange(chunkAddr, chunkEnd);
+                QSet<unsigned int> knownPointers;
+                for(const struct ROMReferenceIndex::Reference &reference : references)
+                {
+                    // Only aligned pointers within the ROM can be rewritten
+                    if((reference.PointerAddress & 3) || reference.PointerAddress + 4 > ROMLength)
+                    {
+                        relocatable = false;
+                        break;
+                    }
+                    knownPointers.insert(reference.PointerAddress);
+                }
+                auto word = std::lower_bound(pointerWords.begin(), pointerWords.end(), chunkAddr,
+                    [](const struct PointerWord &w, unsigned int a) {return w.target < a;});
+                for(; relocatable && word != pointerWords.end() && word->target < chunkEnd; ++word)
+                {
+                    if(!knownPointers.contains(word->pointerAddr)) relocatable = false;
+                }
+                if(references.isEmpty())
+                {
+                    relocatable = false;
+                    pinnedUnreferenced++;
+                }
+                else if(!relocatable)
+                {
+                    pinnedUnknownPointers++;
+                }
+            }
+            unsigned int newAddr = chunkAddr;
+            if(relocatable)
+            {
+                newAddr = ChunkTypeAlignment[chunkType] ? ((cursor + 3) & ~3) : cursor;
+                if(newAddr > chunkAddr) newAddr = chunkAddr; // alignment never pushes a chunk forwards
+            }
+            if(newAddr > cursor) holeCountAfter++;
+            if(newAddr < chunkAddr)
+            {
+                moves.append({chunkAddr, newAddr, sizeWithHeader});
+                movedBytes += sizeWithHeader;
+            }
+            placed.append({newAddr, sizeWithHeader});
+            cursor = newAddr + sizeWithHeader;
+        }
+        unsigned int freeTailAfter = ROMLength > cursor ? ROMLength - cursor : 0;
+
+        // Collect every pointer into the moved chunks, including pointers which live inside moved chunks themselves
+        for(const struct ChunkMove &move : moves)
+        {
+            for(const struct ROMReferenceIndex::Reference &reference :
+                ROMReferenceIndex::FindReferencesInRange(move.oldAddr, move.oldAddr + move.sizeWithHeader))
+            {
+                rewrites.append({TranslateMovedAddress(moves, reference.PointerAddress),
+                                 reference.TargetAddress - move.oldAddr + move.newAddr});
+            }
+        }
+
+        QString result = QString(dryRun ? "Save data defragmentation (dry run):\n" : "Save data defragmentation:\n");
+        result += QString("Chunks: %1 (%2 pinned)\n").arg(chunks.size())
+                    .arg(pinnedByType + pinnedUnreferenced + pinnedUnknownPointers + pinnedByTextAddresses);
+        result += QString("  Pinned by chunk type: %1\n").arg(pinnedByType);
+        result += QString("  Pinned by addresses in the assorted graphic list: %1\n").arg(pinnedByTextAddresses);
+        if(!textAddressesKnown) result += QT_TR_NOOP("  The assorted graphic list cannot be parsed, no chunk is moved.\n");
+        result += QString("  Pinned without known pointers: %1\n").arg(pinnedUnreferenced);
+        result += QString("  Pinned by pointers which are not indexed or cannot be rewritten: %1\n").arg(pinnedUnknownPointers);
+        result += QString("Chunks to relocate: %1 (%2 bytes, %3 pointers)\n").arg(moves.size()).arg(movedBytes).arg(rewrites.size());
+        result += QString("Free space before: %1 in %2 regions, largest region %3\n")
+                    .arg(totalFreeSpace).arg(freeSpace.size()).arg(largestFreeSpace);
+        result += QString("Free space after: %1 in %2 regions, contiguous at end %3\n")
+                    .arg(totalFreeSpace).arg(holeCountAfter + (freeTailAfter ? 1 : 0)).arg(freeTailAfter);
+        result += QString("Reclaimed into contiguous free space: %1\n")
+                    .arg(freeTailAfter > largestFreeSpace ? freeTailAfter - largestFreeSpace : 0);
+
+        if(dryRun || moves.isEmpty() || largestFreeSpace < 12) return result; // SaveFile would expand the ROM without free space
+
+        // Save through SaveFile so backups are made the same way as for normal saves. No new chunks are allocated,
+        // all the work happens in post-processing on the copy of the ROM
+        auto noAllocation = [](unsigned char*, struct FreeSpaceRegion, struct SaveData*, bool, int*)
+            {return ChunkAllocationStatus::NoMoreChunks;};
+        auto applyMoves = [&moves, &placed, &rewrites](unsigned char *TempFile, std::map<int, int>)
+        {
+            for(const struct ChunkMove &move : moves)
+            {
+                memmove(TempFile + move.newAddr, TempFile + move.oldAddr, move.sizeWithHeader);
+            }
+
+            // Clear what is left of the old chunks so their RATS tags cannot be found again
+            for(const struct ChunkMove &move : moves)
+            {
+                unsigned int clearStart = move.oldAddr, oldEnd = move.oldAddr + move.sizeWithHeader;
+                auto iter = std::upper_bound(placed.begin(), placed.end(), clearStart,
+                    [](unsigned int a, const struct FreeSpaceRegion &r) {return a < r.addr + r.size;});
+                while(clearStart < oldEnd)
+                {
+                    unsigned int clearEnd = iter == placed.end() ? oldEnd : qMin(oldEnd, iter->addr);
+                    if(clearEnd > clearStart)
+                    {
+                        memset(TempFile + clearStart, 0xFF, clearEnd - clearStart);
+                    }
+                    if(iter == placed.end()) break;
+                    clearStart = qMax(clearStart, iter->addr + iter->size);
+                    ++iter;
+                }
+            }
+
+            for(const struct PointerRewrite &rewrite : rewrites)
+            {
+                *reinterpret_cast<unsigned int*>(TempFile + rewrite.pointerAddr) = rewrite.newTarget | 0x8000000;
+            }
+            return QString("");
+        };
+        bool success = SaveFile(ROMFileMetadata->FilePath, QVector<unsigned int>(), noAllocation, applyMoves);
+
+        // Pointers were moved behind the reference index's back
+        ROMReferenceIndex::Invalidate();
+        if(saved) *saved = success;
+        if(!success) result += QT_TR_NOOP("Defragmentation failed, the ROM was not changed.\n");
+        return result;
+    }
+
     /// <summary>
     /// Clean up TmpCurrentFile meta data.
     /// </summary>
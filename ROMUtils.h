@@ -31,7 +31,7 @@ namespace ROMUtils
     extern struct ROMFileMetadata TempROMMetadata;
     extern struct ROMFileMetadata *ROMFileMetadata;
 
-    extern unsigned int SaveDataIndex;
+    extern thread_local unsigned int SaveDataIndex;
 
     extern LevelComponents::AnimatedTile8x8Group *animatedTileGroups[270];
     extern LevelComponents::Tileset *singletonTilesets[92];
@@ -96,6 +96,15 @@ namespace ROMUtils
         unsigned int size;
     };
 
+    // Flips applied by the tile codec, same order as the flip bits of the Tile8x8 map data
+    enum TileFlip
+    {
+        TileNoFlip = 0,
+        TileFlipX  = 1,
+        TileFlipY  = 2,
+        TileFlipXY = 3
+    };
+
     // Exposed helper functions
     void FormatPathSeperators(QString &path);
 
@@ -108,11 +117,16 @@ namespace ROMUtils
 
     void Tile8x8DataXFlip(unsigned char *source, unsigned char *destination);
     void Tile8x8DataYFlip(unsigned char *source, unsigned char *destination);
+    void FlipTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount, int flips);
+    void UnpackTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount, int flips);
+    void PackTiles4bpp(const unsigned char *source, unsigned char *destination, int tileCount);
 
     unsigned int PackScreen(unsigned short *screenCharData, unsigned short *&outputCompressedData, bool skipzeros = true);
     unsigned short *UnPackScreen(uint32_t address);
+    unsigned short *UnPackScreen(const unsigned short *src);
     unsigned char *LayerRLEDecompress(int address, size_t outputSize);
-    unsigned int LayerRLECompress(unsigned int _layersize, unsigned short *LayerData, unsigned char **OutputCompressedData);
+    unsigned char *LayerRLEDecompress(const unsigned char *data, size_t outputSize);
+    unsigned int LayerRLECompress(unsigned int _layersize, const unsigned short *LayerData, unsigned char **OutputCompressedData);
 
     bool GetChunkType(unsigned int DataAddr, enum SaveDataChunkType &chunkType);
     unsigned int GetChunkDataLength(unsigned int chunkheaderAddr);
@@ -134,6 +148,7 @@ namespace ROMUtils
     void GenerateEntitySetSaveChunks(int EntitySetId, QVector<struct ROMUtils::SaveData> &chunks);
 
     QString SaveDataAnalysis();
+    QString DefragmentSaveData(bool dryRun, bool *saved = nullptr);
     void StaticInitialization();
     bool WriteChunkSanityCheck(const struct SaveData &chunk, const unsigned int chunk_addr, const QVector<unsigned int> &existChunks);
 
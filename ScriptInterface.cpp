@@ -1,6 +1,10 @@
 ﻿#include "ScriptInterface.h"
 
+#include "BatchRunner.h"
+#include "BulkExportUtils.h"
+#include "ChangeJournal.h"
 #include "Operation.h"
+#include "ProfilingUtils.h"
 #include "ROMUtils.h"
 
 #ifndef WINDOW_INSTANCE_SINGLETON
@@ -272,7 +276,7 @@ void ScriptInterface::_ExportLayerData(QString filePath, int layerid)
         file.open(QIODevice::WriteOnly);
         if (file.isOpen())
         {
-            file.write(reinterpret_cast<const char*>(room->GetLayer(layerid)->GetLayerData()), 2 * witdh * height);
+            file.write(reinterpret_cast<const char*>(room->GetLayer(layerid)->ReadLayerData()), 2 * witdh * height);
         } else {
             log("Cannot save data file!");
             return;
@@ -586,7 +590,7 @@ void ScriptInterface::SetRoomSize(int roomwidth, int roomheight, int layer0width
                                                                                       _currentRoomConfigParams->Layer0Height,
                                                                                       _currentRoomConfigParams->LayerData[0]);
     } else {
-        _nextRoomConfigParams->LayerData[0] = nullptr;
+        _nextRoomConfigParams->LayerData[0].clear();
     }
     _nextRoomConfigParams->LayerData[1] = RoomConfigDialog::ChangeLayerDimensions(roomwidth, roomheight,
                                                                                   _currentRoomConfigParams->RoomWidth,
@@ -598,7 +602,7 @@ void ScriptInterface::SetRoomSize(int roomwidth, int roomheight, int layer0width
                                                                                       _currentRoomConfigParams->RoomHeight,
                                                                                       _currentRoomConfigParams->LayerData[2]);
     } else {
-        _nextRoomConfigParams->LayerData[2] = nullptr;
+        _nextRoomConfigParams->LayerData[2].clear();
     }
 
     // Add changes into the operation history
@@ -612,6 +616,11 @@ void ScriptInterface::SetRoomSize(int roomwidth, int roomheight, int layer0width
 
 void ScriptInterface::alert(QString message)
 {
+    if (BatchRunner::IsActive())
+    {
+        log(message);
+        return;
+    }
     QMessageBox::critical(singleton, QString("Error"), message);
 }
 
@@ -627,6 +636,10 @@ void ScriptInterface::log(QString message)
 
 QString ScriptInterface::prompt(QString message, QString defaultInput)
 {
+    if (BatchRunner::IsActive())
+    {
+        return defaultInput;
+    }
     bool ok;
     QString text = QInputDialog::getText(nullptr, tr("InputBox"),
                                          message, QLineEdit::Normal,
@@ -689,6 +702,69 @@ void ScriptInterface::ShowSaveDataAnalysis()
     log(ROMUtils::SaveDataAnalysis());
 }
 
+void ScriptInterface::ShowSavePreview()
+{
+    log(ChangeJournal::GetSavePreview(singleton->GetCurrentLevel()));
+}
+
+void ScriptInterface::DefragmentSaveData(bool dryRun)
+{
+    // Defragmentation saves and reloads the ROM, so unsaved changes must be saved or discarded first
+    if (!dryRun && !singleton->UnsavedChangesPrompt(tr("There are unsaved changes. Save them before defragmenting the save data?")))
+    {
+        return;
+    }
+    bool saved = false;
+    log(ROMUtils::DefragmentSaveData(dryRun, &saved));
+    if (saved)
+    {
+        // All the loaded LevelComponents still point at the old chunk addresses
+        singleton->LoadROMDataFromFile(ROMUtils::ROMFileMetadata->FilePath);
+    }
+}
+
+void ScriptInterface::ExportAllGraphics(QString directory)
+{
+    log(BulkExportUtils::ExportAllGraphics(directory));
+}
+
+void ScriptInterface::ShowProfilingReport()
+{
+    log(ProfilingUtils::GetReport());
+}
+
+void ScriptInterface::ResetProfiling()
+{
+    ProfilingUtils::Reset();
+}
+
+void ScriptInterface::SaveProfilingTrace(QString filePath)
+{
+    if (!ProfilingUtils::IsEnabled())
+    {
+        log(ProfilingUtils::GetReport());
+        return;
+    }
+    if (!filePath.compare(""))
+        filePath = QFileDialog::getSaveFileName(singleton, tr("Save Chrome trace file"), singleton->GetdDialogInitialPath(), tr("JSON files (*.json)"));
+    if (!filePath.compare(""))
+    {
+        log("Invalid file path!");
+        return;
+    }
+    QFile file(filePath);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        file.write(ProfilingUtils::GetChromeTrace());
+        file.close();
+        log("Writing finished");
+    }
+    else
+    {
+        log("Write file failed !");
+    }
+}
+
 // ---------------------- current Room's hint layer render stuff --------------------------
 
 void HintLayer::GetAutoGeneratedHintLayer()
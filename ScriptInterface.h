@@ -62,6 +62,12 @@ public:
 
     // helper functions
     Q_INVOKABLE void ShowSaveDataAnalysis();
+    Q_INVOKABLE void ShowSavePreview();
+    Q_INVOKABLE void DefragmentSaveData(bool dryRun = true);
+    Q_INVOKABLE void ExportAllGraphics(QString directory);
+    Q_INVOKABLE void ShowProfilingReport();
+    Q_INVOKABLE void ResetProfiling();
+    Q_INVOKABLE void SaveProfilingTrace(QString filePath = QString(""));
 };
 
 class HintLayer : public QObject
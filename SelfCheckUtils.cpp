@@ -0,0 +1,384 @@
+#include "SelfCheckUtils.h"
+#include "BatchRunner.h"
+#include "ROMReferenceIndex.h"
+#include "ROMUtils.h"
+#include "LevelComponents/Level.h"
+
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cstring>
+
+#ifndef WINDOW_INSTANCE_SINGLETON
+#define WINDOW_INSTANCE_SINGLETON
+#include "WL4EditorWindow.h"
+extern WL4EditorWindow *singleton;
+#endif
+
+namespace SelfCheckUtils
+{
+    // Only this many failures are described in the report for each check, the rest are only counted
+    static const int MaxReportedFailures = 20;
+
+    /// <summary>
+    /// Count a failure, and describe it in the report if not too many were described already.
+    /// </summary>
+    static void Fail(QString &report, int &failures, QString message)
+    {
+        if (failures++ < MaxReportedFailures)
+        {
+            report += "  FAIL: " + message + "\n";
+        }
+    }
+
+    /// <summary>
+    /// Fill a buffer with tile data shaped like layer data: runs of one value, runs of increasing values and noise.
+    /// </summary>
+    /// <param name="random">
+    /// The random number generator.
+    /// </param>
+    /// <param name="data">
+    /// The buffer to fill.
+    /// </param>
+    /// <param name="size">
+    /// The number of tiles in the buffer.
+    /// </param>
+    /// <param name="maxValue">
+    /// The largest tile value to generate.
+    /// </param>
+    static void FillRandomTiles(QRandomGenerator &random, unsigned short *data, int size, int maxValue)
+    {
+        int i = 0;
+        while (i < size)
+        {
+            int end = qMin(size, i + random.bounded(1, 300));
+            unsigned short value = static_cast<unsigned short>(random.bounded(0, maxValue + 1));
+            switch (random.bounded(0, 3))
+            {
+            case 0:
+                while (i < end) data[i++] = value;
+                break;
+            case 1:
+                while (i < end) data[i++] = value++;
+                break;
+            default:
+                while (i < end) data[i++] = static_cast<unsigned short>(random.bounded(0, maxValue + 1));
+                break;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Compress layer data with LayerRLECompress and check that LayerRLEDecompress restores it.
+    /// </summary>
+    static bool LayerRLERoundTrip(const unsigned short *data, unsigned int size)
+    {
+        unsigned char *compressedData = nullptr;
+        ROMUtils::LayerRLECompress(size, data, &compressedData);
+        unsigned char *decompressedData = ROMUtils::LayerRLEDecompress(compressedData, size * 2);
+        bool same = decompressedData && !memcmp(decompressedData, data, size * 2);
+        delete[] compressedData;
+        delete[] decompressedData;
+        return same;
+    }
+
+    /// <summary>
+    /// Compress a 32x32 screen with PackScreen and check that UnPackScreen restores it.
+    /// </summary>
+    static bool PackScreenRoundTrip(unsigned short *screen, bool skipzeros)
+    {
+        unsigned short *compressedData = nullptr;
+        ROMUtils::PackScreen(screen, compressedData, skipzeros);
+        unsigned short *decompressedData = ROMUtils::UnPackScreen(static_cast<const unsigned short *>(compressedData));
+        bool same = !memcmp(decompressedData, screen, 32 * 32 * sizeof(unsigned short));
+        delete[] compressedData;
+        delete[] decompressedData;
+        return same;
+    }
+
+    /// <summary>
+    /// Round-trip random layers and screens through the codecs.
+    /// </summary>
+    static int CheckRandomRoundTrips(QRandomGenerator &random, int cases, QString &report)
+    {
+        int failures = 0;
+        QVector<unsigned short> data;
+        for (int i = 0; i < cases; ++i)
+        {
+            // Layer sizes up to 255x255, both with Map16 ids and with the full 16 bit range
+            int width = random.bounded(1, 256), height = random.bounded(1, 256);
+            int maxValue = random.bounded(0, 2) ? 0x2FF : 0xFFFF;
+            data.resize(width * height);
+            FillRandomTiles(random, data.data(), data.size(), maxValue);
+            if (!LayerRLERoundTrip(data.data(), data.size()))
+            {
+                Fail(report, failures, QString("LayerRLE round trip of random %1x%2 layer (case %3)").arg(width).arg(height).arg(i));
+            }
+
+            unsigned short screen[32 * 32];
+            FillRandomTiles(random, screen, 32 * 32, random.bounded(0, 2) ? 0x3FF : 0xFFFF);
+            bool skipzeros = random.bounded(0, 2);
+            if (!PackScreenRoundTrip(screen, skipzeros))
+            {
+                Fail(report, failures, QString("PackScreen round trip of random screen (case %1, skipzeros %2)").arg(i).arg(skipzeros));
+            }
+        }
+        report += QString("Random codec round trips: %1 layers and %1 screens, %2 failures\n").arg(cases).arg(failures);
+        return failures;
+    }
+
+    /// <summary>
+    /// Check the tile codec against pixel by pixel decoding of random 4bpp tiles.
+    /// </summary>
+    static int CheckTileCodec(QRandomGenerator &random, int cases, QString &report)
+    {
+        int failures = 0;
+        QByteArray tiles, colorIndices, flippedTiles, flippedColorIndices, packedTiles;
+        for (int i = 0; i < cases; ++i)
+        {
+            int tileCount = random.bounded(1, 65);
+            tiles.resize(tileCount * 32);
+            for (int j = 0; j < tiles.size(); ++j)
+            {
+                tiles[j] = static_cast<char>(random.bounded(0, 256));
+            }
+            const unsigned char *source = reinterpret_cast<const unsigned char *>(tiles.constData());
+            colorIndices.resize(tileCount * 64);
+            flippedTiles.resize(tileCount * 32);
+            flippedColorIndices.resize(tileCount * 64);
+            packedTiles.resize(tileCount * 32);
+            for (int flips = ROMUtils::TileNoFlip; flips <= ROMUtils::TileFlipXY; ++flips)
+            {
+                unsigned char *indices = reinterpret_cast<unsigned char *>(colorIndices.data());
+                ROMUtils::UnpackTiles4bpp(source, indices, tileCount, flips);
+                bool same = true;
+                for (int j = 0; j < tileCount * 64 && same; ++j)
+                {
+                    int x = j % 8, y = (j / 8) % 8;
+                    if (flips & ROMUtils::TileFlipX) x = 7 - x;
+                    if (flips & ROMUtils::TileFlipY) y = 7 - y;
+                    same = indices[j] == ((source[(j / 64) * 32 + y * 4 + x / 2] >> ((x & 1) * 4)) & 0xF);
+                }
+                if (!same)
+                {
+                    Fail(report, failures, QString("UnpackTiles4bpp of %1 random tiles with flips %2 (case %3)").arg(tileCount).arg(flips).arg(i));
+                }
+
+                // Flipping the packed tiles must give the same pixels as flipping while unpacking
+                unsigned char *flipped = reinterpret_cast<unsigned char *>(flippedTiles.data());
+                ROMUtils::FlipTiles4bpp(source, flipped, tileCount, flips);
+                ROMUtils::UnpackTiles4bpp(flipped, reinterpret_cast<unsigned char *>(flippedColorIndices.data()), tileCount, ROMUtils::TileNoFlip);
+                if (flippedColorIndices != colorIndices)
+                {
+                    Fail(report, failures, QString("FlipTiles4bpp of %1 random tiles with flips %2 (case %3)").arg(tileCount).arg(flips).arg(i));
+                }
+
+                ROMUtils::PackTiles4bpp(indices, reinterpret_cast<unsigned char *>(packedTiles.data()), tileCount);
+                if (packedTiles != flippedTiles)
+                {
+                    Fail(report, failures, QString("PackTiles4bpp of %1 random tiles with flips %2 (case %3)").arg(tileCount).arg(flips).arg(i));
+                }
+            }
+        }
+        report += QString("Tile codec: %1 random tile blocks, %2 failures\n").arg(cases).arg(failures);
+        return failures;
+    }
+
+    /// <summary>
+    /// Round-trip the layers of every vanilla level through the codecs.
+    /// </summary>
+    static int CheckROMLayerRoundTrips(QString &report)
+    {
+        int failures = 0, layerCount = 0, screenCount = 0;
+        for (int i = 0; i < WL4Constants::VanillaLevelCount; ++i)
+        {
+            LevelComponents::Level level(static_cast<LevelComponents::__passage>(WL4Constants::VanillaLevelPassages[i]),
+                                         static_cast<LevelComponents::__stage>(WL4Constants::VanillaLevelStages[i]));
+            for (LevelComponents::Room *room : level.GetRooms())
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    LevelComponents::Layer *layer = room->GetLayer(j);
+                    if (!layer->IsEnabled() || !layer->ReadLayerData()) continue;
+                    int width = layer->GetLayerWidth(), height = layer->GetLayerHeight();
+                    QString name = QString("level %1-%2 room %3 layer %4").arg(WL4Constants::VanillaLevelPassages[i])
+                                       .arg(WL4Constants::VanillaLevelStages[i]).arg(room->GetRoomID()).arg(j);
+                    ++layerCount;
+                    if (!LayerRLERoundTrip(layer->ReadLayerData(), width * height))
+                    {
+                        Fail(report, failures, "LayerRLE round trip of " + name);
+                    }
+                    if (layer->GetMappingType() != LevelComponents::LayerTile8x8) continue;
+
+                    // 8x8 tile layers are made of 32x32 screens
+                    unsigned short screen[32 * 32];
+                    for (int y = 0; y < height; y += 32)
+                    {
+                        for (int x = 0; x < width; x += 32)
+                        {
+                            for (int row = 0; row < 32; ++row)
+                            {
+                                memcpy(screen + row * 32, layer->ReadLayerData() + (y + row) * width + x, 32 * sizeof(unsigned short));
+                            }
+                            ++screenCount;
+                            if (!PackScreenRoundTrip(screen, true))
+                            {
+                                Fail(report, failures, QString("PackScreen round trip of %1 screen (%2, %3)").arg(name).arg(x).arg(y));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        report += QString("ROM codec round trips: %1 layers and %2 screens, %3 failures\n").arg(layerCount).arg(screenCount).arg(failures);
+        return failures;
+    }
+
+    // The data of one chunk in the save area, without the RATS header
+    struct ChunkRange
+    {
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    /// <summary>
+    /// Check that every chunk in the save area fits in the ROM and has a known type,
+    /// and that every pointer into the save area points into the data of a chunk.
+    /// </summary>
+    static int CheckSaveDataChunks(QString &report)
+    {
+        int failures = 0;
+        unsigned char *ROMData = ROMUtils::ROMFileMetadata->ROMDataPtr;
+        unsigned int ROMLength = ROMUtils::ROMFileMetadata->Length;
+        QVector<unsigned int> chunks = ROMUtils::FindAllChunksInROM(ROMData, ROMLength, WL4Constants::AvailableSpaceBeginningInROM,
+                                                                    ROMUtils::SaveDataChunkType::InvalidationChunk, true);
+        QVector<struct ChunkRange> ranges;
+        for (unsigned int chunkAddr : chunks)
+        {
+            unsigned int dataLength = ROMUtils::GetChunkDataLength(chunkAddr);
+            if (chunkAddr + 12 + dataLength > ROMLength)
+            {
+                Fail(report, failures, QString("chunk at 0x%1 runs past the end of the ROM").arg(chunkAddr, 0, 16));
+            }
+            if (ROMData[chunkAddr + 8] > ROMUtils::SaveDataChunkType::AnimatedTileGroupTile8x8DataChunkType)
+            {
+                Fail(report, failures, QString("chunk at 0x%1 has unknown type 0x%2").arg(chunkAddr, 0, 16).arg(ROMData[chunkAddr + 8], 0, 16));
+            }
+            ranges.append({chunkAddr + 12, chunkAddr + 12 + dataLength});
+        }
+
+        QVector<struct ROMReferenceIndex::Reference> references =
+            ROMReferenceIndex::FindReferencesInRange(WL4Constants::AvailableSpaceBeginningInROM, ROMLength);
+        for (const struct ROMReferenceIndex::Reference &reference : references)
+        {
+            // The chunks are found in address order, so the first chunk ending after the target is the only candidate
+            auto iter = std::upper_bound(ranges.begin(), ranges.end(), reference.TargetAddress,
+                                         [](unsigned int address, const struct ChunkRange &range) { return address < range.end; });
+            if (iter == ranges.end() || reference.TargetAddress < iter->begin)
+            {
+                Fail(report, failures, QString("pointer at 0x%1 to 0x%2 does not point into chunk data")
+                                           .arg(reference.PointerAddress, 0, 16).arg(reference.TargetAddress, 0, 16));
+            }
+        }
+        report += QString("Save data chunks: %1 chunks and %2 pointers, %3 failures\n").arg(chunks.size()).arg(references.size()).arg(failures);
+        return failures;
+    }
+
+    /// <summary>
+    /// Save the current level with every layer recompressed, then check the chunks again
+    /// and check that the saved layers decompress to the layers in memory.
+    /// </summary>
+    /// <remarks>
+    /// The save goes to a temporary file, the loaded ROM data is updated like for a normal save.
+    /// A save also clears the change journal and the unsaved changes state, which would make the edits of an
+    /// interactive session look saved, so the check only runs in batch mode.
+    /// </remarks>
+    static int CheckSaveRoundTrip(QString &report)
+    {
+        Q_ASSERT(BatchRunner::IsActive());
+        if (!BatchRunner::IsActive())
+        {
+            report += "Save round trip: skipped, only runs in batch mode\n";
+            return 0;
+        }
+        int failures = 0;
+        LevelComponents::Level *currentLevel = singleton->GetCurrentLevel();
+        QTemporaryDir saveDir;
+        if (!currentLevel || !saveDir.isValid())
+        {
+            report += "Save round trip: skipped, no level loaded or no temporary directory\n";
+            return 0;
+        }
+        for (LevelComponents::Room *room : currentLevel->GetRooms())
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                LevelComponents::Layer *layer = room->GetLayer(i);
+                if (layer->GetMappingType() == LevelComponents::LayerMap16) layer->SetDirty(true);
+            }
+        }
+        if (!ROMUtils::SaveLevel(saveDir.filePath("selfcheck.gba")))
+        {
+            Fail(report, failures, "saving the current level failed");
+            report += QString("Save round trip: %1 failures\n").arg(failures);
+            return failures;
+        }
+
+        failures += CheckSaveDataChunks(report);
+        int layerCount = 0;
+        for (LevelComponents::Room *room : currentLevel->GetRooms())
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                LevelComponents::Layer *layer = room->GetLayer(i);
+                if (layer->GetMappingType() != LevelComponents::LayerMap16) continue;
+                ++layerCount;
+                unsigned int dataPtr = layer->GetDataPtr();
+                int width = layer->GetLayerWidth(), height = layer->GetLayerHeight();
+                unsigned char *savedData = nullptr;
+                if (ROMUtils::ROMFileMetadata->ROMDataPtr[dataPtr] == width && ROMUtils::ROMFileMetadata->ROMDataPtr[dataPtr + 1] == height)
+                {
+                    savedData = ROMUtils::LayerRLEDecompress(dataPtr + 2, width * height * 2);
+                }
+                if (!savedData || memcmp(savedData, layer->ReadLayerData(), width * height * 2))
+                {
+                    Fail(report, failures, QString("saved room %1 layer %2 does not match the layer in memory").arg(room->GetRoomID()).arg(i));
+                }
+                delete[] savedData;
+            }
+        }
+        report += QString("Save round trip: %1 layers, %2 failures\n").arg(layerCount).arg(failures);
+        return failures;
+    }
+
+    /// <summary>
+    /// Run every self check against the loaded ROM.
+    /// </summary>
+    /// <remarks>
+    /// The random cases only depend on the seed, so a failing run can be reproduced.
+    /// The save check runs last since it relocates the current level's chunks in the loaded ROM data.
+    /// </remarks>
+    /// <param name="seed">
+    /// The seed of the random cases.
+    /// </param>
+    /// <param name="randomCases">
+    /// How many random layers and screens to round-trip.
+    /// </param>
+    /// <param name="passed">
+    /// Set to true if no check failed.
+    /// </param>
+    /// <return>The report of the checks.</return>
+    QString RunSelfChecks(unsigned int seed, int randomCases, bool *passed)
+    {
+        QString report = QString("Self checks, seed %1\n").arg(seed);
+        QRandomGenerator random(seed);
+        int failures = CheckRandomRoundTrips(random, randomCases, report);
+        failures += CheckTileCodec(random, randomCases, report);
+        failures += CheckROMLayerRoundTrips(report);
+        failures += CheckSaveDataChunks(report);
+        failures += CheckSaveRoundTrip(report);
+        report += failures ? QString("%1 failures").arg(failures) : QString("All checks passed");
+        *passed = !failures;
+        return report;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef SELFCHECKUTILS_H
+#define SELFCHECKUTILS_H
+
+#include <QString>
+
+// Round-trip checks for the layer, screen and tile codecs and invariant checks for the save data chunks,
+// run against the loaded ROM so that faster implementations of those paths can be verified.
+namespace SelfCheckUtils
+{
+    QString RunSelfChecks(unsigned int seed, int randomCases, bool *passed);
+}
+
+#endif // SELFCHECKUTILS_H
@@ -35,6 +35,11 @@ namespace WL4Constants
     const unsigned int TreasureBoxGFXTiles         = 0x352CF0;
     const unsigned int CreditsTiles                = 0x789FCC;
 
+    // The passage and stage of every level in the vanilla game
+    const int VanillaLevelCount = 25;
+    const int VanillaLevelPassages[VanillaLevelCount] = {0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 5, 5};
+    const int VanillaLevelStages[VanillaLevelCount]   = {0, 2, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 4};
+
     // Wall Paint GFX and Palettes
     const unsigned int WallPaintGFXAddr                      = 0x64C8C4;
     const unsigned int WallPaintPalPassageColor              = 0x6A0A48;
@@ -19,6 +19,10 @@ RC_ICONS = images/icon.ico
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 
+# Scoped timers and counters around the slow paths, see ProfilingUtils.h.
+# Comment this out to compile them out of the editor.
+DEFINES += WL4EDITOR_PROFILING
+
 # You can also make your code fail to compile if you use deprecated APIs.
 # In order to do so, uncomment the following line.
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
@@ -51,7 +55,17 @@ SOURCES += \
     DockWidget/OutputDockWidget.cpp \
     FileIOUtils.cpp \
     AssortedGraphicUtils.cpp \
+    BatchRunner.cpp \
+    BenchmarkUtils.cpp \
+    BulkExportUtils.cpp \
+    ChangeJournal.cpp \
+    ProfilingUtils.cpp \
+    SelfCheckUtils.cpp \
     LevelComponents/AnimatedTile8x8Group.cpp \
+    LevelComponents/AnimatedTilePreview.cpp \
+    LevelComponents/AsyncRoomRenderer.cpp \
+    LevelComponents/RoomThumbnailCache.cpp \
+    LevelComponents/RenderedLayerCache.cpp \
     LevelComponents/LevelDoorVector.cpp \
     PCG/Graphics/TileUtils.cpp \
     ScriptInterface.cpp \
@@ -63,6 +77,7 @@ SOURCES += \
     LevelComponents/Tile.cpp \
     LevelComponents/Tileset.cpp \
     ROMUtils.cpp \
+    ROMReferenceIndex.cpp \
     Operation.cpp \
     Dialog/ChooseLevelDialog.cpp \
     DockWidget/Tile16DockWidget.cpp \
@@ -103,7 +118,17 @@ HEADERS += \
     DockWidget/OutputDockWidget.h \
     FileIOUtils.h \
     AssortedGraphicUtils.h \
+    BatchRunner.h \
+    BenchmarkUtils.h \
+    BulkExportUtils.h \
+    ChangeJournal.h \
+    ProfilingUtils.h \
+    SelfCheckUtils.h \
     LevelComponents/AnimatedTile8x8Group.h \
+    LevelComponents/AnimatedTilePreview.h \
+    LevelComponents/AsyncRoomRenderer.h \
+    LevelComponents/RoomThumbnailCache.h \
+    LevelComponents/RenderedLayerCache.h \
     LevelComponents/LevelDoorVector.h \
     PCG/Graphics/TileUtils.h \
     ScriptInterface.h \
@@ -112,6 +137,7 @@ HEADERS += \
     LevelComponents/Room.h \
     LevelComponents/Layer.h \
     ROMUtils.h \
+    ROMReferenceIndex.h \
     WL4Constants.h \
     LevelComponents/Tile.h \
     LevelComponents/Tileset.h \
@@ -1,10 +1,14 @@
 ﻿#include "WL4EditorWindow.h"
 
+#include "BatchRunner.h"
+#include "BulkExportUtils.h"
+#include "ChangeJournal.h"
 #include "SettingsUtils.h"
 #include "Themes.h"
 #include "ROMUtils.h"
 #include "FileIOUtils.h"
 #include "Operation.h"
+#include "ProfilingUtils.h"
 
 #include "Dialog/SpritesEditorDialog.h"
 #include "Dialog/PatchManagerDialog.h"
@@ -71,6 +75,13 @@ WL4EditorWindow::WL4EditorWindow(QWidget *parent) : QMainWindow(parent), ui(new
     { ui->actionDark->setChecked(true); break; }
     }
     ui->actionRolling_Save->setChecked(SettingsUtils::GetKey(SettingsUtils::IniKeys::RollingSaveLimit).toInt());
+    AnimatedTilePreviewTimer = new QTimer(this);
+    AnimatedTilePreviewTimer->setInterval(16);
+    connect(AnimatedTilePreviewTimer, SIGNAL(timeout()), this, SLOT(AnimatedTilePreviewTick()));
+    RoomRenderer = new LevelComponents::AsyncRoomRenderer(this);
+    ThumbnailCache = new LevelComponents::RoomThumbnailCache(this);
+    connect(RoomRenderer, SIGNAL(PreviewReady(int, QImage)), this, SLOT(ShowRoomRenderPreview(int, QImage)));
+    connect(RoomRenderer, SIGNAL(LayersReady(int, QVector<QImage>)), this, SLOT(FinishRoomRenderAsync(int, QVector<QImage>)));
 
     // Create DockWidgets
     EditModeWidget = new EditModeDockWidget();
@@ -108,6 +119,7 @@ WL4EditorWindow::~WL4EditorWindow()
     delete statusBarLabel_Scalerate;
 
     // Decomstruct all Tileset singletons
+    LevelComponents::RenderedLayerCache::Clear();
     for(int i = 0; i < (sizeof(ROMUtils::animatedTileGroups) / sizeof(ROMUtils::animatedTileGroups[0])); i++)
     {
         delete ROMUtils::animatedTileGroups[i];
@@ -135,6 +147,7 @@ WL4EditorWindow::~WL4EditorWindow()
     {
         delete CurrentLevel;
     }
+    ChangeJournal::Clear();
 
     if (ROMUtils::ROMFileMetadata->ROMDataPtr)
     {
@@ -184,8 +197,8 @@ void WL4EditorWindow::LoadRoomUIUpdate()
     ui->spinBox_RoomID->setMinimum(0);
     ui->spinBox_RoomID->setMaximum(CurrentLevel->GetRooms().size() - 1);
 
-    // Render the screen
-    RenderScreenFull();
+    // Render the screen, the Room is drawn in the background so that switching Rooms does not block the UI
+    RenderScreenFullAsync();
     SetEditModeDockWidgetLayerEditability();
 }
 
@@ -232,17 +245,29 @@ void WL4EditorWindow::OpenROM()
 /// <param name="filePath">
 /// The path of the ROM file
 /// </param>
-void WL4EditorWindow::LoadROMDataFromFile(QString qFilePath)
+bool WL4EditorWindow::LoadROMDataFromFile(QString qFilePath, bool showErrorDialog)
 {
+    PROFILE_SCOPE("LoadROMDataFromFile");
+
     // Load the ROM file
     std::string filePath = qFilePath.toStdString();
     if (QString errorMessage = FileIOUtils::LoadROMFile(qFilePath); !errorMessage.isEmpty())
     {
-        QMessageBox::critical(nullptr, QString(tr("Load Error")), QString(errorMessage));
-        return;
+        if (showErrorDialog)
+        {
+            QMessageBox::critical(nullptr, QString(tr("Load Error")), QString(errorMessage));
+        }
+        else
+        {
+            OutputWidget->PrintString(tr("Load Error: ") + errorMessage);
+        }
+        return false;
     }
     dialogInitialPath = QFileInfo(qFilePath).dir().path();
-    SettingsUtils::SetKey(SettingsUtils::IniKeys::OpenRomInitPath, dialogInitialPath);
+    if (!BatchRunner::IsActive())
+    {
+        SettingsUtils::SetKey(SettingsUtils::IniKeys::OpenRomInitPath, dialogInitialPath);
+    }
 
     // Clean-up
     if (CurrentLevel)
@@ -282,6 +307,8 @@ void WL4EditorWindow::LoadROMDataFromFile(QString qFilePath)
     setWindowTitle(fileName.c_str());
 
     // Load all LevelComponents singletons
+    LevelComponents::RenderedLayerCache::Clear();
+    ChangeJournal::Clear();
     for(int i = 0; i < (sizeof(ROMUtils::animatedTileGroups) / sizeof(ROMUtils::animatedTileGroups[0])); i++)
     {
         int animatedTileGroupHeaderAddr = WL4Constants::AnimatedTileHeaderTable + i * 8;
@@ -301,8 +328,16 @@ void WL4EditorWindow::LoadROMDataFromFile(QString qFilePath)
     {
         ROMUtils::entitiessets[i] = new LevelComponents::EntitySet(i);
     }
-    UnsavedChanges = false;
+    UnsavedChanges = CurrentLevelEdited = false;
     UIStartUp();
+
+    // Draw the room thumbnails of the whole game in the background
+    ThumbnailCache->Clear();
+    if (!BatchRunner::IsActive())
+    {
+        ThumbnailCache->Refresh();
+    }
+    return true;
 }
 
 /// <summary>
@@ -459,7 +494,6 @@ void WL4EditorWindow::EditCurrentTileset(DialogParams::TilesetEditParams *_newTi
         _oldRoomTilesetEditParams->currentTilesetIndex = currentTilesetId;
         _oldRoomTilesetEditParams->newTileset = ROMUtils::singletonTilesets[currentTilesetId];
         _newTilesetEditParams->newTileset->setTilesetPtr(tilesetPtr);
-        _newTilesetEditParams->newTileset->SetChanged(true);
 
         // Execute Operation and add changes into the operation history
         OperationParams *operation = new OperationParams;
@@ -493,6 +527,7 @@ void WL4EditorWindow::UIStartUp()
             ui->actionSave_As->setEnabled(true);
         }
         ui->actionSave_Room_s_graphic->setEnabled(true);
+        ui->actionExport_All_Graphics->setEnabled(true);
         ui->menuImport_from_ROM->setEnabled(true);
         ui->actionUndo->setEnabled(true);
         ui->actionRedo->setEnabled(true);
@@ -501,6 +536,7 @@ void WL4EditorWindow::UIStartUp()
         ui->actionLevel_Config->setEnabled(true);
         ui->actionRoom_Config->setEnabled(true);
         ui->actionEdit_Animated_Tile_Groups->setEnabled(true);
+        ui->actionPreview_Animated_Tiles->setEnabled(true);
         ui->actionEdit_Tileset->setEnabled(true);
         ui->actionEdit_Credits->setEnabled(true);
         ui->menuAdd->setEnabled(true);
@@ -531,15 +567,35 @@ void WL4EditorWindow::UIStartUp()
         EntitySetWidget->setVisible(false);
     }
 
-    // Modify Recent ROM menu
-    ManageRecentFilesOrScripts(ROMUtils::ROMFileMetadata->FilePath);
+    // Modify Recent ROM menu, batch jobs should not show up in the history
+    if (!BatchRunner::IsActive())
+    {
+        ManageRecentFilesOrScripts(ROMUtils::ROMFileMetadata->FilePath);
+    }
 
     // Load the first level and render the screen, also set up the UI
-    selectedLevel._PassageIndex = SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentPassage_id)).toInt();
-    selectedLevel._LevelIndex = SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentLevel_id)).toInt();
+    int startRoomId;
+    if (BatchRunner::IsActive())
+    {
+        int passage, stage;
+        BatchRunner::GetStartLevel(&passage, &stage, &startRoomId);
+        selectedLevel._PassageIndex = passage;
+        selectedLevel._LevelIndex = stage;
+    }
+    else
+    {
+        selectedLevel._PassageIndex = SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentPassage_id)).toInt();
+        selectedLevel._LevelIndex = SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentLevel_id)).toInt();
+        startRoomId = SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentRoom_id)).toInt();
+    }
     CurrentLevel = new LevelComponents::Level(static_cast<enum LevelComponents::__passage>(selectedLevel._PassageIndex),
                                               static_cast<enum LevelComponents::__stage>(selectedLevel._LevelIndex));
-    ui->spinBox_RoomID->setValue(SettingsUtils::GetKey(static_cast<SettingsUtils::IniKeys>(SettingsUtils::IniKeys::RecentROM_0_RecentRoom_id)).toInt());
+    if (BatchRunner::IsActive() && startRoomId >= static_cast<int>(CurrentLevel->GetRooms().size()))
+    {
+        // Only the batch command line can ask for a room the level doesn't have
+        startRoomId = 0;
+    }
+    ui->spinBox_RoomID->setValue(startRoomId);
 
     unsigned int currentroomid = ui->spinBox_RoomID->value();
     int tmpTilesetID = CurrentLevel->GetRooms()[currentroomid]->GetTilesetID();
@@ -794,11 +850,40 @@ void WL4EditorWindow::on_actionOpen_ROM_triggered()
     OpenROM();
 }
 
+/// <summary>
+/// Put the static layers of every Room back, while the scene they were rendered to still exists.
+/// </summary>
+/// <remarks>
+/// The animated tile preview restarts on the next timer tick.
+/// </remarks>
+void WL4EditorWindow::StopAnimatedTilePreviews()
+{
+    if (CurrentLevel)
+    {
+        for (LevelComponents::Room *room : CurrentLevel->GetRooms())
+        {
+            room->StopAnimatedTilePreview();
+        }
+    }
+}
+
 /// <summary>
 /// Perform a full render of the currently selected room.
 /// </summary>
-void WL4EditorWindow::RenderScreenFull()
+/// <remarks>
+/// This replaces any background render of the room which is still running.
+/// </remarks>
+/// <param name="prerenderedLayers">
+/// Layer framebuffers already drawn by the AsyncRoomRenderer, the missing ones are rendered here.
+/// </param>
+void WL4EditorWindow::RenderScreenFull(QVector<QImage> prerenderedLayers)
 {
+    PROFILE_SCOPE("RenderScreenFull");
+
+    RoomRenderer->Cancel();
+    ui->graphicsView->setEnabled(true);
+    StopAnimatedTilePreviews();
+
     // Delete the old scene, if it exists
     QGraphicsScene *oldScene = ui->graphicsView->scene();
     if (oldScene)
@@ -811,6 +896,7 @@ void WL4EditorWindow::RenderScreenFull()
     struct LevelComponents::RenderUpdateParams renderParams(LevelComponents::FullRender);
     renderParams.mode = EditModeWidget->GetEditModeParams();
     renderParams.SelectedDoorID = (unsigned int) ui->graphicsView->GetSelectedDoorID();
+    renderParams.prerenderedLayers = prerenderedLayers;
     LevelComponents::Room *curRoom = this->GetCurrentRoom();
     renderParams.localDoors = CurrentLevel->GetRoomDoorVec(curRoom->GetRoomID());
     QGraphicsScene *scene = curRoom->RenderGraphicsScene(ui->graphicsView->scene(), &renderParams);
@@ -818,14 +904,90 @@ void WL4EditorWindow::RenderScreenFull()
     ui->graphicsView->setAlignment(Qt::AlignTop | Qt::AlignLeft);
 }
 
+/// <summary>
+/// Start a full render of the currently selected room on worker threads.
+/// </summary>
+/// <remarks>
+/// The old scene stays visible until a low resolution preview of the room replaces it, and the graphics view
+/// ignores input until the full render is shown. Any other render of the room finishes it synchronously first.
+/// </remarks>
+void WL4EditorWindow::RenderScreenFullAsync()
+{
+    // Render right away if all the layers were drawn before, by this view or by a dialog preview
+    LevelComponents::Room *room = GetCurrentRoom();
+    bool layersCached = true;
+    for (int i = 0; i < 4 && layersCached; ++i)
+    {
+        LevelComponents::Layer *layer = room->GetLayer(i);
+        QPixmap cachedPixmap;
+        if (layer->IsEnabled() && layer->GetMappingType() != LevelComponents::LayerDisabled)
+        {
+            layersCached = LevelComponents::RenderedLayerCache::Find(LevelComponents::RenderedLayerCache::LayerKey(layer, room->GetTileset()), &cachedPixmap);
+        }
+    }
+    if (layersCached)
+    {
+        RenderScreenFull();
+        return;
+    }
+
+    StopAnimatedTilePreviews();
+    ui->graphicsView->setEnabled(false);
+    RoomRenderer->Start(GetCurrentRoom());
+}
+
+/// <summary>
+/// Show the low resolution preview of the room being rendered in the background.
+/// </summary>
+/// <param name="generation">
+/// The generation of the background render.
+/// </param>
+/// <param name="preview">
+/// The preview, with one pixel per 16x16 block of the scene.
+/// </param>
+void WL4EditorWindow::ShowRoomRenderPreview(int generation, QImage preview)
+{
+    (void) generation;
+    QGraphicsScene *oldScene = ui->graphicsView->scene();
+    if (oldScene)
+    {
+        delete oldScene;
+    }
+    ui->graphicsView->ClearRectPointer();
+    QGraphicsScene *scene = new QGraphicsScene(0, 0, preview.width() * 16, preview.height() * 16);
+    scene->addPixmap(QPixmap::fromImage(preview))->setScale(16);
+    ui->graphicsView->setScene(scene);
+    ui->graphicsView->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+}
+
+/// <summary>
+/// Build the scene of the current room from the layer framebuffers rendered in the background.
+/// </summary>
+/// <param name="generation">
+/// The generation of the background render.
+/// </param>
+/// <param name="layers">
+/// The framebuffers of the 4 layers.
+/// </param>
+void WL4EditorWindow::FinishRoomRenderAsync(int generation, QVector<QImage> layers)
+{
+    (void) generation;
+    if (!CurrentLevel) return;
+    RenderScreenFull(layers);
+}
+
 /// <summary>
 /// Perform a re-render of the currently selected room, if only layer visibility has been toggled.
 /// </summary>
 void WL4EditorWindow::RenderScreenVisibilityChange()
 {
+    // The room has no scene to update before its background render finished
+    if (RoomRenderer->IsRendering()) RenderScreenFull();
+
     struct LevelComponents::RenderUpdateParams renderParams(LevelComponents::LayerEnable);
     renderParams.mode = EditModeWidget->GetEditModeParams();
     LevelComponents::Room *curRoom = this->GetCurrentRoom();
+    curRoom->StopAnimatedTilePreview();
     renderParams.localDoors = CurrentLevel->GetRoomDoorVec(curRoom->GetRoomID());
     QGraphicsScene *scene = curRoom->RenderGraphicsScene(ui->graphicsView->scene(), &renderParams);
     ui->graphicsView->setScene(scene);
@@ -837,6 +999,8 @@ void WL4EditorWindow::RenderScreenVisibilityChange()
 /// </summary>
 void WL4EditorWindow::RenderScreenElementsLayersUpdate(unsigned int DoorId, int EntityId)
 {
+    if (RoomRenderer->IsRendering()) RenderScreenFull();
+
     struct LevelComponents::RenderUpdateParams renderParams(LevelComponents::ElementsLayersUpdate);
     renderParams.mode = EditModeWidget->GetEditModeParams();
     renderParams.SelectedDoorID = DoorId;
@@ -853,11 +1017,14 @@ void WL4EditorWindow::RenderScreenElementsLayersUpdate(unsigned int DoorId, int
 /// </summary>
 void WL4EditorWindow::RenderScreenTilesChange(QVector<LevelComponents::Tileinfo> tilelist, int LayerID)
 {
+    if (RoomRenderer->IsRendering()) RenderScreenFull();
+
     struct LevelComponents::RenderUpdateParams renderParams(LevelComponents::TileChanges);
     renderParams.mode = EditModeWidget->GetEditModeParams();
     renderParams.mode.selectedLayer = LayerID;
     renderParams.tilechangelist = tilelist;
     LevelComponents::Room *curRoom = this->GetCurrentRoom();
+    curRoom->StopAnimatedTilePreview(); // the changed tiles are drawn into the static layer pixmaps
     renderParams.localDoors = CurrentLevel->GetRoomDoorVec(curRoom->GetRoomID());
     curRoom->RenderGraphicsScene(ui->graphicsView->scene(), &renderParams);
 }
@@ -938,13 +1105,11 @@ bool WL4EditorWindow::SaveCurrentFile()
 /// </summary>
 /// <remarks>
 /// The newly loaded level will start by loading room 0 into the editor.
+/// A level with unsaved edits of its own is kept in the change journal, and is written with the next save.
+/// Edits of the global assets are recorded in the journal already and do not keep the level.
 /// </remarks>
 void WL4EditorWindow::on_loadLevelButton_clicked()
 {
-    // Check for unsaved operations
-    if (!UnsavedChangesPrompt(tr("There are unsaved changes. Discard changes and load level anyway?")))
-        return;
-
     // Deselect Door and Entity and deselect rect
     ui->graphicsView->DeselectDoorAndEntity(false);
     ui->graphicsView->ResetRectPixmaps();
@@ -956,10 +1121,27 @@ void WL4EditorWindow::on_loadLevelButton_clicked()
     {
         selectedLevel = tmpdialog.GetResult();
         if (CurrentLevel)
-            delete CurrentLevel;
-        CurrentLevel =
-            new LevelComponents::Level(static_cast<enum LevelComponents::__passage>(selectedLevel._PassageIndex),
-                                       static_cast<enum LevelComponents::__stage>(selectedLevel._LevelIndex));
+        {
+            // The previews hold items of the current scene, which is deleted when the new level is rendered
+            StopAnimatedTilePreviews();
+            if (CurrentLevelEdited)
+                ChangeJournal::KeepEditedLevel(CurrentLevel);
+            else
+                delete CurrentLevel;
+        }
+        CurrentLevel = ChangeJournal::TakeEditedLevel(selectedLevel._PassageIndex, selectedLevel._LevelIndex);
+        bool editedLevel = CurrentLevel;
+        if (editedLevel)
+        {
+            // The global instances may have been replaced while the level was kept
+            CurrentLevel->ResetGlobalInstances();
+        }
+        else
+        {
+            CurrentLevel =
+                new LevelComponents::Level(static_cast<enum LevelComponents::__passage>(selectedLevel._PassageIndex),
+                                           static_cast<enum LevelComponents::__stage>(selectedLevel._LevelIndex));
+        }
         ui->spinBox_RoomID->setValue(0);
         LoadRoomUIUpdate();
         int tmpTilesetID = CurrentLevel->GetRooms()[ui->spinBox_RoomID->value()]->GetTilesetID();
@@ -967,8 +1149,9 @@ void WL4EditorWindow::on_loadLevelButton_clicked()
         ResetEntitySetDockWidget();
         ResetCameraControlDockWidget();
 
-        // Set program control changes
-        UnsavedChanges = false;
+        // Set program control changes, the undo history of the rooms does not follow the kept levels
+        // UnsavedChanges stays as it is, the kept levels and the global edits are still to be saved
+        CurrentLevelEdited = editedLevel;
         ResetUndoHistory();
     }
 }
@@ -1715,7 +1898,7 @@ static const char *layerSwapFailureMsg = "Swapping Layers failed!";
 void WL4EditorWindow::on_action_swap_Layer_0_Layer_1_triggered()
 {
     // TODO: support swap a disabled Layer with a normal Layer
-    // swap Layerdata pointers if possible
+    // swap the shared Layerdata if possible
     auto currentroom = CurrentLevel->GetRooms()[ui->spinBox_RoomID->value()];
     if (!(currentroom->GetLayer(0)->IsEnabled()))
     {
@@ -1727,8 +1910,8 @@ void WL4EditorWindow::on_action_swap_Layer_0_Layer_1_triggered()
         OutputWidget->PrintString(tr(layerSwapFailureMsg));
         return;
     }
-    unsigned short *dataptr1 = currentroom->GetLayer(0)->GetLayerData();
-    unsigned short *dataptr2 = currentroom->GetLayer(1)->GetLayerData();
+    QVector<unsigned short> dataptr1 = currentroom->GetLayer(0)->GetSharedLayerData();
+    QVector<unsigned short> dataptr2 = currentroom->GetLayer(1)->GetSharedLayerData();
     currentroom->GetLayer(0)->SetLayerData(dataptr2);
     currentroom->GetLayer(1)->SetLayerData(dataptr1);
 
@@ -1749,15 +1932,15 @@ void WL4EditorWindow::on_action_swap_Layer_0_Layer_1_triggered()
 void WL4EditorWindow::on_action_swap_Layer_1_Layer_2_triggered()
 {
     // TODO: support swap a disabled Layer with a normal Layer
-    // swap Layerdata pointers if possible
+    // swap the shared Layerdata if possible
     auto currentroom = CurrentLevel->GetRooms()[ui->spinBox_RoomID->value()];
     if (!(currentroom->GetLayer(2)->IsEnabled()))
     {
         OutputWidget->PrintString(tr(layerSwapFailureMsg));
         return;
     }
-    unsigned short *dataptr1 = currentroom->GetLayer(1)->GetLayerData();
-    unsigned short *dataptr2 = currentroom->GetLayer(2)->GetLayerData();
+    QVector<unsigned short> dataptr1 = currentroom->GetLayer(1)->GetSharedLayerData();
+    QVector<unsigned short> dataptr2 = currentroom->GetLayer(2)->GetSharedLayerData();
     currentroom->GetLayer(1)->SetLayerData(dataptr2);
     currentroom->GetLayer(2)->SetLayerData(dataptr1);
 
@@ -1778,7 +1961,7 @@ void WL4EditorWindow::on_action_swap_Layer_1_Layer_2_triggered()
 void WL4EditorWindow::on_action_swap_Layer_0_Layer_2_triggered()
 {
     // TODO: support swap a disabled Layer with a normal Layer
-    // swap Layerdata pointers if possible
+    // swap the shared Layerdata if possible
     auto currentroom = CurrentLevel->GetRooms()[ui->spinBox_RoomID->value()];
     if (!(currentroom->GetLayer(0)->IsEnabled()) ||
         !(currentroom->GetLayer(2)->IsEnabled()))
@@ -1791,8 +1974,8 @@ void WL4EditorWindow::on_action_swap_Layer_0_Layer_2_triggered()
         OutputWidget->PrintString(tr(layerSwapFailureMsg));
         return;
     }
-    unsigned short *dataptr1 = currentroom->GetLayer(0)->GetLayerData();
-    unsigned short *dataptr2 = currentroom->GetLayer(2)->GetLayerData();
+    QVector<unsigned short> dataptr1 = currentroom->GetLayer(0)->GetSharedLayerData();
+    QVector<unsigned short> dataptr2 = currentroom->GetLayer(2)->GetSharedLayerData();
     currentroom->GetLayer(0)->SetLayerData(dataptr2);
     currentroom->GetLayer(2)->SetLayerData(dataptr1);
 
@@ -1994,6 +2177,7 @@ void WL4EditorWindow::on_actionSave_Room_s_graphic_triggered()
         auto currentroom = CurrentLevel->GetRooms()[ui->spinBox_RoomID->value()];
         CR_width = currentroom->GetLayer1Width();
         CR_height = currentroom->GetLayer1Height();
+        if (RoomRenderer->IsRendering()) RenderScreenFull();
         QGraphicsScene *tmpscene = ui->graphicsView->scene();
         QPixmap currentRoompixmap(CR_width * 16, CR_height * 16);
         QPainter tmppainter(&currentRoompixmap);
@@ -2003,6 +2187,19 @@ void WL4EditorWindow::on_actionSave_Room_s_graphic_triggered()
     }
 }
 
+/// <summary>
+/// Export the graphics of every room, tileset, entity set and wall paint to a folder.
+/// </summary>
+void WL4EditorWindow::on_actionExport_All_Graphics_triggered()
+{
+    QString directory = QFileDialog::getExistingDirectory(this, tr("Export all graphics to a folder"), dialogInitialPath);
+    if (directory.isEmpty()) return;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QString report = BulkExportUtils::ExportAllGraphics(directory);
+    QApplication::restoreOverrideCursor();
+    OutputWidget->PrintString(report);
+}
+
 /// <summary>
 /// Open the patch manager.
 /// </summary>
@@ -2109,6 +2306,51 @@ void WL4EditorWindow::on_actionRect_Select_Mode_toggled(bool arg1)
     ui->graphicsView->SetRectSelectMode(arg1);
 }
 
+/// <summary>
+/// Start or stop playing the animated tiles of the current Room.
+/// </summary>
+/// <param name="arg1">
+/// True if the preview is turned on.
+/// </param>
+void WL4EditorWindow::on_actionPreview_Animated_Tiles_toggled(bool arg1)
+{
+    if (arg1)
+    {
+        AnimatedTilePreviewClock.start();
+        AnimatedTilePreviewFrames = 0;
+        AnimatedTilePreviewTimer->start();
+    }
+    else
+    {
+        AnimatedTilePreviewTimer->stop();
+        if (CurrentLevel)
+        {
+            GetCurrentRoom()->StopAnimatedTilePreview();
+        }
+    }
+}
+
+/// <summary>
+/// Advance the animated tile preview of the current Room to the elapsed game time.
+/// </summary>
+/// <remarks>
+/// The game frames are counted from a clock rather than from the ticks, so a late tick catches up
+/// instead of slowing the animation down. The preview is (re)started here whenever a render stopped it.
+/// </remarks>
+void WL4EditorWindow::AnimatedTilePreviewTick()
+{
+    if (!CurrentLevel || RoomRenderer->IsRendering()) return;
+    qint64 frames = AnimatedTilePreviewClock.elapsed() * 60 / 1000;
+    LevelComponents::Room *curRoom = GetCurrentRoom();
+    if (!curRoom->IsAnimatedTilePreviewActive())
+    {
+        curRoom->StartAnimatedTilePreview();
+        AnimatedTilePreviewFrames = 0;
+    }
+    curRoom->AdvanceAnimatedTilePreview(frames - AnimatedTilePreviewFrames);
+    AnimatedTilePreviewFrames = frames;
+}
+
 /// <summary>
 /// Add a new Room to the current Level.
 /// </summary>
@@ -2177,18 +2419,15 @@ void WL4EditorWindow::on_actionEdit_Entity_EntitySet_triggered()
     if (dialog.exec() == QDialog::Accepted)
     {
         // Generate operation history data
-        // Set changed bools in multiple places
         DialogParams::EntitiesAndEntitySetsEditParams *_oldEntitiesAndEntitysetsEditParams =
             new DialogParams::EntitiesAndEntitySetsEditParams();
         for (LevelComponents::Entity *entityIter: _currentEntitiesAndEntitysetsEditParams->entities)
         {
             _oldEntitiesAndEntitysetsEditParams->entities.push_back(ROMUtils::entities[entityIter->GetEntityGlobalID()]);
-            entityIter->SetChanged(true);
         }
         for (LevelComponents::EntitySet *entitySetIter: _currentEntitiesAndEntitysetsEditParams->entitySets)
         {
             _oldEntitiesAndEntitysetsEditParams->entitySets.push_back(ROMUtils::entitiessets[entitySetIter->GetEntitySetId()]);
-            entitySetIter->SetChanged(true);
         }
 
         // Execute Operation
@@ -2410,13 +2649,11 @@ void WL4EditorWindow::on_actionEdit_Animated_Tile_Groups_triggered()
     if (tmpdialog.exec() == QDialog::Accepted)
     {
         // Generate operation history data
-        // Set changed bools in to all the new data
         DialogParams::AnimatedTileGroupsEditParams *_oldAnimatedTileGroupsEditParams =
             new DialogParams::AnimatedTileGroupsEditParams();
         for (auto *&animatedTileGroupIter: _currentAnimatedTileGroupsEditParams->animatedTileGroups)
         {
             _oldAnimatedTileGroupsEditParams->animatedTileGroups.push_back(ROMUtils::animatedTileGroups[animatedTileGroupIter->GetGlobalID()]);
-            animatedTileGroupIter->SetChanged(true);
         }
 
         // Execute Operation
@@ -2445,7 +2682,7 @@ void WL4EditorWindow::on_actionEdit_Wall_Paints_triggered()
     if (acc == QDialog::Accepted)
     {
         dialog.AcceptChanges();
-        SetUnsavedChanges(true);
+        SetUnsavedChanges(true, false); // the wall paints are global
     }
 }
 
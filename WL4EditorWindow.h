@@ -2,8 +2,10 @@
 #define WL4EDITORWINDOW_H
 
 #include <QButtonGroup>
+#include <QElapsedTimer>
 #include <QLabel>
 #include <QMainWindow>
+#include <QTimer>
 
 #include "Dialog/ChooseLevelDialog.h"
 #include "Dialog/DoorConfigDialog.h"
@@ -16,8 +18,10 @@
 #include "DockWidget/EntitySetDockWidget.h"
 #include "DockWidget/Tile16DockWidget.h"
 #include "DockWidget/OutputDockWidget.h"
+#include "LevelComponents/AsyncRoomRenderer.h"
 #include "LevelComponents/Level.h"
 #include "LevelComponents/Room.h"
+#include "LevelComponents/RoomThumbnailCache.h"
 
 namespace Ui
 {
@@ -48,8 +52,14 @@ private:
     uint graphicViewScalerate = 2;
     bool UnsavedChanges = false; // state check bool only be used when user try loading another ROM, another Level or
                                  // close the editor without saving changes
+    bool CurrentLevelEdited = false; // the current level has edits of its own, not only edits of global assets
     bool firstROMLoaded = false;
     QString dialogInitialPath = QString("");
+    QTimer *AnimatedTilePreviewTimer;
+    QElapsedTimer AnimatedTilePreviewClock;
+    qint64 AnimatedTilePreviewFrames = 0; // game frames already played on the current room's preview
+    LevelComponents::AsyncRoomRenderer *RoomRenderer;
+    LevelComponents::RoomThumbnailCache *ThumbnailCache;
 
     void closeEvent(QCloseEvent *event);
     bool notify(QObject *receiver, QEvent *event);
@@ -57,6 +67,7 @@ private:
     bool SaveCurrentFileAs();
     bool UnsavedChangesPrompt(QString str);
     void ClearEverythingInRoom(bool no_warning = false);
+    void StopAnimatedTilePreviews();
 
     // recent file manager functions
     void InitRecentFileMenuEntries(const bool manageRecentScripts = false);
@@ -69,7 +80,8 @@ protected:
 public:
     explicit WL4EditorWindow(QWidget *parent = 0);
     ~WL4EditorWindow();
-    void RenderScreenFull();
+    void RenderScreenFull(QVector<QImage> prerenderedLayers = QVector<QImage>());
+    void RenderScreenFullAsync();
     void RenderScreenVisibilityChange();
     void RenderScreenElementsLayersUpdate(unsigned int DoorId, int EntityId);
     void RenderScreenTilesChange(QVector<LevelComponents::Tileinfo> tilelist, int LayerID);
@@ -83,7 +95,13 @@ public:
     LevelComponents::Room *GetCurrentRoom() { return CurrentLevel->GetRooms()[GetCurrentRoomId()]; }
     int GetCurrentRoomId();
     LevelComponents::Level *GetCurrentLevel() { return CurrentLevel; }
-    void SetUnsavedChanges(bool newValue) { UnsavedChanges = newValue; }
+    void SetUnsavedChanges(bool newValue, bool levelChanged = true)
+    {
+        UnsavedChanges = newValue;
+        CurrentLevelEdited = newValue && (levelChanged || CurrentLevelEdited);
+        if (newValue) ThumbnailCache->InvalidateCurrentLevel();
+    }
+    LevelComponents::RoomThumbnailCache *GetRoomThumbnailCache() { return ThumbnailCache; }
     bool FirstROMIsLoaded() { return firstROMLoaded; }
     void OpenROM();
     void UIStartUp();
@@ -106,7 +124,7 @@ public:
     void DeleteEntity(int EntityIndex) { CurrentLevel->GetRooms()[GetCurrentRoomId()]->DeleteEntity(EntityIndex); }
     bool DeleteDoor(int globalDoorIndex);
     void SetEditModeWidgetDifficultyRadioBox(int rd) { EditModeWidget->SetDifficultyRadioBox(rd); }
-    void LoadROMDataFromFile(QString qFilePath);
+    bool LoadROMDataFromFile(QString qFilePath, bool showErrorDialog = true);
     void PrintMousePos(int x, int y);
     uint GetGraphicViewScalerate() { return graphicViewScalerate; }
     void SetGraphicViewScalerate(uint scalerate);
@@ -123,12 +141,16 @@ private slots:
     // called slots
     void openRecentROM();
     void openRecentScript();
+    void AnimatedTilePreviewTick();
+    void ShowRoomRenderPreview(int generation, QImage preview);
+    void FinishRoomRenderAsync(int generation, QVector<QImage> layers);
 
     // Auto-generated
     void on_actionOpen_ROM_triggered();
     void on_actionSave_ROM_triggered();
     void on_actionSave_As_triggered();
     void on_actionSave_Room_s_graphic_triggered();
+    void on_actionExport_All_Graphics_triggered();
     void on_loadLevelButton_clicked();
     void on_roomDecreaseButton_clicked();
     void on_roomIncreaseButton_clicked();
@@ -159,6 +181,7 @@ private slots:
     void on_action_clear_S_Hard_triggered();
     void on_actionClear_all_triggered();
     void on_actionRect_Select_Mode_toggled(bool arg1);
+    void on_actionPreview_Animated_Tiles_toggled(bool arg1);
     void on_actionPatch_Manager_triggered();
     void on_actionRun_from_file_triggered();
     void on_actionLight_triggered();
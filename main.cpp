@@ -6,6 +6,7 @@
 #include "Dialog/GraphicManagerDialog.h"
 #include "Dialog/SpritesEditorDialog.h"
 #include "WL4EditorWindow.h"
+#include "BatchRunner.h"
 #include "SettingsUtils.h"
 
 #include <QApplication>
@@ -42,8 +43,19 @@ int main(int argc, char *argv[])
     // use this to deal with the problems
     QGuiApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::Floor);
 
+    // Batch jobs never show a window, so they do not need a display either
+    bool batchMode = BatchRunner::IsBatchCommandLine(argc, argv);
+    if (batchMode && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     QApplication application(argc, argv);
     SettingsUtils::InitProgramSetupPath(application);
+    if (batchMode)
+    {
+        return BatchRunner::Run(application.arguments());
+    }
     application.setWindowIcon(QIcon("./images/icon.ico"));
     WL4EditorWindow window;
     window.show();